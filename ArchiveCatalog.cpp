@@ -0,0 +1,359 @@
+#include "ArchiveCatalog.hpp"
+#include "commonFunctions.hpp"
+#include "Level0BReader.hpp"
+#include "LogFileWriter.hpp"
+#include "TimeInfo.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <omp.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace {
+
+constexpr int64_t SECONDS_PER_DAY = 86400;
+const uint16_t CATALOG_APIDS[] = {MEGSA_APID, MEGSB_APID, MEGSP_APID, ESP_APID, SHK_APID};
+
+// each channel appends to the catalog of its own day directory, this only keeps an append and a
+// rebuild of the same day in this process from interleaving, other processes are not excluded
+std::mutex appendMutex;
+
+std::string directoryOf(const std::string& filename) {
+    size_t slash = filename.find_last_of('/');
+    return (slash == std::string::npos) ? std::string("./") : filename.substr(0, slash + 1);
+}
+
+bool endsWith(const std::string& text, const std::string& suffix) {
+    return (text.size() >= suffix.size()) && (text.compare(text.size() - suffix.size(), suffix.size(), suffix) == 0);
+}
+
+ArchiveCatalogHeader makeHeader() {
+    ArchiveCatalogHeader header = {};
+    std::memcpy(header.magic, ARCHIVE_CATALOG_MAGIC, sizeof(header.magic));
+    header.version = ARCHIVE_CATALOG_VERSION;
+    header.recordBytes = sizeof(ArchiveCatalogRecord);
+    return header;
+}
+
+bool validHeader(const ArchiveCatalogHeader& header) {
+    return (std::memcmp(header.magic, ARCHIVE_CATALOG_MAGIC, sizeof(header.magic)) == 0) &&
+           (header.version == ARCHIVE_CATALOG_VERSION) && (header.recordBytes == sizeof(ArchiveCatalogRecord));
+}
+
+// path relative to dataRoot, size and compression, false if the path does not fit the record
+bool locate(ArchiveCatalogRecord& record, const std::string& dataRoot, const std::string& publishedName, uint64_t fileBytes) {
+    std::string relative = publishedName;
+    if (!dataRoot.empty() && (relative.compare(0, dataRoot.size(), dataRoot) == 0)) {
+        relative = relative.substr(dataRoot.size());
+    }
+    if (relative.size() >= ARCHIVE_CATALOG_PATH_BYTES) {
+        return false;
+    }
+    std::memset(record.path, 0, sizeof(record.path));
+    std::memcpy(record.path, relative.data(), relative.size());
+    record.fileBytes = fileBytes;
+    if (endsWith(publishedName, ".gz")) {
+        record.flags |= CATALOG_COMPRESSED;
+    }
+    return true;
+}
+
+bool passes(const ArchiveCatalogRecord& record, const ArchiveCatalogQuery& query) {
+    return (record.startTai >= query.startTai) && (record.startTai < query.endTai) &&
+           (record.completeness() >= query.minCompleteness) &&
+           (record.saturatedPixels <= query.maxSaturatedPixels) && (record.parityErrors <= query.maxParityErrors);
+}
+
+// maps one catalog and copies out the matching records
+void queryFile(const std::string& catalogName, const ArchiveCatalogQuery& query, std::vector<ArchiveCatalogRecord>& matches) {
+    int fd = open(catalogName.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return;  // no products that day
+    }
+    struct stat info;
+    if ((fstat(fd, &info) != 0) || (static_cast<size_t>(info.st_size) < sizeof(ArchiveCatalogHeader))) {
+        close(fd);
+        return;
+    }
+    size_t mappedBytes = static_cast<size_t>(info.st_size);
+    void* mapped = mmap(nullptr, mappedBytes, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (mapped == MAP_FAILED) {
+        return;
+    }
+
+    const ArchiveCatalogHeader* header = static_cast<const ArchiveCatalogHeader*>(mapped);
+    if (validHeader(*header)) {
+        // a record cut short by a crash is not counted, the next append writes over it
+        size_t count = (mappedBytes - sizeof(ArchiveCatalogHeader)) / sizeof(ArchiveCatalogRecord);
+        const ArchiveCatalogRecord* first = reinterpret_cast<const ArchiveCatalogRecord*>(
+            static_cast<const uint8_t*>(mapped) + sizeof(ArchiveCatalogHeader));
+        const ArchiveCatalogRecord* last = first + count;
+        if (header->unsorted == 0) {
+            first = std::lower_bound(first, last, query.startTai,
+                [](const ArchiveCatalogRecord& record, uint32_t tai) { return record.startTai < tai; });
+        }
+        for (const ArchiveCatalogRecord* record = first; record != last; ++record) {
+            if ((header->unsorted == 0) && (record->startTai >= query.endTai)) {
+                break;
+            }
+            if (passes(*record, query)) {
+                matches.push_back(*record);
+            }
+        }
+    }
+    munmap(mapped, mappedBytes);
+}
+
+// the catalog of one parsed FITS file, false if it does not read
+bool describeFile(const std::string& dataRoot, uint16_t apid, const std::string& filename, ArchiveCatalogRecord& record) {
+    std::vector<uint8_t> bytes;
+    std::string error;
+    struct stat info;
+    if ((stat(filename.c_str(), &info) != 0) || !Level0BReader::loadFile(filename, bytes, error)) {
+        return false;
+    }
+    bool ok = false;
+    switch (apid) {
+        case MEGSA_APID:
+        case MEGSB_APID: {
+            std::unique_ptr<MEGS_IMAGE_REC> megsImage(new MEGS_IMAGE_REC);
+            bool transposed = false;
+            ok = Level0BReader::readMegsImage(bytes, *megsImage, error, &transposed);
+            uint32_t saturatedTop = 0;
+            uint32_t saturatedBottom = 0;
+            countSaturatedPixels(megsImage->image, saturatedTop, saturatedBottom);
+            record = ArchiveCatalog::describe(*megsImage, apid, 0, saturatedTop + saturatedBottom);
+            // NAXIS1 of 1024 rather than 2048, as FITSWriter flags the files it writes transposed
+            if (transposed) {
+                record.flags |= CATALOG_TRANSPOSED;
+            }
+            break;
+        }
+        case MEGSP_APID: {
+            std::unique_ptr<MEGSP_PACKET> megsP(new MEGSP_PACKET);
+            ok = Level0BReader::readMegsP(bytes, *megsP, error);
+            record = ArchiveCatalog::describe(*megsP);
+            break;
+        }
+        case ESP_APID: {
+            std::unique_ptr<ESP_PACKET> esp(new ESP_PACKET);
+            ok = Level0BReader::readESP(bytes, *esp, error);
+            record = ArchiveCatalog::describe(*esp);
+            break;
+        }
+        case SHK_APID: {
+            std::unique_ptr<SHK_PACKET> shk(new SHK_PACKET);
+            ok = Level0BReader::readSHK(bytes, *shk, error);
+            record = ArchiveCatalog::describe(*shk);
+            break;
+        }
+    }
+    // the filename time is what the day directory and queries go by
+    uint32_t filenameTai = 0;
+    if (ok && Level0BReader::filenameTai(filename, filenameTai) && (filenameTai != record.startTai)) {
+        record.endTai = filenameTai + (record.endTai - record.startTai);
+        record.startTai = filenameTai;
+    }
+    record.flags |= CATALOG_REBUILT;
+    return ok && locate(record, dataRoot, filename, static_cast<uint64_t>(info.st_size));
+}
+
+// writes a whole catalog to a temporary name and renames it into place
+bool writeCatalog(const std::string& catalogName, const std::vector<ArchiveCatalogRecord>& records) {
+    std::string tmpName = catalogName + ".tmp";
+    FILE* file = std::fopen(tmpName.c_str(), "wb");
+    if (file == nullptr) {
+        return false;
+    }
+    ArchiveCatalogHeader header = makeHeader();
+    bool ok = (std::fwrite(&header, sizeof(header), 1, file) == 1);
+    if (ok && !records.empty()) {
+        ok = (std::fwrite(records.data(), sizeof(ArchiveCatalogRecord), records.size(), file) == records.size());
+    }
+    ok = (std::fclose(file) == 0) && ok;
+    if (!ok || (std::rename(tmpName.c_str(), catalogName.c_str()) != 0)) {
+        std::remove(tmpName.c_str());
+        return false;
+    }
+    return true;
+}
+
+} // namespace
+
+ArchiveCatalogRecord ArchiveCatalog::describe(const MEGS_IMAGE_REC& megsImage, uint16_t apid, uint32_t parityErrors, uint32_t saturatedPixels) {
+    ArchiveCatalogRecord record = {};
+    record.startTai = megsImage.tai_time_seconds;
+    record.endTai = megsImage.tai_time_seconds + SECONDS_PER_MEGS_IMAGE;
+    record.apid = apid;
+    record.packetsReceived = megsImage.packets_received;
+    record.packetsExpected = N_PKT_PER_IMAGE;
+    record.saturatedPixels = saturatedPixels;
+    record.parityErrors = parityErrors;
+    return record;
+}
+
+ArchiveCatalogRecord ArchiveCatalog::describe(const MEGSP_PACKET& megsP) {
+    ArchiveCatalogRecord record = {};
+    record.startTai = megsP.tai_time_seconds;
+    record.endTai = megsP.tai_time_seconds + SECONDS_PER_MEGSP_FILE;
+    record.apid = MEGSP_APID;
+    record.packetsReceived = MEGSP_PACKETS_PER_FILE;
+    record.packetsExpected = MEGSP_PACKETS_PER_FILE;
+    return record;
+}
+
+ArchiveCatalogRecord ArchiveCatalog::describe(const ESP_PACKET& esp) {
+    ArchiveCatalogRecord record = {};
+    record.startTai = esp.tai_time_seconds;
+    record.endTai = esp.tai_time_seconds + SECONDS_PER_ESP_FILE;
+    record.apid = ESP_APID;
+    record.packetsReceived = ESP_PACKETS_PER_FILE;
+    record.packetsExpected = ESP_PACKETS_PER_FILE;
+    return record;
+}
+
+ArchiveCatalogRecord ArchiveCatalog::describe(const SHK_PACKET& shk) {
+    ArchiveCatalogRecord record = {};
+    record.startTai = shk.tai_time_seconds;
+    record.endTai = shk.tai_time_seconds + SECONDS_PER_SHK_FILE;
+    record.apid = SHK_APID;
+    record.packetsReceived = SHK_PACKETS_PER_FILE;
+    record.packetsExpected = SHK_PACKETS_PER_FILE;
+    return record;
+}
+
+bool ArchiveCatalog::append(const std::string& dataRoot, const std::string& publishedName, ArchiveCatalogRecord record) {
+    struct stat fileInfo;
+    if (stat(publishedName.c_str(), &fileInfo) != 0) {
+        LogFileWriter::getInstance().logError("ArchiveCatalog::append: {} was not published", publishedName);
+        return false;
+    }
+    if (!locate(record, dataRoot, publishedName, static_cast<uint64_t>(fileInfo.st_size))) {
+        LogFileWriter::getInstance().logError("ArchiveCatalog::append: {} is too long for a catalog record", publishedName);
+        return false;
+    }
+    std::string catalogName = directoryOf(publishedName) + ARCHIVE_CATALOG_NAME;
+
+    std::lock_guard<std::mutex> lock(appendMutex);
+    // not O_APPEND, Linux pwrite ignores the offset then and the header could not be updated
+    int fd = open(catalogName.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+    if (fd < 0) {
+        LogFileWriter::getInstance().logError("ArchiveCatalog::append: Failed to open {}: {}", catalogName, strerror(errno));
+        return false;
+    }
+    struct stat info;
+    bool ok = (fstat(fd, &info) == 0);
+    ArchiveCatalogHeader header = makeHeader();
+    size_t fileBytes = ok ? static_cast<size_t>(info.st_size) : 0;
+    if (ok && (fileBytes < sizeof(header))) {
+        ok = (pwrite(fd, &header, sizeof(header), 0) == static_cast<ssize_t>(sizeof(header)));
+        fileBytes = sizeof(header);
+    } else if (ok) {
+        ok = (pread(fd, &header, sizeof(header), 0) == static_cast<ssize_t>(sizeof(header))) && validHeader(header);
+    }
+
+    size_t count = (fileBytes - sizeof(header)) / sizeof(ArchiveCatalogRecord);
+    off_t end = static_cast<off_t>(sizeof(header) + count * sizeof(ArchiveCatalogRecord));
+    if (ok && (count > 0) && (header.unsorted == 0)) {
+        ArchiveCatalogRecord previous;
+        ok = (pread(fd, &previous, sizeof(previous), end - static_cast<off_t>(sizeof(previous))) == static_cast<ssize_t>(sizeof(previous)));
+        if (ok && (record.startTai < previous.startTai)) {
+            header.unsorted = 1;
+            ok = (pwrite(fd, &header, sizeof(header), 0) == static_cast<ssize_t>(sizeof(header)));
+        }
+    }
+    // one write per record, a partial record left by a crash is overwritten
+    ok = ok && (pwrite(fd, &record, sizeof(record), end) == static_cast<ssize_t>(sizeof(record)));
+    int writeErrno = errno;
+    ok = (close(fd) == 0) && ok;
+    if (!ok) {
+        LogFileWriter::getInstance().logError("ArchiveCatalog::append: Failed to append to {}: {}", catalogName, strerror(writeErrno));
+    }
+    return ok;
+}
+
+std::vector<ArchiveCatalogRecord> ArchiveCatalog::query(const std::string& dataRoot, const ArchiveCatalogQuery& query) {
+    std::vector<ArchiveCatalogRecord> matches;
+    for (uint16_t apid : CATALOG_APIDS) {
+        if (!query.apids.empty() && (std::find(query.apids.begin(), query.apids.end(), apid) == query.apids.end())) {
+            continue;
+        }
+        for (const std::string& directory : Level0BReader::dayDirectories(dataRoot, apid, query.startTai, query.endTai)) {
+            queryFile(directory + ARCHIVE_CATALOG_NAME, query, matches);
+        }
+    }
+    std::sort(matches.begin(), matches.end(), [](const ArchiveCatalogRecord& a, const ArchiveCatalogRecord& b) {
+        return (a.startTai != b.startTai) ? (a.startTai < b.startTai) : (a.apid < b.apid);
+    });
+    return matches;
+}
+
+size_t ArchiveCatalog::rebuild(const std::string& dataRoot, uint16_t apid, uint32_t startTai, uint32_t endTai,
+                               int threads, size_t& failedFiles) {
+    failedFiles = 0;
+    if (endTai <= startTai) {
+        return 0;
+    }
+    // whole days, a catalog is always rewritten complete
+    const int64_t taiToUnix = static_cast<int64_t>(TAI_EPOCH_OFFSET_TO_UNIX) + static_cast<int64_t>(TAI_LEAP_SECONDS);
+    int64_t dayStart = startTai - ((static_cast<int64_t>(startTai) - taiToUnix) % SECONDS_PER_DAY);
+    int64_t dayEnd = endTai + ((SECONDS_PER_DAY - ((static_cast<int64_t>(endTai) - taiToUnix) % SECONDS_PER_DAY)) % SECONDS_PER_DAY);
+    uint32_t firstTai = static_cast<uint32_t>(dayStart);
+    uint32_t lastTai = static_cast<uint32_t>(std::min<int64_t>(dayEnd, std::numeric_limits<uint32_t>::max()));
+
+    std::string root = dataRoot;
+    if (!root.empty() && (root.back() != '/')) {
+        root += '/';
+    }
+    std::vector<std::string> filenames = Level0BReader::findFiles(root, apid, firstTai, lastTai);
+    std::vector<ArchiveCatalogRecord> records(filenames.size());
+    std::vector<char> described(filenames.size(), 0);
+
+    if (threads <= 0) {
+        threads = omp_get_max_threads();
+    }
+    // decompression and parsing dominate, each file is independent
+    #pragma omp parallel for schedule(dynamic) num_threads(threads)
+    for (size_t i = 0; i < filenames.size(); ++i) {
+        described[i] = describeFile(root, apid, filenames[i], records[i]) ? 1 : 0;
+    }
+
+    std::map<std::string, std::vector<ArchiveCatalogRecord>> byDirectory;
+    for (const std::string& directory : Level0BReader::dayDirectories(root, apid, firstTai, lastTai)) {
+        struct stat info;
+        if ((stat(directory.c_str(), &info) == 0) && S_ISDIR(info.st_mode)) {
+            byDirectory[directory];  // a day whose files are all gone gets an empty catalog
+        }
+    }
+    for (size_t i = 0; i < filenames.size(); ++i) {
+        if (described[i] == 0) {
+            ++failedFiles;
+            continue;
+        }
+        byDirectory[directoryOf(filenames[i])].push_back(records[i]);
+    }
+
+    size_t written = 0;
+    for (auto& entry : byDirectory) {
+        std::vector<ArchiveCatalogRecord>& dayRecords = entry.second;
+        std::stable_sort(dayRecords.begin(), dayRecords.end(), [](const ArchiveCatalogRecord& a, const ArchiveCatalogRecord& b) {
+            return a.startTai < b.startTai;
+        });
+        std::lock_guard<std::mutex> lock(appendMutex);
+        if (writeCatalog(entry.first + ARCHIVE_CATALOG_NAME, dayRecords)) {
+            written += dayRecords.size();
+        } else {
+            failedFiles += dayRecords.size();
+        }
+    }
+    return written;
+}
@@ -0,0 +1,86 @@
+#ifndef ARCHIVE_CATALOG_HPP
+#define ARCHIVE_CATALOG_HPP
+
+// Index of the Level 0B products, one catalog.l0bc per channel and UTC day next to the FITS files it lists.
+// A catalog is a 64 byte header followed by fixed 128 byte records that FITSWriter appends as it publishes
+// each product. Records arrive in time order, so a query maps the file and binary searches it by start time.
+// A record appended before an earlier one marks the header unsorted, and that day is then scanned.
+// rebuild() recreates the catalogs of a range from the FITS files on a thread pool.
+
+#include "eve_l0b.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <string>
+#include <vector>
+
+constexpr char ARCHIVE_CATALOG_NAME[] = "catalog.l0bc";
+constexpr char ARCHIVE_CATALOG_MAGIC[8] = {'E', 'V', 'E', 'L', '0', 'B', 'C', '\0'};
+constexpr uint32_t ARCHIVE_CATALOG_VERSION = 1;
+constexpr size_t ARCHIVE_CATALOG_PATH_BYTES = 96;
+
+enum ArchiveCatalogFlags : uint16_t {
+    CATALOG_COMPRESSED = 1,  // published as .fit.gz
+    CATALOG_TRANSPOSED = 2,  // MEGS image written 1024 wide by 2048 tall
+    CATALOG_REBUILT = 4,     // from rebuild(), parity errors are not in the FITS file and read zero
+};
+
+struct ArchiveCatalogHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t recordBytes;
+    uint32_t unsorted;  // set once a record was appended with an earlier startTai than the one before it
+    uint8_t reserved[44];
+};
+
+struct ArchiveCatalogRecord {
+    uint32_t startTai;          // tai_time_seconds of the product, the time in its filename
+    uint32_t endTai;            // startTai plus the product cadence
+    uint16_t apid;
+    uint16_t packetsReceived;   // distinct MEGS packets assembled, packets per file for the other products
+    uint16_t packetsExpected;
+    uint16_t flags;             // ArchiveCatalogFlags
+    uint32_t saturatedPixels;   // MEGS pixels at 0x3fff
+    uint32_t parityErrors;      // MEGS pixel parity errors counted while the image was assembled
+    uint64_t fileBytes;         // as published, compressed when CATALOG_COMPRESSED is set
+    char path[ARCHIVE_CATALOG_PATH_BYTES];  // relative to eve_data_root, NUL terminated
+
+    double completeness() const {
+        return (packetsExpected == 0) ? 0.0 : static_cast<double>(packetsReceived) / packetsExpected;
+    }
+};
+
+static_assert(sizeof(ArchiveCatalogHeader) == 64, "the catalog header is part of the file format");
+static_assert(sizeof(ArchiveCatalogRecord) == 128, "catalog records are part of the file format");
+
+struct ArchiveCatalogQuery {
+    uint32_t startTai = 0;
+    uint32_t endTai = 0;            // exclusive
+    std::vector<uint16_t> apids;    // empty selects every channel
+    double minCompleteness = 0.0;
+    uint32_t maxSaturatedPixels = std::numeric_limits<uint32_t>::max();
+    uint32_t maxParityErrors = std::numeric_limits<uint32_t>::max();
+};
+
+class ArchiveCatalog {
+public:
+    // the record for a product, append() fills in its path, size and compression flag
+    static ArchiveCatalogRecord describe(const MEGS_IMAGE_REC& megsImage, uint16_t apid, uint32_t parityErrors, uint32_t saturatedPixels);
+    static ArchiveCatalogRecord describe(const MEGSP_PACKET& megsP);
+    static ArchiveCatalogRecord describe(const ESP_PACKET& esp);
+    static ArchiveCatalogRecord describe(const SHK_PACKET& shk);
+
+    // appends record to the catalog in the directory of publishedName, the path is stored relative to dataRoot
+    static bool append(const std::string& dataRoot, const std::string& publishedName, ArchiveCatalogRecord record);
+
+    // records with startTai in [startTai, endTai) that pass the filters, ordered by time then APID
+    static std::vector<ArchiveCatalogRecord> query(const std::string& dataRoot, const ArchiveCatalogQuery& query);
+
+    // rewrites the catalogs of every UTC day the range touches from the FITS files of one channel,
+    // threads 0 uses the OpenMP default, returns the records written
+    static size_t rebuild(const std::string& dataRoot, uint16_t apid, uint32_t startTai, uint32_t endTai,
+                          int threads, size_t& failedFiles);
+};
+
+#endif // ARCHIVE_CATALOG_HPP
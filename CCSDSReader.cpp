@@ -51,6 +51,7 @@ bool CCSDSReader::findSyncMarker() {
 
 // read the sync marker, packet header, and packet data
 bool CCSDSReader::readNextPacket(std::vector<uint8_t>& packet) {
+  ScopedStageTimer readTimer(STAGE_READ);
 
   globalState.totalReadCounter.fetch_add(1, std::memory_order_relaxed);
 
@@ -80,9 +81,13 @@ bool CCSDSReader::readNextPacket(std::vector<uint8_t>& packet) {
   (packetLength != STANDARD_MEGSP_PACKET_LENGTH)) {
     std::cout << "ERROR: CCSDSREADER::readNextPacket has unexpected packetLength " << packetLength << std::endl;
     std::cout << " CCSDSREADER::readNextPacket APID with unexpected packetLength " << getAPID(header) << std::endl;
+    PacketStats::getInstance().count(getAPID(header), COUNTER_DROPS);
     return false;
   }
 
+  // the read stage latency is keyed by the APID of the packet it returns
+  PacketStats::getInstance().setCurrentAPID(getAPID(header));
+
   if (getAPID(header) == ESP_APID) {
     globalState.packetsPerSecond.store(globalState.totalReadCounter.load()); //totalPacketCounter;    
     globalState.readsPerSecond.store(globalState.totalReadCounter.load());
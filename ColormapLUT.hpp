@@ -0,0 +1,16 @@
+#ifndef COLORMAP_LUT_HPP
+#define COLORMAP_LUT_HPP
+
+#include <cstdint>
+#include "implot.h"
+
+// 256 entry r,g,b lookup table for one colormap
+// texture intensities are 8-bit, so sampling the colormap once per level is exact
+struct ColormapLUT
+{
+    bool valid = false;
+    ImPlotColormap colormap = ImPlotColormap_Jet;
+    uint8_t rgb[256 * 3] = {0};
+};
+
+#endif // COLORMAP_LUT_HPP
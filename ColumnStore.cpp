@@ -0,0 +1,453 @@
+#include "ColumnStore.hpp"
+#include "Level0BReader.hpp"
+#include "LogFileWriter.hpp"
+#include "PathService.hpp"
+#include "TimeInfo.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "/usr/local/include/fitsio.h"
+
+namespace {
+
+constexpr int64_t SECONDS_PER_DAY = 86400;
+const int64_t TAI_TO_UNIX = static_cast<int64_t>(TAI_EPOCH_OFFSET_TO_UNIX) + static_cast<int64_t>(TAI_LEAP_SECONDS);
+
+// the time columns are the slot itself
+const char* const TIME_COLUMNS[] = {"yyyydoy", "sod", "tai_time_seconds", "tai_time_subseconds", "rec_tai_seconds", "rec_tai_subseconds"};
+
+int64_t dayOf(int64_t taiSeconds) {
+    return (taiSeconds - TAI_TO_UNIX) / SECONDS_PER_DAY;
+}
+
+uint32_t dayStartTai(int64_t dayIndex) {
+    return static_cast<uint32_t>(dayIndex * SECONDS_PER_DAY + TAI_TO_UNIX);
+}
+
+bool isTimeColumn(const char* name) {
+    for (const char* timeColumn : TIME_COLUMNS) {
+        if (std::strcmp(name, timeColumn) == 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+uint32_t elementBytes(int typeCode) {
+    switch (typeCode) {
+        case TBYTE: return 1;
+        case TUSHORT: return 2;
+        case TUINT:
+        case TFLOAT: return 4;
+        case TDOUBLE: return 8;
+        default: return 0;
+    }
+}
+
+double sampleValue(int typeCode, const uint8_t* sample) {
+    switch (typeCode) {
+        case TBYTE: return *sample;
+        case TUSHORT: { uint16_t v; std::memcpy(&v, sample, sizeof(v)); return v; }
+        case TUINT: { uint32_t v; std::memcpy(&v, sample, sizeof(v)); return v; }
+        case TFLOAT: { float v; std::memcpy(&v, sample, sizeof(v)); return v; }
+        case TDOUBLE: { double v; std::memcpy(&v, sample, sizeof(v)); return v; }
+        default: return 0.0;
+    }
+}
+
+uint32_t secondsPerProduct(uint16_t apid) {
+    switch (apid) {
+        case MEGSP_APID: return SECONDS_PER_MEGSP_FILE;
+        case ESP_APID: return SECONDS_PER_ESP_FILE;
+        case SHK_APID: return SECONDS_PER_SHK_FILE;
+        default: return 0;
+    }
+}
+
+// samples start 8 byte aligned after the header, the summaries 8 byte aligned after the samples
+size_t summaryOffset(const ColumnFileHeader& header) {
+    size_t sampleBytes = static_cast<size_t>(header.samplesPerDay) * header.elementBytes;
+    return sizeof(ColumnFileHeader) + ((sampleBytes + 7) & ~static_cast<size_t>(7));
+}
+
+size_t summaryCount(const ColumnFileHeader& header) {
+    return (header.samplesPerDay + header.summaryChunkSamples - 1) / header.summaryChunkSamples;
+}
+
+// the written bits follow the summaries, bit (slot % 8) of byte slot / 8
+size_t writtenOffset(const ColumnFileHeader& header) {
+    return summaryOffset(header) + summaryCount(header) * sizeof(ColumnSummary);
+}
+
+size_t fileBytes(const ColumnFileHeader& header) {
+    return writtenOffset(header) + (header.samplesPerDay + 7) / 8;
+}
+
+// the slot nearest to a TAI time of day, tai_time_subseconds keeps its 1/65536 s in the upper 16 bits
+uint64_t slotOf(uint64_t secondOfDay, uint32_t taiSubseconds, uint32_t samplesPerProduct, uint32_t productSeconds) {
+    const uint64_t ticks = (secondOfDay << 16) + (taiSubseconds >> 16);
+    const uint64_t ticksPerProduct = static_cast<uint64_t>(productSeconds) << 16;
+    return (ticks * samplesPerProduct + ticksPerProduct / 2) / ticksPerProduct;
+}
+
+// sets the written bits of count slots from slot on, overwrote tells whether any was already set
+bool markWritten(int fd, const ColumnFileHeader& header, uint64_t slot, size_t count, bool& overwrote) {
+    overwrote = false;
+    if (count == 0) {
+        return true;
+    }
+    const uint64_t firstByte = slot / 8;
+    std::vector<uint8_t> bits(static_cast<size_t>((slot + count - 1) / 8 - firstByte + 1));
+    off_t offset = static_cast<off_t>(writtenOffset(header) + firstByte);
+    if (pread(fd, bits.data(), bits.size(), offset) != static_cast<ssize_t>(bits.size())) {
+        return false;
+    }
+    for (uint64_t s = slot; s < slot + count; ++s) {
+        uint8_t& byte = bits[static_cast<size_t>(s / 8 - firstByte)];
+        const uint8_t mask = static_cast<uint8_t>(1u << (s % 8));
+        overwrote = overwrote || ((byte & mask) != 0);
+        byte |= mask;
+    }
+    return pwrite(fd, bits.data(), bits.size(), offset) == static_cast<ssize_t>(bits.size());
+}
+
+// the min/max of the written slots of a chunk, read back from the file
+bool summarizeChunk(int fd, const ColumnFileHeader& header, uint64_t chunk, ColumnSummary& summary) {
+    const uint64_t first = chunk * header.summaryChunkSamples;
+    const size_t count = static_cast<size_t>(std::min<uint64_t>(header.summaryChunkSamples, header.samplesPerDay - first));
+    std::vector<uint8_t> samples(count * header.elementBytes);
+    std::vector<uint8_t> bits((count + 7) / 8);
+    off_t sampleOffset = static_cast<off_t>(sizeof(ColumnFileHeader) + first * header.elementBytes);
+    off_t bitsOffset = static_cast<off_t>(writtenOffset(header) + first / 8);  // chunks start on a byte
+    if ((pread(fd, samples.data(), samples.size(), sampleOffset) != static_cast<ssize_t>(samples.size())) ||
+        (pread(fd, bits.data(), bits.size(), bitsOffset) != static_cast<ssize_t>(bits.size()))) {
+        return false;
+    }
+    summary = ColumnSummary{};
+    for (size_t i = 0; i < count; ++i) {
+        if (((bits[i / 8] >> (i % 8)) & 1) == 0) {
+            continue;
+        }
+        double value = sampleValue(header.typeCode, samples.data() + i * header.elementBytes);
+        if ((summary.count == 0) || (value < summary.minimum)) {
+            summary.minimum = value;
+        }
+        if ((summary.count == 0) || (value > summary.maximum)) {
+            summary.maximum = value;
+        }
+        ++summary.count;
+    }
+    return true;
+}
+
+ColumnFileHeader makeHeader(int typeCode, uint32_t samplesPerProduct, uint32_t productSeconds, int64_t dayIndex) {
+    ColumnFileHeader header = {};
+    std::memcpy(header.magic, COLUMN_STORE_MAGIC, sizeof(header.magic));
+    header.version = COLUMN_STORE_VERSION;
+    header.typeCode = typeCode;
+    header.elementBytes = elementBytes(typeCode);
+    header.samplesPerDay = static_cast<uint32_t>(SECONDS_PER_DAY * samplesPerProduct / productSeconds);
+    header.samplesPerProduct = samplesPerProduct;
+    header.secondsPerProduct = productSeconds;
+    header.summaryChunkSamples = COLUMN_SUMMARY_CHUNK;
+    header.dayStartTai = dayStartTai(dayIndex);
+    return header;
+}
+
+bool validHeader(const ColumnFileHeader& header) {
+    return (std::memcmp(header.magic, COLUMN_STORE_MAGIC, sizeof(header.magic)) == 0) &&
+           (header.version == COLUMN_STORE_VERSION) && (header.elementBytes == elementBytes(header.typeCode)) &&
+           (header.elementBytes != 0) && (header.secondsPerProduct != 0) && (header.summaryChunkSamples != 0);
+}
+
+bool readHeader(int fd, ColumnFileHeader& header) {
+    return (pread(fd, &header, sizeof(header), 0) == static_cast<ssize_t>(sizeof(header))) && validHeader(header);
+}
+
+} // namespace
+
+ColumnStore& ColumnStore::getInstance() {
+    static ColumnStore instance;
+    return instance;
+}
+
+ColumnStore::~ColumnStore() {
+    closeAll();
+}
+
+void ColumnStore::closeAll() {
+    std::lock_guard<std::mutex> lock(mutex);
+    for (auto& entry : openFiles) {
+        close(entry.second);
+    }
+    openFiles.clear();
+    openDay = -1;
+}
+
+std::vector<std::string> ColumnStore::columnNames(uint16_t apid) {
+    std::vector<std::string> names;
+    if (secondsPerProduct(apid) == 0) {
+        return names;
+    }
+    for (const Level0BField& field : Level0BReader::tableFields(apid)) {
+        if (!isTimeColumn(field.name)) {
+            names.push_back(field.name);
+        }
+    }
+    names.push_back(COLUMN_PRESENT_NAME);
+    return names;
+}
+
+std::string ColumnStore::columnFilename(const std::string& dataRoot, uint16_t apid, const std::string& column, uint32_t taiSeconds) {
+    std::vector<std::string> directories = Level0BReader::dayDirectories(dataRoot, apid, taiSeconds, taiSeconds + 1);
+    return directories.front() + "columns/" + column + ".col";
+}
+
+bool ColumnStore::append(const std::string& dataRoot, const MEGSP_PACKET& megsP) {
+    return appendProduct(dataRoot, MEGSP_APID, &megsP, megsP.tai_time_seconds, megsP.tai_time_subseconds);
+}
+
+bool ColumnStore::append(const std::string& dataRoot, const ESP_PACKET& esp) {
+    return appendProduct(dataRoot, ESP_APID, &esp, esp.tai_time_seconds, esp.tai_time_subseconds);
+}
+
+bool ColumnStore::append(const std::string& dataRoot, const SHK_PACKET& shk) {
+    return appendProduct(dataRoot, SHK_APID, &shk, shk.tai_time_seconds, shk.tai_time_subseconds);
+}
+
+bool ColumnStore::appendProduct(const std::string& dataRoot, uint16_t apid, const void* record, uint32_t taiSeconds, uint32_t taiSubseconds) {
+    const uint32_t productSeconds = secondsPerProduct(apid);
+    const int64_t dayIndex = dayOf(taiSeconds);
+    const uint64_t secondOfDay = static_cast<uint64_t>(static_cast<int64_t>(taiSeconds) - static_cast<int64_t>(dayStartTai(dayIndex)));
+    const uint8_t* base = static_cast<const uint8_t*>(record);
+
+    std::lock_guard<std::mutex> lock(mutex);
+    if (dayIndex != openDay) {
+        for (auto& entry : openFiles) {
+            close(entry.second);
+        }
+        openFiles.clear();
+        openDay = dayIndex;
+    }
+
+    bool ok = true;
+    for (const Level0BField& field : Level0BReader::tableFields(apid)) {
+        if (isTimeColumn(field.name)) {
+            continue;
+        }
+        const uint32_t samplesPerProduct = static_cast<uint32_t>(field.length);
+        const uint64_t slot = slotOf(secondOfDay, taiSubseconds, samplesPerProduct, productSeconds);
+        ok = writeRun(dataRoot, apid, field.name, field.typeCode, samplesPerProduct, dayIndex, slot,
+                      base + field.offset, samplesPerProduct) && ok;
+    }
+    const uint8_t present = 1;
+    ok = writeRun(dataRoot, apid, COLUMN_PRESENT_NAME, TBYTE, 1, dayIndex, slotOf(secondOfDay, taiSubseconds, 1, productSeconds),
+                  &present, 1) && ok;
+    return ok;
+}
+
+// writes count samples from slot on, the ones past the end of the day go to the start of the next day
+bool ColumnStore::writeRun(const std::string& dataRoot, uint16_t apid, const std::string& column, int typeCode, uint32_t samplesPerProduct,
+                           int64_t dayIndex, uint64_t slot, const uint8_t* values, size_t count) {
+    const uint32_t productSeconds = secondsPerProduct(apid);
+    ColumnFileHeader header = makeHeader(typeCode, samplesPerProduct, productSeconds, dayIndex);
+    size_t inDay = static_cast<size_t>(std::min<uint64_t>(count, (slot < header.samplesPerDay) ? header.samplesPerDay - slot : 0));
+
+    std::string filename = columnFilename(dataRoot, apid, column, header.dayStartTai);
+    int fd = openColumn(filename, header);
+    if (fd < 0) {
+        return false;
+    }
+    bool ok = true;
+    size_t runBytes = inDay * header.elementBytes;
+    off_t sampleOffset = static_cast<off_t>(sizeof(ColumnFileHeader) + slot * header.elementBytes);
+    if (pwrite(fd, values, runBytes, sampleOffset) != static_cast<ssize_t>(runBytes)) {
+        LogFileWriter::getInstance().logError("ColumnStore::append: Failed to write {}: {}", filename, strerror(errno));
+        ok = false;
+    }
+
+    bool overwrote = false;
+    if (ok && !markWritten(fd, header, slot, inDay, overwrote)) {
+        LogFileWriter::getInstance().logError("ColumnStore::append: Failed to mark the written slots of {}: {}", filename, strerror(errno));
+        ok = false;
+    }
+
+    // fold the new samples into the min/max of each chunk they fall in, or rebuild the chunk if they replaced samples
+    size_t written = 0;
+    while (ok && (written < inDay)) {
+        uint64_t chunk = (slot + written) / header.summaryChunkSamples;
+        size_t chunkEnd = static_cast<size_t>(std::min<uint64_t>((chunk + 1) * header.summaryChunkSamples - slot, inDay));
+        off_t chunkOffset = static_cast<off_t>(summaryOffset(header) + chunk * sizeof(ColumnSummary));
+        ColumnSummary summary = {};
+        if (overwrote) {
+            ok = summarizeChunk(fd, header, chunk, summary);
+            written = chunkEnd;
+        } else {
+            ok = (pread(fd, &summary, sizeof(summary), chunkOffset) == static_cast<ssize_t>(sizeof(summary)));
+        }
+        for (; ok && (written < chunkEnd); ++written) {
+            double value = sampleValue(typeCode, values + written * header.elementBytes);
+            if ((summary.count == 0) || (value < summary.minimum)) {
+                summary.minimum = value;
+            }
+            if ((summary.count == 0) || (value > summary.maximum)) {
+                summary.maximum = value;
+            }
+            ++summary.count;
+        }
+        ok = ok && (pwrite(fd, &summary, sizeof(summary), chunkOffset) == static_cast<ssize_t>(sizeof(summary)));
+        if (!ok) {
+            LogFileWriter::getInstance().logError("ColumnStore::append: Failed to update the summary of {}: {}", filename, strerror(errno));
+        }
+    }
+
+    if (ok && (inDay < count)) {
+        ok = writeRun(dataRoot, apid, column, typeCode, samplesPerProduct, dayIndex + 1, 0,
+                      values + runBytes, count - inDay);
+    }
+    return ok;
+}
+
+// the cached fd of a column file, a new file is written full size with the expected header, -1 on failure
+int ColumnStore::openColumn(const std::string& filename, const ColumnFileHeader& expected) {
+    auto cached = openFiles.find(filename);
+    if (cached != openFiles.end()) {
+        return cached->second;
+    }
+    std::string directory = filename.substr(0, filename.find_last_of('/') + 1);
+    if (!PathService::getInstance().ensureDirectory(directory)) {
+        LogFileWriter::getInstance().logError("ColumnStore::append: Failed to create {}", directory);
+        return -1;
+    }
+    int fd = open(filename.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+    if (fd < 0) {
+        LogFileWriter::getInstance().logError("ColumnStore::append: Failed to open {}: {}", filename, strerror(errno));
+        return -1;
+    }
+
+    struct stat info;
+    bool ok = (fstat(fd, &info) == 0);
+    ColumnFileHeader header = {};
+    if (ok && (info.st_size == 0)) {
+        header = expected;
+        off_t totalBytes = static_cast<off_t>(fileBytes(header));
+        // sparse, only the pages that get samples take disk space
+        ok = (ftruncate(fd, totalBytes) == 0) && (pwrite(fd, &header, sizeof(header), 0) == static_cast<ssize_t>(sizeof(header)));
+    } else if (ok) {
+        ok = readHeader(fd, header) && (header.typeCode == expected.typeCode) &&
+             (header.samplesPerProduct == expected.samplesPerProduct) && (header.dayStartTai == expected.dayStartTai);
+    }
+    if (!ok) {
+        LogFileWriter::getInstance().logError("ColumnStore::append: {} is not a column file of this layout", filename);
+        close(fd);
+        return -1;
+    }
+    openFiles[filename] = fd;
+    return fd;
+}
+
+ColumnReader::ColumnReader(const std::string& dataRoot, uint16_t apid, const std::string& column)
+    : dataRoot(dataRoot), apid(apid), column(column) {
+}
+
+ColumnReader::~ColumnReader() {
+    for (auto& entry : mappings) {
+        munmap(const_cast<uint8_t*>(entry.second.base), entry.second.bytes);
+    }
+}
+
+// maps the column file of the day holding taiSeconds once, nullptr if there is none yet
+const ColumnReader::Mapping* ColumnReader::mapDay(uint32_t taiSeconds) {
+    std::string filename = ColumnStore::columnFilename(dataRoot, apid, column, taiSeconds);
+    auto mapped = mappings.find(filename);
+    if (mapped != mappings.end()) {
+        return &mapped->second;
+    }
+    int fd = open(filename.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return nullptr;
+    }
+    ColumnFileHeader header = {};
+    struct stat info;
+    bool ok = readHeader(fd, header) && (fstat(fd, &info) == 0) &&
+              (static_cast<size_t>(info.st_size) >= fileBytes(header));
+    void* base = MAP_FAILED;
+    if (ok) {
+        base = mmap(nullptr, static_cast<size_t>(info.st_size), PROT_READ, MAP_SHARED, fd, 0);
+    }
+    close(fd);
+    if (base == MAP_FAILED) {
+        return nullptr;
+    }
+    Mapping& mapping = mappings[filename];
+    mapping.base = static_cast<const uint8_t*>(base);
+    mapping.bytes = static_cast<size_t>(info.st_size);
+    return &mapping;
+}
+
+std::vector<ColumnSpan> ColumnReader::read(uint32_t startTai, uint32_t endTai) {
+    std::vector<ColumnSpan> spans;
+    if (endTai <= startTai) {
+        return spans;
+    }
+    for (int64_t day = dayOf(startTai); day <= dayOf(static_cast<int64_t>(endTai) - 1); ++day) {
+        const Mapping* mapping = mapDay(dayStartTai(day));
+        if (mapping == nullptr) {
+            continue;
+        }
+        const ColumnFileHeader& header = *reinterpret_cast<const ColumnFileHeader*>(mapping->base);
+        uint64_t from = std::max<int64_t>(startTai, header.dayStartTai) - header.dayStartTai;
+        uint64_t to = std::min<int64_t>(endTai, static_cast<int64_t>(header.dayStartTai) + SECONDS_PER_DAY) - header.dayStartTai;
+        // the samples whose time falls in [from, to)
+        uint64_t firstSlot = (from * header.samplesPerProduct + header.secondsPerProduct - 1) / header.secondsPerProduct;
+        uint64_t endSlot = std::min<uint64_t>((to * header.samplesPerProduct + header.secondsPerProduct - 1) / header.secondsPerProduct,
+                                              header.samplesPerDay);
+        if (firstSlot >= endSlot) {
+            continue;
+        }
+        ColumnSpan span;
+        span.data = mapping->base + sizeof(ColumnFileHeader) + firstSlot * header.elementBytes;
+        span.count = static_cast<size_t>(endSlot - firstSlot);
+        span.typeCode = header.typeCode;
+        span.samplePeriod = static_cast<double>(header.secondsPerProduct) / header.samplesPerProduct;
+        span.firstTai = header.dayStartTai + firstSlot * span.samplePeriod;
+        spans.push_back(span);
+    }
+    return spans;
+}
+
+std::vector<ColumnSummarySpan> ColumnReader::summary(uint32_t startTai, uint32_t endTai) {
+    std::vector<ColumnSummarySpan> spans;
+    if (endTai <= startTai) {
+        return spans;
+    }
+    for (int64_t day = dayOf(startTai); day <= dayOf(static_cast<int64_t>(endTai) - 1); ++day) {
+        const Mapping* mapping = mapDay(dayStartTai(day));
+        if (mapping == nullptr) {
+            continue;
+        }
+        const ColumnFileHeader& header = *reinterpret_cast<const ColumnFileHeader*>(mapping->base);
+        uint64_t from = std::max<int64_t>(startTai, header.dayStartTai) - header.dayStartTai;
+        uint64_t to = std::min<int64_t>(endTai, static_cast<int64_t>(header.dayStartTai) + SECONDS_PER_DAY) - header.dayStartTai;
+        uint64_t firstChunk = from * header.samplesPerProduct / header.secondsPerProduct / header.summaryChunkSamples;
+        uint64_t endSlot = (to * header.samplesPerProduct + header.secondsPerProduct - 1) / header.secondsPerProduct;
+        uint64_t endChunk = std::min<uint64_t>((endSlot + header.summaryChunkSamples - 1) / header.summaryChunkSamples,
+                                               summaryCount(header));
+        if (firstChunk >= endChunk) {
+            continue;
+        }
+        ColumnSummarySpan span;
+        span.data = reinterpret_cast<const ColumnSummary*>(mapping->base + summaryOffset(header)) + firstChunk;
+        span.count = static_cast<size_t>(endChunk - firstChunk);
+        span.chunkSeconds = static_cast<double>(header.summaryChunkSamples) * header.secondsPerProduct / header.samplesPerProduct;
+        span.firstTai = header.dayStartTai + firstChunk * span.chunkSeconds;
+        spans.push_back(span);
+    }
+    return spans;
+}
@@ -0,0 +1,132 @@
+#ifndef COLUMN_STORE_HPP
+#define COLUMN_STORE_HPP
+
+// Day-long columns of the ESP, MEGS-P and SHK tables, appended as each 10 second product is written.
+// Every table column gets one file per UTC day under <day directory>/columns/, named after the struct member.
+// The file is a 64 byte header, then one fixed-width slot per sample of the day, then a min/max summary of
+// every COLUMN_SUMMARY_CHUNK samples, then one bit per slot that is set once the slot is written.
+// A sample's slot is its TAI seconds and subseconds rounded to the nearest sample period, so files are made
+// full size (sparse) when first touched, a time range maps straight to a slice, and readers get spans into
+// the mapping with no copy. Slots never written read as zero. The present column has one byte per product
+// slot that is set when a product was appended, so a gap can be told from a zero.
+// Appending over written slots, a replay of the same product, rebuilds the summaries of their chunks
+// from the written slots, so a slot is only ever counted once.
+
+#include "eve_l0b.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+constexpr char COLUMN_STORE_MAGIC[8] = {'E', 'V', 'E', 'C', 'O', 'L', '1', '\0'};
+constexpr uint32_t COLUMN_STORE_VERSION = 2;       // 2 added the written bits
+constexpr uint32_t COLUMN_SUMMARY_CHUNK = 256;   // samples per min/max summary entry
+constexpr char COLUMN_PRESENT_NAME[] = "present";
+
+struct ColumnFileHeader {
+    char magic[8];
+    uint32_t version;
+    int32_t typeCode;             // cfitsio datatype of a sample, as in the FITS table
+    uint32_t elementBytes;
+    uint32_t samplesPerDay;
+    uint32_t samplesPerProduct;   // samples in one 10 second product
+    uint32_t secondsPerProduct;
+    uint32_t summaryChunkSamples;
+    uint32_t dayStartTai;         // TAI of 00:00:00 UTC, the time of slot 0
+    uint8_t reserved[24];
+};
+
+struct ColumnSummary {
+    double minimum;
+    double maximum;
+    uint32_t count;               // written slots of the chunk, 0 leaves minimum and maximum meaningless
+    uint32_t reserved;
+};
+
+static_assert(sizeof(ColumnFileHeader) == 64, "the column header is part of the file format");
+static_assert(sizeof(ColumnSummary) == 24, "column summaries are part of the file format");
+
+// one day's samples of a range, pointing into the mapped file
+struct ColumnSpan {
+    const void* data = nullptr;
+    size_t count = 0;
+    int typeCode = 0;
+    double firstTai = 0.0;        // time of data[0]
+    double samplePeriod = 0.0;    // seconds between samples
+
+    template <typename T>
+    const T* as() const { return static_cast<const T*>(data); }
+};
+
+// one day's summary entries of a range, pointing into the mapped file
+struct ColumnSummarySpan {
+    const ColumnSummary* data = nullptr;
+    size_t count = 0;
+    double firstTai = 0.0;        // start of data[0]
+    double chunkSeconds = 0.0;
+};
+
+class ColumnStore {
+public:
+    static ColumnStore& getInstance();
+
+    // appends every table column of a product below dataRoot
+    bool append(const std::string& dataRoot, const MEGSP_PACKET& megsP);
+    bool append(const std::string& dataRoot, const ESP_PACKET& esp);
+    bool append(const std::string& dataRoot, const SHK_PACKET& shk);
+
+    // closes the open column files, the next append reopens them
+    void closeAll();
+
+    // the columns a channel stores, the FITS table columns without the time columns, then present
+    static std::vector<std::string> columnNames(uint16_t apid);
+    // <day directory>/columns/<column>.col for the UTC day holding taiSeconds
+    static std::string columnFilename(const std::string& dataRoot, uint16_t apid, const std::string& column, uint32_t taiSeconds);
+
+private:
+    ColumnStore() = default;
+    ~ColumnStore();
+    ColumnStore(const ColumnStore&) = delete;
+    ColumnStore& operator=(const ColumnStore&) = delete;
+
+    bool appendProduct(const std::string& dataRoot, uint16_t apid, const void* record, uint32_t taiSeconds, uint32_t taiSubseconds);
+    bool writeRun(const std::string& dataRoot, uint16_t apid, const std::string& column, int typeCode, uint32_t samplesPerProduct,
+                  int64_t dayIndex, uint64_t slot, const uint8_t* values, size_t count);
+    int openColumn(const std::string& filename, const ColumnFileHeader& expected);
+
+    std::mutex mutex;
+    int64_t openDay = -1;
+    std::unordered_map<std::string, int> openFiles;
+};
+
+// maps the day files of one column and hands out spans of them, not thread safe
+class ColumnReader {
+public:
+    ColumnReader(const std::string& dataRoot, uint16_t apid, const std::string& column);
+    ~ColumnReader();
+    ColumnReader(const ColumnReader&) = delete;
+    ColumnReader& operator=(const ColumnReader&) = delete;
+
+    // one span per day of [startTai, endTai) that has a column file, valid while the reader lives
+    std::vector<ColumnSpan> read(uint32_t startTai, uint32_t endTai);
+    // the summary entries overlapping [startTai, endTai), for plots of more samples than pixels
+    std::vector<ColumnSummarySpan> summary(uint32_t startTai, uint32_t endTai);
+
+private:
+    struct Mapping {
+        const uint8_t* base = nullptr;
+        size_t bytes = 0;
+    };
+    const Mapping* mapDay(uint32_t taiSeconds);
+
+    std::string dataRoot;
+    uint16_t apid;
+    std::string column;
+    std::map<std::string, Mapping> mappings;
+};
+
+#endif // COLUMN_STORE_HPP
@@ -0,0 +1,110 @@
+#ifndef EVE_SHARED_MEMORY_HPP
+#define EVE_SHARED_MEMORY_HPP
+
+// Layout of the POSIX shared-memory segment published by rl0b_main -shm.
+// External tools mmap it read-only with EveShmReader to get new frames without waiting for FITS files.
+//
+// One writer (the packet thread) and any number of readers in other processes.
+// Image slots use a sequence lock: sequence is odd while the writer updates the slot,
+// a reader copies and retries if the sequence changed. Rings are overwritten oldest first,
+// writeCount is the number of entries ever written and entry i lives at i % capacity.
+// generation[] in the header increments once per completed update of each channel,
+// readers poll it to find out cheaply whether anything changed.
+//
+// Any change to these structures must bump EVE_SHM_VERSION.
+
+#include <atomic>
+#include <cstdint>
+#include "eve_l0b.hpp"
+
+constexpr char EVE_SHM_DEFAULT_NAME[] = "/eve_rocket_l0b";
+constexpr uint32_t EVE_SHM_MAGIC = 0x45564553; // "SEVE" in memory
+constexpr uint32_t EVE_SHM_VERSION = 2;
+
+constexpr uint32_t EVE_SHM_ESP_RING_SIZE = 4096;   // about 17 minutes of 4 Hz integrations
+constexpr uint32_t EVE_SHM_MEGSP_RING_SIZE = 4096;
+constexpr uint32_t EVE_SHM_SHK_RING_SIZE = 1024;   // 1 Hz
+constexpr uint32_t EVE_SHM_SHK_FIELDS = sizeof(SHK_CONVERTED_PACKET) / (sizeof(double) * SHK_INTEGRATIONS_PER_FILE);
+
+enum EveShmChannel : uint32_t {
+    EVE_SHM_MEGSA_COMPLETE = 0,
+    EVE_SHM_MEGSA_IN_PROGRESS,
+    EVE_SHM_MEGSB_COMPLETE,
+    EVE_SHM_MEGSB_IN_PROGRESS,
+    EVE_SHM_IMAGE_SLOTS, // number of image slots, also the first ring channel
+    EVE_SHM_ESP = EVE_SHM_IMAGE_SLOTS,
+    EVE_SHM_MEGSP,
+    EVE_SHM_SHK,
+    EVE_SHM_CHANNELS
+};
+
+struct EveShmImageInfo {
+    uint32_t imageCount;        // images completed before this one
+    uint32_t tai_time_seconds;  // from the first packet of the image
+    uint32_t tai_time_subseconds;
+    uint32_t yyyydoy;
+    uint32_t sod;
+    uint32_t lastSourceSequenceCounter; // 2394 once the image is finished
+    uint32_t testPattern;
+    uint32_t packetsReceived;   // less than 2395 in a finished image that lost packets
+};
+
+struct EveShmImage {
+    std::atomic<uint32_t> sequence; // odd while the writer is updating
+    uint32_t reserved;
+    EveShmImageInfo info;
+    uint16_t pixels[MEGS_IMAGE_HEIGHT][MEGS_IMAGE_WIDTH]; // same orientation as MEGS_IMAGE_REC.image
+};
+
+struct EveShmESPEntry {
+    uint32_t tai_time_seconds; // packet time, shared by the 4 integrations in a packet
+    uint32_t tai_time_subseconds;
+    uint16_t xfer_cnt;
+    uint16_t q0;
+    uint16_t q1;
+    uint16_t q2;
+    uint16_t q3;
+    uint16_t esp171;
+    uint16_t esp257;
+    uint16_t esp304;
+    uint16_t esp366;
+    uint16_t dark;
+};
+
+struct EveShmMEGSPEntry {
+    uint32_t tai_time_seconds;
+    uint32_t tai_time_subseconds;
+    uint16_t lya;
+    uint16_t dark;
+};
+
+struct EveShmSHKEntry {
+    uint32_t tai_time_seconds; // time of the last packet in the 10 second SHK file
+    uint32_t integration;      // index within that file
+    double values[EVE_SHM_SHK_FIELDS]; // converted values in SHK_CONVERTED_PACKET field order
+};
+
+template <typename Entry, uint32_t Capacity>
+struct EveShmRing {
+    static constexpr uint32_t capacity = Capacity;
+    std::atomic<uint64_t> writeCount;
+    Entry entries[Capacity];
+};
+
+struct EveShmSegment {
+    uint32_t magic;   // written last by the writer, readers check it first
+    uint32_t version;
+    uint64_t segmentBytes; // sizeof(EveShmSegment) as compiled by the writer
+    std::atomic<int32_t> writerPid;
+    uint32_t reserved;
+    std::atomic<uint64_t> generation[EVE_SHM_CHANNELS];
+    EveShmImage images[EVE_SHM_IMAGE_SLOTS];
+    EveShmRing<EveShmESPEntry, EVE_SHM_ESP_RING_SIZE> esp;
+    EveShmRing<EveShmMEGSPEntry, EVE_SHM_MEGSP_RING_SIZE> megsp;
+    EveShmRing<EveShmSHKEntry, EVE_SHM_SHK_RING_SIZE> shk;
+};
+
+static_assert(std::atomic<uint32_t>::is_always_lock_free && std::atomic<uint64_t>::is_always_lock_free,
+    "shared-memory atomics must be lock free to work across processes");
+
+#endif // EVE_SHARED_MEMORY_HPP
@@ -0,0 +1,162 @@
+#include "EveShmReader.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <thread>
+#include <fcntl.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace {
+
+constexpr int COPY_IMAGE_RETRIES = 100;
+
+// copy the entries written since nextIndex, then drop any the writer may have overwritten during the copy
+template <typename Ring, typename Entry>
+uint64_t readRing(const Ring& ring, uint64_t& nextIndex, std::vector<Entry>& entries) {
+    uint64_t before = ring.writeCount.load(std::memory_order_acquire);
+    uint64_t lost = 0;
+    // the writer may already be replacing entry before - capacity, so at most capacity - 1 are readable
+    if (before > nextIndex + Ring::capacity - 1) {
+        lost = before - (Ring::capacity - 1) - nextIndex;
+        nextIndex = before - (Ring::capacity - 1);
+    }
+    if (nextIndex >= before) {
+        return lost;
+    }
+
+    size_t firstNew = entries.size();
+    for (uint64_t index = nextIndex; index < before; ++index) {
+        entries.push_back(ring.entries[index % Ring::capacity]);
+    }
+    std::atomic_thread_fence(std::memory_order_acquire);
+
+    uint64_t after = ring.writeCount.load(std::memory_order_relaxed);
+    if (after > nextIndex + Ring::capacity - 1) {
+        // the writer moved on while copying, entries below after - capacity + 1 may have been rewritten
+        uint64_t firstValid = after - Ring::capacity + 1;
+        uint64_t overwritten = std::min(firstValid, before) - nextIndex;
+        entries.erase(entries.begin() + firstNew, entries.begin() + firstNew + overwritten);
+        lost += overwritten;
+    }
+    nextIndex = before;
+    return lost;
+}
+
+} // namespace
+
+EveShmReader::~EveShmReader() {
+    close();
+}
+
+bool EveShmReader::open(const std::string& segmentName) {
+    close();
+
+    int fd = shm_open(segmentName.c_str(), O_RDONLY, 0);
+    if (fd < 0) {
+        error = "shm_open " + segmentName + " failed: " + strerror(errno);
+        return false;
+    }
+    struct stat status;
+    if (fstat(fd, &status) != 0 || status.st_size < static_cast<off_t>(sizeof(EveShmSegment))) {
+        error = "segment " + segmentName + " is smaller than expected, writer and reader layouts differ";
+        ::close(fd);
+        return false;
+    }
+    void* mapped = mmap(nullptr, sizeof(EveShmSegment), PROT_READ, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if (mapped == MAP_FAILED) {
+        error = "mmap " + segmentName + " failed: " + strerror(errno);
+        return false;
+    }
+
+    const EveShmSegment* candidate = static_cast<const EveShmSegment*>(mapped);
+    if (candidate->magic != EVE_SHM_MAGIC) {
+        error = "segment " + segmentName + " has no valid header yet";
+    } else if (candidate->version != EVE_SHM_VERSION) {
+        error = "segment " + segmentName + " version " + std::to_string(candidate->version) +
+            " does not match reader version " + std::to_string(EVE_SHM_VERSION);
+    } else if (candidate->segmentBytes != sizeof(EveShmSegment)) {
+        error = "segment " + segmentName + " size " + std::to_string(candidate->segmentBytes) +
+            " does not match reader size " + std::to_string(sizeof(EveShmSegment));
+    } else {
+        std::atomic_thread_fence(std::memory_order_acquire);
+        segment = candidate;
+        mappedBytes = sizeof(EveShmSegment);
+        error.clear();
+        return true;
+    }
+    munmap(mapped, sizeof(EveShmSegment));
+    return false;
+}
+
+void EveShmReader::close() {
+    if (segment != nullptr) {
+        munmap(const_cast<EveShmSegment*>(segment), mappedBytes);
+        segment = nullptr;
+        mappedBytes = 0;
+    }
+}
+
+bool EveShmReader::writerAlive() const {
+    if (segment == nullptr) {
+        return false;
+    }
+    int32_t pid = segment->writerPid.load(std::memory_order_acquire);
+    return pid > 0 && (kill(pid, 0) == 0 || errno == EPERM);
+}
+
+uint64_t EveShmReader::generation(EveShmChannel channel) const {
+    if (segment == nullptr || channel >= EVE_SHM_CHANNELS) {
+        return 0;
+    }
+    return segment->generation[channel].load(std::memory_order_acquire);
+}
+
+bool EveShmReader::waitForGeneration(EveShmChannel channel, uint64_t lastSeen, int timeoutMs) const {
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeoutMs);
+    while (generation(channel) == lastSeen) {
+        if (std::chrono::steady_clock::now() >= deadline) {
+            return false;
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    return true;
+}
+
+bool EveShmReader::copyImage(EveShmChannel slot, EveShmImageInfo& info, uint16_t* pixels) const {
+    if (segment == nullptr || slot >= EVE_SHM_IMAGE_SLOTS) {
+        return false;
+    }
+    const EveShmImage& image = segment->images[slot];
+    for (int attempt = 0; attempt < COPY_IMAGE_RETRIES; ++attempt) {
+        uint32_t before = image.sequence.load(std::memory_order_acquire);
+        if (before & 1) {
+            std::this_thread::yield();
+            continue;
+        }
+        info = image.info;
+        std::memcpy(pixels, image.pixels, sizeof(image.pixels));
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (image.sequence.load(std::memory_order_relaxed) == before) {
+            return true;
+        }
+    }
+    return false;
+}
+
+uint64_t EveShmReader::readESP(uint64_t& nextIndex, std::vector<EveShmESPEntry>& entries) const {
+    return segment == nullptr ? 0 : readRing(segment->esp, nextIndex, entries);
+}
+
+uint64_t EveShmReader::readMEGSP(uint64_t& nextIndex, std::vector<EveShmMEGSPEntry>& entries) const {
+    return segment == nullptr ? 0 : readRing(segment->megsp, nextIndex, entries);
+}
+
+uint64_t EveShmReader::readSHK(uint64_t& nextIndex, std::vector<EveShmSHKEntry>& entries) const {
+    return segment == nullptr ? 0 : readRing(segment->shk, nextIndex, entries);
+}
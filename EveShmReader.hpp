@@ -0,0 +1,48 @@
+#ifndef EVE_SHM_READER_HPP
+#define EVE_SHM_READER_HPP
+
+// Reader side of the EveSharedMemory.hpp segment for external tools.
+// Depends only on the standard library and POSIX so it can be copied into another project
+// together with EveSharedMemory.hpp and eve_l0b.hpp.
+
+#include <string>
+#include <vector>
+#include "EveSharedMemory.hpp"
+
+class EveShmReader {
+public:
+    EveShmReader() = default;
+    ~EveShmReader();
+    EveShmReader(const EveShmReader&) = delete;
+    EveShmReader& operator=(const EveShmReader&) = delete;
+
+    // maps the segment read-only and checks magic, version and size, false with a message in lastError()
+    bool open(const std::string& segmentName = EVE_SHM_DEFAULT_NAME);
+    void close();
+    bool isOpen() const { return segment != nullptr; }
+    const std::string& lastError() const { return error; }
+
+    // zero-copy access, pixels may change underneath the caller, use copyImage for a consistent frame
+    const EveShmSegment* getSegment() const { return segment; }
+    bool writerAlive() const;
+
+    uint64_t generation(EveShmChannel channel) const;
+    // sleeps in short steps until generation(channel) != lastSeen, true if it changed before timeoutMs
+    bool waitForGeneration(EveShmChannel channel, uint64_t lastSeen, int timeoutMs) const;
+
+    // consistent copy of one image slot, pixels must hold MEGS_TOTAL_PIXELS, false if the writer kept it busy
+    bool copyImage(EveShmChannel slot, EveShmImageInfo& info, uint16_t* pixels) const;
+
+    // appends entries from nextIndex up to the latest and advances nextIndex,
+    // returns the number of entries lost because the ring wrapped past nextIndex, at most capacity - 1 are kept
+    uint64_t readESP(uint64_t& nextIndex, std::vector<EveShmESPEntry>& entries) const;
+    uint64_t readMEGSP(uint64_t& nextIndex, std::vector<EveShmMEGSPEntry>& entries) const;
+    uint64_t readSHK(uint64_t& nextIndex, std::vector<EveShmSHKEntry>& entries) const;
+
+private:
+    const EveShmSegment* segment = nullptr;
+    size_t mappedBytes = 0;
+    std::string error;
+};
+
+#endif // EVE_SHM_READER_HPP
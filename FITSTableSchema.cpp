@@ -0,0 +1,259 @@
+#include "FITSTableSchema.hpp"
+#include "eve_l0b.hpp"
+
+#include <stdexcept>
+
+#include "/usr/local/include/fitsio.h"
+
+FITSTableSchema::FITSTableSchema(const std::string& extname, const std::vector<std::string>& names, const std::string& types,
+                                 const std::vector<int>& lengths, const std::vector<std::string>& units)
+    : tableName(extname) {
+    if ((names.size() != types.size()) || (names.size() != lengths.size()) || (names.size() != units.size())) {
+        throw std::invalid_argument("FITS table " + extname + " has mismatched column definitions");
+    }
+    tableColumns.reserve(names.size());
+    for (size_t i = 0; i < names.size(); ++i) {
+        FITSColumn column;
+        column.name = names[i];
+        column.tform = std::to_string(lengths[i]) + types[i];
+        column.unit = units[i];
+        column.typeLetter = types[i];
+        column.typeCode = typeCode(types[i]);
+        column.length = lengths[i];
+        column.offset = packedRowBytes;
+        column.elementBytes = elementBytes(types[i]);
+        if (column.typeCode == 0) {
+            throw std::invalid_argument("FITS table " + extname + " column " + names[i] + " has unknown type code " + types[i]);
+        }
+        packedRowBytes += column.elementBytes * column.length;
+        tableColumns.push_back(column);
+    }
+    // the columns are not touched again, so these stay valid for the life of the schema
+    for (FITSColumn& column : tableColumns) {
+        ttypePointers.push_back(&column.name[0]);
+        tformPointers.push_back(&column.tform[0]);
+        tunitPointers.push_back(&column.unit[0]);
+    }
+}
+
+int FITSTableSchema::typeCode(char typeLetter) {
+    switch (typeLetter) {
+        case 'B': return TBYTE;     // unsigned byte
+        case 'U': return TUSHORT;   // uint16
+        case 'V': return TUINT;     // uint32
+        case 'E': return TFLOAT;    // 32-bit float
+        case 'D': return TDOUBLE;   // 64-bit double
+        case 'S': return TSBYTE;    // signed byte
+        case 'X': return TBIT;      // one byte per bit in the row
+        case 'L': return TLOGICAL;
+        case 'A': return TSTRING;   // chars
+        case 'I': return TSHORT;    // int16
+        case 'J': return TINT;      // int32
+        case 'K': return TLONG;     // int64
+        default: return 0;
+    }
+}
+
+size_t FITSTableSchema::elementBytes(char typeLetter) {
+    switch (typeLetter) {
+        case 'U':
+        case 'I': return sizeof(uint16_t);
+        case 'V':
+        case 'J': return sizeof(uint32_t);
+        case 'E': return sizeof(float);
+        case 'D': return sizeof(double);
+        case 'K': return sizeof(long);
+        case 'A': return sizeof("0123456789ABCDEFG");
+        default: return sizeof(uint8_t);
+    }
+}
+
+namespace {
+
+FITSTableSchema makeMegsTableSchema(const std::string& extname) {
+    std::vector<std::string> columnNames = {
+        "YYYYDOY", "SOD", "TAI_TIME_SECONDS", "TAI_TIME_SUBSECONDS",
+        "REC_TAI_SECONDS", "REC_TAI_SUBSECONDS", "VCDU_COUNT",
+        "FPGA_BOARD_TEMPERATURE", "CEB_TEMPERATURE", "CPR_TEMPERATURE", "PRT_TEMPERATURE",
+        "PACKETS_RECEIVED", "RECEIVED_PACKETS"
+    };
+
+    // RECEIVED_PACKETS element n is set when the packet with SSC n was assembled
+    std::vector<std::string> columnTypes = {"V", "V", "V", "V", "V", "V", "U", "E", "E", "E", "E", "U", "X"};
+    std::vector<int> columnLengths = {1,1,1,1,1,1,1,1,1,1,1,1,N_PKT_PER_IMAGE};
+    std::string combinedColumnTypes;
+    for (const auto& type : columnTypes) {
+        combinedColumnTypes += type;
+    }
+    std::vector<std::string> columnUnits = {"DATE", "s", "s", "s", "s", "s", "count", "degC", "degC", "degC", "degC", "count", ""};
+
+    return FITSTableSchema(extname, columnNames, combinedColumnTypes, columnLengths, columnUnits);
+}
+
+FITSTableSchema makeMegsSpectrumTableSchema(const std::string& extname) {
+    std::vector<std::string> columnNames = {
+        "FIRST_ROW", "LAST_ROW", "ROWS", "DARK_FRAMES", "DARK_LEFT", "DARK_RIGHT", "SPECTRUM", "PIXELS"
+    };
+
+    // SPECTRUM is the mean DN above dark of the PIXELS unsaturated pixels in each column,
+    // DARK_FRAMES the frames in the dark frame subtracted before the dark columns, 0 for none
+    std::string combinedColumnTypes = "UUUUEEEU";
+    std::vector<int> columnLengths = {1, 1, 1, 1, 1, 1, static_cast<int>(MEGS_IMAGE_WIDTH), static_cast<int>(MEGS_IMAGE_WIDTH)};
+    std::vector<std::string> columnUnits = {"row", "row", "count", "count", "DN", "DN", "DN", "count"};
+
+    return FITSTableSchema(extname, columnNames, combinedColumnTypes, columnLengths, columnUnits);
+}
+
+FITSTableSchema makeMegsPTableSchema() {
+    std::string extname = "MEGSP_DATA";
+    std::vector<std::string> columnNames = {
+        "YYYYDOY", "SOD", "TAI_TIME_SECONDS", "TAI_TIME_SUBSECONDS",
+        "REC_TAI_SECONDS", "REC_TAI_SUBSECONDS", 
+        "FPGA_BOARD_TEMPERATURE", "MEGSP_Temperature",
+        "MP_lya", "MP_dark" 
+    };
+
+    std::vector<std::string> columnTypes = {"V", "V", "V", "V", 
+        "V", "V", 
+        "E", "E",
+        "U", "U"};
+    std::string combinedColumnTypes;
+    for (const auto& type : columnTypes) {
+        combinedColumnTypes += type;
+    }
+    std::vector<std::string> columnUnits = {"DATE", "s", "s", "s", "s", "s", "C", "C", "count","count"};
+
+    std::vector<int> columnLengths = {1,1,1,1,1,1,1,1,MEGSP_INTEGRATIONS_PER_FILE, MEGSP_INTEGRATIONS_PER_FILE};
+
+    return FITSTableSchema(extname, columnNames, combinedColumnTypes, columnLengths, columnUnits);
+}
+
+FITSTableSchema makeESPTableSchema() {
+    std::string extname = "ESP_DATA";
+    std::vector<std::string> columnNames = {
+        "YYYYDOY", "SOD", "TAI_TIME_SECONDS", "TAI_TIME_SUBSECONDS",
+        "REC_TAI_SECONDS", "REC_TAI_SUBSECONDS", 
+        "FPGA_BOARD_TEMPERATURE", "ESP_Electrometer_Temperature", "ESP_Detector_Temperature",
+        "ESP_xfer_cnt","ESP_q0", "ESP_q1", "ESP_q2", "ESP_q3", "ESP_171", "ESP_257", "ESP_304", "ESP_366", "ESP_dark" 
+    };
+
+    std::vector<std::string> columnTypes = {"V", "V", "V", "V", 
+        "V", "V", 
+        "E", "E", "E",
+        "U", "U", "U", "U", "U", "U", "U", "U", "U", "U"};
+    std::string combinedColumnTypes;
+    for (const auto& type : columnTypes) {
+        combinedColumnTypes += type;
+    }
+    std::vector<std::string> columnUnits = {"DATE", "s", "s", "s", "s", "s", "C", "C", "C", "", "count","count","count", "count","count","count", "count","count","count"};
+
+    std::vector<int> columnLengths = {1,1,1,1,1,1,1,1,1,ESP_INTEGRATIONS_PER_FILE, 
+        ESP_INTEGRATIONS_PER_FILE, ESP_INTEGRATIONS_PER_FILE, ESP_INTEGRATIONS_PER_FILE,
+        ESP_INTEGRATIONS_PER_FILE, ESP_INTEGRATIONS_PER_FILE, ESP_INTEGRATIONS_PER_FILE,
+        ESP_INTEGRATIONS_PER_FILE, ESP_INTEGRATIONS_PER_FILE, ESP_INTEGRATIONS_PER_FILE 
+    };
+
+    return FITSTableSchema(extname, columnNames, combinedColumnTypes, columnLengths, columnUnits);
+}
+
+FITSTableSchema makeSHKTableSchema() {
+    const std::string extname = "SHK_DATA";
+    std::vector<std::string> columnNames = {
+        "YYYYDOY", "SOD", "TAI_TIME_SECONDS", "TAI_TIME_SUBSECONDS", // 4
+        "REC_TAI_SECONDS", "REC_TAI_SUBSECONDS", "mode",  // 7
+        "FPGA_Board_Temperature", "FPGA_Board_p5_0_Voltage", "FPGA_Board_p3_3_Voltage", "FPGA_Board_p2_5_Voltage", 
+        "FPGA_Board_p1_2_Voltage", "MEGSA_CEB_Temperature", "MEGSA_CPR_Temperature", "MEGSA_p24_Voltage", 
+        "MEGSA_p15_Voltage", "MEGSA_m15_Voltage", "MEGSA_p5_0_Analog_Voltage", "MEGSA_m5_0_Voltage", // 19
+        "MEGSA_p5_0_Digital_Voltage", "MEGSA_p2_5_Voltage", "MEGSA_p24_Current", "MEGSA_p15_Current", //16+7
+        "MEGSA_m15_Current", "MEGSA_p5_0_Analog_Current", "MEGsA_m5_0_Current", "MEGSA_p5_0_Digital_Current", 
+        "MEGSA_p2_5_Current", "MEGSA_Integration_Register", "MEGSA_Analog_Mux_Register", "MEGSA_Digital_Status_Register", 
+        "MEGSA_Integration_Timer_Register", "MEGSA_Command_Error_Count_Register", "MEGSA_CEB_FPGA_Version_Register", "MEGSB_CEB_Temperature", 
+        "MEGSB_CPR_Temperature", "MEGSB_p24_Voltage", "MEGSB_p15_Voltage", "MEGSB_m15_Voltage", //  39, 32+7
+        "MEGSB_p5_0_Analog_Voltage", "MEGSB_m5_0_Voltage", "MEGSB_p5_0_Digital_Voltage", "MEGSB_p2_5_Voltage", //  43
+        "MEGSB_p24_Current", "MEGSB_p15_Current", "MEGSB_m15_Current", "MEGSB_p5_0_Analog_Current", 
+        "MEGSB_m5_0_Current", "MEGSB_p5_0_Digital_Current", "MEGSB_p2_5_Current", "MEGSB_Integration_Register", 
+        "MEGSB_Analog_Mux_Register", "MEGSB_Digital_Status_Register", "MEGSB_Integration_Timer_Register", "MEGSB_Command_Error_Count_Register", //48+7
+        "MEGSB_CEB_FPGA_Version_Register", "MEGSA_Thermistor_Diode", "MEGSA_PRT", "MEGSB_Thermistor_Diode", //52+7
+        "MEGSB_PRT", "ESP_Electrometer_Temperature", "ESP_Detector_Temperature", "MEGSP_Temperature", // 63= 56+7
+        "cFPGA_Board_Temperature", "cFPGA_Board_p5_0_Voltage", "cFPGA_Board_p3_3_Voltage", "cFPGA_Board_p2_5_Voltage", "cFPGA_Board_p1_2_Voltage", // 68
+        "cMEGSA_CEB_Temperature", "cMEGSA_CPR_Temperature", "cMEGSA_p24_Voltage", "cMEGSA_p15_Voltage", "cMEGSA_m15_Voltage", "cMEGSA_p5_0_Analog_Voltage", "cMEGSA_m5_0_Voltage", "cMEGSA_p5_0_Digital_Voltage", "cMEGSA_p2_5_Voltage", // 77
+        "cMEGSA_p24_Current", "cMEGSA_p15_Current", "cMEGSA_m15_Current", "cMEGSA_p5_0_Analog_Current", "cMEGsA_m5_0_Current", "cMEGSA_p5_0_Digital_Current", "cMEGSA_p2_5_Current",  // 84
+        "cMEGSB_CEB_Temperature", "cMEGSB_CPR_Temperature", "cMEGSB_p24_Voltage", "cMEGSB_p15_Voltage", "cMEGSB_m15_Voltage", "cMEGSB_p5_0_Analog_Voltage", "cMEGSB_m5_0_Voltage", "cMEGSB_p5_0_Digital_Voltage", "cMEGSB_p2_5_Voltage",  // 93
+        "cMEGSB_p24_Current", "cMEGSB_p15_Current", "cMEGSB_m15_Current", "cMEGSB_p5_0_Analog_Current", "cMEGSB_m5_0_Current", "cMEGSB_p5_0_Digital_Current", "cMEGSB_p2_5_Current", // 100
+        "cMEGSA_Thermistor_Diode", "cMEGSA_PRT", "cMEGSB_Thermistor_Diode", "cMEGSB_PRT", // 104
+        "cESP_Electrometer_Temperature", "cESP_Detector_Temperature", "cMEGSP_Temperature" // 107
+    };
+
+    std::vector<std::string> columnTypes = {"V", "V", "V", "V", 
+        "V", "V", //6 from common time stuff
+        "V", // mode
+        "V","V","V","V", "V","V","V","V", "V","V","V","V", "V","V","V","V", //16
+        "V","V","V","V", "V","V","V","V", "V","V","V","V", "V","V","V","V", //32
+        "V","V","V","V", "V","V","V","V", "V","V","V","V", "V","V","V","V", //48
+        "V","V","V","V", "V","V","V","V", // 53 +7 before converted values
+        // add 44 doubles
+        "D","D","D","D", "D","D","D","D", "D","D","D","D", "D","D","D","D",
+        "D","D","D","D", "D","D","D","D", "D","D","D","D", "D","D","D","D",
+        "D","D","D","D", "D","D","D","D", "D","D","D","D"
+        };
+    std::string combinedColumnTypes;
+    for (const auto& type : columnTypes) {
+        combinedColumnTypes += type;
+    }
+    std::vector<std::string> columnUnits = {"DATE", "s", "s", "s", 
+    "s", "s", // rec tai
+    "DN", // mode code, MSB is a heartbeat at 1 minute, LSBs are sample time in seconds 
+    "DN","DN","DN","DN", "DN","DN","DN","DN", "DN","DN","DN","DN", "DN","DN","DN","DN",
+    "DN","DN","DN","DN", "DN","DN","DN","DN", "DN","DN","DN","DN", "DN","DN","DN","DN",
+    "DN","DN","DN","DN", "DN","DN","DN","DN", "DN","DN","DN","DN", "DN","DN","DN","DN",
+    "DN","DN","DN","DN", "DN","DN","DN","DN",
+    "C","V","V","V", "V","C","C","V", "V","V","V","V", "V","V","A","A", // 5 FPGAs, 2 Temps, 7 Voltages, 2 Currents (p24 and p15)
+    "A","A","A","A", "A","C","C","V", "V","V","V","V", "V","V","A","A", // 5 Currents, 2 Temps, 7 Voltages, 2 Currents
+    "A","A","A","A", "A","C","C","C", "C","C","C","C" // 5 Currents, 7 Temps
+    };
+
+    
+    int32_t n = SHK_INTEGRATIONS_PER_FILE;
+    std::vector<int> columnLengths = {1,1,1,1,
+        1,1, // rec_tai
+        n, // mode
+        n,n,n,n, n,n,n,n, n,n,n,n, n,n,n,n,
+        n,n,n,n, n,n,n,n, n,n,n,n, n,n,n,n,
+        n,n,n,n, n,n,n,n, n,n,n,n, n,n,n,n,
+        n,n,n,n, n,n,n,n,
+        n,n,n,n, n,n,n,n, n,n,n,n, n,n,n,n, // converted
+        n,n,n,n, n,n,n,n, n,n,n,n, n,n,n,n, // converted
+        n,n,n,n, n,n,n,n, n,n,n,n  // converted
+    }; //
+
+    return FITSTableSchema(extname, columnNames, combinedColumnTypes, columnLengths, columnUnits);
+}
+
+} // namespace
+
+const FITSTableSchema& megsTableSchema(uint16_t apid) {
+    static const FITSTableSchema megsASchema = makeMegsTableSchema("MEGSA_TABLE");
+    static const FITSTableSchema megsBSchema = makeMegsTableSchema("MEGSB_TABLE");
+    return (apid == MEGSA_APID) ? megsASchema : megsBSchema;
+}
+
+const FITSTableSchema& megsSpectrumTableSchema(uint16_t apid) {
+    static const FITSTableSchema megsASchema = makeMegsSpectrumTableSchema("MEGSA_SPECTRUM");
+    static const FITSTableSchema megsBSchema = makeMegsSpectrumTableSchema("MEGSB_SPECTRUM");
+    return (apid == MEGSA_APID) ? megsASchema : megsBSchema;
+}
+
+const FITSTableSchema& megsPTableSchema() {
+    static const FITSTableSchema schema = makeMegsPTableSchema();
+    return schema;
+}
+
+const FITSTableSchema& espTableSchema() {
+    static const FITSTableSchema schema = makeESPTableSchema();
+    return schema;
+}
+
+const FITSTableSchema& shkTableSchema() {
+    static const FITSTableSchema schema = makeSHKTableSchema();
+    return schema;
+}
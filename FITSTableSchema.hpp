@@ -0,0 +1,63 @@
+#ifndef FITS_TABLE_SCHEMA_HPP
+#define FITS_TABLE_SCHEMA_HPP
+
+// One immutable binary table layout per Level 0B product, built on first use and shared after.
+// Holds the TTYPE/TFORM/TUNIT arrays fits_create_tbl takes, the cfitsio type code of each
+// column and its byte offset in the packed row, so the FITS layout has a single source of truth
+// and writing a row only walks the column descriptors.
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+struct FITSColumn {
+    std::string name;      // TTYPE
+    std::string tform;     // TFORM, repeat count and type letter, e.g. 1V or 2395X
+    std::string unit;      // TUNIT
+    char typeLetter;
+    int typeCode;          // cfitsio datatype for fits_write_col
+    long length;           // elements per row
+    size_t offset;         // bytes from the start of the packed row
+    size_t elementBytes;   // bytes per element in the packed row
+};
+
+class FITSTableSchema {
+public:
+    // types holds one TFORM letter per column, throws std::invalid_argument on a mismatch
+    FITSTableSchema(const std::string& extname, const std::vector<std::string>& names, const std::string& types,
+                    const std::vector<int>& lengths, const std::vector<std::string>& units);
+    FITSTableSchema(const FITSTableSchema&) = delete;
+    FITSTableSchema& operator=(const FITSTableSchema&) = delete;
+
+    const std::string& extname() const { return tableName; }
+    const std::vector<FITSColumn>& columns() const { return tableColumns; }
+    size_t rowBytes() const { return packedRowBytes; }
+
+    // arrays in the form fits_create_tbl takes, pointing into columns()
+    char** ttype() const { return const_cast<char**>(ttypePointers.data()); }
+    char** tform() const { return const_cast<char**>(tformPointers.data()); }
+    char** tunit() const { return const_cast<char**>(tunitPointers.data()); }
+
+    // cfitsio datatype for a TFORM letter, 0 when the letter is unknown
+    static int typeCode(char typeLetter);
+    static size_t elementBytes(char typeLetter);
+
+private:
+    std::string tableName;
+    std::vector<FITSColumn> tableColumns;
+    size_t packedRowBytes = 0;
+    std::vector<char*> ttypePointers;
+    std::vector<char*> tformPointers;
+    std::vector<char*> tunitPointers;
+};
+
+// MEGSA_TABLE or MEGSB_TABLE, the binary table after the MEGS image
+const FITSTableSchema& megsTableSchema(uint16_t apid);
+// MEGSA_SPECTRUM or MEGSB_SPECTRUM, one row per slit region, after the MEGS table
+const FITSTableSchema& megsSpectrumTableSchema(uint16_t apid);
+const FITSTableSchema& megsPTableSchema();
+const FITSTableSchema& espTableSchema();
+const FITSTableSchema& shkTableSchema();
+
+#endif // FITS_TABLE_SCHEMA_HPP
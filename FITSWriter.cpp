@@ -1,10 +1,34 @@
 #include "FITSWriter.hpp"
 #include "commonFunctions.hpp"
+#include "ArchiveCatalog.hpp"
+#include "ColumnStore.hpp"
 #include "FileCompressor.hpp"
+#include "PathService.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
 
-extern std::vector<uint16_t> transposeImageTo1D(const uint16_t image[MEGS_IMAGE_HEIGHT][MEGS_IMAGE_WIDTH]);
 extern std::string tai_to_iso8601(uint32_t tai);
 
+namespace {
+// parity errors are only counted in total, an image is cataloged with the increase since the channel's last image
+std::atomic<int64_t> parityErrorsAtLastMA{0};
+std::atomic<int64_t> parityErrorsAtLastMB{0};
+
+uint32_t parityErrorsSinceLastImage(uint16_t apid) {
+    const bool isMegsA = (apid == MEGSA_APID);
+    int64_t total = (isMegsA ? globalState.parityErrorsMA : globalState.parityErrorsMB).load(std::memory_order_relaxed);
+    int64_t previous = (isMegsA ? parityErrorsAtLastMA : parityErrorsAtLastMB).exchange(total, std::memory_order_relaxed);
+    // the GUI can reset the totals, then everything counted since is this image's
+    int64_t increase = (total >= previous) ? (total - previous) : total;
+    return static_cast<uint32_t>(std::min<int64_t>(increase, UINT32_MAX));
+}
+}
+
 // Constructor
 FITSWriter::FITSWriter() {}
 
@@ -26,20 +50,37 @@ std::string FITSWriter::createFITSFilename(uint16_t apid, double tai_seconds) {
     std::time_t t = static_cast<std::time_t>(unixtime);
     std::tm* tm = std::gmtime(&t);
 
-    // this env is checked in main.cpp
-    static const char* env_eve_data_root = std::getenv("eve_data_root");
-    if (env_eve_data_root == nullptr) {
+    // this env is checked in main.cpp, PathService resolves it once
+    const std::string& dataRootPath = PathService::getInstance().dataRoot();
+    if (dataRootPath.empty()) {
         std::cout<< "***";
         std::cout << "ERROR: environment variable eve_data_root is undefined - aborting" <<std::endl;
         std::cout<< "***";
         exit(EXIT_FAILURE);
     }
-    static const std::string dataRootPath(env_eve_data_root);
     std::string l0bpath = dataRootPath + "level0b/";
 
     std::string filename_prefix;
     std::string channelstring;
+    level0bNaming(apid, channelstring, filename_prefix);
+
+    oss << l0bpath << channelstring << std::put_time(tm, "%Y/%j/");
+
+    // Create the directories if they don't exist, only the first file of the day touches the disk
+    std::string dirPath = oss.str();
+    if (!PathService::getInstance().ensureDirectory(dirPath)) {
+        return "";
+    }
+
+    oss << filename_prefix << std::put_time(tm, "%Y%j_%H%M%S") << ".fit";
+
+    //std::cout<< "createFITSFilename - " << oss.str() << std::endl;
+
+    return oss.str();
+}
 
+// Directory under level0b/ and filename prefix for each APID, shared with Level0BReader
+void FITSWriter::level0bNaming(uint16_t apid, std::string& channelstring, std::string& filename_prefix) {
     switch (apid) {
         case MEGSA_APID:
             channelstring = "megs_a/";
@@ -66,39 +107,20 @@ std::string FITSWriter::createFITSFilename(uint16_t apid, double tai_seconds) {
             filename_prefix = "unknown_apid_" + std::to_string(apid) + "_";
             break;
     }
-
-    oss << l0bpath << channelstring << std::put_time(tm, "%Y/%j/");
-
-    // Create the directories if they don't exist, use system call
-    std::string dirPath = oss.str();
-    if (!create_directory_if_not_exists(dirPath)) {
-        return "";
-    }
-
-    oss << filename_prefix << std::put_time(tm, "%Y%j_%H%M%S") << ".fit";
-
-    //std::cout<< "createFITSFilename - " << oss.str() << std::endl;
-
-    return oss.str();
 }
 
-// Function to initialize a FITS file
-bool FITSWriter::initializeFITSFile(const std::string& filename, fitsfile*& fptr) {
+// Function to create a FITS file in memory, nothing touches the disk until publishFITSFile
+bool FITSWriter::createMemoryFITSFile(fitsfile*& fptr, MemoryFITSBuffer& buffer, size_t initialBytes) {
     int status = 0;
 
-    // This part overwrites an existing FITS file.
-    // Check if the file already exists
-    struct stat buffer;
-    if (stat(filename.c_str(), &buffer) == 0) {
-        // File exists, so delete it
-        if (std::remove(filename.c_str()) != 0) {
-            std::cerr << "ERROR: Failed to delete existing FITS file: " << filename << std::endl;
-            return false;
-        }
+    buffer.size = initialBytes;
+    buffer.data = malloc(buffer.size);
+    if (buffer.data == nullptr) {
+        std::cerr << "ERROR: Failed to allocate " << buffer.size << " bytes for a FITS file" << std::endl;
+        return false;
     }
 
-    // Create a new FITS file
-    if (fits_create_file(&fptr, filename.c_str(), &status)) {
+    if (fits_create_memfile(&fptr, &buffer.data, &buffer.size, FITS_MEMORY_GROWTH_BYTES, realloc, &status)) {
         fits_report_error(stderr, status);
         return false;
     }
@@ -106,184 +128,201 @@ bool FITSWriter::initializeFITSFile(const std::string& filename, fitsfile*& fptr
     return true;
 }
 
-// Error handling function
-void FITSWriter::checkFitsStatus(int status) {
+// Close the memory file and queue it for FITSPublisher, the packet thread does not wait for gzip or the disk
+bool FITSWriter::publishFITSFile(const std::string& filename, fitsfile* fptr, MemoryFITSBuffer& buffer,
+                                 const ArchiveCatalogRecord& catalogRecord) {
+    int status = 0;
+
+    // flushing closes out the last HDU, so its padded end is the length of the file
+    LONGLONG headStart = 0, dataStart = 0, dataEnd = 0;
+    fits_flush_file(fptr, &status);
+    fits_get_hduaddrll(fptr, &headStart, &dataStart, &dataEnd, &status);
+    fits_close_file(fptr, &status);
     if (status) {
         fits_report_error(stderr, status);
-        exit(status);
+        LogFileWriter::getInstance().logError("FITSWriter::publishFITSFile: Failed to close memory FITS file for {}", filename);
+        return false;
+    }
+    if (filename.empty()) {
+        return false; // createFITSFilename could not create the directory
     }
+    size_t fileSize = std::min(static_cast<size_t>(dataEnd), buffer.size);
+
+    // the publisher frees the buffer once the product is on disk
+    FITSPublisher::getInstance().enqueue(filename, buffer.data, fileSize, catalogRecord);
+    buffer.data = nullptr;
+    buffer.size = 0;
+    return true;
 }
 
-// Helper function to convert vector of strings to array of char pointers
-std::vector<char*> FITSWriter::convertToCharPtrArray(const std::vector<std::string>& vec) {
-    std::vector<char*> charArray(vec.size());
-    for (size_t i = 0; i < vec.size(); ++i) {
-        charArray[i] = const_cast<char*>(vec[i].c_str());
-    }
-    return charArray;
+FITSPublisher& FITSPublisher::getInstance() {
+    static FITSPublisher instance;
+    return instance;
 }
 
-// Helper function to convert a single string to array of char pointers
-std::vector<char*> FITSWriter::convertTypesToCharPtrArray(const std::string& types) {
-    std::vector<char*> typeArray(types.size());
-    for (size_t i = 0; i < types.size(); ++i) {
-        typeArray[i] = new char[2];  // Allocate space for single char + null terminator
-        typeArray[i][0] = types[i];
-        typeArray[i][1] = '\0';  // Null terminator
+FITSPublisher::~FITSPublisher() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    queuedCondition.notify_all();
+    if (worker.joinable()) {
+        worker.join();
     }
-    return typeArray;
 }
 
-std::vector<char*> FITSWriter::convertTypesToTFormPtrArray(const std::string& types, const std::vector<int>& lengths) {
-    std::vector<char*> tFormArray(types.size());
-    for (size_t i = 0; i < types.size(); ++i) {
-        tFormArray[i] = new char[10];  // Allocate space for 9 chars + null terminator
-        sprintf(tFormArray[i], "%d%c", lengths[i], types[i]);
+void FITSPublisher::enqueue(const std::string& filename, void* data, size_t size, const ArchiveCatalogRecord& catalogRecord) {
+    std::unique_lock<std::mutex> lock(mutex);
+    if (!worker.joinable()) {
+        worker = std::thread(&FITSPublisher::run, this);
     }
-    return tFormArray;
+    doneCondition.wait(lock, [this]() { return products.size() < FITS_PUBLISH_QUEUE_PRODUCTS; });
+    Product product;
+    product.filename = filename;
+    product.data = data;
+    product.size = size;
+    product.catalogRecord = catalogRecord;
+    products.push_back(std::move(product));
+    lock.unlock();
+    queuedCondition.notify_one();
 }
 
-void FITSWriter::freeCharPtrArray(std::vector<char*>& array) {
-    for (size_t i = 0; i < array.size(); ++i) {
-        delete[] array[i];  // Free each char array
-    }
+void FITSPublisher::flush() {
+    std::unique_lock<std::mutex> lock(mutex);
+    doneCondition.wait(lock, [this]() { return products.empty() && !publishing; });
 }
 
-// Function to write a binary table to a FITS file
-int FITSWriter::writeBinaryTable(const std::string& filename, 
-        const void* data, 
-        int columns,
-        const std::vector<std::string>& names, 
-        const std::string& types,
-        const std::vector<int>& columnLengths,
-        const std::vector<std::string>& units, 
-        bool useUnits, const std::string& extname) {
+uint64_t FITSPublisher::failures() {
+    std::lock_guard<std::mutex> lock(mutex);
+    return failureCount;
+}
 
-    int status = 0;  // CFITSIO status value
-    fitsfile* fptr = nullptr;  // Pointer to the FITS file
-
-    // Lock file mechanism
-    std::string lockfile = filename + ".lock";
-    if (access(lockfile.c_str(), F_OK) == 0) {
-        sleep(0.01);
-        if (access(lockfile.c_str(), F_OK) == 0) {
-            return -1;  // File is locked
+// drains the queue before it stops, so products queued at exit still reach the disk
+void FITSPublisher::run() {
+    std::unique_lock<std::mutex> lock(mutex);
+    while (true) {
+        queuedCondition.wait(lock, [this]() { return stopping || !products.empty(); });
+        if (products.empty()) {
+            return;
         }
-    } else {
-        FILE* flock = fopen(lockfile.c_str(), "w");
-        if (flock) {
-            fprintf(flock, "File locked by L0B\n");
-            fclose(flock);
+        Product product = std::move(products.front());
+        products.pop_front();
+        publishing = true;
+        lock.unlock();
+        doneCondition.notify_all();
+
+        bool ok = publish(product.filename, product.data, product.size, product.catalogRecord);
+        free(product.data);
+
+        lock.lock();
+        publishing = false;
+        if (!ok) {
+            ++failureCount;
+            globalState.fitsPublishFailures.fetch_add(1, std::memory_order_relaxed);
         }
+        doneCondition.notify_all();
     }
+}
 
-    // Convert column names and units to char* arrays
-    std::vector<char*> colnames = convertToCharPtrArray(names);
-    std::vector<char*> unitnames;
-    if (useUnits) {
-        unitnames = convertToCharPtrArray(units);
+bool FITSPublisher::publish(const std::string& filename, const void* data, size_t size, const ArchiveCatalogRecord& catalogRecord) {
+    const void* bytes = data;
+    size_t byteCount = size;
+    std::string publishedName = filename;
+    std::vector<uint8_t> gzipped;
+    if (!globalState.args.skipCompress.load(std::memory_order_relaxed)) {
+        FileCompressor compressor;
+        if (compressor.compressBuffer(data, size, gzipped)) {
+            bytes = gzipped.data();
+            byteCount = gzipped.size();
+            publishedName += ".gz";
+        }
     }
 
-    // Convert types to char* array
-    std::vector<char*> typeArray = convertTypesToCharPtrArray(types); // "U,V, etc"
-    std::vector<char*> tFormArray = convertTypesToTFormPtrArray(types, columnLengths); // "1U,1V, etc"
-
-    // Open or create FITS file
-    if (fits_open_file(&fptr, filename.c_str(), READWRITE, &status)) {
-        if (fits_create_file(&fptr, filename.c_str(), &status)) {
-            checkFitsStatus(status);
-        } else {
-            // Create binary table HDU if file already exists
-            if (useUnits) {
-                // args         file, BINTABL,nrows, tfields,           ttype,            tform,            tunit,         extname, &status
-                fits_create_tbl(fptr, BINARY_TBL, 0, columns, colnames.data(), tFormArray.data(), unitnames.data(), extname.c_str(), &status);
-            } else {
-                fits_create_tbl(fptr, BINARY_TBL, 0, columns, colnames.data(), tFormArray.data(), nullptr, extname.c_str(), &status);
-            }
-            checkFitsStatus(status);
-        }
-    } else {
-        // Move to the existing binary table HDU
-        char* extname_cstr = const_cast<char*>(extname.c_str());
-        fits_movnam_hdu(fptr, BINARY_TBL, extname_cstr, 0, &status);
-        if (status) {
-            status = 0;
-            if (useUnits) {
-                fits_create_tbl(fptr, BINARY_TBL, 0, columns, colnames.data(), tFormArray.data(), unitnames.data(), extname.c_str(), &status);
-            } else {
-                fits_create_tbl(fptr, BINARY_TBL, 0, columns, colnames.data(), tFormArray.data(), nullptr, extname.c_str(), &status);
+    std::string tmpName = publishedName + ".tmp";
+    int fd = open(tmpName.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        std::cerr << "ERROR: Failed to create " << tmpName << ": " << strerror(errno) << std::endl;
+        LogFileWriter::getInstance().logError("FITSPublisher::publish: Failed to create {}: {}", tmpName, strerror(errno));
+        return false;
+    }
+    // a single write for the whole product, the loop only covers short writes
+    const uint8_t* next = static_cast<const uint8_t*>(bytes);
+    size_t remaining = byteCount;
+    while (remaining > 0) {
+        ssize_t written = write(fd, next, remaining);
+        if (written < 0) {
+            if (errno == EINTR) {
+                continue;
             }
-            checkFitsStatus(status);
+            break;
         }
+        next += written;
+        remaining -= static_cast<size_t>(written);
+    }
+    // on disk before the rename, so a crash cannot leave an empty product under the published name
+    if ((remaining == 0) && (fsync(fd) != 0)) {
+        remaining = byteCount;
+    }
+    int writeErrno = errno;
+    if ((close(fd) != 0) || (remaining > 0)) {
+        std::cerr << "ERROR: Failed to write " << tmpName << ": " << strerror(writeErrno) << std::endl;
+        LogFileWriter::getInstance().logError("FITSPublisher::publish: Failed to write {}: {}", tmpName, strerror(writeErrno));
+        std::remove(tmpName.c_str());
+        return false;
     }
 
-    // Write data to the table
-    long firstrow = 1;
-    long firstelem = 1;
-    const char* pdata = static_cast<const char*>(data);
-    //char* pdata = (char*)(data);
-
-    for (int i = 0; i < columns; ++i) {
-
-        int colType = 0;
-        size_t colTypeSize = sizeof(uint8_t); //bytes
-        if (types[i] == 'B') {
-            colType = TBYTE;        // unsigned byte
-            //colTypeSize = 1;
-        } else if (types[i] == 'U') {
-            colType = TUSHORT; // uint16
-            colTypeSize = sizeof(uint16_t); //2;
-        } else if (types[i] == 'V') {
-            colType = TUINT;  // uint32 (TULONG if 64-bit)
-            colTypeSize = sizeof(uint32_t); //4;
-        } else if (types[i] == 'E') {
-            colType = TFLOAT;  // 32-bit float
-            colTypeSize = sizeof(float); //4;
-        } else if (types[i] == 'D') {
-            colType = TDOUBLE; // 64-bit double
-            colTypeSize = sizeof(double); //8;
-        } else if (types[i] == 'S') {
-            colType = TSBYTE;  // signed byte
-            //colTypeSize = 1;
-        } else if (types[i] == 'X') {
-            colType = TBIT;
-            //colTypeSize = 1;
-        } else if (types[i] == 'L') {
-            colType = TLOGICAL;
-            //colTypeSize = 1;
-        } else if (types[i] == 'A') {
-            colType = TSTRING; // chars
-            colTypeSize = sizeof("0123456789ABCDEFG"); //17;
-        } else if (types[i] == 'I') {
-            colType = TSHORT;  // int16
-            colTypeSize = sizeof(uint16_t); //2;
-        } else if (types[i] == 'J') {
-            colType = TINT;    // int32
-            colTypeSize = sizeof(uint32_t); //4;
-        } else if (types[i] == 'K') {
-            colType = TLONG;   // int64
-            colTypeSize = sizeof(long); //8;
-        } else {
-            std::cerr << "Unknown type code: " << types[i] << std::endl;
-            return -1;
-        }
+    if (std::rename(tmpName.c_str(), publishedName.c_str()) != 0) {
+        std::cerr << "ERROR: Failed to rename " << tmpName << " to " << publishedName << std::endl;
+        LogFileWriter::getInstance().logError("FITSPublisher::publish: Failed to rename {} to {}", tmpName, publishedName);
+        std::remove(tmpName.c_str());
+        return false;
+    }
+    // the uncompressed name may be left from a run with -skipCompress, or the compressed one from a run without
+    std::remove(((publishedName == filename) ? filename + ".gz" : filename).c_str());
 
-        fits_write_col(fptr, colType, i + 1, firstrow, firstelem, columnLengths[i], (void*)pdata, &status);
-        checkFitsStatus(status);
+    // the product is already in place, a catalog that cannot be written is rebuilt later with l0b_catalog -rebuild
+    if (!globalState.args.skipCatalog.load(std::memory_order_relaxed)) {
+        ArchiveCatalog::append(PathService::getInstance().dataRoot(), publishedName, catalogRecord);
+    }
+
+    return true;
+}
 
-        pdata += (colTypeSize * columnLengths[i]); // Adjusts based on the type of data
+// Error handling function
+void FITSWriter::checkFitsStatus(int status) {
+    if (status) {
+        fits_report_error(stderr, status);
+        exit(status);
     }
+}
 
-    // Close the FITS file
-    fits_close_file(fptr, &status);
-    checkFitsStatus(status);
+// Function to append a binary table HDU with rowCount packed rows to an open FITS file
+int FITSWriter::writeBinaryTable(fitsfile* fptr, const FITSTableSchema& schema, const void* row, size_t rowBytes, long rowCount) {
+    int status = 0;  // CFITSIO status value
 
-    // Remove lock file
-    remove(lockfile.c_str());
+    if (rowBytes != schema.rowBytes()) {
+        std::cerr << "ERROR: " << schema.extname() << " row is " << rowBytes << " bytes, the schema expects " << schema.rowBytes() << std::endl;
+        LogFileWriter::getInstance().logError("FITSWriter::writeBinaryTable: {} row is {} bytes, the schema expects {}",
+            schema.extname(), rowBytes, schema.rowBytes());
+        return -1;
+    }
+
+    // args         file, BINTABL,nrows, tfields,           ttype,            tform,            tunit,         extname, &status
+    fits_create_tbl(fptr, BINARY_TBL, 0, static_cast<int>(schema.columns().size()), schema.ttype(), schema.tform(),
+        schema.tunit(), schema.extname().c_str(), &status);
+    checkFitsStatus(status);
 
-    // Free allocated memory
-    freeCharPtrArray(typeArray);
-    freeCharPtrArray(tFormArray);
+    // Write data to the table
+    const long firstelem = 1;
+    for (long firstrow = 1; firstrow <= rowCount; ++firstrow) {
+        const char* pdata = static_cast<const char*>(row) + (firstrow - 1) * rowBytes;
+        int columnNumber = 1;
+        for (const FITSColumn& column : schema.columns()) {
+            fits_write_col(fptr, column.typeCode, columnNumber++, firstrow, firstelem, column.length,
+                const_cast<char*>(pdata + column.offset), &status);
+            checkFitsStatus(status);
+        }
+    }
 
     return 0;
 }
@@ -319,29 +358,49 @@ bool FITSWriter::writeMegsFITSImgHeader(fitsfile* fptr, const MEGS_IMAGE_REC& me
     fits_write_key(fptr, TUINT, "OBS_HDU", &obs_hdu, "Partially SOLARNET compliant", &status);
     checkFitsStatus(status);
 
+    // the binary table RECEIVED_PACKETS column has one bit per packet
+    uint32_t packetsReceived = megsStructure.packets_received;
+    fits_write_key(fptr, TUINT, "NPKTS", &packetsReceived, "packets received of 2395", &status);
+    checkFitsStatus(status);
+
+    float completeness = megsImageCompleteness(megsStructure);
+    fits_write_key(fptr, TFLOAT, "COMPLETE", &completeness, "percent of image packets received", &status);
+    checkFitsStatus(status);
+
+    int partial = (megsStructure.packets_received < N_PKT_PER_IMAGE) ? 1 : 0;
+    fits_write_key(fptr, TLOGICAL, "PARTIAL", &partial, "written before every packet arrived", &status);
+    checkFitsStatus(status);
+
     return (status == 0);
 }
 
-// write the MEGS binary tables in HDU1
-int FITSWriter::writeMegsFITSBinaryTable(
-    const std::string& filename,
-    const MEGS_IMAGE_REC& megsStructure,
-    const std::string& extname,
-    uint16_t apid
-) {
-    std::vector<std::string> columnNames = {
-        "YYYYDOY", "SOD", "TAI_TIME_SECONDS", "TAI_TIME_SUBSECONDS",
-        "REC_TAI_SECONDS", "REC_TAI_SUBSECONDS", "VCDU_COUNT",
-        "FPGA_BOARD_TEMPERATURE", "CEB_TEMPERATURE", "CPR_TEMPERATURE", "PRT_TEMPERATURE"
-    };
+// write the image HDU in row bands straight from the record, the image is already in FITS pixel order
+// the transposed layout goes through one transpose buffer per thread that is reused for every image
+bool FITSWriter::writeMegsFITSImage(fitsfile* fptr, const MEGS_IMAGE_REC& megsStructure, bool transposed, int32_t& status) {
+    const uint16_t* pixels = &megsStructure.image[0][0];
+    LONGLONG rowPixels = MEGS_IMAGE_WIDTH;
+    if (transposed) {
+        static thread_local std::vector<uint16_t> transposeBuffer;
+        transposeImage(megsStructure.image, transposeBuffer);
+        pixels = transposeBuffer.data();
+        rowPixels = MEGS_IMAGE_T_WIDTH;
+    }
 
-    std::vector<std::string> columnTypes = {"V", "V", "V", "V", "V", "V", "U", "E", "E", "E", "E"};
-    std::vector<int> columnLengths = {1,1,1,1,1,1,1,1,1,1,1};
-    std::string combinedColumnTypes;    
-    for (const auto& type : columnTypes) {
-        combinedColumnTypes += type;  // Concatenate each string in columnTypes
+    const LONGLONG bandPixels = rowPixels * MEGS_FITS_WRITE_BAND_ROWS;
+    for (LONGLONG first = 0; first < MEGS_TOTAL_PIXELS; first += bandPixels) {
+        LONGLONG count = std::min<LONGLONG>(bandPixels, MEGS_TOTAL_PIXELS - first);
+        // cfitsio takes a non-const buffer but only reads it
+        if (fits_write_img(fptr, TUSHORT, first + 1, count, const_cast<uint16_t*>(pixels + first), &status)) {
+            fits_report_error(stderr, status);
+            return false;
+        }
     }
-    std::vector<std::string> columnUnits = {"DATE", "s", "s", "s", "s", "s", "count", "degC", "degC", "degC", "degC"};
+    return true;
+}
+
+// write the MEGS binary tables in HDU1
+int FITSWriter::writeMegsFITSBinaryTable(fitsfile* fptr, const MEGS_IMAGE_REC& megsStructure, uint16_t apid) {
+    const FITSTableSchema& schema = megsTableSchema(apid);
 
     //copy data
     struct DataRow {
@@ -356,6 +415,8 @@ int FITSWriter::writeMegsFITSBinaryTable(
         float CEB_Temperature;
         float CPR_Temperature;
         float PRT_Temperature;
+        uint16_t packets_received;
+        uint8_t received_packets[N_PKT_PER_IMAGE]; // cfitsio writes TBIT columns from one byte per bit
     } __attribute__((packed));
 
     DataRow row = {
@@ -363,104 +424,133 @@ int FITSWriter::writeMegsFITSBinaryTable(
         megsStructure.tai_time_subseconds, megsStructure.rec_tai_seconds,
         megsStructure.rec_tai_subseconds, megsStructure.vcdu_count,
         megsStructure.FPGA_Board_Temperature, megsStructure.CEB_Temperature,
-        megsStructure.CPR_Temperature, megsStructure.PRT_Temperature
+        megsStructure.CPR_Temperature, megsStructure.PRT_Temperature,
+        megsStructure.packets_received, {}
     };
+    for (uint16_t ssc = 0; ssc < N_PKT_PER_IMAGE; ++ssc) {
+        row.received_packets[ssc] = isMegsPacketReceived(megsStructure, ssc) ? 1 : 0;
+    }
 
-    std::vector<uint8_t> data(sizeof(DataRow));
-    memcpy(data.data(), &row, sizeof(DataRow));
 
-    return writeBinaryTable(
-        filename, data.data(), columnNames.size(), columnNames,
-        combinedColumnTypes, columnLengths, columnUnits, true, extname.c_str()
-    );
+    return writeBinaryTable(fptr, schema, &row, sizeof(DataRow));
+}
+
+// write the spectra of one image in HDU2, one row per slit region
+int FITSWriter::writeMegsSpectrumBinaryTable(fitsfile* fptr, const MEGS_SPECTRUM& spectrum, uint16_t apid) {
+    const FITSTableSchema& schema = megsSpectrumTableSchema(apid);
+
+    struct DataRow {
+        uint16_t firstRow;
+        uint16_t lastRow;
+        uint16_t rows;
+        uint16_t darkFrames;
+        float darkLeft;
+        float darkRight;
+        float spectrum[MEGS_IMAGE_WIDTH];
+        uint16_t pixels[MEGS_IMAGE_WIDTH];
+    } __attribute__((packed));
+
+    std::vector<DataRow> rows(spectrum.regions);
+    for (uint16_t r = 0; r < spectrum.regions; ++r) {
+        rows[r].firstRow = spectrum.firstRow[r];
+        rows[r].lastRow = spectrum.lastRow[r];
+        rows[r].rows = spectrum.rows[r];
+        rows[r].darkFrames = spectrum.darkFrames;
+        rows[r].darkLeft = spectrum.darkLeft[r];
+        rows[r].darkRight = spectrum.darkRight[r];
+        std::memcpy(rows[r].spectrum, spectrum.spectrum[r], sizeof(rows[r].spectrum));
+        std::memcpy(rows[r].pixels, spectrum.pixels[r], sizeof(rows[r].pixels));
+    }
+
+    return writeBinaryTable(fptr, schema, rows.data(), sizeof(DataRow), spectrum.regions);
 }
 
 // primary function to manage FITS file writing for CCD images with a binary table
-bool FITSWriter::writeMegsFITS(const MEGS_IMAGE_REC& megsStructure, uint16_t apid, const std::string& extname) {
+bool FITSWriter::writeMegsFITS(const MEGS_IMAGE_REC& megsStructure, uint16_t apid, uint32_t saturatedPixels, const MEGS_SPECTRUM* spectrum) {
     //std::cout << "writing MEGS FITS file for APID: " << apid << std::endl;
+    if (globalState.args.skipFITS.load(std::memory_order_relaxed)) {
+        return true; // benchmarks and quicklook-only runs can turn FITS output off
+    }
+    ScopedStageTimer fitsTimer(STAGE_FITS_WRITE);
     LogFileWriter::getInstance().logInfo("writing MEGS FITS file");
 
     int32_t status = 0;
     std::string filename = createFITSFilename(apid, megsStructure.tai_time_seconds);
 
     fitsfile* fptr = nullptr;
-    if (!initializeFITSFile(filename, fptr)) {
+    MemoryFITSBuffer buffer;
+    // the image plus headers and the binary table, so cfitsio never reallocs
+    if (!createMemoryFITSFile(fptr, buffer, sizeof(megsStructure.image) + FITS_MEMORY_INITIAL_BYTES)) {
         std::cerr << "ERROR: Failed to initialize FITS file: " << filename << std::endl;
         LogFileWriter::getInstance().logError("FITSWriter::writeMegsFITS: Failed to initialize FITS file: {}", filename);
         return false;
     }
 
     // Create a primary array image (e.g., 16-bit unsigned integer)
+    const bool transposed = globalState.args.transposeFITS.load(std::memory_order_relaxed);
     long naxes[2] = {MEGS_IMAGE_WIDTH, MEGS_IMAGE_HEIGHT}; // dimensions
+    if (transposed) {
+        naxes[0] = MEGS_IMAGE_T_WIDTH;
+        naxes[1] = MEGS_IMAGE_T_HEIGHT;
+    }
     if (fits_create_img(fptr, USHORT_IMG, 2, naxes, &status)) {
         fits_report_error(stderr, status);
+        fits_close_file(fptr, &status);
         return false;
     }
 
     if (!writeMegsFITSImgHeader(fptr, megsStructure, status)) {
+        fits_close_file(fptr, &status);
         return false;
     }
 
-    std::vector<uint16_t> transposedData = transposeImageTo1D(megsStructure.image);
-
-    LONGLONG fpixel = 1;
-    if (fits_write_img(fptr, TUSHORT, fpixel, transposedData.size(), transposedData.data(), &status)) {
+    if (!writeMegsFITSImage(fptr, megsStructure, transposed, status)) {
         LogFileWriter::getInstance().logError("Failed to write image data to FITS file: {}", filename);
         fits_close_file(fptr, &status);
         return false;
     }
 
-    int result = writeMegsFITSBinaryTable(filename, megsStructure, extname, apid);
+    int result = writeMegsFITSBinaryTable(fptr, megsStructure, apid);
     if (result != 0) {
         std::cerr << "Failed to write binary table to FITS file: " << filename << std::endl;
-        std::cerr << " Check for .lock.gz files " << std::endl;
+        fits_close_file(fptr, &status);
         return false;
     }
 
-    fits_close_file(fptr, &status);
-    checkFitsStatus(status);
+    if ((spectrum != nullptr) && (spectrum->regions > 0) && (writeMegsSpectrumBinaryTable(fptr, *spectrum, apid) != 0)) {
+        std::cerr << "Failed to write spectrum table to FITS file: " << filename << std::endl;
+        fits_close_file(fptr, &status);
+        return false;
+    }
+
+    ArchiveCatalogRecord catalogRecord = ArchiveCatalog::describe(megsStructure, apid, parityErrorsSinceLastImage(apid), saturatedPixels);
+    if (transposed) {
+        catalogRecord.flags |= CATALOG_TRANSPOSED;
+    }
+    if (!publishFITSFile(filename, fptr, buffer, catalogRecord)) {
+        return false;
+    }
 
     std::cout << "FITSWriter::writeMegsFITS _successfully wrote " << filename << std::endl;
     LogFileWriter::getInstance().logInfo("FITSWriter::writeMegsFITS successfully wrote {}", filename);
 
-    FileCompressor compressor;
-    compressor.compressFile(filename);
-
     return true;
 }
 
 // MEGS-A wrapper function to the common writeMegsFITS
-bool FITSWriter::writeMegsAFITS( const MEGS_IMAGE_REC& megsStructure) {
-    return writeMegsFITS(megsStructure, MEGSA_APID, "MEGSA_TABLE");
+bool FITSWriter::writeMegsAFITS( const MEGS_IMAGE_REC& megsStructure, uint32_t saturatedPixels, const MEGS_SPECTRUM* spectrum) {
+    return writeMegsFITS(megsStructure, MEGSA_APID, saturatedPixels, spectrum);
 }
 
 // MEGS-B wrapper function to the common writeMegsFITS
-bool FITSWriter::writeMegsBFITS( const MEGS_IMAGE_REC& megsStructure) {
-    return writeMegsFITS(megsStructure, MEGSB_APID, "MEGSB_TABLE");
+bool FITSWriter::writeMegsBFITS( const MEGS_IMAGE_REC& megsStructure, uint32_t saturatedPixels, const MEGS_SPECTRUM* spectrum) {
+    return writeMegsFITS(megsStructure, MEGSB_APID, saturatedPixels, spectrum);
 }
 
 // MEGS-P binary table writer
-int FITSWriter::writeMegsPFITSBinaryTable(const std::string& filename, const MEGSP_PACKET& megsPStructure) {
+int FITSWriter::writeMegsPFITSBinaryTable(fitsfile* fptr, const MEGSP_PACKET& megsPStructure) {
     
-    std::string extname = "MEGSP_DATA";
-    std::vector<std::string> columnNames = {
-        "YYYYDOY", "SOD", "TAI_TIME_SECONDS", "TAI_TIME_SUBSECONDS",
-        "REC_TAI_SECONDS", "REC_TAI_SUBSECONDS", 
-        "FPGA_BOARD_TEMPERATURE", "MEGSP_Temperature",
-        "MP_lya", "MP_dark" 
-    };
-
-    std::vector<std::string> columnTypes = {"V", "V", "V", "V", 
-        "V", "V", 
-        "E", "E",
-        "U", "U"};
-    std::string combinedColumnTypes;    
-    for (const auto& type : columnTypes) {
-        combinedColumnTypes += type;  // Concatenate each string in columnTypes
-    }
-    std::vector<std::string> columnUnits = {"DATE", "s", "s", "s", "s", "s", "C", "C", "count","count"};
-
-    std::vector<int> columnLengths = {1,1,1,1,1,1,1,1,MEGSP_INTEGRATIONS_PER_FILE, MEGSP_INTEGRATIONS_PER_FILE};
+    const FITSTableSchema& schema = megsPTableSchema();
 
     //copy data
     struct DataRow {
@@ -489,77 +579,57 @@ int FITSWriter::writeMegsPFITSBinaryTable(const std::string& filename, const MEG
         row.MP_dark[i] = megsPStructure.MP_dark[i];
     }
 
-    std::vector<uint8_t> data(sizeof(DataRow));
-    memcpy(data.data(), &row, sizeof(DataRow));
 
-    return writeBinaryTable(
-        filename, data.data(), columnNames.size(), columnNames,
-        combinedColumnTypes, columnLengths, columnUnits, true, extname.c_str()
-    );
+    return writeBinaryTable(fptr, schema, &row, sizeof(DataRow));
 }
 
 // MEGS-P main writer
 bool FITSWriter::writeMegsPFITS( const MEGSP_PACKET& megsPStructure) {
 
     //std::cout << "writing MEGS-P FITS file for APID: " << MEGSP_APID << std::endl;
+    if (globalState.args.skipFITS.load(std::memory_order_relaxed)) {
+        return true; // benchmarks and quicklook-only runs can turn FITS output off
+    }
+    ScopedStageTimer fitsTimer(STAGE_FITS_WRITE);
     LogFileWriter::getInstance().logInfo("writing MEGS-P FITS file");
 
     int32_t status = 0;
     std::string filename = createFITSFilename(MEGSP_APID, megsPStructure.tai_time_seconds);
 
     fitsfile* fptr = nullptr;
-    if (!initializeFITSFile(filename, fptr)) {
+    MemoryFITSBuffer buffer;
+    if (!createMemoryFITSFile(fptr, buffer)) {
         std::cerr << "ERROR: Failed to initialize FITS file: " << filename << std::endl;
         LogFileWriter::getInstance().logError("FITSWriter::writeMegsPFITS: Failed to initialize FITS file: {}", filename);
         return false;
     }
 
-    checkFitsStatus(status);
-
-    int result = writeMegsPFITSBinaryTable(filename, megsPStructure);
-    fits_close_file(fptr, &status);
+    int result = writeMegsPFITSBinaryTable(fptr, megsPStructure);
     if (result != 0) {
         std::cerr << "Failed to write binary table to MEGSP FITS file: " << filename << std::endl;
-        std::cerr << " Check for .lock.gz files " << std::endl;
+        fits_close_file(fptr, &status);
         return false;
     }
 
+    if (!publishFITSFile(filename, fptr, buffer, ArchiveCatalog::describe(megsPStructure))) {
+        return false;
+    }
+    // the columns are a view of the product, one that cannot be written is logged and the file stands
+    if (!globalState.args.skipColumns.load(std::memory_order_relaxed)) {
+        ColumnStore::getInstance().append(PathService::getInstance().dataRoot(), megsPStructure);
+    }
+
     std::cout << "FITSWriter::writeMegsPFITS successfully wrote " << filename << std::endl;
     LogFileWriter::getInstance().logInfo("FITSWriter::writeMegsPFITS successfully wrote {}", filename);
 
-    FileCompressor compressor;
-    compressor.compressFile(filename);
-
     return true;
 
 }
 
 // ESP binary table writer
-int FITSWriter::writeESPFITSBinaryTable(const std::string& filename, const ESP_PACKET& ESPStructure) {
+int FITSWriter::writeESPFITSBinaryTable(fitsfile* fptr, const ESP_PACKET& ESPStructure) {
     
-    std::string extname = "ESP_DATA";
-    std::vector<std::string> columnNames = {
-        "YYYYDOY", "SOD", "TAI_TIME_SECONDS", "TAI_TIME_SUBSECONDS",
-        "REC_TAI_SECONDS", "REC_TAI_SUBSECONDS", 
-        "FPGA_BOARD_TEMPERATURE", "ESP_Electrometer_Temperature", "ESP_Detector_Temperature",
-        "ESP_xfer_cnt","ESP_q0", "ESP_q1", "ESP_q2", "ESP_q3", "ESP_171", "ESP_257", "ESP_304", "ESP_366", "ESP_dark" 
-    };
-
-    std::vector<std::string> columnTypes = {"V", "V", "V", "V", 
-        "V", "V", 
-        "E", "E", "E",
-        "U", "U", "U", "U", "U", "U", "U", "U", "U", "U"};
-    std::string combinedColumnTypes;    
-    for (const auto& type : columnTypes) {
-        combinedColumnTypes += type;  // Concatenate each string in columnTypes
-    }
-    std::vector<std::string> columnUnits = {"DATE", "s", "s", "s", "s", "s", "C", "C", "C", "", "count","count","count", "count","count","count", "count","count","count"};
-
-    std::vector<int> columnLengths = {1,1,1,1,1,1,1,1,1,ESP_INTEGRATIONS_PER_FILE, 
-        ESP_INTEGRATIONS_PER_FILE, ESP_INTEGRATIONS_PER_FILE, ESP_INTEGRATIONS_PER_FILE,
-        ESP_INTEGRATIONS_PER_FILE, ESP_INTEGRATIONS_PER_FILE, ESP_INTEGRATIONS_PER_FILE,
-        ESP_INTEGRATIONS_PER_FILE, ESP_INTEGRATIONS_PER_FILE, ESP_INTEGRATIONS_PER_FILE 
-    };
+    const FITSTableSchema& schema = espTableSchema();
 
     //copy data
     struct DataRow {
@@ -605,123 +675,57 @@ int FITSWriter::writeESPFITSBinaryTable(const std::string& filename, const ESP_P
         row.ESP_dark[i] = ESPStructure.ESP_dark[i];
     }
 
-    std::vector<uint8_t> data(sizeof(DataRow));
-    memcpy(data.data(), &row, sizeof(DataRow)); // this does not seem to work
 
-    return writeBinaryTable(
-        filename, data.data(), columnNames.size(), columnNames,
-        combinedColumnTypes, columnLengths, columnUnits, true, extname.c_str()
-    );
+    return writeBinaryTable(fptr, schema, &row, sizeof(DataRow));
 }
 
 // ESP main writer
 bool FITSWriter::writeESPFITS( const ESP_PACKET& ESPStructure) {
 
     //std::cout << "writing ESP FITS file for APID: " << ESP_APID << std::endl;
+    if (globalState.args.skipFITS.load(std::memory_order_relaxed)) {
+        return true; // benchmarks and quicklook-only runs can turn FITS output off
+    }
+    ScopedStageTimer fitsTimer(STAGE_FITS_WRITE);
     LogFileWriter::getInstance().logInfo("writing ESP FITS file");
 
     int32_t status = 0;
     std::string filename = createFITSFilename(ESP_APID, ESPStructure.tai_time_seconds);
 
     fitsfile* fptr = nullptr;
-    if (!initializeFITSFile(filename, fptr)) {
+    MemoryFITSBuffer buffer;
+    if (!createMemoryFITSFile(fptr, buffer)) {
         std::cerr << "ERROR: Failed to initialize FITS file: " << filename << std::endl;
         LogFileWriter::getInstance().logError("FITSWriter::writeESPFITS: Failed to initialize FITS file: {}", filename);
         return false;
     }
 
-    checkFitsStatus(status);
-
-    int result = writeESPFITSBinaryTable(filename, ESPStructure);
-    fits_close_file(fptr, &status);
+    int result = writeESPFITSBinaryTable(fptr, ESPStructure);
     if (result != 0) {
         std::cerr << "Failed to write binary table to ESP FITS file: " << filename << std::endl;
-        std::cerr << " Check for .lock.gz files " << std::endl;
+        fits_close_file(fptr, &status);
         return false;
     }
 
+    if (!publishFITSFile(filename, fptr, buffer, ArchiveCatalog::describe(ESPStructure))) {
+        return false;
+    }
+    // the columns are a view of the product, one that cannot be written is logged and the file stands
+    if (!globalState.args.skipColumns.load(std::memory_order_relaxed)) {
+        ColumnStore::getInstance().append(PathService::getInstance().dataRoot(), ESPStructure);
+    }
+
     std::cout << "FITSWriter::writeESPFITS __successfully wrote " << filename << std::endl;
     LogFileWriter::getInstance().logInfo("FITSWriter::writeESPFITS successfully wrote {}", filename);
 
-    FileCompressor compressor;
-    compressor.compressFile(filename);
-
     return true;
 
 }
 
 // SHK binary table writer
-int FITSWriter::writeSHKFITSBinaryTable(const std::string& filename, const SHK_PACKET& SHKStructure ) {
-    
-    const std::string extname = "SHK_DATA";
-    std::vector<std::string> columnNames = {
-        "YYYYDOY", "SOD", "TAI_TIME_SECONDS", "TAI_TIME_SUBSECONDS", // 4
-        "REC_TAI_SECONDS", "REC_TAI_SUBSECONDS", "mode",  // 7
-        "FPGA_Board_Temperature", "FPGA_Board_p5_0_Voltage", "FPGA_Board_p3_3_Voltage", "FPGA_Board_p2_5_Voltage", 
-        "FPGA_Board_p1_2_Voltage", "MEGSA_CEB_Temperature", "MEGSA_CPR_Temperature", "MEGSA_p24_Voltage", 
-        "MEGSA_p15_Voltage", "MEGSA_m15_Voltage", "MEGSA_p5_0_Analog_Voltage", "MEGSA_m5_0_Voltage", // 19
-        "MEGSA_p5_0_Digital_Voltage", "MEGSA_p2_5_Voltage", "MEGSA_p24_Current", "MEGSA_p15_Current", //16+7
-        "MEGSA_m15_Current", "MEGSA_p5_0_Analog_Current", "MEGsA_m5_0_Current", "MEGSA_p5_0_Digital_Current", 
-        "MEGSA_p2_5_Current", "MEGSA_Integration_Register", "MEGSA_Analog_Mux_Register", "MEGSA_Digital_Status_Register", 
-        "MEGSA_Integration_Timer_Register", "MEGSA_Command_Error_Count_Register", "MEGSA_CEB_FPGA_Version_Register", "MEGSB_CEB_Temperature", 
-        "MEGSB_CPR_Temperature", "MEGSB_p24_Voltage", "MEGSB_p15_Voltage", "MEGSB_m15_Voltage", //  39, 32+7
-        "MEGSB_p5_0_Analog_Voltage", "MEGSB_m5_0_Voltage", "MEGSB_p5_0_Digital_Voltage", "MEGSB_p2_5_Voltage", //  43
-        "MEGSB_p24_Current", "MEGSB_p15_Current", "MEGSB_m15_Current", "MEGSB_p5_0_Analog_Current", 
-        "MEGSB_m5_0_Current", "MEGSB_p5_0_Digital_Current", "MEGSB_p2_5_Current", "MEGSB_Integration_Register", 
-        "MEGSB_Analog_Mux_Register", "MEGSB_Digital_Status_Register", "MEGSB_Integration_Timer_Register", "MEGSB_Command_Error_Count_Register", //48+7
-        "MEGSB_CEB_FPGA_Version_Register", "MEGSA_Thermistor_Diode", "MEGSA_PRT", "MEGSB_Thermistor_Diode", //52+7
-        "MEGSB_PRT", "ESP_Electrometer_Temperature", "ESP_Detector_Temperature", "MEGSP_Temperature", // 63= 56+7
-        "cFPGA_Board_Temperature", "cFPGA_Board_p5_0_Voltage", "cFPGA_Board_p3_3_Voltage", "cFPGA_Board_p2_5_Voltage", "cFPGA_Board_p1_2_Voltage", // 68
-        "cMEGSA_CEB_Temperature", "cMEGSA_CPR_Temperature", "cMEGSA_p24_Voltage", "cMEGSA_p15_Voltage", "cMEGSA_m15_Voltage", "cMEGSA_p5_0_Analog_Voltage", "cMEGSA_m5_0_Voltage", "cMEGSA_p5_0_Digital_Voltage", "cMEGSA_p2_5_Voltage", // 77
-        "cMEGSA_p24_Current", "cMEGSA_p15_Current", "cMEGSA_m15_Current", "cMEGSA_p5_0_Analog_Current", "cMEGsA_m5_0_Current", "cMEGSA_p5_0_Digital_Current", "cMEGSA_p2_5_Current",  // 84
-        "cMEGSB_CEB_Temperature", "cMEGSB_CPR_Temperature", "cMEGSB_p24_Voltage", "cMEGSB_p15_Voltage", "cMEGSB_m15_Voltage", "cMEGSB_p5_0_Analog_Voltage", "cMEGSB_m5_0_Voltage", "cMEGSB_p5_0_Digital_Voltage", "cMEGSB_p2_5_Voltage",  // 93
-        "cMEGSB_p24_Current", "cMEGSB_p15_Current", "cMEGSB_m15_Current", "cMEGSB_p5_0_Analog_Current", "cMEGSB_m5_0_Current", "cMEGSB_p5_0_Digital_Current", "cMEGSB_p2_5_Current", // 100
-        "cMEGSA_Thermistor_Diode", "cMEGSA_PRT", "cMEGSB_Thermistor_Diode", "cMEGSB_PRT", // 104
-        "cESP_Electrometer_Temperature", "cESP_Detector_Temperature", "cMEGSP_Temperature" // 107
-    };
-
-    std::vector<std::string> columnTypes = {"V", "V", "V", "V", 
-        "V", "V", //6 from common time stuff
-        "V", // mode
-        "V","V","V","V", "V","V","V","V", "V","V","V","V", "V","V","V","V", //16
-        "V","V","V","V", "V","V","V","V", "V","V","V","V", "V","V","V","V", //32
-        "V","V","V","V", "V","V","V","V", "V","V","V","V", "V","V","V","V", //48
-        "V","V","V","V", "V","V","V","V", // 53 +7 before converted values
-        // add 44 doubles
-        "D","D","D","D", "D","D","D","D", "D","D","D","D", "D","D","D","D",
-        "D","D","D","D", "D","D","D","D", "D","D","D","D", "D","D","D","D",
-        "D","D","D","D", "D","D","D","D", "D","D","D","D"
-        };
-    std::string combinedColumnTypes;    
-    for (const auto& type : columnTypes) {
-        combinedColumnTypes += type;  // Concatenate each string in columnTypes
-    }
-    std::vector<std::string> columnUnits = {"DATE", "s", "s", "s", 
-    "s", "s", // rec tai
-    "DN", // mode code, MSB is a heartbeat at 1 minute, LSBs are sample time in seconds 
-    "DN","DN","DN","DN", "DN","DN","DN","DN", "DN","DN","DN","DN", "DN","DN","DN","DN",
-    "DN","DN","DN","DN", "DN","DN","DN","DN", "DN","DN","DN","DN", "DN","DN","DN","DN",
-    "DN","DN","DN","DN", "DN","DN","DN","DN", "DN","DN","DN","DN", "DN","DN","DN","DN",
-    "DN","DN","DN","DN", "DN","DN","DN","DN",
-    "C","V","V","V", "V","C","C","V", "V","V","V","V", "V","V","A","A", // 5 FPGAs, 2 Temps, 7 Voltages, 2 Currents (p24 and p15)
-    "A","A","A","A", "A","C","C","V", "V","V","V","V", "V","V","A","A", // 5 Currents, 2 Temps, 7 Voltages, 2 Currents
-    "A","A","A","A", "A","C","C","C", "C","C","C","C" // 5 Currents, 7 Temps
-    };
-
-    
-    int32_t n = SHK_INTEGRATIONS_PER_FILE;
-    std::vector<int> columnLengths = {1,1,1,1,
-        1,1, // rec_tai
-        n, // mode
-        n,n,n,n, n,n,n,n, n,n,n,n, n,n,n,n,
-        n,n,n,n, n,n,n,n, n,n,n,n, n,n,n,n,
-        n,n,n,n, n,n,n,n, n,n,n,n, n,n,n,n,
-        n,n,n,n, n,n,n,n,
-        n,n,n,n, n,n,n,n, n,n,n,n, n,n,n,n, // converted
-        n,n,n,n, n,n,n,n, n,n,n,n, n,n,n,n, // converted
-        n,n,n,n, n,n,n,n, n,n,n,n  // converted
-    }; //
+int FITSWriter::writeSHKFITSBinaryTable(fitsfile* fptr, const SHK_PACKET& SHKStructure ) {
     
+    const FITSTableSchema& schema = shkTableSchema();
 
     //copy data
     struct DataRow {
@@ -976,17 +980,8 @@ int FITSWriter::writeSHKFITSBinaryTable(const std::string& filename, const SHK_P
 
     }
 
-    std::vector<uint8_t> data(sizeof(DataRow));
-    memcpy(data.data(), &row, sizeof(DataRow));
-
-    // vectors have size=107 elements
-    //std::cout<<"Sizes: "<<sizeof(DataRow)<<" "<<(data.size())<<" "<<(columnNames.size())<<" "<<(combinedColumnTypes.size())<<" "<<(columnLengths.size())<<" "<<(columnUnits.size())<<std::endl;
-    // shows Sizes: 5824 5824 107 107 107 107
-
-    return writeBinaryTable(
-        filename, data.data(), columnNames.size(), columnNames,
-        combinedColumnTypes, columnLengths, columnUnits, true, extname.c_str()
-    );
+    // 107 columns, writeBinaryTable checks sizeof(DataRow) against the schema
+    return writeBinaryTable(fptr, schema, &row, sizeof(DataRow));
 }
 
 
@@ -994,44 +989,41 @@ int FITSWriter::writeSHKFITSBinaryTable(const std::string& filename, const SHK_P
 bool FITSWriter::writeSHKFITS( const SHK_PACKET& SHKStructure) {
 
     //std::cout << "writing SHK FITS file for APID: " << SHK_APID << std::endl;
+    if (globalState.args.skipFITS.load(std::memory_order_relaxed)) {
+        return true; // benchmarks and quicklook-only runs can turn FITS output off
+    }
+    ScopedStageTimer fitsTimer(STAGE_FITS_WRITE);
     LogFileWriter::getInstance().logInfo("writing SHK FITS file");
 
     int32_t status = 0;
     std::string filename = createFITSFilename(SHK_APID, SHKStructure.tai_time_seconds);
 
     fitsfile* fptr = nullptr;
-    if (!initializeFITSFile(filename, fptr)) {
+    MemoryFITSBuffer buffer;
+    if (!createMemoryFITSFile(fptr, buffer)) {
         std::cerr << "ERROR: Failed to initialize FITS file: " << filename << std::endl;
         LogFileWriter::getInstance().logError("FITSWriter::writeSHKFITS: Failed to initialize FITS file: {}", filename);
         return false;
     }
 
-    checkFitsStatus(status);
-
-    // Write the binary table to the FITS file
-    int result = writeSHKFITSBinaryTable(filename, SHKStructure);
+    int result = writeSHKFITSBinaryTable(fptr, SHKStructure);
     if (result != 0) {
         std::cerr << "Failed to write binary table to SHK FITS file: " << filename << std::endl;
-        std::cerr << " Check for .lock.gz files " << std::endl;
+        fits_close_file(fptr, &status);
         return false;
     }
 
-    // Close the FITS file and check for errors
-    fits_close_file(fptr, &status);
-    if (status) {
-        std::cerr << "ERROR: Failed to close FITS file: " << filename << std::endl;
-        LogFileWriter::getInstance().logError("FITSWriter::writeSHKFITS: Failed to close FITS file: {}", filename);
+    if (!publishFITSFile(filename, fptr, buffer, ArchiveCatalog::describe(SHKStructure))) {
         return false;
     }
-
-    // this is where to write the converted SHK data into a second HDU
+    // the columns are a view of the product, one that cannot be written is logged and the file stands
+    if (!globalState.args.skipColumns.load(std::memory_order_relaxed)) {
+        ColumnStore::getInstance().append(PathService::getInstance().dataRoot(), SHKStructure);
+    }
 
     std::cout << "FITSWriter::writeSHKFITS __successfully wrote " << filename << std::endl;
     LogFileWriter::getInstance().logInfo("FITSWriter::writeSHKFITS successfully wrote {}", filename);
 
-    FileCompressor compressor;
-    compressor.compressFile(filename);
-
     return true;
 
 }
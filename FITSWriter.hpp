@@ -2,10 +2,17 @@
 #define FITSWRITER_HPP
 
 #include "eve_l0b.hpp" 
+#include "ArchiveCatalog.hpp"
+#include "FITSTableSchema.hpp"
+#include "MegsSpectrum.hpp"
 #include <string>
 #include <vector>
 #include <memory>
 #include <unordered_map>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
 
 #include <sstream>
 #include <iomanip>
@@ -14,52 +21,108 @@
 
 #include "/usr/local/include/fitsio.h"
 
+// Each product is assembled in a cfitsio memory file, then published with one write
+// to a temporary name and a rename, so readers never see a partial file.
+constexpr size_t FITS_MEMORY_INITIAL_BYTES = 64 * 1024;
+constexpr size_t FITS_MEMORY_GROWTH_BYTES = 256 * 1024;
+constexpr uint32_t MEGS_FITS_WRITE_BAND_ROWS = 64; // 256 KB of image per fits_write_img call
+constexpr size_t FITS_PUBLISH_QUEUE_PRODUCTS = 16;  // about 70 MB of MEGS images waiting for gzip
+
+// cfitsio reallocs data while the memory file is open, the finished file stays in it after close
+struct MemoryFITSBuffer {
+    void* data = nullptr;
+    size_t size = 0;
+    ~MemoryFITSBuffer() { free(data); }
+};
+
+// Compresses, writes and catalogs the finished memory files on its own thread, so the packet thread
+// only builds them. Products are published in the order they were queued. A full queue makes the
+// writer wait rather than drop a product.
+class FITSPublisher {
+public:
+    static FITSPublisher& getInstance();
+
+    // takes the size bytes at data, allocated with malloc, the thread starts with the first product
+    void enqueue(const std::string& filename, void* data, size_t size, const ArchiveCatalogRecord& catalogRecord);
+    // blocks until every queued product is published
+    void flush();
+    // products that could not be written, also counted in globalState.fitsPublishFailures
+    uint64_t failures();
+
+    // what the thread does with each product: gzip unless -skipCompress, one write to the .tmp name,
+    // an fsync, a rename over any existing file, then the catalog append unless -skipCatalog
+    static bool publish(const std::string& filename, const void* data, size_t size, const ArchiveCatalogRecord& catalogRecord);
+
+private:
+    FITSPublisher() = default;
+    ~FITSPublisher();
+    FITSPublisher(const FITSPublisher&) = delete;
+    FITSPublisher& operator=(const FITSPublisher&) = delete;
+
+    struct Product {
+        std::string filename;
+        void* data = nullptr;
+        size_t size = 0;
+        ArchiveCatalogRecord catalogRecord;
+    };
+
+    void run();
+
+    std::mutex mutex;
+    std::condition_variable queuedCondition;  // the thread waits for a product
+    std::condition_variable doneCondition;    // enqueue waits for room, flush for the queue to drain
+    std::deque<Product> products;
+    bool publishing = false;                  // the thread holds a product taken off the queue
+    bool stopping = false;
+    uint64_t failureCount = 0;
+    std::thread worker;
+};
+
 class FITSWriter {
 public:
     FITSWriter();
     ~FITSWriter();
 
-    // interfaces to common writeMegsFITS
-    bool writeMegsAFITS(const MEGS_IMAGE_REC& megsStructure);
-    bool writeMegsBFITS(const MEGS_IMAGE_REC& megsStructure);
+    // the write*FITS functions return true once the product is queued for FITSPublisher,
+    // later gzip, write or rename failures are counted in globalState.fitsPublishFailures
+    // interfaces to common writeMegsFITS, a spectrum with regions is added as a table after the MEGS table,
+    // saturatedPixels is the count kept while the image was assembled and goes into the catalog record
+    bool writeMegsAFITS(const MEGS_IMAGE_REC& megsStructure, uint32_t saturatedPixels, const MEGS_SPECTRUM* spectrum = nullptr);
+    bool writeMegsBFITS(const MEGS_IMAGE_REC& megsStructure, uint32_t saturatedPixels, const MEGS_SPECTRUM* spectrum = nullptr);
     // interfaces to write the other packet types
     bool writeMegsPFITS(const MEGSP_PACKET& megsPStructure);
     bool writeESPFITS(const ESP_PACKET& ESPStructure);
     bool writeSHKFITS(const SHK_PACKET& SHKStructure);
 
+    // directory under level0b/ and filename prefix for an APID, e.g. megs_a/ and MA__L0B_0_
+    static void level0bNaming(uint16_t apid, std::string& channelstring, std::string& filename_prefix);
+
 private:
     // common MEGS image writing
-    bool writeMegsFITS(const MEGS_IMAGE_REC& megsStructure, uint16_t apid, const std::string& extname);
+    bool writeMegsFITS(const MEGS_IMAGE_REC& megsStructure, uint16_t apid, uint32_t saturatedPixels, const MEGS_SPECTRUM* spectrum);
 
     // common function to create a FITS filename based on APID and timestamp
     // that calls the cfitsio API fits_create_file function
     std::string createFITSFilename(uint16_t apid, double timestamp);
 
-    // common function to initialize a FITS file
-    bool initializeFITSFile(const std::string& filename, fitsfile*& fptr);
+    // common function to create a FITS file in memory, initialBytes avoids reallocs for large images
+    bool createMemoryFITSFile(fitsfile*& fptr, MemoryFITSBuffer& buffer, size_t initialBytes = FITS_MEMORY_INITIAL_BYTES);
+
+    // closes the memory file and hands it to FITSPublisher, which compresses, writes and catalogs it
+    bool publishFITSFile(const std::string& filename, fitsfile* fptr, MemoryFITSBuffer& buffer, const ArchiveCatalogRecord& catalogRecord);
 
     //handler for errors - all errors are fatal
     void checkFitsStatus(int status);
 
-    // converts a vector of strings to a vector of char* for arays of FITS types
-    std::vector<char*> convertToCharPtrArray(const std::vector<std::string>& vec);
-
-    // converts an array of strings into a vector of char* for scalar FITS types
-    // this might be replacable by convertToCharPtrArray, relies on new
-    std::vector<char*> convertTypesToCharPtrArray(const std::string& types);
-    std::vector<char*> convertTypesToTFormPtrArray(const std::string& types, const std::vector<int>& lengths);
-    // use to free memory allocated in convertTypesTo... functions
-    void freeCharPtrArray(std::vector<char*>& array);
-
     bool writeMegsFITSImgHeader(fitsfile* fptr, const MEGS_IMAGE_REC& megsStructure, int32_t& status);
-    int writeBinaryTable(const std::string& filename, const void* data, int columns, 
-        const std::vector<std::string>& names, const std::string& types, const std::vector<int>& columnLengths,
-        const std::vector<std::string>& units, bool useUnits, const std::string& extname);
-    int writeMegsFITSBinaryTable(const std::string& filename, const MEGS_IMAGE_REC& megsStructure,
-        const std::string& extname, uint16_t apid);    
-    int writeMegsPFITSBinaryTable(const std::string& filename, const MEGSP_PACKET& megsPStructure);
-    int writeESPFITSBinaryTable(const std::string& filename, const ESP_PACKET& ESPStructure);
-    int writeSHKFITSBinaryTable(const std::string& filename, const SHK_PACKET& SHKStructure);
+    bool writeMegsFITSImage(fitsfile* fptr, const MEGS_IMAGE_REC& megsStructure, bool transposed, int32_t& status);
+    // rowBytes must match the schema, each of the rowCount rows is packed in schema column order
+    int writeBinaryTable(fitsfile* fptr, const FITSTableSchema& schema, const void* row, size_t rowBytes, long rowCount = 1);
+    int writeMegsFITSBinaryTable(fitsfile* fptr, const MEGS_IMAGE_REC& megsStructure, uint16_t apid);
+    int writeMegsSpectrumBinaryTable(fitsfile* fptr, const MEGS_SPECTRUM& spectrum, uint16_t apid);
+    int writeMegsPFITSBinaryTable(fitsfile* fptr, const MEGSP_PACKET& megsPStructure);
+    int writeESPFITSBinaryTable(fitsfile* fptr, const ESP_PACKET& ESPStructure);
+    int writeSHKFITSBinaryTable(fitsfile* fptr, const SHK_PACKET& SHKStructure);
 };
 
 #endif // FITSWRITER_HPP
@@ -1,7 +1,13 @@
 #include "FileCompressor.hpp"
 
+#include <zlib.h>
+
 // Public method to start the compression in a separate thread
 void FileCompressor::compressFile(const std::string& inputFilename) {
+    if (globalState.args.skipCompress.load(std::memory_order_relaxed)) {
+        return; // leave the file uncompressed
+    }
+    // pigz runs in the background, the compress stage only times the FITS products compressBuffer gzips
     compressAndTime(inputFilename);
 }
 
@@ -27,3 +33,26 @@ void FileCompressor::compressAndTime(const std::string& inputFilename) {
 
     LogFileWriter::getInstance().logInfo("Compression of " + inputFilename + " completed in " + std::to_string(elapsed.count()) + " microseconds.");
 }
+
+bool FileCompressor::compressBuffer(const void* data, size_t size, std::vector<uint8_t>& gzipped) {
+    ScopedStageTimer compressTimer(STAGE_COMPRESS);
+    z_stream stream = {};
+    // windowBits 15 + 16 writes a gzip header and trailer, the same .gz format pigz produces
+    if (deflateInit2(&stream, Z_DEFAULT_COMPRESSION, Z_DEFLATED, 15 + 16, 8, Z_DEFAULT_STRATEGY) != Z_OK) {
+        LogFileWriter::getInstance().logError("ERROR: deflateInit2 failed");
+        return false;
+    }
+    gzipped.resize(deflateBound(&stream, size));
+    stream.next_in = static_cast<Bytef*>(const_cast<void*>(data));
+    stream.avail_in = static_cast<uInt>(size);
+    stream.next_out = gzipped.data();
+    stream.avail_out = static_cast<uInt>(gzipped.size());
+    int result = deflate(&stream, Z_FINISH);
+    gzipped.resize(stream.total_out);
+    deflateEnd(&stream);
+    if (result != Z_STREAM_END) {
+        LogFileWriter::getInstance().logError("ERROR: In-memory gzip failed with zlib code {}", result);
+        return false;
+    }
+    return true;
+}
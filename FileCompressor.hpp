@@ -7,8 +7,10 @@
 #include <mutex>
 #include <chrono>
 #include <cstdlib>
+#include <vector>
 #include "LogFileWriter.hpp"
 #include "ProgramState.hpp"
+#include "StageTimer.hpp"
 
 class FileCompressor {
 public:
@@ -16,6 +18,9 @@ public:
     void compressFile(const std::string& inputFilename);
     // void waitForAllThreads();
 
+    // gzip in memory with zlib at the pigz default level, for products written in one piece
+    bool compressBuffer(const void* data, size_t size, std::vector<uint8_t>& gzipped);
+
 private:
     // Method to call pigz to compress a file
     void compressWithPigz(const std::string& inputFile);
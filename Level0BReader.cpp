@@ -0,0 +1,540 @@
+#include "Level0BReader.hpp"
+#include "FITSWriter.hpp"
+#include "TimeInfo.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <type_traits>
+#include <unistd.h>
+#include <zlib.h>
+
+#include "/usr/local/include/fitsio.h"
+
+namespace {
+
+constexpr long SECONDS_PER_DAY = 86400;
+
+template <typename T> int fitsTypeCode();
+template <> int fitsTypeCode<uint16_t>() { return TUSHORT; }
+template <> int fitsTypeCode<uint32_t>() { return TUINT; }
+template <> int fitsTypeCode<float>() { return TFLOAT; }
+template <> int fitsTypeCode<double>() { return TDOUBLE; }
+
+#define LEVEL0B_FIELD(STRUCT, MEMBER) \
+    Level0BField{#MEMBER, offsetof(STRUCT, MEMBER), \
+        fitsTypeCode<std::remove_all_extents<decltype(STRUCT::MEMBER)>::type>(), \
+        static_cast<long>(sizeof(STRUCT::MEMBER) / sizeof(std::remove_all_extents<decltype(STRUCT::MEMBER)>::type))}
+
+const std::vector<Level0BField> megsFields = {
+    LEVEL0B_FIELD(MEGS_IMAGE_REC, yyyydoy), LEVEL0B_FIELD(MEGS_IMAGE_REC, sod),
+    LEVEL0B_FIELD(MEGS_IMAGE_REC, tai_time_seconds), LEVEL0B_FIELD(MEGS_IMAGE_REC, tai_time_subseconds),
+    LEVEL0B_FIELD(MEGS_IMAGE_REC, rec_tai_seconds), LEVEL0B_FIELD(MEGS_IMAGE_REC, rec_tai_subseconds),
+    LEVEL0B_FIELD(MEGS_IMAGE_REC, vcdu_count),
+    LEVEL0B_FIELD(MEGS_IMAGE_REC, FPGA_Board_Temperature), LEVEL0B_FIELD(MEGS_IMAGE_REC, CEB_Temperature),
+    LEVEL0B_FIELD(MEGS_IMAGE_REC, CPR_Temperature), LEVEL0B_FIELD(MEGS_IMAGE_REC, PRT_Temperature),
+    LEVEL0B_FIELD(MEGS_IMAGE_REC, packets_received)
+};
+
+const std::vector<Level0BField> megsPFields = {
+    LEVEL0B_FIELD(MEGSP_PACKET, yyyydoy), LEVEL0B_FIELD(MEGSP_PACKET, sod),
+    LEVEL0B_FIELD(MEGSP_PACKET, tai_time_seconds), LEVEL0B_FIELD(MEGSP_PACKET, tai_time_subseconds),
+    LEVEL0B_FIELD(MEGSP_PACKET, rec_tai_seconds), LEVEL0B_FIELD(MEGSP_PACKET, rec_tai_subseconds),
+    LEVEL0B_FIELD(MEGSP_PACKET, FPGA_Board_Temperature), LEVEL0B_FIELD(MEGSP_PACKET, MEGSP_Temperature),
+    LEVEL0B_FIELD(MEGSP_PACKET, MP_lya), LEVEL0B_FIELD(MEGSP_PACKET, MP_dark)
+};
+
+const std::vector<Level0BField> espFields = {
+    LEVEL0B_FIELD(ESP_PACKET, yyyydoy), LEVEL0B_FIELD(ESP_PACKET, sod),
+    LEVEL0B_FIELD(ESP_PACKET, tai_time_seconds), LEVEL0B_FIELD(ESP_PACKET, tai_time_subseconds),
+    LEVEL0B_FIELD(ESP_PACKET, rec_tai_seconds), LEVEL0B_FIELD(ESP_PACKET, rec_tai_subseconds),
+    LEVEL0B_FIELD(ESP_PACKET, FPGA_Board_Temperature), LEVEL0B_FIELD(ESP_PACKET, ESP_Electrometer_Temperature),
+    LEVEL0B_FIELD(ESP_PACKET, ESP_Detector_Temperature),
+    LEVEL0B_FIELD(ESP_PACKET, ESP_xfer_cnt), LEVEL0B_FIELD(ESP_PACKET, ESP_q0), LEVEL0B_FIELD(ESP_PACKET, ESP_q1),
+    LEVEL0B_FIELD(ESP_PACKET, ESP_q2), LEVEL0B_FIELD(ESP_PACKET, ESP_q3), LEVEL0B_FIELD(ESP_PACKET, ESP_171),
+    LEVEL0B_FIELD(ESP_PACKET, ESP_257), LEVEL0B_FIELD(ESP_PACKET, ESP_304), LEVEL0B_FIELD(ESP_PACKET, ESP_366),
+    LEVEL0B_FIELD(ESP_PACKET, ESP_dark)
+};
+
+// every member except the spares, the column order in the file does not matter
+const std::vector<Level0BField> shkFields = {
+        LEVEL0B_FIELD(SHK_PACKET, yyyydoy), LEVEL0B_FIELD(SHK_PACKET, sod), LEVEL0B_FIELD(SHK_PACKET, tai_time_seconds),
+        LEVEL0B_FIELD(SHK_PACKET, tai_time_subseconds), LEVEL0B_FIELD(SHK_PACKET, rec_tai_seconds), LEVEL0B_FIELD(SHK_PACKET, rec_tai_subseconds),
+        LEVEL0B_FIELD(SHK_PACKET, mode), LEVEL0B_FIELD(SHK_PACKET, FPGA_Board_Temperature), LEVEL0B_FIELD(SHK_PACKET, FPGA_Board_p5_0_Voltage),
+        LEVEL0B_FIELD(SHK_PACKET, FPGA_Board_p3_3_Voltage), LEVEL0B_FIELD(SHK_PACKET, FPGA_Board_p2_5_Voltage), LEVEL0B_FIELD(SHK_PACKET, FPGA_Board_p1_2_Voltage),
+        LEVEL0B_FIELD(SHK_PACKET, MEGSA_CEB_Temperature), LEVEL0B_FIELD(SHK_PACKET, MEGSA_CPR_Temperature), LEVEL0B_FIELD(SHK_PACKET, MEGSA_p24_Voltage),
+        LEVEL0B_FIELD(SHK_PACKET, MEGSA_p15_Voltage), LEVEL0B_FIELD(SHK_PACKET, MEGSA_m15_Voltage), LEVEL0B_FIELD(SHK_PACKET, MEGSA_p5_0_Analog_Voltage),
+        LEVEL0B_FIELD(SHK_PACKET, MEGSA_m5_0_Voltage), LEVEL0B_FIELD(SHK_PACKET, MEGSA_p5_0_Digital_Voltage), LEVEL0B_FIELD(SHK_PACKET, MEGSA_p2_5_Voltage),
+        LEVEL0B_FIELD(SHK_PACKET, MEGSA_p24_Current), LEVEL0B_FIELD(SHK_PACKET, MEGSA_p15_Current), LEVEL0B_FIELD(SHK_PACKET, MEGSA_m15_Current),
+        LEVEL0B_FIELD(SHK_PACKET, MEGSA_p5_0_Analog_Current), LEVEL0B_FIELD(SHK_PACKET, MEGSA_m5_0_Current), LEVEL0B_FIELD(SHK_PACKET, MEGSA_p5_0_Digital_Current),
+        LEVEL0B_FIELD(SHK_PACKET, MEGSA_p2_5_Current), LEVEL0B_FIELD(SHK_PACKET, MEGSA_Integration_Register), LEVEL0B_FIELD(SHK_PACKET, MEGSA_Analog_Mux_Register),
+        LEVEL0B_FIELD(SHK_PACKET, MEGSA_Digital_Status_Register), LEVEL0B_FIELD(SHK_PACKET, MEGSA_Integration_Timer_Register), LEVEL0B_FIELD(SHK_PACKET, MEGSA_Command_Error_Count_Register),
+        LEVEL0B_FIELD(SHK_PACKET, MEGSA_CEB_FPGA_Version_Register), LEVEL0B_FIELD(SHK_PACKET, MEGSB_CEB_Temperature), LEVEL0B_FIELD(SHK_PACKET, MEGSB_CPR_Temperature),
+        LEVEL0B_FIELD(SHK_PACKET, MEGSB_p24_Voltage), LEVEL0B_FIELD(SHK_PACKET, MEGSB_p15_Voltage), LEVEL0B_FIELD(SHK_PACKET, MEGSB_m15_Voltage),
+        LEVEL0B_FIELD(SHK_PACKET, MEGSB_p5_0_Analog_Voltage), LEVEL0B_FIELD(SHK_PACKET, MEGSB_m5_0_Voltage), LEVEL0B_FIELD(SHK_PACKET, MEGSB_p5_0_Digital_Voltage),
+        LEVEL0B_FIELD(SHK_PACKET, MEGSB_p2_5_Voltage), LEVEL0B_FIELD(SHK_PACKET, MEGSB_p24_Current), LEVEL0B_FIELD(SHK_PACKET, MEGSB_p15_Current),
+        LEVEL0B_FIELD(SHK_PACKET, MEGSB_m15_Current), LEVEL0B_FIELD(SHK_PACKET, MEGSB_p5_0_Analog_Current), LEVEL0B_FIELD(SHK_PACKET, MEGSB_m5_0_Current),
+        LEVEL0B_FIELD(SHK_PACKET, MEGSB_p5_0_Digital_Current), LEVEL0B_FIELD(SHK_PACKET, MEGSB_p2_5_Current), LEVEL0B_FIELD(SHK_PACKET, MEGSB_Integration_Register),
+        LEVEL0B_FIELD(SHK_PACKET, MEGSB_Analog_Mux_Register), LEVEL0B_FIELD(SHK_PACKET, MEGSB_Digital_Status_Register), LEVEL0B_FIELD(SHK_PACKET, MEGSB_Integration_Timer_Register),
+        LEVEL0B_FIELD(SHK_PACKET, MEGSB_Command_Error_Count_Register), LEVEL0B_FIELD(SHK_PACKET, MEGSB_CEB_FPGA_Version_Register), LEVEL0B_FIELD(SHK_PACKET, MEGSA_PRT),
+        LEVEL0B_FIELD(SHK_PACKET, MEGSA_Thermistor_Diode), LEVEL0B_FIELD(SHK_PACKET, MEGSB_PRT), LEVEL0B_FIELD(SHK_PACKET, MEGSB_Thermistor_Diode),
+        LEVEL0B_FIELD(SHK_PACKET, ESP_Detector_Temperature), LEVEL0B_FIELD(SHK_PACKET, ESP_Electrometer_Temperature), LEVEL0B_FIELD(SHK_PACKET, MEGSP_Temperature),
+        LEVEL0B_FIELD(SHK_PACKET, cFPGA_Board_Temperature), LEVEL0B_FIELD(SHK_PACKET, cFPGA_Board_p5_0_Voltage), LEVEL0B_FIELD(SHK_PACKET, cFPGA_Board_p3_3_Voltage),
+        LEVEL0B_FIELD(SHK_PACKET, cFPGA_Board_p2_5_Voltage), LEVEL0B_FIELD(SHK_PACKET, cFPGA_Board_p1_2_Voltage), LEVEL0B_FIELD(SHK_PACKET, cMEGSA_CEB_Temperature),
+        LEVEL0B_FIELD(SHK_PACKET, cMEGSA_CPR_Temperature), LEVEL0B_FIELD(SHK_PACKET, cMEGSA_p24_Voltage), LEVEL0B_FIELD(SHK_PACKET, cMEGSA_p15_Voltage),
+        LEVEL0B_FIELD(SHK_PACKET, cMEGSA_m15_Voltage), LEVEL0B_FIELD(SHK_PACKET, cMEGSA_p5_0_Analog_Voltage), LEVEL0B_FIELD(SHK_PACKET, cMEGSA_m5_0_Voltage),
+        LEVEL0B_FIELD(SHK_PACKET, cMEGSA_p5_0_Digital_Voltage), LEVEL0B_FIELD(SHK_PACKET, cMEGSA_p2_5_Voltage), LEVEL0B_FIELD(SHK_PACKET, cMEGSA_p24_Current),
+        LEVEL0B_FIELD(SHK_PACKET, cMEGSA_p15_Current), LEVEL0B_FIELD(SHK_PACKET, cMEGSA_m15_Current), LEVEL0B_FIELD(SHK_PACKET, cMEGSA_p5_0_Analog_Current),
+        LEVEL0B_FIELD(SHK_PACKET, cMEGSA_m5_0_Current), LEVEL0B_FIELD(SHK_PACKET, cMEGSA_p5_0_Digital_Current), LEVEL0B_FIELD(SHK_PACKET, cMEGSA_p2_5_Current),
+        LEVEL0B_FIELD(SHK_PACKET, cMEGSB_CEB_Temperature), LEVEL0B_FIELD(SHK_PACKET, cMEGSB_CPR_Temperature), LEVEL0B_FIELD(SHK_PACKET, cMEGSB_p24_Voltage),
+        LEVEL0B_FIELD(SHK_PACKET, cMEGSB_p15_Voltage), LEVEL0B_FIELD(SHK_PACKET, cMEGSB_m15_Voltage), LEVEL0B_FIELD(SHK_PACKET, cMEGSB_p5_0_Analog_Voltage),
+        LEVEL0B_FIELD(SHK_PACKET, cMEGSB_m5_0_Voltage), LEVEL0B_FIELD(SHK_PACKET, cMEGSB_p5_0_Digital_Voltage), LEVEL0B_FIELD(SHK_PACKET, cMEGSB_p2_5_Voltage),
+        LEVEL0B_FIELD(SHK_PACKET, cMEGSB_p24_Current), LEVEL0B_FIELD(SHK_PACKET, cMEGSB_p15_Current), LEVEL0B_FIELD(SHK_PACKET, cMEGSB_m15_Current),
+        LEVEL0B_FIELD(SHK_PACKET, cMEGSB_p5_0_Analog_Current), LEVEL0B_FIELD(SHK_PACKET, cMEGSB_m5_0_Current), LEVEL0B_FIELD(SHK_PACKET, cMEGSB_p5_0_Digital_Current),
+        LEVEL0B_FIELD(SHK_PACKET, cMEGSB_p2_5_Current), LEVEL0B_FIELD(SHK_PACKET, cMEGSA_Thermistor_Diode), LEVEL0B_FIELD(SHK_PACKET, cMEGSA_PRT),
+        LEVEL0B_FIELD(SHK_PACKET, cMEGSB_Thermistor_Diode), LEVEL0B_FIELD(SHK_PACKET, cMEGSB_PRT), LEVEL0B_FIELD(SHK_PACKET, cESP_Electrometer_Temperature),
+        LEVEL0B_FIELD(SHK_PACKET, cESP_Detector_Temperature), LEVEL0B_FIELD(SHK_PACKET, cMEGSP_Temperature),
+};
+
+const std::vector<Level0BField> noFields;
+
+// cfitsio reports into status, the text of the last error is kept for the caller
+bool fitsFailed(int status, const char* what, std::string& error) {
+    if (status == 0) {
+        return false;
+    }
+    char statusText[FLEN_STATUS];
+    fits_get_errstatus(status, statusText);
+    error = std::string(what) + ": " + statusText;
+    return true;
+}
+
+// opens the bytes read-only in place, cfitsio neither copies nor frees them
+bool openMemoryFITS(const std::vector<uint8_t>& bytes, fitsfile*& fptr, std::string& error) {
+    if (bytes.empty()) {
+        error = "empty file";
+        return false;
+    }
+    void* memory = const_cast<uint8_t*>(bytes.data());
+    size_t memorySize = bytes.size();
+    int status = 0;
+    fits_open_memfile(&fptr, "level0b.fit", READONLY, &memory, &memorySize, 0, nullptr, &status);
+    return !fitsFailed(status, "fits_open_memfile", error);
+}
+
+void closeFITS(fitsfile* fptr) {
+    int status = 0;
+    fits_close_file(fptr, &status);
+}
+
+// reads the first row of the named table into record, columns the file lacks are left zero
+bool readTableRow(fitsfile* fptr, const char* extname, const std::vector<Level0BField>& fields, void* record, std::string& error) {
+    int status = 0;
+    fits_movnam_hdu(fptr, BINARY_TBL, const_cast<char*>(extname), 0, &status);
+    if (fitsFailed(status, extname, error)) {
+        return false;
+    }
+    for (const Level0BField& field : fields) {
+        int colnum = 0;
+        fits_get_colnum(fptr, CASEINSEN, const_cast<char*>(field.name), &colnum, &status);
+        if (status == COL_NOT_FOUND) {
+            status = 0;
+            continue;
+        }
+        int typecode = 0;
+        long repeat = 0;
+        long width = 0;
+        fits_get_coltype(fptr, colnum, &typecode, &repeat, &width, &status);
+        long elements = std::min(repeat, field.length);
+        int anynul = 0;
+        fits_read_col(fptr, field.typeCode, colnum, 1LL, 1LL, static_cast<LONGLONG>(elements), nullptr,
+                      static_cast<uint8_t*>(record) + field.offset, &anynul, &status);
+        if (fitsFailed(status, field.name, error)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// RECEIVED_PACKETS is an X column, cfitsio hands it back one char per bit
+bool readReceivedPackets(fitsfile* fptr, MEGS_IMAGE_REC& megsImage, std::string& error) {
+    int status = 0;
+    int colnum = 0;
+    fits_get_colnum(fptr, CASEINSEN, const_cast<char*>("RECEIVED_PACKETS"), &colnum, &status);
+    if (status == COL_NOT_FOUND) {
+        // older files only have the packet count
+        return true;
+    }
+    char bits[N_PKT_PER_IMAGE];
+    fits_read_col_bit(fptr, colnum, 1LL, 1LL, static_cast<LONGLONG>(N_PKT_PER_IMAGE), bits, &status);
+    if (fitsFailed(status, "RECEIVED_PACKETS", error)) {
+        return false;
+    }
+    for (int ssc = 0; ssc < N_PKT_PER_IMAGE; ++ssc) {
+        if (bits[ssc] != 0) {
+            megsImage.received_packets[ssc >> 3] |= static_cast<uint8_t>(1u << (ssc & 7));
+        }
+    }
+    return true;
+}
+
+// the primary image, transposed files (-transposeFITS) are turned back into image[y][x]
+bool readImage(fitsfile* fptr, MEGS_IMAGE_REC& megsImage, std::string& error, bool& transposedImage) {
+    int status = 0;
+    long naxes[2] = {0, 0};
+    fits_get_img_size(fptr, 2, naxes, &status);
+    if (fitsFailed(status, "fits_get_img_size", error)) {
+        return false;
+    }
+    const LONGLONG pixels = static_cast<LONGLONG>(MEGS_IMAGE_WIDTH) * MEGS_IMAGE_HEIGHT;
+    int anynul = 0;
+    if ((naxes[0] == MEGS_IMAGE_WIDTH) && (naxes[1] == MEGS_IMAGE_HEIGHT)) {
+        transposedImage = false;
+        fits_read_img(fptr, TUSHORT, 1LL, pixels, nullptr, &megsImage.image[0][0], &anynul, &status);
+        return !fitsFailed(status, "fits_read_img", error);
+    }
+    if ((naxes[0] == MEGS_IMAGE_T_WIDTH) && (naxes[1] == MEGS_IMAGE_T_HEIGHT)) {
+        transposedImage = true;
+        thread_local std::vector<uint16_t> transposed;
+        transposed.resize(static_cast<size_t>(pixels));
+        fits_read_img(fptr, TUSHORT, 1LL, pixels, nullptr, transposed.data(), &anynul, &status);
+        if (fitsFailed(status, "fits_read_img", error)) {
+            return false;
+        }
+        for (uint32_t y = 0; y < MEGS_IMAGE_HEIGHT; ++y) {
+            for (uint32_t x = 0; x < MEGS_IMAGE_WIDTH; ++x) {
+                megsImage.image[y][x] = transposed[static_cast<size_t>(x) * MEGS_IMAGE_T_WIDTH + y];
+            }
+        }
+        return true;
+    }
+    error = "unexpected image size " + std::to_string(naxes[0]) + " x " + std::to_string(naxes[1]);
+    return false;
+}
+
+// runs read on the bytes opened as a FITS file, always closing it
+template <typename Read>
+bool withMemoryFITS(const std::vector<uint8_t>& bytes, std::string& error, Read read) {
+    fitsfile* fptr = nullptr;
+    if (!openMemoryFITS(bytes, fptr, error)) {
+        return false;
+    }
+    bool ok = read(fptr);
+    closeFITS(fptr);
+    return ok;
+}
+
+bool endsWith(const std::string& text, const std::string& suffix) {
+    return (text.size() >= suffix.size()) && (text.compare(text.size() - suffix.size(), suffix.size(), suffix) == 0);
+}
+
+} // namespace
+
+bool Level0BReader::filenameTai(const std::string& filename, uint32_t& taiSeconds) {
+    // the time is the last _YYYYDOY_HHMMSS before the extension
+    size_t slash = filename.find_last_of('/');
+    std::string base = (slash == std::string::npos) ? filename : filename.substr(slash + 1);
+    size_t dot = base.find('.');
+    if ((dot == std::string::npos) || (dot < 15)) {
+        return false;
+    }
+    int year = 0, doy = 0, hour = 0, minute = 0, second = 0;
+    char separator = 0;
+    if ((std::sscanf(base.c_str() + dot - 14, "%4d%3d%c%2d%2d%2d", &year, &doy, &separator, &hour, &minute, &second) != 6) ||
+        (separator != '_') || (doy < 1) || (doy > 366)) {
+        return false;
+    }
+    std::tm tm = {};
+    tm.tm_year = year - 1900;
+    tm.tm_mday = doy;  // timegm normalizes day of year into month and day
+    tm.tm_hour = hour;
+    tm.tm_min = minute;
+    tm.tm_sec = second;
+    int64_t unixtime = static_cast<int64_t>(timegm(&tm));
+    // the inverse of FITSWriter::createFITSFilename
+    taiSeconds = static_cast<uint32_t>(unixtime + static_cast<int64_t>(TAI_EPOCH_OFFSET_TO_UNIX) + static_cast<int64_t>(TAI_LEAP_SECONDS));
+    return true;
+}
+
+std::vector<std::string> Level0BReader::dayDirectories(const std::string& dataRoot, uint16_t apid, uint32_t startTai, uint32_t endTai) {
+    std::vector<std::string> directories;
+    if (endTai <= startTai) {
+        return directories;
+    }
+    std::string channelstring;
+    std::string filenamePrefix;
+    FITSWriter::level0bNaming(apid, channelstring, filenamePrefix);
+    std::string root = dataRoot;
+    if (!root.empty() && (root.back() != '/')) {
+        root += '/';
+    }
+
+    const int64_t taiToUnix = static_cast<int64_t>(TAI_EPOCH_OFFSET_TO_UNIX) + static_cast<int64_t>(TAI_LEAP_SECONDS);
+    int64_t firstDay = (static_cast<int64_t>(startTai) - taiToUnix) / SECONDS_PER_DAY;
+    int64_t lastDay = (static_cast<int64_t>(endTai) - 1 - taiToUnix) / SECONDS_PER_DAY;
+    for (int64_t day = firstDay; day <= lastDay; ++day) {
+        std::time_t t = static_cast<std::time_t>(day * SECONDS_PER_DAY);
+        std::tm tm = {};
+        gmtime_r(&t, &tm);
+        char dayPath[16];
+        std::strftime(dayPath, sizeof(dayPath), "%Y/%j/", &tm);
+        directories.push_back(root + "level0b/" + channelstring + dayPath);
+    }
+    return directories;
+}
+
+std::vector<std::string> Level0BReader::findFiles(const std::string& dataRoot, uint16_t apid, uint32_t startTai, uint32_t endTai) {
+    std::vector<std::pair<uint32_t, std::string>> found;
+    std::string channelstring;
+    std::string filenamePrefix;
+    FITSWriter::level0bNaming(apid, channelstring, filenamePrefix);
+
+    for (const std::string& dirPath : dayDirectories(dataRoot, apid, startTai, endTai)) {
+        DIR* dir = opendir(dirPath.c_str());
+        if (dir == nullptr) {
+            continue;
+        }
+        while (struct dirent* entry = readdir(dir)) {
+            std::string name = entry->d_name;
+            if ((name.compare(0, filenamePrefix.size(), filenamePrefix) != 0) ||
+                !(endsWith(name, ".fit") || endsWith(name, ".fit.gz"))) {
+                continue;
+            }
+            uint32_t fileTai = 0;
+            if (filenameTai(name, fileTai) && (fileTai >= startTai) && (fileTai < endTai)) {
+                found.emplace_back(fileTai, dirPath + name);
+            }
+        }
+        closedir(dir);
+    }
+
+    // .fit sorts before .fit.gz, a leftover uncompressed copy of the same second is dropped
+    std::sort(found.begin(), found.end());
+    std::vector<std::string> filenames;
+    filenames.reserve(found.size());
+    for (size_t i = 0; i < found.size(); ++i) {
+        if ((i + 1 < found.size()) && (found[i + 1].first == found[i].first)) {
+            continue;
+        }
+        filenames.push_back(found[i].second);
+    }
+    return filenames;
+}
+
+bool Level0BReader::loadFile(const std::string& filename, std::vector<uint8_t>& bytes, std::string& error) {
+    bytes.clear();
+    int fd = open(filename.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        error = std::string("open: ") + strerror(errno);
+        return false;
+    }
+    struct stat info;
+    if (fstat(fd, &info) != 0) {
+        error = std::string("fstat: ") + strerror(errno);
+        close(fd);
+        return false;
+    }
+    std::vector<uint8_t> raw(static_cast<size_t>(info.st_size));
+    size_t offset = 0;
+    while (offset < raw.size()) {
+        ssize_t got = read(fd, raw.data() + offset, raw.size() - offset);
+        if (got < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            error = std::string("read: ") + strerror(errno);
+            close(fd);
+            return false;
+        }
+        if (got == 0) {
+            break;
+        }
+        offset += static_cast<size_t>(got);
+    }
+    close(fd);
+    raw.resize(offset);
+
+    // gzip magic, not the name, decides, a renamed file still reads
+    if ((raw.size() >= 2) && (raw[0] == 0x1f) && (raw[1] == 0x8b)) {
+        return gunzip(raw, bytes, error);
+    }
+    bytes.swap(raw);
+    return true;
+}
+
+bool Level0BReader::gunzip(const std::vector<uint8_t>& gzipped, std::vector<uint8_t>& bytes, std::string& error) {
+    // the gzip trailer holds the length mod 2^32, every Level 0B file is far below that
+    size_t expected = gzipped.size() * 4;
+    if (gzipped.size() >= 18) {
+        const uint8_t* trailer = gzipped.data() + gzipped.size() - 4;
+        expected = static_cast<size_t>(trailer[0]) | (static_cast<size_t>(trailer[1]) << 8) |
+                   (static_cast<size_t>(trailer[2]) << 16) | (static_cast<size_t>(trailer[3]) << 24);
+    }
+    bytes.resize(std::max<size_t>(expected, 1));
+
+    z_stream stream = {};
+    // windowBits 15 + 16 reads only gzip, the format compressBuffer and pigz write
+    if (inflateInit2(&stream, 15 + 16) != Z_OK) {
+        error = "inflateInit2 failed";
+        return false;
+    }
+    stream.next_in = const_cast<Bytef*>(gzipped.data());
+    stream.avail_in = static_cast<uInt>(gzipped.size());
+    int result = Z_OK;
+    while (true) {
+        if (stream.total_out == bytes.size()) {
+            bytes.resize(bytes.size() * 2);
+        }
+        stream.next_out = bytes.data() + stream.total_out;
+        stream.avail_out = static_cast<uInt>(bytes.size() - stream.total_out);
+        result = inflate(&stream, Z_NO_FLUSH);
+        if ((result == Z_STREAM_END) && (stream.avail_in > 0)) {
+            // concatenated members, as gzip appends them
+            uLong produced = stream.total_out;
+            inflateReset(&stream);
+            stream.total_out = produced;
+            continue;
+        }
+        if ((result != Z_OK) && (result != Z_BUF_ERROR)) {
+            break;
+        }
+        if ((result == Z_BUF_ERROR) && (stream.avail_in == 0)) {
+            break;
+        }
+    }
+    bytes.resize(stream.total_out);
+    inflateEnd(&stream);
+    if (result != Z_STREAM_END) {
+        error = "gunzip failed with zlib code " + std::to_string(result);
+        bytes.clear();
+        return false;
+    }
+    return true;
+}
+
+bool Level0BReader::readMegsImage(const std::vector<uint8_t>& bytes, MEGS_IMAGE_REC& megsImage, std::string& error,
+                                  bool* transposed) {
+    std::memset(&megsImage, 0, sizeof(megsImage));
+    return withMemoryFITS(bytes, error, [&](fitsfile* fptr) {
+        bool transposedImage = false;
+        if (!readImage(fptr, megsImage, error, transposedImage)) {
+            return false;
+        }
+        if (transposed != nullptr) {
+            *transposed = transposedImage;
+        }
+        // the table is MEGSA_TABLE or MEGSB_TABLE, whichever this file has
+        int status = 0;
+        fits_movnam_hdu(fptr, BINARY_TBL, const_cast<char*>("MEGSA_TABLE"), 0, &status);
+        const char* extname = (status == 0) ? "MEGSA_TABLE" : "MEGSB_TABLE";
+        return readTableRow(fptr, extname, megsFields, &megsImage, error) &&
+               readReceivedPackets(fptr, megsImage, error);
+    });
+}
+
+bool Level0BReader::readMegsP(const std::vector<uint8_t>& bytes, MEGSP_PACKET& megsP, std::string& error) {
+    std::memset(&megsP, 0, sizeof(megsP));
+    return withMemoryFITS(bytes, error, [&](fitsfile* fptr) {
+        return readTableRow(fptr, "MEGSP_DATA", megsPFields, &megsP, error);
+    });
+}
+
+bool Level0BReader::readESP(const std::vector<uint8_t>& bytes, ESP_PACKET& esp, std::string& error) {
+    std::memset(&esp, 0, sizeof(esp));
+    return withMemoryFITS(bytes, error, [&](fitsfile* fptr) {
+        return readTableRow(fptr, "ESP_DATA", espFields, &esp, error);
+    });
+}
+
+bool Level0BReader::readSHK(const std::vector<uint8_t>& bytes, SHK_PACKET& shk, std::string& error) {
+    std::memset(&shk, 0, sizeof(shk));
+    return withMemoryFITS(bytes, error, [&](fitsfile* fptr) {
+        return readTableRow(fptr, "SHK_DATA", shkFields, &shk, error);
+    });
+}
+
+const std::vector<Level0BField>& Level0BReader::tableFields(uint16_t apid) {
+    switch (apid) {
+        case MEGSA_APID:
+        case MEGSB_APID:
+            return megsFields;
+        case MEGSP_APID:
+            return megsPFields;
+        case ESP_APID:
+            return espFields;
+        case SHK_APID:
+            return shkFields;
+        default:
+            return noFields;
+    }
+}
+
+Level0BStream::Level0BStream(std::vector<std::string> filenames, unsigned threads, size_t prefetch)
+    : filenames(std::move(filenames)), prefetch(std::max<size_t>(prefetch, 1)) {
+    if (threads == 0) {
+        threads = std::max(1u, std::thread::hardware_concurrency());
+    }
+    // more workers than the window can never all be busy
+    threads = static_cast<unsigned>(std::min<size_t>(threads, this->prefetch));
+    for (unsigned i = 0; i < threads; ++i) {
+        workers.emplace_back(&Level0BStream::runWorker, this);
+    }
+}
+
+Level0BStream::~Level0BStream() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    spaceCondition.notify_all();
+    for (std::thread& worker : workers) {
+        worker.join();
+    }
+}
+
+void Level0BStream::runWorker() {
+    while (true) {
+        size_t index = 0;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            spaceCondition.wait(lock, [this] {
+                return stopping || (nextToClaim >= filenames.size()) || (nextToClaim < nextToHand + prefetch);
+            });
+            if (stopping || (nextToClaim >= filenames.size())) {
+                return;
+            }
+            index = nextToClaim++;
+        }
+
+        Level0BFile file;
+        file.filename = filenames[index];
+        Level0BReader::filenameTai(file.filename, file.taiSeconds);
+        Level0BReader::loadFile(file.filename, file.bytes, file.error);
+
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            ready.emplace(index, std::move(file));
+        }
+        readyCondition.notify_all();
+    }
+}
+
+bool Level0BStream::next(Level0BFile& file) {
+    std::unique_lock<std::mutex> lock(mutex);
+    if (nextToHand >= filenames.size()) {
+        return false;
+    }
+    readyCondition.wait(lock, [this] { return ready.count(nextToHand) != 0; });
+    auto it = ready.find(nextToHand);
+    file = std::move(it->second);
+    ready.erase(it);
+    ++nextToHand;
+    lock.unlock();
+    spaceCondition.notify_all();
+    return true;
+}
@@ -0,0 +1,92 @@
+#ifndef LEVEL0B_READER_HPP
+#define LEVEL0B_READER_HPP
+
+// Reads the Level 0B archive written by FITSWriter back into the structs it was written from.
+// Level0BStream gunzips files on a pool of threads, at most prefetch files ahead of the consumer,
+// and hands them out in time order. The read* functions then parse one file with cfitsio in memory.
+// Table columns are matched to struct members by name, ignoring case, so files written before a
+// column was added still read and the missing members stay zero.
+
+#include "eve_l0b.hpp"
+
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+constexpr size_t LEVEL0B_DEFAULT_PREFETCH = 8;
+
+struct Level0BFile {
+    std::string filename;
+    uint32_t taiSeconds = 0;      // from the filename, the time of the first packet
+    std::vector<uint8_t> bytes;   // the FITS file, gunzipped
+    std::string error;            // set when the file could not be read, bytes is then empty
+};
+
+// one binary table column read straight into a struct member
+struct Level0BField {
+    const char* name;   // the member name, matches the TTYPE ignoring case
+    size_t offset;      // offsetof the member
+    int typeCode;       // cfitsio datatype of one element
+    long length;        // elements in the member
+};
+
+class Level0BReader {
+public:
+    // the files of one APID under dataRoot/level0b whose filename time is in [startTai, endTai), oldest first
+    static std::vector<std::string> findFiles(const std::string& dataRoot, uint16_t apid, uint32_t startTai, uint32_t endTai);
+    // dataRoot/level0b/<channel>/%Y/%j/ for each UTC day the range touches, whether or not it exists
+    static std::vector<std::string> dayDirectories(const std::string& dataRoot, uint16_t apid, uint32_t startTai, uint32_t endTai);
+    // TAI seconds from a name such as MA__L0B_0_2025079_123456.fit.gz
+    static bool filenameTai(const std::string& filename, uint32_t& taiSeconds);
+
+    // reads a .fit or .fit.gz file with one read and gunzips it in memory
+    static bool loadFile(const std::string& filename, std::vector<uint8_t>& bytes, std::string& error);
+    static bool gunzip(const std::vector<uint8_t>& gzipped, std::vector<uint8_t>& bytes, std::string& error);
+
+    // parse one loaded file, the struct is zeroed first
+    // transposed, when given, is set if the image was written 1024 wide by 2048 tall (-transposeFITS)
+    static bool readMegsImage(const std::vector<uint8_t>& bytes, MEGS_IMAGE_REC& megsImage, std::string& error,
+                              bool* transposed = nullptr);
+    static bool readMegsP(const std::vector<uint8_t>& bytes, MEGSP_PACKET& megsP, std::string& error);
+    static bool readESP(const std::vector<uint8_t>& bytes, ESP_PACKET& esp, std::string& error);
+    static bool readSHK(const std::vector<uint8_t>& bytes, SHK_PACKET& shk, std::string& error);
+
+    // the members each product table fills, MEGS RECEIVED_PACKETS is read separately as bits
+    static const std::vector<Level0BField>& tableFields(uint16_t apid);
+};
+
+// hands out the decompressed files of a list in order while a thread pool works ahead
+class Level0BStream {
+public:
+    // threads 0 uses one per core
+    explicit Level0BStream(std::vector<std::string> filenames, unsigned threads = 0, size_t prefetch = LEVEL0B_DEFAULT_PREFETCH);
+    ~Level0BStream();
+    Level0BStream(const Level0BStream&) = delete;
+    Level0BStream& operator=(const Level0BStream&) = delete;
+
+    // the next file in list order, false once every file was handed out
+    bool next(Level0BFile& file);
+    size_t size() const { return filenames.size(); }
+
+private:
+    void runWorker();
+
+    std::vector<std::string> filenames;
+    size_t prefetch;
+
+    std::mutex mutex;
+    std::condition_variable readyCondition;   // next() waits for its file
+    std::condition_variable spaceCondition;   // workers wait for room in the prefetch window
+    size_t nextToClaim = 0;
+    size_t nextToHand = 0;
+    std::map<size_t, Level0BFile> ready;
+    bool stopping = false;
+    std::vector<std::thread> workers;
+};
+
+#endif // LEVEL0B_READER_HPP
@@ -1,5 +1,7 @@
 #include "LogFileWriter.hpp"
 #include "FileCompressor.hpp"
+#include "PathService.hpp"
+#include "TraceRecorder.hpp"
 
 LogFileWriter::LogFileWriter()
     : logFile(generateLogFilename()), logFileMinute(-1) {
@@ -23,6 +25,7 @@ bool LogFileWriter::checkAndRotateFile() {
     int currentMinute = currentTime.getMinute();
 
     if (logFileMinute == -1 || logFileMinute != currentMinute) {
+        ScopedTrace trace("log rotation");
         std::string oldLogFile = logFile;
 
         // Minute has changed, rotate log file
@@ -60,9 +63,8 @@ std::string LogFileWriter::generateLogFilename() const {
     // create directory
     oss << std::put_time(&buf, "./logs/%Y/%j/");
     std::string dirPath = oss.str();
-    // Create the directories if they don't exist, use system call
-    std::string mkdirCommand = "mkdir -p " + dirPath;
-    if (system(mkdirCommand.c_str()) != 0) {
+    // Create the directories if they don't exist
+    if (!PathService::getInstance().ensureDirectory(dirPath)) {
         std::cerr << "ERROR: Could not create directories for log file." << std::endl;
         return "";
     }
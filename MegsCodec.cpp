@@ -0,0 +1,388 @@
+#include "MegsCodec.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <omp.h>
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+namespace {
+
+constexpr unsigned PREDICTOR_BITS = 2;
+constexpr unsigned RICE_PARAMETER_BITS = 5;
+constexpr unsigned RICE_ESCAPE = 24;         // this many ones in a row are followed by the raw 16 bit value
+constexpr unsigned MAX_RICE_PARAMETER = 16;
+// a band that does not code smaller, such as noise, is stored as is and has exactly this many bytes
+constexpr size_t RAW_BAND_BYTES = MEGS_CODEC_ROWS_PER_BAND * MEGS_IMAGE_WIDTH * sizeof(uint16_t);
+
+struct BitWriter {
+    std::vector<uint8_t>& bytes;
+    uint64_t bits = 0;
+    unsigned count = 0;
+
+    explicit BitWriter(std::vector<uint8_t>& bytes) : bytes(bytes) {}
+
+    // value holds at most 32 bits, written least significant first
+    inline void put(uint32_t value, unsigned width) {
+        bits |= static_cast<uint64_t>(value) << count;
+        count += width;
+        if (count >= 32) {
+            for (int i = 0; i < 4; ++i) {
+                bytes.push_back(static_cast<uint8_t>(bits >> (8 * i)));
+            }
+            bits >>= 32;
+            count -= 32;
+        }
+    }
+
+    void flush() {
+        for (; count > 0; count = (count > 8) ? count - 8 : 0) {
+            bytes.push_back(static_cast<uint8_t>(bits));
+            bits >>= 8;
+        }
+    }
+};
+
+struct BitReader {
+    const uint8_t* data;
+    size_t size;
+    size_t next = 0;    // bytes loaded into bits, reads past the end load zeros
+    uint64_t bits = 0;
+    unsigned count = 0;
+
+    BitReader(const uint8_t* data, size_t size) : data(data), size(size) {}
+
+    inline void refill() {
+        while (count <= 56) {
+            bits |= static_cast<uint64_t>((next < size) ? data[next] : 0) << count;
+            ++next;
+            count += 8;
+        }
+    }
+
+    // width of at most 32
+    inline uint32_t get(unsigned width) {
+        if (count < width) {
+            refill();
+        }
+        uint32_t value = static_cast<uint32_t>(bits & ((uint64_t(1) << width) - 1));
+        bits >>= width;
+        count -= width;
+        return value;
+    }
+
+    // counts ones up to limit, and consumes the zero after them if there are fewer
+    inline unsigned ones(unsigned limit) {
+        if (count < limit + 1) {
+            refill();
+        }
+        unsigned n = static_cast<unsigned>(__builtin_ctzll(~bits | (uint64_t(1) << limit)));
+        unsigned used = (n < limit) ? n + 1 : n;
+        bits >>= used;
+        count -= used;
+        return n;
+    }
+
+    bool overrun() const {
+        return (next * 8 - count) > size * 8;
+    }
+};
+
+inline uint16_t fold(uint16_t residual) {
+    return static_cast<uint16_t>((residual << 1) ^ static_cast<uint16_t>(static_cast<int16_t>(residual) >> 15));
+}
+
+inline uint16_t unfold(uint16_t folded) {
+    return static_cast<uint16_t>((folded >> 1) ^ static_cast<uint16_t>(-(folded & 1)));
+}
+
+inline uint16_t medPrediction(uint16_t left, uint16_t up, uint16_t upLeft) {
+    uint16_t low = std::min(left, up);
+    uint16_t high = std::max(left, up);
+    if (upLeft >= high) {
+        return low;
+    }
+    if (upLeft <= low) {
+        return high;
+    }
+    return static_cast<uint16_t>(left + up - upLeft);
+}
+
+inline uint16_t prediction(const uint16_t* row, const uint16_t* up, MegsPredictor predictor, uint32_t x) {
+    if (x == 0) {
+        return (up != nullptr) ? up[0] : 0;
+    }
+    switch (predictor) {
+        case MEGS_PREDICT_UP: return up[x];
+        case MEGS_PREDICT_MED: return medPrediction(row[x - 1], up[x], up[x - 1]);
+        case MEGS_PREDICT_AVERAGE: return static_cast<uint16_t>((row[x - 1] + up[x] + 1) >> 1);
+        default: return row[x - 1];
+    }
+}
+
+#if defined(__SSE2__)
+// unsigned 16 bit compare and select with the sign bit flipped, SSE2 only has signed
+inline __m128i select(__m128i mask, __m128i ifSet, __m128i ifClear) {
+    return _mm_or_si128(_mm_and_si128(mask, ifSet), _mm_andnot_si128(mask, ifClear));
+}
+
+inline __m128i medPrediction(__m128i left, __m128i up, __m128i upLeft) {
+    const __m128i bias = _mm_set1_epi16(static_cast<short>(0x8000));
+    __m128i leftBiased = _mm_xor_si128(left, bias);
+    __m128i upBiased = _mm_xor_si128(up, bias);
+    __m128i upLeftBiased = _mm_xor_si128(upLeft, bias);
+    __m128i low = _mm_xor_si128(_mm_min_epi16(leftBiased, upBiased), bias);
+    __m128i high = _mm_xor_si128(_mm_max_epi16(leftBiased, upBiased), bias);
+    __m128i gradient = _mm_sub_epi16(_mm_add_epi16(left, up), upLeft);
+    __m128i belowHigh = _mm_cmpgt_epi16(_mm_xor_si128(high, bias), upLeftBiased);
+    __m128i aboveLow = _mm_cmpgt_epi16(upLeftBiased, _mm_xor_si128(low, bias));
+    return select(belowHigh, select(aboveLow, gradient, high), low);
+}
+
+inline __m128i fold(__m128i residual) {
+    return _mm_xor_si128(_mm_slli_epi16(residual, 1), _mm_srai_epi16(residual, 15));
+}
+#endif
+
+// folded residuals of one row under predictor, up is nullptr for the first row of a band, returns their sum
+uint64_t foldResiduals(const uint16_t* row, const uint16_t* up, MegsPredictor predictor, uint16_t* folded) {
+    uint64_t sum = 0;
+    uint32_t x = 0;
+    folded[0] = fold(static_cast<uint16_t>(row[0] - prediction(row, up, predictor, 0)));
+    sum += folded[0];
+    x = 1;
+#if defined(__SSE2__)
+    const __m128i zero = _mm_setzero_si128();
+    __m128i sums = zero;
+    for (; x + 8 <= MEGS_IMAGE_WIDTH; x += 8) {
+        __m128i pixels = _mm_loadu_si128(reinterpret_cast<const __m128i*>(row + x));
+        __m128i predicted;
+        if (predictor == MEGS_PREDICT_LEFT) {
+            predicted = _mm_loadu_si128(reinterpret_cast<const __m128i*>(row + x - 1));
+        } else if (predictor == MEGS_PREDICT_UP) {
+            predicted = _mm_loadu_si128(reinterpret_cast<const __m128i*>(up + x));
+        } else if (predictor == MEGS_PREDICT_AVERAGE) {
+            predicted = _mm_avg_epu16(_mm_loadu_si128(reinterpret_cast<const __m128i*>(row + x - 1)),
+                                      _mm_loadu_si128(reinterpret_cast<const __m128i*>(up + x)));
+        } else {
+            predicted = medPrediction(_mm_loadu_si128(reinterpret_cast<const __m128i*>(row + x - 1)),
+                                      _mm_loadu_si128(reinterpret_cast<const __m128i*>(up + x)),
+                                      _mm_loadu_si128(reinterpret_cast<const __m128i*>(up + x - 1)));
+        }
+        __m128i residuals = fold(_mm_sub_epi16(pixels, predicted));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(folded + x), residuals);
+        sums = _mm_add_epi32(sums, _mm_add_epi32(_mm_unpacklo_epi16(residuals, zero), _mm_unpackhi_epi16(residuals, zero)));
+    }
+    uint32_t lanes[4];
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(lanes), sums);
+    sum += static_cast<uint64_t>(lanes[0]) + lanes[1] + lanes[2] + lanes[3];
+#endif
+    for (; x < MEGS_IMAGE_WIDTH; ++x) {
+        folded[x] = fold(static_cast<uint16_t>(row[x] - prediction(row, up, predictor, x)));
+        sum += folded[x];
+    }
+    return sum;
+}
+
+// the Rice parameter cfitsio picks for a block with this sum of folded residuals
+inline unsigned riceParameter(uint32_t sum) {
+    uint32_t mean = (sum > MEGS_CODEC_BLOCK / 2) ? (sum - MEGS_CODEC_BLOCK / 2 - 1) / MEGS_CODEC_BLOCK : 0;
+    unsigned k = 0;
+    for (; mean > 0; mean >>= 1) {
+        ++k;
+    }
+    return std::min(k, MAX_RICE_PARAMETER);
+}
+
+void encodeRow(const uint16_t* folded, BitWriter& writer) {
+    for (uint32_t block = 0; block < MEGS_IMAGE_WIDTH; block += MEGS_CODEC_BLOCK) {
+        uint32_t sum = 0;
+        for (uint32_t i = 0; i < MEGS_CODEC_BLOCK; ++i) {
+            sum += folded[block + i];
+        }
+        unsigned k = riceParameter(sum);
+        writer.put(k, RICE_PARAMETER_BITS);
+        for (uint32_t i = 0; i < MEGS_CODEC_BLOCK; ++i) {
+            uint32_t value = folded[block + i];
+            uint32_t quotient = value >> k;
+            if (quotient < RICE_ESCAPE) {
+                writer.put((1u << quotient) - 1, quotient + 1);
+                writer.put(value & ((1u << k) - 1), k);
+            } else {
+                writer.put((1u << RICE_ESCAPE) - 1, RICE_ESCAPE);
+                writer.put(value, 16);
+            }
+        }
+    }
+}
+
+bool decodeRow(BitReader& reader, uint16_t* folded) {
+    for (uint32_t block = 0; block < MEGS_IMAGE_WIDTH; block += MEGS_CODEC_BLOCK) {
+        unsigned k = reader.get(RICE_PARAMETER_BITS);
+        if (k > MAX_RICE_PARAMETER) {
+            return false;
+        }
+        for (uint32_t i = 0; i < MEGS_CODEC_BLOCK; ++i) {
+            unsigned quotient = reader.ones(RICE_ESCAPE);
+            folded[block + i] = (quotient < RICE_ESCAPE) ? static_cast<uint16_t>((quotient << k) | reader.get(k))
+                                                         : static_cast<uint16_t>(reader.get(16));
+        }
+    }
+    return true;
+}
+
+void encodeBand(const uint16_t (&image)[MEGS_IMAGE_HEIGHT][MEGS_IMAGE_WIDTH], uint32_t band, std::vector<uint8_t>& stream) {
+    std::vector<uint16_t> candidates(4 * MEGS_IMAGE_WIDTH);
+    BitWriter writer(stream);
+    const uint32_t firstRow = band * MEGS_CODEC_ROWS_PER_BAND;
+    for (uint32_t y = firstRow; y < firstRow + MEGS_CODEC_ROWS_PER_BAND; ++y) {
+        MegsPredictor best = MEGS_PREDICT_LEFT;
+        if (y == firstRow) {
+            foldResiduals(image[y], nullptr, MEGS_PREDICT_LEFT, candidates.data());
+        } else {
+            uint64_t bestSum = 0;
+            for (MegsPredictor predictor : {MEGS_PREDICT_LEFT, MEGS_PREDICT_UP, MEGS_PREDICT_MED, MEGS_PREDICT_AVERAGE}) {
+                uint64_t sum = foldResiduals(image[y], image[y - 1], predictor, candidates.data() + predictor * MEGS_IMAGE_WIDTH);
+                if ((predictor == MEGS_PREDICT_LEFT) || (sum < bestSum)) {
+                    best = predictor;
+                    bestSum = sum;
+                }
+            }
+        }
+        writer.put(best, PREDICTOR_BITS);
+        encodeRow(candidates.data() + best * MEGS_IMAGE_WIDTH, writer);
+    }
+    writer.flush();
+    if (stream.size() >= RAW_BAND_BYTES) {
+        stream.resize(RAW_BAND_BYTES);
+        std::memcpy(stream.data(), image[firstRow], RAW_BAND_BYTES);
+    }
+}
+
+bool decodeBand(const uint8_t* data, size_t bytes, uint32_t band, uint16_t (&image)[MEGS_IMAGE_HEIGHT][MEGS_IMAGE_WIDTH]) {
+    const uint32_t firstRow = band * MEGS_CODEC_ROWS_PER_BAND;
+    if (bytes == RAW_BAND_BYTES) {
+        std::memcpy(image[firstRow], data, RAW_BAND_BYTES);
+        return true;
+    }
+    std::vector<uint16_t> folded(MEGS_IMAGE_WIDTH);
+    BitReader reader(data, bytes);
+    for (uint32_t y = firstRow; y < firstRow + MEGS_CODEC_ROWS_PER_BAND; ++y) {
+        MegsPredictor predictor = static_cast<MegsPredictor>(reader.get(PREDICTOR_BITS));
+        const uint16_t* up = (y == firstRow) ? nullptr : image[y - 1];
+        if (((up == nullptr) && (predictor != MEGS_PREDICT_LEFT)) ||
+            !decodeRow(reader, folded.data()) || reader.overrun()) {
+            return false;
+        }
+        uint16_t* row = image[y];
+        row[0] = static_cast<uint16_t>(prediction(row, up, predictor, 0) + unfold(folded[0]));
+        switch (predictor) {
+            case MEGS_PREDICT_UP:
+                for (uint32_t x = 1; x < MEGS_IMAGE_WIDTH; ++x) {
+                    row[x] = static_cast<uint16_t>(up[x] + unfold(folded[x]));
+                }
+                break;
+            case MEGS_PREDICT_MED:
+                for (uint32_t x = 1; x < MEGS_IMAGE_WIDTH; ++x) {
+                    row[x] = static_cast<uint16_t>(medPrediction(row[x - 1], up[x], up[x - 1]) + unfold(folded[x]));
+                }
+                break;
+            case MEGS_PREDICT_AVERAGE:
+                for (uint32_t x = 1; x < MEGS_IMAGE_WIDTH; ++x) {
+                    row[x] = static_cast<uint16_t>(((row[x - 1] + up[x] + 1) >> 1) + unfold(folded[x]));
+                }
+                break;
+            default:
+                for (uint32_t x = 1; x < MEGS_IMAGE_WIDTH; ++x) {
+                    row[x] = static_cast<uint16_t>(row[x - 1] + unfold(folded[x]));
+                }
+                break;
+        }
+    }
+    return !reader.overrun();
+}
+
+MegsCodecHeader makeHeader() {
+    MegsCodecHeader header = {};
+    std::memcpy(header.magic, MEGS_CODEC_MAGIC, sizeof(header.magic));
+    header.version = MEGS_CODEC_VERSION;
+    header.width = MEGS_IMAGE_WIDTH;
+    header.height = MEGS_IMAGE_HEIGHT;
+    header.rowsPerBand = MEGS_CODEC_ROWS_PER_BAND;
+    header.bands = MEGS_CODEC_BANDS;
+    return header;
+}
+
+} // namespace
+
+void MegsCodec::encode(const uint16_t (&image)[MEGS_IMAGE_HEIGHT][MEGS_IMAGE_WIDTH], std::vector<uint8_t>& encoded) {
+    std::vector<std::vector<uint8_t>> streams(MEGS_CODEC_BANDS);
+    #pragma omp parallel for schedule(dynamic)
+    for (uint32_t band = 0; band < MEGS_CODEC_BANDS; ++band) {
+        streams[band].reserve(MEGS_CODEC_ROWS_PER_BAND * MEGS_IMAGE_WIDTH);
+        encodeBand(image, band, streams[band]);
+    }
+
+    MegsCodecHeader header = makeHeader();
+    size_t total = sizeof(header) + MEGS_CODEC_BANDS * sizeof(uint32_t);
+    for (const std::vector<uint8_t>& stream : streams) {
+        total += stream.size();
+    }
+    encoded.resize(total);
+    uint8_t* out = encoded.data();
+    std::memcpy(out, &header, sizeof(header));
+    out += sizeof(header);
+    for (const std::vector<uint8_t>& stream : streams) {
+        uint32_t bytes = static_cast<uint32_t>(stream.size());
+        std::memcpy(out, &bytes, sizeof(bytes));
+        out += sizeof(bytes);
+    }
+    for (const std::vector<uint8_t>& stream : streams) {
+        std::memcpy(out, stream.data(), stream.size());
+        out += stream.size();
+    }
+}
+
+bool MegsCodec::isEncoded(const uint8_t* data, size_t bytes) {
+    return (bytes >= sizeof(MegsCodecHeader)) && (std::memcmp(data, MEGS_CODEC_MAGIC, sizeof(MEGS_CODEC_MAGIC)) == 0);
+}
+
+bool MegsCodec::decode(const uint8_t* data, size_t bytes, uint16_t (&image)[MEGS_IMAGE_HEIGHT][MEGS_IMAGE_WIDTH], std::string& error) {
+    const size_t tableEnd = sizeof(MegsCodecHeader) + MEGS_CODEC_BANDS * sizeof(uint32_t);
+    if (!isEncoded(data, bytes) || (bytes < tableEnd)) {
+        error = "not a MEGS codec image";
+        return false;
+    }
+    MegsCodecHeader header;
+    std::memcpy(&header, data, sizeof(header));
+    MegsCodecHeader expected = makeHeader();
+    if ((header.version != expected.version) || (header.width != expected.width) || (header.height != expected.height) ||
+        (header.rowsPerBand != expected.rowsPerBand) || (header.bands != expected.bands)) {
+        error = "unsupported MEGS codec version " + std::to_string(header.version) + " or image layout";
+        return false;
+    }
+
+    std::vector<size_t> offsets(MEGS_CODEC_BANDS + 1, tableEnd);
+    for (uint32_t band = 0; band < MEGS_CODEC_BANDS; ++band) {
+        uint32_t bandBytes;
+        std::memcpy(&bandBytes, data + sizeof(header) + band * sizeof(uint32_t), sizeof(bandBytes));
+        offsets[band + 1] = offsets[band] + bandBytes;
+    }
+    if (offsets.back() != bytes) {
+        error = "MEGS codec image is " + std::to_string(bytes) + " bytes, its bands need " + std::to_string(offsets.back());
+        return false;
+    }
+
+    std::vector<char> decoded(MEGS_CODEC_BANDS, 0);
+    #pragma omp parallel for schedule(dynamic)
+    for (uint32_t band = 0; band < MEGS_CODEC_BANDS; ++band) {
+        decoded[band] = decodeBand(data + offsets[band], offsets[band + 1] - offsets[band], band, image) ? 1 : 0;
+    }
+    auto bad = std::find(decoded.begin(), decoded.end(), 0);
+    if (bad != decoded.end()) {
+        error = "MEGS codec band " + std::to_string(bad - decoded.begin()) + " is corrupt";
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,62 @@
+#ifndef MEGS_CODEC_HPP
+#define MEGS_CODEC_HPP
+
+// Lossless codec for MEGS_IMAGE_REC::image, smaller than gzip on CCD spectra and many times faster (see megs_codec).
+// The image is cut into bands of MEGS_CODEC_ROWS_PER_BAND rows, coded independently on OpenMP threads.
+// No band crosses the top/bottom half split, the halves are read out by separate amplifiers.
+// Each row is predicted from its left or upper neighbour, their MED (median edge detector) as in LOCO-I,
+// or their mean. The encoder tries all four on SSE2 and keeps the one with the smallest residuals for that row.
+// The first row of a band has no upper row and is predicted from the left.
+// Residuals are taken mod 2^16, so any 16 bit pixel round trips. They are folded to unsigned and Rice
+// coded in blocks of MEGS_CODEC_BLOCK pixels, each block with its own parameter, as in cfitsio's RICE_1.
+// A band that would not get smaller is stored raw, so noise costs only the header.
+//
+// Layout: MegsCodecHeader, then the byte count of each band, then the band bit streams one after another.
+
+#include "eve_l0b.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+constexpr char MEGS_CODEC_MAGIC[8] = {'E', 'V', 'E', 'M', 'G', 'C', '1', '\0'};
+constexpr uint32_t MEGS_CODEC_VERSION = 1;
+constexpr uint32_t MEGS_CODEC_ROWS_PER_BAND = 64;
+constexpr uint32_t MEGS_CODEC_BANDS = MEGS_IMAGE_HEIGHT / MEGS_CODEC_ROWS_PER_BAND;
+constexpr uint32_t MEGS_CODEC_BLOCK = 32;   // pixels sharing one Rice parameter
+
+static_assert((MEGS_IMAGE_HEIGHT / 2) % MEGS_CODEC_ROWS_PER_BAND == 0, "a band may not cross the half split");
+static_assert(MEGS_IMAGE_WIDTH % MEGS_CODEC_BLOCK == 0, "rows are whole Rice blocks");
+
+enum MegsPredictor : uint8_t {
+    MEGS_PREDICT_LEFT = 0,
+    MEGS_PREDICT_UP = 1,
+    MEGS_PREDICT_MED = 2,
+    MEGS_PREDICT_AVERAGE = 3,   // rounded mean of left and up, the best of the four on noise-dominated rows
+};
+
+struct MegsCodecHeader {
+    char magic[8];
+    uint32_t version;
+    uint16_t width;
+    uint16_t height;
+    uint16_t rowsPerBand;
+    uint16_t bands;
+    uint8_t reserved[12];
+};
+
+static_assert(sizeof(MegsCodecHeader) == 32, "the codec header is part of the format");
+
+class MegsCodec {
+public:
+    // replaces encoded with the coded image
+    static void encode(const uint16_t (&image)[MEGS_IMAGE_HEIGHT][MEGS_IMAGE_WIDTH], std::vector<uint8_t>& encoded);
+    // false with error set if the data is not a complete coded image, the image is then undefined
+    static bool decode(const uint8_t* data, size_t bytes, uint16_t (&image)[MEGS_IMAGE_HEIGHT][MEGS_IMAGE_WIDTH], std::string& error);
+
+    // true if data starts with a codec header, to tell coded images from raw ones
+    static bool isEncoded(const uint8_t* data, size_t bytes);
+};
+
+#endif // MEGS_CODEC_HPP
@@ -0,0 +1,403 @@
+#include "MegsDark.hpp"
+#include "LogFileWriter.hpp"
+#include "MegsCodec.hpp"
+#include "PathService.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <dirent.h>
+#include <iostream>
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+namespace {
+
+constexpr uint16_t SATURATED_DN = 0x3fff;
+constexpr float MAD_TO_SIGMA = 1.4826f;   // sigma of a normal distribution from its median absolute deviation
+constexpr const char* DARK_FILE_SUFFIX = ".mgd";
+
+// sums += frame, 16 bit pixels widened to the 32 bit sums
+void addFrame(const uint16_t* frame, uint32_t* sums) {
+    size_t i = 0;
+#if defined(__SSE2__)
+    const __m128i zero = _mm_setzero_si128();
+    for (; i + 8 <= MEGS_TOTAL_PIXELS; i += 8) {
+        __m128i values = _mm_loadu_si128(reinterpret_cast<const __m128i*>(frame + i));
+        __m128i* out = reinterpret_cast<__m128i*>(sums + i);
+        _mm_storeu_si128(out, _mm_add_epi32(_mm_loadu_si128(out), _mm_unpacklo_epi16(values, zero)));
+        _mm_storeu_si128(out + 1, _mm_add_epi32(_mm_loadu_si128(out + 1), _mm_unpackhi_epi16(values, zero)));
+    }
+#endif
+    for (; i < MEGS_TOTAL_PIXELS; ++i) {
+        sums[i] += frame[i];
+    }
+}
+
+// median of values[0, count), which are reordered
+uint16_t median(uint16_t* values, uint16_t count) {
+    std::sort(values, values + count);
+    return (count % 2) ? values[count / 2] : static_cast<uint16_t>((values[count / 2 - 1] + values[count / 2] + 1) / 2);
+}
+
+// median of the frames within MEGS_DARK_CLIP_SIGMA of their median, sigma estimated from the median absolute deviation
+uint16_t clippedMedian(const uint16_t* frames, uint16_t count, size_t pixel) {
+    uint16_t values[MEGS_DARK_MAX_FRAMES];
+    uint16_t deviations[MEGS_DARK_MAX_FRAMES];
+    for (uint16_t f = 0; f < count; ++f) {
+        values[f] = frames[f * static_cast<size_t>(MEGS_TOTAL_PIXELS) + pixel];
+    }
+    const int32_t center = median(values, count);
+    for (uint16_t f = 0; f < count; ++f) {
+        deviations[f] = static_cast<uint16_t>(std::abs(values[f] - center));
+    }
+    const float limit = MEGS_DARK_CLIP_SIGMA * MAD_TO_SIGMA * median(deviations, count);
+    uint16_t kept = 0;
+    for (uint16_t f = 0; f < count; ++f) {
+        if (std::abs(values[f] - center) <= limit) {
+            values[kept++] = values[f];
+        }
+    }
+    return median(values, kept);   // at least half the values are within one MAD of the median
+}
+
+} // namespace
+
+MegsDarkKey megsDarkKey(uint16_t apid, uint32_t integration, float cebTemperature) {
+    MegsDarkKey key;
+    key.apid = apid;
+    key.integration = integration;
+    key.temperatureBin = static_cast<int16_t>(std::floor(cebTemperature / MEGS_DARK_TEMPERATURE_BIN_C));
+    return key;
+}
+
+void subtractMegsDark(const uint16_t* image, const uint16_t* dark, uint16_t* out, size_t pixels) {
+    size_t i = 0;
+#if defined(__SSE2__)
+    const __m128i mask = _mm_set1_epi16(SATURATED_DN);
+    for (; i + 8 <= pixels; i += 8) {
+        __m128i values = _mm_and_si128(_mm_loadu_si128(reinterpret_cast<const __m128i*>(image + i)), mask);
+        __m128i saturated = _mm_cmpeq_epi16(values, mask);
+        __m128i difference = _mm_subs_epu16(values, _mm_loadu_si128(reinterpret_cast<const __m128i*>(dark + i)));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(out + i),
+            _mm_or_si128(_mm_and_si128(saturated, mask), _mm_andnot_si128(saturated, difference)));
+    }
+#endif
+    for (; i < pixels; ++i) {
+        uint16_t value = image[i] & SATURATED_DN;
+        out[i] = (value == SATURATED_DN) ? SATURATED_DN : ((value > dark[i]) ? static_cast<uint16_t>(value - dark[i]) : 0);
+    }
+}
+
+MegsDarkLibrary& MegsDarkLibrary::getInstance() {
+    static MegsDarkLibrary instance;
+    return instance;
+}
+
+// builds what is still queued before it stops, so a dark finished at exit is still saved
+MegsDarkLibrary::~MegsDarkLibrary() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    queuedCondition.notify_all();
+    if (builder.joinable()) {
+        builder.join();
+    }
+}
+
+std::string MegsDarkLibrary::filename(const MegsDarkKey& key) {
+    char name[64];
+    std::snprintf(name, sizeof(name), "%s_DARK_I%u_T%+dC%s", (key.apid == MEGSA_APID) ? "MA" : "MB", key.integration,
+        static_cast<int>(key.temperatureBin * MEGS_DARK_TEMPERATURE_BIN_C), DARK_FILE_SUFFIX);
+    return name;
+}
+
+// written to a temporary name and renamed, so a dark file is never seen half written
+bool MegsDarkLibrary::save(const MegsDarkFrame& dark, const std::string& path, std::string& error) {
+    std::vector<uint8_t> encoded;
+    MegsCodec::encode(dark.image, encoded);
+
+    MegsDarkFileHeader header = {};
+    std::memcpy(header.magic, MEGS_DARK_MAGIC, sizeof(header.magic));
+    header.version = MEGS_DARK_VERSION;
+    header.apid = dark.key.apid;
+    header.temperatureBin = dark.key.temperatureBin;
+    header.integration = dark.key.integration;
+    header.mode = dark.mode;
+    header.frames = dark.frames;
+    header.tai_time_seconds = dark.tai_time_seconds;
+    header.encodedBytes = static_cast<uint32_t>(encoded.size());
+
+    std::string tmpName = path + ".tmp";
+    FILE* file = std::fopen(tmpName.c_str(), "wb");
+    if (file == nullptr) {
+        error = "cannot create " + tmpName;
+        return false;
+    }
+    bool ok = (std::fwrite(&header, sizeof(header), 1, file) == 1) &&
+              (std::fwrite(encoded.data(), 1, encoded.size(), file) == encoded.size());
+    ok = (std::fclose(file) == 0) && ok;
+    if (!ok || (std::rename(tmpName.c_str(), path.c_str()) != 0)) {
+        std::remove(tmpName.c_str());
+        error = "cannot write " + path;
+        return false;
+    }
+    return true;
+}
+
+bool MegsDarkLibrary::read(const std::string& path, MegsDarkFrame& dark, std::string& error) {
+    FILE* file = std::fopen(path.c_str(), "rb");
+    if (file == nullptr) {
+        error = "cannot open " + path;
+        return false;
+    }
+    MegsDarkFileHeader header = {};
+    std::vector<uint8_t> encoded;
+    bool ok = (std::fread(&header, sizeof(header), 1, file) == 1) &&
+              (std::memcmp(header.magic, MEGS_DARK_MAGIC, sizeof(header.magic)) == 0) && (header.version == MEGS_DARK_VERSION);
+    if (ok) {
+        encoded.resize(header.encodedBytes);
+        ok = (std::fread(encoded.data(), 1, encoded.size(), file) == encoded.size());
+    }
+    std::fclose(file);
+    if (!ok) {
+        error = path + " is not a version " + std::to_string(MEGS_DARK_VERSION) + " dark file";
+        return false;
+    }
+    if (!MegsCodec::decode(encoded.data(), encoded.size(), dark.image, error)) {
+        error = path + ": " + error;
+        return false;
+    }
+    dark.key.apid = header.apid;
+    dark.key.temperatureBin = header.temperatureBin;
+    dark.key.integration = header.integration;
+    dark.mode = static_cast<MegsDarkMode>(header.mode);
+    dark.frames = header.frames;
+    dark.tai_time_seconds = header.tai_time_seconds;
+    return true;
+}
+
+size_t MegsDarkLibrary::load(const std::string& newDirectory) {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        directory = newDirectory;
+    }
+    DIR* dir = opendir(newDirectory.c_str());
+    if (dir == nullptr) {
+        return 0;
+    }
+    std::vector<std::string> names;
+    while (struct dirent* entry = readdir(dir)) {
+        std::string name = entry->d_name;
+        if ((name.size() > std::strlen(DARK_FILE_SUFFIX)) &&
+            (name.compare(name.size() - std::strlen(DARK_FILE_SUFFIX), std::string::npos, DARK_FILE_SUFFIX) == 0)) {
+            names.push_back(name);
+        }
+    }
+    closedir(dir);
+
+    size_t loaded = 0;
+    for (const std::string& name : names) {
+        std::shared_ptr<MegsDarkFrame> dark(new MegsDarkFrame);
+        std::string error;
+        if (!read(newDirectory + name, *dark, error)) {
+            LogFileWriter::getInstance().logError("MegsDarkLibrary::load {}", error);
+            continue;
+        }
+        insert(dark);
+        ++loaded;
+    }
+    LogFileWriter::getInstance().logInfo("MegsDarkLibrary loaded {} dark frames from {}", loaded, newDirectory);
+    return loaded;
+}
+
+void MegsDarkLibrary::startCollecting(uint16_t apid, uint16_t frames, MegsDarkMode mode) {
+    std::lock_guard<std::mutex> lock(mutex);
+    Collection& collection = collections[channelIndex(apid)];
+    collection = Collection();
+    collection.wanted = std::max<uint16_t>(1, std::min(frames, MEGS_DARK_MAX_FRAMES));
+    collection.mode = mode;
+    LogFileWriter::getInstance().logInfo("collecting a {} frame {} dark for APID {}", collection.wanted,
+        (mode == MEGS_DARK_MEAN) ? "mean" : "clipped median", apid);
+}
+
+void MegsDarkLibrary::stopCollecting(uint16_t apid) {
+    std::lock_guard<std::mutex> lock(mutex);
+    collections[channelIndex(apid)] = Collection();
+}
+
+void MegsDarkLibrary::collectionProgress(uint16_t apid, uint16_t& added, uint16_t& wanted) {
+    std::lock_guard<std::mutex> lock(mutex);
+    added = collections[channelIndex(apid)].added;
+    wanted = collections[channelIndex(apid)].wanted;
+}
+
+void MegsDarkLibrary::addImage(const MEGS_IMAGE_REC& image, const MegsDarkKey& key) {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        Collection& collection = collections[channelIndex(key.apid)];
+        if (collection.wanted == 0) {
+            return;
+        }
+        if ((collection.added > 0) && (collection.key != key)) {
+            LogFileWriter::getInstance().logInfo("APID {} integration or CEB temperature changed, restarting the dark", key.apid);
+            collection.added = 0;
+        }
+        if (collection.added == 0) {
+            collection.key = key;
+            collection.firstTai = image.tai_time_seconds;
+            if (collection.mode == MEGS_DARK_MEAN) {
+                collection.sums.reset(new uint32_t[MEGS_TOTAL_PIXELS]());
+            } else if (!collection.frames) {
+                collection.frames.reset(new uint16_t[static_cast<size_t>(collection.wanted) * MEGS_TOTAL_PIXELS]);
+            }
+        }
+
+        if (collection.mode == MEGS_DARK_MEAN) {
+            addFrame(&image.image[0][0], collection.sums.get());
+        } else {
+            std::memcpy(collection.frames.get() + static_cast<size_t>(collection.added) * MEGS_TOTAL_PIXELS, image.image, sizeof(image.image));
+        }
+        if (++collection.added < collection.wanted) {
+            return;
+        }
+        // the packet thread only queues it, MEGS-A and MEGS-B darks collected together build one after the other
+        finishedCollections.push_back(std::move(collection));
+        collection = Collection();
+        if (!builder.joinable()) {
+            builder = std::thread(&MegsDarkLibrary::runBuilder, this);
+        }
+    }
+    queuedCondition.notify_one();
+}
+
+void MegsDarkLibrary::runBuilder() {
+    std::unique_lock<std::mutex> lock(mutex);
+    while (true) {
+        queuedCondition.wait(lock, [this]() { return stopping || !finishedCollections.empty(); });
+        if (finishedCollections.empty()) {
+            return;
+        }
+        Collection collection = std::move(finishedCollections.front());
+        finishedCollections.pop_front();
+        building = true;
+        // build takes the mutex itself
+        lock.unlock();
+        build(std::move(collection));
+        lock.lock();
+        building = false;
+        builtCondition.notify_all();
+    }
+}
+
+void MegsDarkLibrary::build(Collection collection) {
+    std::shared_ptr<MegsDarkFrame> dark(new MegsDarkFrame);
+    dark->key = collection.key;
+    dark->mode = collection.mode;
+    dark->frames = collection.added;
+    dark->tai_time_seconds = collection.firstTai;
+    uint16_t* out = &dark->image[0][0];
+    const uint32_t frames = collection.added;
+
+    #pragma omp parallel for
+    for (uint32_t y = 0; y < MEGS_IMAGE_HEIGHT; ++y) {
+        for (size_t i = y * size_t(MEGS_IMAGE_WIDTH); i < (y + 1) * size_t(MEGS_IMAGE_WIDTH); ++i) {
+            out[i] = (collection.mode == MEGS_DARK_MEAN) ? static_cast<uint16_t>((collection.sums[i] + frames / 2) / frames)
+                                                         : clippedMedian(collection.frames.get(), collection.added, i);
+        }
+    }
+
+    std::string path;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (!directory.empty()) {
+            path = directory + filename(dark->key);
+        }
+    }
+    std::string error;
+    if (!path.empty()) {
+        if (!PathService::getInstance().ensureDirectory(path.substr(0, path.rfind('/')))) {
+            error = "could not create the directory for " + path;
+        }
+        if (!error.empty() || !save(*dark, path, error)) {
+            LogFileWriter::getInstance().logError("MegsDarkLibrary: {}", error);
+        }
+    }
+    insert(dark);
+    LogFileWriter::getInstance().logInfo("new dark {} from {} frames", filename(dark->key), dark->frames);
+    std::cout << "New MEGS dark " << filename(dark->key) << " from " << dark->frames << " frames" << std::endl;
+}
+
+void MegsDarkLibrary::waitForBuild() {
+    std::unique_lock<std::mutex> lock(mutex);
+    builtCondition.wait(lock, [this]() { return finishedCollections.empty() && !building; });
+}
+
+void MegsDarkLibrary::setCurrentKey(const MegsDarkKey& key) {
+    std::lock_guard<std::mutex> lock(mutex);
+    currentKeys[channelIndex(key.apid)] = key;
+}
+
+void MegsDarkLibrary::setEnabled(uint16_t apid, bool enabled) {
+    enabledFlags[channelIndex(apid)].store(enabled, std::memory_order_relaxed);
+}
+
+bool MegsDarkLibrary::enabled(uint16_t apid) const {
+    return enabledFlags[channelIndex(apid)].load(std::memory_order_relaxed);
+}
+
+std::shared_ptr<const MegsDarkFrame> MegsDarkLibrary::active(uint16_t apid) {
+    if (!enabled(apid)) {
+        return nullptr;
+    }
+    std::lock_guard<std::mutex> lock(mutex);
+    return findLocked(currentKeys[channelIndex(apid)]);
+}
+
+std::shared_ptr<const MegsDarkFrame> MegsDarkLibrary::find(const MegsDarkKey& key) {
+    std::lock_guard<std::mutex> lock(mutex);
+    return findLocked(key);
+}
+
+std::shared_ptr<const MegsDarkFrame> MegsDarkLibrary::findLocked(const MegsDarkKey& key) const {
+    std::shared_ptr<const MegsDarkFrame> nearest;
+    int nearestDistance = MEGS_DARK_MAX_BIN_DISTANCE + 1;
+    for (const std::shared_ptr<const MegsDarkFrame>& dark : darks) {
+        if ((dark->key.apid != key.apid) || (dark->key.integration != key.integration)) {
+            continue;
+        }
+        int distance = std::abs(dark->key.temperatureBin - key.temperatureBin);
+        if (distance < nearestDistance) {
+            nearest = dark;
+            nearestDistance = distance;
+        }
+    }
+    return nearest;
+}
+
+void MegsDarkLibrary::insert(std::shared_ptr<const MegsDarkFrame> dark) {
+    std::lock_guard<std::mutex> lock(mutex);
+    for (std::shared_ptr<const MegsDarkFrame>& existing : darks) {
+        if (existing->key == dark->key) {
+            existing = std::move(dark);
+            return;
+        }
+    }
+    darks.push_back(std::move(dark));
+}
+
+void MegsDarkLibrary::reset() {
+    waitForBuild();
+    std::lock_guard<std::mutex> lock(mutex);
+    darks.clear();
+    for (size_t channel = 0; channel < 2; ++channel) {
+        collections[channel] = Collection();
+        currentKeys[channel] = MegsDarkKey();
+        enabledFlags[channel].store(false, std::memory_order_relaxed);
+    }
+    directory.clear();
+}
@@ -0,0 +1,152 @@
+#ifndef MEGS_DARK_HPP
+#define MEGS_DARK_HPP
+
+// Dark frames for MEGS-A/B, one per channel, integration register and CEB temperature bin.
+// A dark is made from the next N complete images of a channel, either the per-pixel mean of 32 bit sums
+// added on SSE2 or a sigma-clipped median that drops cosmic ray hits. The packet thread only adds or
+// copies each image, the dark itself is built on one builder thread, in the order collections finish, saved under <eve_data_root>/darks/
+// coded with MegsCodec, and loaded again at start up.
+// While subtraction is enabled for a channel, the dark matching its current integration register (SHK)
+// and CEB temperature is applied with subtractMegsDark, a saturating SSE2 subtract, to the rows the GUI,
+// the spectrum extraction and the quicklook server read anyway, so none of them keeps its own dark.
+
+#include "eve_l0b.hpp"
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+constexpr uint16_t MEGS_DARK_MAX_FRAMES = 16;        // a median keeps every frame, 4 MB each
+constexpr uint16_t MEGS_DARK_DEFAULT_FRAMES = 8;
+constexpr float MEGS_DARK_TEMPERATURE_BIN_C = 2.0f;
+constexpr int16_t MEGS_DARK_MAX_BIN_DISTANCE = 1;    // the dark of a neighbouring bin stands in when there is none for the bin
+constexpr float MEGS_DARK_CLIP_SIGMA = 3.0f;
+constexpr char MEGS_DARK_MAGIC[8] = {'E', 'V', 'E', 'D', 'R', 'K', '1', '\0'};
+constexpr uint32_t MEGS_DARK_VERSION = 1;
+
+enum MegsDarkMode : uint8_t {
+    MEGS_DARK_MEAN = 0,
+    MEGS_DARK_CLIPPED_MEDIAN = 1,   // median of the frames within MEGS_DARK_CLIP_SIGMA of the median
+};
+
+struct MegsDarkKey {
+    uint16_t apid = 0;
+    int16_t temperatureBin = 0;     // floor(CEB temperature / MEGS_DARK_TEMPERATURE_BIN_C)
+    uint32_t integration = 0;       // MEGSA_Integration_Register or MEGSB_Integration_Register from SHK
+
+    bool operator==(const MegsDarkKey& other) const {
+        return (apid == other.apid) && (temperatureBin == other.temperatureBin) && (integration == other.integration);
+    }
+    bool operator!=(const MegsDarkKey& other) const { return !(*this == other); }
+};
+
+MegsDarkKey megsDarkKey(uint16_t apid, uint32_t integration, float cebTemperature);
+
+struct MegsDarkFrame {
+    MegsDarkKey key;
+    MegsDarkMode mode = MEGS_DARK_MEAN;
+    uint16_t frames = 0;
+    uint32_t tai_time_seconds = 0;  // first image in the dark
+    alignas(16) uint16_t image[MEGS_IMAGE_HEIGHT][MEGS_IMAGE_WIDTH];
+};
+
+// Layout of a dark file: this header, then encodedBytes of MegsCodec stream
+struct MegsDarkFileHeader {
+    char magic[8];
+    uint32_t version;
+    uint16_t apid;
+    int16_t temperatureBin;
+    uint32_t integration;
+    uint8_t mode;
+    uint8_t reserved;
+    uint16_t frames;
+    uint32_t tai_time_seconds;
+    uint32_t encodedBytes;
+};
+
+static_assert(sizeof(MegsDarkFileHeader) == 32, "the dark file header is part of the format");
+
+// out = image - dark, clamped at 0, except that pixels saturated in image (0x3fff) stay saturated.
+// Pixels are masked to 14 bits first. out may be image.
+void subtractMegsDark(const uint16_t* image, const uint16_t* dark, uint16_t* out, size_t pixels);
+
+class MegsDarkLibrary {
+public:
+    static MegsDarkLibrary& getInstance();
+
+    // reads every dark file in directory, which ends with a slash, and saves new darks there, returns the number read
+    size_t load(const std::string& directory);
+    // e.g. MA_DARK_I10_T+24C.mgd for a MEGS-A dark of integration register 10 between 24 and 26 C
+    static std::string filename(const MegsDarkKey& key);
+    static bool save(const MegsDarkFrame& dark, const std::string& path, std::string& error);
+    static bool read(const std::string& path, MegsDarkFrame& dark, std::string& error);
+
+    // the next frames complete images of the channel make a dark, a change of key starts over
+    void startCollecting(uint16_t apid, uint16_t frames, MegsDarkMode mode);
+    void stopCollecting(uint16_t apid);
+    // frames added so far and asked for, both 0 when the channel is not collecting
+    void collectionProgress(uint16_t apid, uint16_t& added, uint16_t& wanted);
+    // packet thread, each complete image written, ignored unless the channel is collecting
+    void addImage(const MEGS_IMAGE_REC& image, const MegsDarkKey& key);
+    // blocks until every finished collection is built and in the library, never called on the packet thread
+    void waitForBuild();
+
+    // packet thread, at the start of each image
+    void setCurrentKey(const MegsDarkKey& key);
+    void setEnabled(uint16_t apid, bool enabled);
+    bool enabled(uint16_t apid) const;
+    // the dark for the channel's current key while subtraction is enabled, nullptr otherwise
+    std::shared_ptr<const MegsDarkFrame> active(uint16_t apid);
+    // the dark for the key, or the nearest within MEGS_DARK_MAX_BIN_DISTANCE bins, nullptr if none
+    std::shared_ptr<const MegsDarkFrame> find(const MegsDarkKey& key);
+    // replaces any dark with the same key
+    void insert(std::shared_ptr<const MegsDarkFrame> dark);
+    // tests, waits for the builder then forgets every dark, collection, key and the save directory
+    void reset();
+
+private:
+    MegsDarkLibrary() = default;
+    ~MegsDarkLibrary();
+    MegsDarkLibrary(const MegsDarkLibrary&) = delete;
+    MegsDarkLibrary& operator=(const MegsDarkLibrary&) = delete;
+
+    struct Collection {
+        uint16_t wanted = 0;
+        uint16_t added = 0;
+        MegsDarkMode mode = MEGS_DARK_MEAN;
+        MegsDarkKey key;
+        uint32_t firstTai = 0;
+        std::unique_ptr<uint32_t[]> sums;    // mean, MEGS_TOTAL_PIXELS
+        std::unique_ptr<uint16_t[]> frames;  // clipped median, wanted * MEGS_TOTAL_PIXELS
+    };
+
+    static size_t channelIndex(uint16_t apid) { return (apid == MEGSA_APID) ? 0 : 1; }
+    std::shared_ptr<const MegsDarkFrame> findLocked(const MegsDarkKey& key) const;
+    // builds, saves and inserts the dark on the builder thread
+    void build(Collection collection);
+    // takes finished collections off the queue until the library is destroyed
+    void runBuilder();
+
+    std::mutex mutex;
+    std::vector<std::shared_ptr<const MegsDarkFrame>> darks;
+    Collection collections[2];
+    MegsDarkKey currentKeys[2];
+    std::atomic<bool> enabledFlags[2] = {{false}, {false}};
+    std::string directory;
+
+    std::condition_variable queuedCondition;  // the builder waits for a finished collection
+    std::condition_variable builtCondition;   // waitForBuild waits for the queue to drain
+    std::deque<Collection> finishedCollections;
+    bool building = false;                    // the builder holds a collection taken off the queue
+    bool stopping = false;
+    std::thread builder;
+};
+
+#endif // MEGS_DARK_HPP
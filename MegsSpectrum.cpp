@@ -0,0 +1,194 @@
+#include "MegsSpectrum.hpp"
+#include "MegsDark.hpp"
+#include "commonFunctions.hpp"
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <sstream>
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+namespace {
+
+constexpr uint16_t SATURATED_DN = 0x3fff;
+constexpr uint32_t MIDDLE_COLUMN = MEGS_IMAGE_WIDTH / 2;
+
+// sum of the unsaturated dark pixels scaled to all X_DARK_COLUMNS of them, false if every one is saturated
+bool darkGroupSum(const uint16_t* row, uint32_t firstColumn, int32_t& sum) {
+    int32_t total = 0;
+    int32_t count = 0;
+    for (uint32_t x = firstColumn; x < firstColumn + X_DARK_COLUMNS; ++x) {
+        uint16_t value = row[x] & SATURATED_DN;
+        if (value != SATURATED_DN) {
+            total += value;
+            ++count;
+        }
+    }
+    if (count == 0) {
+        return false;
+    }
+    sum = (count == X_DARK_COLUMNS) ? total : (total * X_DARK_COLUMNS + count / 2) / count;
+    return true;
+}
+
+// adds the unsaturated pixels of columns [first, last) and the dark group sum of their row to each column they are in
+void accumulateColumns(const uint16_t* row, uint32_t first, uint32_t last, int32_t darkSum,
+                       int32_t* pixelSums, int32_t* darkSums, uint16_t* pixels) {
+    uint32_t x = first;
+#if defined(__SSE2__)
+    const __m128i mask = _mm_set1_epi16(SATURATED_DN);
+    const __m128i ones = _mm_set1_epi16(-1);
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i dark = _mm_set1_epi32(darkSum);
+    for (; x + 8 <= last; x += 8) {
+        __m128i values = _mm_and_si128(_mm_loadu_si128(reinterpret_cast<const __m128i*>(row + x)), mask);
+        __m128i valid = _mm_xor_si128(_mm_cmpeq_epi16(values, mask), ones);
+        values = _mm_and_si128(values, valid);
+        __m128i validLow = _mm_unpacklo_epi16(valid, valid);
+        __m128i validHigh = _mm_unpackhi_epi16(valid, valid);
+
+        __m128i* sums = reinterpret_cast<__m128i*>(pixelSums + x);
+        _mm_store_si128(sums, _mm_add_epi32(_mm_load_si128(sums), _mm_unpacklo_epi16(values, zero)));
+        _mm_store_si128(sums + 1, _mm_add_epi32(_mm_load_si128(sums + 1), _mm_unpackhi_epi16(values, zero)));
+        __m128i* darks = reinterpret_cast<__m128i*>(darkSums + x);
+        _mm_store_si128(darks, _mm_add_epi32(_mm_load_si128(darks), _mm_and_si128(dark, validLow)));
+        _mm_store_si128(darks + 1, _mm_add_epi32(_mm_load_si128(darks + 1), _mm_and_si128(dark, validHigh)));
+        // valid lanes are -1, so subtracting counts them
+        __m128i* counts = reinterpret_cast<__m128i*>(pixels + x);
+        _mm_store_si128(counts, _mm_sub_epi16(_mm_load_si128(counts), valid));
+    }
+#endif
+    for (; x < last; ++x) {
+        uint16_t value = row[x] & SATURATED_DN;
+        if (value != SATURATED_DN) {
+            pixelSums[x] += value;
+            darkSums[x] += darkSum;
+            ++pixels[x];
+        }
+    }
+}
+
+} // namespace
+
+bool parseMegsSpectrumRegions(const std::string& text, std::vector<MegsSpectrumRegion>& regions, std::string& error) {
+    regions.clear();
+    std::stringstream list(text);
+    std::string item;
+    while (std::getline(list, item, ',')) {
+        size_t dash = item.find('-');
+        char* end = nullptr;
+        long firstRow = std::strtol(item.c_str(), &end, 10);
+        bool valid = (dash != std::string::npos) && (end == item.c_str() + dash);
+        long lastRow = valid ? std::strtol(item.c_str() + dash + 1, &end, 10) : 0;
+        valid = valid && (*end == '\0') && (dash + 1 < item.size());
+        if (!valid || (firstRow < 0) || (lastRow < firstRow) || (lastRow >= static_cast<long>(MEGS_IMAGE_HEIGHT))) {
+            error = "spectrum region \"" + item + "\" is not first-last with rows 0 to " + std::to_string(MEGS_IMAGE_HEIGHT - 1);
+            return false;
+        }
+        if (regions.size() == MEGS_SPECTRUM_MAX_REGIONS) {
+            error = "at most " + std::to_string(MEGS_SPECTRUM_MAX_REGIONS) + " spectrum regions";
+            return false;
+        }
+        regions.push_back({static_cast<uint16_t>(firstRow), static_cast<uint16_t>(lastRow)});
+    }
+    if (regions.empty()) {
+        error = "no spectrum regions in \"" + text + "\"";
+        return false;
+    }
+    return true;
+}
+
+void MegsSpectrumAccumulator::start(const std::vector<MegsSpectrumRegion>& newRegions, const uint16_t (*newDark)[MEGS_IMAGE_WIDTH],
+                                    uint16_t newDarkFrames) {
+    regionCount = static_cast<uint16_t>(std::min<size_t>(newRegions.size(), MEGS_SPECTRUM_MAX_REGIONS));
+    dark = newDark;
+    darkFrames = (newDark != nullptr) ? newDarkFrames : 0;
+    std::copy(newRegions.begin(), newRegions.begin() + regionCount, regions);
+    std::memset(rows, 0, sizeof(rows));
+    std::memset(darkLeftSums, 0, sizeof(darkLeftSums));
+    std::memset(darkRightSums, 0, sizeof(darkRightSums));
+    std::memset(darkLeftRows, 0, sizeof(darkLeftRows));
+    std::memset(darkRightRows, 0, sizeof(darkRightRows));
+    // only the regions in use are cleared, finish never reads the others
+    for (uint16_t r = 0; r < regionCount; ++r) {
+        std::memset(pixelSums[r], 0, sizeof(pixelSums[r]));
+        std::memset(darkSums[r], 0, sizeof(darkSums[r]));
+        std::memset(pixels[r], 0, sizeof(pixels[r]));
+    }
+}
+
+// Top row y holds half pixels y * 2048 to y * 2048 + 2047 and is complete with the packet holding the last of them.
+// Bottom row 1023 - y is filled from the same packets.
+void MegsSpectrumAccumulator::addPacketRows(const MEGS_IMAGE_REC& image, uint16_t sourceSequenceCounter) {
+    if ((regionCount == 0) || (sourceSequenceCounter >= N_PKT_PER_IMAGE)) {
+        return;
+    }
+    uint32_t firstRow, lastRow;
+    megsTopRowsForPacket(sourceSequenceCounter, firstRow, lastRow);
+    for (uint32_t y = firstRow; y <= lastRow; ++y) {
+        const uint32_t firstPacket = (y * MEGS_IMAGE_WIDTH) / MEGS_PIXELS_PER_HALF_PACKET;
+        const uint32_t lastPacket = (y * MEGS_IMAGE_WIDTH + MEGS_IMAGE_WIDTH - 1) / MEGS_PIXELS_PER_HALF_PACKET;
+        if (lastPacket != sourceSequenceCounter) {
+            continue;
+        }
+        bool complete = true;
+        for (uint32_t ssc = firstPacket; complete && (ssc <= lastPacket); ++ssc) {
+            complete = isMegsPacketReceived(image, static_cast<uint16_t>(ssc));
+        }
+        if (!complete) {
+            continue;
+        }
+        for (uint32_t row : {y, MEGS_IMAGE_HEIGHT - 1 - y}) {
+            if (dark != nullptr) {
+                subtractMegsDark(image.image[row], dark[row], darkRow, MEGS_IMAGE_WIDTH);
+                addRow(row, darkRow);
+            } else {
+                addRow(row, image.image[row]);
+            }
+        }
+    }
+}
+
+void MegsSpectrumAccumulator::addRow(uint32_t y, const uint16_t* row) {
+    int32_t darkLeft = 0;
+    int32_t darkRight = 0;
+    const bool haveLeft = darkGroupSum(row, X_DARK_START_LEFT, darkLeft);
+    const bool haveRight = darkGroupSum(row, X_DARK_START_RIGHT, darkRight);
+    for (uint16_t r = 0; r < regionCount; ++r) {
+        if ((y < regions[r].firstRow) || (y > regions[r].lastRow)) {
+            continue;
+        }
+        ++rows[r];
+        // a half whose dark pixels are all saturated has no dark to subtract and is left out
+        if (haveLeft) {
+            darkLeftSums[r] += darkLeft;
+            ++darkLeftRows[r];
+            accumulateColumns(row, 0, MIDDLE_COLUMN, darkLeft, pixelSums[r], darkSums[r], pixels[r]);
+        }
+        if (haveRight) {
+            darkRightSums[r] += darkRight;
+            ++darkRightRows[r];
+            accumulateColumns(row, MIDDLE_COLUMN, MEGS_IMAGE_WIDTH, darkRight, pixelSums[r], darkSums[r], pixels[r]);
+        }
+    }
+}
+
+void MegsSpectrumAccumulator::finish(MEGS_SPECTRUM& spectrum) const {
+    spectrum.regions = regionCount;
+    spectrum.darkFrames = darkFrames;
+    for (uint16_t r = 0; r < regionCount; ++r) {
+        spectrum.firstRow[r] = regions[r].firstRow;
+        spectrum.lastRow[r] = regions[r].lastRow;
+        spectrum.rows[r] = rows[r];
+        spectrum.darkLeft[r] = darkLeftRows[r] ? static_cast<float>(darkLeftSums[r]) / (X_DARK_COLUMNS * darkLeftRows[r]) : 0.0f;
+        spectrum.darkRight[r] = darkRightRows[r] ? static_cast<float>(darkRightSums[r]) / (X_DARK_COLUMNS * darkRightRows[r]) : 0.0f;
+        for (uint32_t x = 0; x < MEGS_IMAGE_WIDTH; ++x) {
+            const uint16_t count = pixels[r][x];
+            spectrum.pixels[r][x] = count;
+            spectrum.spectrum[r][x] = count ? static_cast<float>(
+                (static_cast<double>(pixelSums[r][x]) - static_cast<double>(darkSums[r][x]) / X_DARK_COLUMNS) / count) : 0.0f;
+        }
+    }
+}
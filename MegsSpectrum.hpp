@@ -0,0 +1,78 @@
+#ifndef MEGS_SPECTRUM_HPP
+#define MEGS_SPECTRUM_HPP
+
+// 1-D spectra of MEGS images, one per slit region of image rows, extracted while the image is assembled.
+// A row is added once the packet holding its last pixel arrives and every packet it spans was received,
+// so each packet adds at most one top and one bottom row and an image never costs a pass at its end.
+// Each pixel has the dark of its half of the row subtracted, the mean of the X_DARK_COLUMNS dark pixels
+// at X_DARK_START_LEFT for columns below the middle and at X_DARK_START_RIGHT for the rest.
+// Saturated pixels (0x3fff) are left out of their column, PIXELS says how many were used.
+// With a dark frame the row has it subtracted first, the dark columns then remove what drifted since.
+// Sums are integers, so the SSE2 and scalar row loops give the same spectrum.
+
+#include "eve_l0b.hpp"
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+constexpr uint32_t MEGS_SPECTRUM_MAX_REGIONS = 4;
+// the halves are read out by separate amplifiers, so by default each is its own spectrum
+constexpr const char* MEGS_SPECTRUM_DEFAULT_REGIONS = "0-511,512-1023";
+
+// image rows firstRow to lastRow inclusive, in FITS image row order
+struct MegsSpectrumRegion {
+    uint16_t firstRow;
+    uint16_t lastRow;
+};
+
+// The spectra of one image, published to the GUI and written as the MEGSA_SPECTRUM or MEGSB_SPECTRUM table
+struct MEGS_SPECTRUM {
+    uint32_t tai_time_seconds;
+    uint32_t tai_time_subseconds;
+    uint32_t imageCount;
+    uint16_t regions;                                   // regions filled below, 0 before the first image
+    uint16_t darkFrames;                                // frames in the dark frame subtracted, 0 without one
+    uint16_t firstRow[MEGS_SPECTRUM_MAX_REGIONS];
+    uint16_t lastRow[MEGS_SPECTRUM_MAX_REGIONS];
+    uint16_t rows[MEGS_SPECTRUM_MAX_REGIONS];           // complete rows accumulated
+    float darkLeft[MEGS_SPECTRUM_MAX_REGIONS];          // mean DN of the left dark columns
+    float darkRight[MEGS_SPECTRUM_MAX_REGIONS];
+    float spectrum[MEGS_SPECTRUM_MAX_REGIONS][MEGS_IMAGE_WIDTH];    // mean DN above dark of the unsaturated pixels
+    uint16_t pixels[MEGS_SPECTRUM_MAX_REGIONS][MEGS_IMAGE_WIDTH];   // unsaturated pixels in each column
+};
+
+// "first-last[,first-last...]", at most MEGS_SPECTRUM_MAX_REGIONS regions of rows 0 to 1023, regions may overlap
+bool parseMegsSpectrumRegions(const std::string& text, std::vector<MegsSpectrumRegion>& regions, std::string& error);
+
+// Sums of one image being assembled. Only the packet thread touches it.
+class MegsSpectrumAccumulator {
+public:
+    // clears the sums for a new image, a dark frame must stay valid until finish
+    void start(const std::vector<MegsSpectrumRegion>& regions, const uint16_t (*dark)[MEGS_IMAGE_WIDTH] = nullptr,
+               uint16_t darkFrames = 0);
+    // adds the top and bottom rows that end in this packet, if every packet they span is in the image
+    void addPacketRows(const MEGS_IMAGE_REC& image, uint16_t sourceSequenceCounter);
+    // adds image row y to every region holding it
+    void addRow(uint32_t y, const uint16_t* row);
+    // means of the sums, times and image count are left to the caller
+    void finish(MEGS_SPECTRUM& spectrum) const;
+
+private:
+    uint16_t regionCount = 0;
+    const uint16_t (*dark)[MEGS_IMAGE_WIDTH] = nullptr;
+    uint16_t darkFrames = 0;
+    alignas(16) uint16_t darkRow[MEGS_IMAGE_WIDTH] = {};
+    MegsSpectrumRegion regions[MEGS_SPECTRUM_MAX_REGIONS] = {};
+    uint16_t rows[MEGS_SPECTRUM_MAX_REGIONS] = {};
+    // dark sums are of the whole dark group, X_DARK_COLUMNS times the mean, to stay integers
+    int64_t darkLeftSums[MEGS_SPECTRUM_MAX_REGIONS] = {};
+    int64_t darkRightSums[MEGS_SPECTRUM_MAX_REGIONS] = {};
+    uint16_t darkLeftRows[MEGS_SPECTRUM_MAX_REGIONS] = {};
+    uint16_t darkRightRows[MEGS_SPECTRUM_MAX_REGIONS] = {};
+    alignas(16) int32_t pixelSums[MEGS_SPECTRUM_MAX_REGIONS][MEGS_IMAGE_WIDTH] = {};
+    alignas(16) int32_t darkSums[MEGS_SPECTRUM_MAX_REGIONS][MEGS_IMAGE_WIDTH] = {};
+    alignas(16) uint16_t pixels[MEGS_SPECTRUM_MAX_REGIONS][MEGS_IMAGE_WIDTH] = {};
+};
+
+#endif // MEGS_SPECTRUM_HPP
@@ -0,0 +1,338 @@
+#include "MetricsServer.hpp"
+#include "LogFileWriter.hpp"
+#include "PacketStats.hpp"
+#include "ProgramState.hpp"
+#include "QuicklookServer.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <sstream>
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/statvfs.h>
+#include <unistd.h>
+
+extern ProgramState globalState;
+
+namespace {
+
+constexpr size_t MAX_REQUEST_BYTES = 8192;
+
+class MetricsWriter {
+public:
+    void family(const char* name, const char* type, const char* help) {
+        out << "# HELP " << name << " " << help << "\n# TYPE " << name << " " << type << "\n";
+    }
+
+    template <typename T>
+    void sample(const char* name, const std::string& labels, T value) {
+        out << name;
+        if (!labels.empty()) {
+            out << "{" << labels << "}";
+        }
+        out << " " << value << "\n";
+    }
+
+    std::string str() const { return out.str(); }
+
+private:
+    std::ostringstream out;
+};
+
+std::string channelLabel(const char* channel) {
+    return std::string("channel=\"") + channel + "\"";
+}
+
+} // namespace
+
+std::string renderMetrics(const QuicklookServer* quicklook) {
+    MetricsWriter metrics;
+
+    struct PacketChannel {
+        const char* channel;
+        const char* apid;
+        const std::atomic<int64_t>& count;
+    };
+    const PacketChannel packetChannels[] = {
+        {"MA", "601", globalState.packetsReceived.MA},
+        {"MB", "602", globalState.packetsReceived.MB},
+        {"MP", "604", globalState.packetsReceived.MP},
+        {"ESP", "605", globalState.packetsReceived.ESP},
+        {"SHK", "606", globalState.packetsReceived.SHK},
+        {"unknown", "unknown", globalState.packetsReceived.Unknown},
+    };
+    metrics.family("eve_packets_received_total", "counter", "Packets processed per APID");
+    for (const PacketChannel& p : packetChannels) {
+        metrics.sample("eve_packets_received_total", channelLabel(p.channel) + ",apid=\"" + p.apid + "\"",
+            p.count.load(std::memory_order_relaxed));
+    }
+
+    metrics.family("eve_data_gaps_total", "counter", "Source sequence counter gaps");
+    metrics.sample("eve_data_gaps_total", channelLabel("MA"), globalState.dataGapsMA.load(std::memory_order_relaxed));
+    metrics.sample("eve_data_gaps_total", channelLabel("MB"), globalState.dataGapsMB.load(std::memory_order_relaxed));
+    metrics.sample("eve_data_gaps_total", channelLabel("MP"), globalState.dataGapsMP.load(std::memory_order_relaxed));
+    metrics.sample("eve_data_gaps_total", channelLabel("ESP"), globalState.dataGapsESP.load(std::memory_order_relaxed));
+    metrics.sample("eve_data_gaps_total", channelLabel("SHK"), globalState.dataGapsSHK.load(std::memory_order_relaxed));
+
+    metrics.family("eve_parity_errors_total", "counter", "MEGS pixel parity errors");
+    metrics.sample("eve_parity_errors_total", channelLabel("MA"), globalState.parityErrorsMA.load(std::memory_order_relaxed));
+    metrics.sample("eve_parity_errors_total", channelLabel("MB"), globalState.parityErrorsMB.load(std::memory_order_relaxed));
+
+    metrics.family("eve_saturated_pixels", "gauge", "Saturated pixels in the latest finished MEGS image");
+    metrics.sample("eve_saturated_pixels", channelLabel("MA") + ",half=\"top\"", globalState.saturatedPixelsMATop.load(std::memory_order_relaxed));
+    metrics.sample("eve_saturated_pixels", channelLabel("MA") + ",half=\"bottom\"", globalState.saturatedPixelsMABottom.load(std::memory_order_relaxed));
+    metrics.sample("eve_saturated_pixels", channelLabel("MB") + ",half=\"top\"", globalState.saturatedPixelsMBTop.load(std::memory_order_relaxed));
+    metrics.sample("eve_saturated_pixels", channelLabel("MB") + ",half=\"bottom\"", globalState.saturatedPixelsMBBottom.load(std::memory_order_relaxed));
+
+    metrics.family("eve_fits_publish_failures_total", "counter", "FITS products queued but not written to disk");
+    metrics.sample("eve_fits_publish_failures_total", "", globalState.fitsPublishFailures.load(std::memory_order_relaxed));
+
+    metrics.family("eve_megs_images_total", "counter", "MEGS images written, partial ones included");
+    metrics.sample("eve_megs_images_total", channelLabel("MA"), globalState.megsAImageCount.load(std::memory_order_relaxed));
+    metrics.sample("eve_megs_images_total", channelLabel("MB"), globalState.megsBImageCount.load(std::memory_order_relaxed));
+
+    metrics.family("eve_megs_partial_images_total", "counter", "MEGS images written before every packet arrived");
+    metrics.sample("eve_megs_partial_images_total", channelLabel("MA"), globalState.megsAPartialImages.load(std::memory_order_relaxed));
+    metrics.sample("eve_megs_partial_images_total", channelLabel("MB"), globalState.megsBPartialImages.load(std::memory_order_relaxed));
+
+    metrics.family("eve_megs_image_packets", "gauge", "Packets received in the MEGS image being assembled");
+    metrics.sample("eve_megs_image_packets", channelLabel("MA"), globalState.megsAImagePackets.load(std::memory_order_relaxed));
+    metrics.sample("eve_megs_image_packets", channelLabel("MB"), globalState.megsBImagePackets.load(std::memory_order_relaxed));
+
+    metrics.family("eve_megs_last_image_completeness_percent", "gauge", "Percent of packets received in the last MEGS image written");
+    metrics.sample("eve_megs_last_image_completeness_percent", channelLabel("MA"), globalState.megsALastCompleteness.load(std::memory_order_relaxed));
+    metrics.sample("eve_megs_last_image_completeness_percent", channelLabel("MB"), globalState.megsBLastCompleteness.load(std::memory_order_relaxed));
+
+    metrics.family("eve_short_packets_total", "counter", "Short packets received");
+    metrics.sample("eve_short_packets_total", "", globalState.shortPacketCounter.load(std::memory_order_relaxed));
+
+    metrics.family("eve_packets_per_second", "gauge", "Packets read between the last two ESP packets");
+    metrics.sample("eve_packets_per_second", "", globalState.packetsPerSecond.load(std::memory_order_relaxed));
+
+    metrics.family("eve_fpga_register", "gauge", "Opal Kelly GSE status registers");
+    metrics.sample("eve_fpga_register", "reg=\"0\"", globalState.FPGA_reg0.load(std::memory_order_relaxed));
+    metrics.sample("eve_fpga_register", "reg=\"1\"", globalState.FPGA_reg1.load(std::memory_order_relaxed));
+    metrics.sample("eve_fpga_register", "reg=\"2\"", globalState.FPGA_reg2.load(std::memory_order_relaxed));
+    metrics.sample("eve_fpga_register", "reg=\"3\"", globalState.FPGA_reg3.load(std::memory_order_relaxed));
+
+    // PacketStats publishes once per stats interval, the latencies cover that interval only
+    PacketStatsInterval stats;
+    PacketStats::getInstance().readLatest(stats);
+    metrics.family("eve_packet_stats_total", "counter", "PacketStats counters per APID as of the last stats interval");
+    for (int slot = 0; slot < APID_SLOT_COUNT; ++slot) {
+        for (int counter = 0; counter < PACKET_COUNTER_COUNT; ++counter) {
+            metrics.sample("eve_packet_stats_total",
+                channelLabel(PacketStats::slotName(static_cast<ApidSlot>(slot))) +
+                ",counter=\"" + PacketStats::counterName(static_cast<PacketCounter>(counter)) + "\"",
+                stats.totals[slot][counter]);
+        }
+    }
+    metrics.family("eve_stage_latency_microseconds", "gauge", "Stage latency per APID during the last stats interval");
+    for (int slot = 0; slot < APID_SLOT_COUNT; ++slot) {
+        for (int stage = 0; stage < PIPELINE_STAGE_COUNT; ++stage) {
+            const StageLatencySummary& s = stats.latency[slot][stage];
+            if (s.count == 0) {
+                continue;
+            }
+            std::string labels = channelLabel(PacketStats::slotName(static_cast<ApidSlot>(slot))) +
+                ",stage=\"" + StageTimers::stageName(static_cast<PipelineStage>(stage)) + "\"";
+            metrics.sample("eve_stage_latency_microseconds", labels + ",quantile=\"0.5\"", s.p50Microsec);
+            metrics.sample("eve_stage_latency_microseconds", labels + ",quantile=\"0.99\"", s.p99Microsec);
+            metrics.sample("eve_stage_latency_microseconds", labels + ",quantile=\"1\"", s.maxMicrosec);
+        }
+    }
+    metrics.family("eve_stats_interval_seconds", "gauge", "Length of the last PacketStats interval");
+    metrics.sample("eve_stats_interval_seconds", "", stats.intervalSeconds);
+
+    if (quicklook != nullptr) {
+        metrics.family("eve_quicklook_clients", "gauge", "Connected quicklook clients");
+        metrics.sample("eve_quicklook_clients", "", quicklook->getClientCount());
+        metrics.family("eve_quicklook_queued_bytes", "gauge", "Frames queued to quicklook clients and not yet sent");
+        metrics.sample("eve_quicklook_queued_bytes", "", quicklook->getQueuedBytes());
+    }
+
+    const char* dataRoot = std::getenv("eve_data_root");
+    struct statvfs fs;
+    if ((dataRoot != nullptr) && (statvfs(dataRoot, &fs) == 0)) {
+        std::string label = std::string("path=\"") + dataRoot + "\"";
+        metrics.family("eve_disk_free_bytes", "gauge", "Space available to rl0b_main under eve_data_root");
+        metrics.sample("eve_disk_free_bytes", label, uint64_t(fs.f_bavail) * fs.f_frsize);
+        metrics.family("eve_disk_size_bytes", "gauge", "Size of the file system holding eve_data_root");
+        metrics.sample("eve_disk_size_bytes", label, uint64_t(fs.f_blocks) * fs.f_frsize);
+    }
+
+    return metrics.str();
+}
+
+MetricsServer::MetricsServer(const MetricsConfig& config) : config(config) {}
+
+MetricsServer::~MetricsServer() {
+    stop();
+}
+
+bool MetricsServer::start() {
+    listenFd = socket(AF_INET, SOCK_STREAM, 0);
+    if (listenFd < 0) {
+        std::cerr << "MetricsServer error creating socket: " << strerror(errno) << std::endl;
+        LogFileWriter::getInstance().logError("MetricsServer error creating socket: {}", strerror(errno));
+        return false;
+    }
+
+    int opt = 1;
+    setsockopt(listenFd, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt));
+
+    sockaddr_in serverAddr = {};
+    serverAddr.sin_family = AF_INET;
+    serverAddr.sin_addr.s_addr = htonl(config.loopbackOnly ? INADDR_LOOPBACK : INADDR_ANY);
+    serverAddr.sin_port = htons(config.port);
+
+    if ((bind(listenFd, reinterpret_cast<sockaddr*>(&serverAddr), sizeof(serverAddr)) < 0) || (listen(listenFd, 8) < 0)) {
+        std::cerr << "MetricsServer error binding port " << config.port << ": " << strerror(errno) << std::endl;
+        LogFileWriter::getInstance().logError("MetricsServer error binding port {}: {}", config.port, strerror(errno));
+        close(listenFd);
+        listenFd = -1;
+        return false;
+    }
+
+    socklen_t addrLen = sizeof(serverAddr);
+    getsockname(listenFd, reinterpret_cast<sockaddr*>(&serverAddr), &addrLen);
+    boundPort = ntohs(serverAddr.sin_port);
+    fcntl(listenFd, F_SETFL, fcntl(listenFd, F_GETFL, 0) | O_NONBLOCK);
+
+    std::cout << "Metrics server listening on port " << boundPort << std::endl;
+    LogFileWriter::getInstance().logInfo("Metrics server listening on port {}", boundPort);
+
+    stopRequested.store(false);
+    serverThread = std::thread(&MetricsServer::run, this);
+    return true;
+}
+
+void MetricsServer::stop() {
+    stopRequested.store(true);
+    if (serverThread.joinable()) {
+        serverThread.join();
+    }
+    if (listenFd >= 0) {
+        close(listenFd);
+        listenFd = -1;
+    }
+}
+
+void MetricsServer::run() {
+    const int pollTimeoutMs = 100;
+    std::vector<pollfd> fds;
+
+    while (!stopRequested.load(std::memory_order_relaxed) && globalState.running.load(std::memory_order_relaxed)) {
+        fds.clear();
+        fds.push_back({listenFd, POLLIN, 0});
+        for (const Client& client : clients) {
+            fds.push_back({client.fd, static_cast<short>(client.response.empty() ? POLLIN : POLLOUT), 0});
+        }
+
+        if ((poll(fds.data(), fds.size(), pollTimeoutMs) < 0) && (errno != EINTR)) {
+            LogFileWriter::getInstance().logError("MetricsServer poll failed: {}", strerror(errno));
+            break;
+        }
+
+        auto now = std::chrono::steady_clock::now();
+        for (size_t i = 1; i < fds.size(); ++i) {
+            Client& client = clients[i - 1];
+            if (fds[i].revents & (POLLERR | POLLNVAL)) {
+                client.closed = true;
+            } else if (fds[i].revents & POLLOUT) {
+                flushClient(client);
+            } else if (fds[i].revents & (POLLIN | POLLHUP)) {
+                readRequest(client);
+                if (!client.response.empty()) {
+                    flushClient(client); // usually the whole response fits in the socket buffer
+                }
+            }
+            if ((now - client.accepted) >= std::chrono::milliseconds(config.requestTimeoutMs)) {
+                client.closed = true;
+            }
+        }
+        if (fds[0].revents & POLLIN) {
+            acceptClients();
+        }
+
+        auto firstClosed = std::remove_if(clients.begin(), clients.end(), [](const Client& client) {
+            if (client.closed) {
+                close(client.fd);
+            }
+            return client.closed;
+        });
+        clients.erase(firstClosed, clients.end());
+    }
+
+    for (const Client& client : clients) {
+        close(client.fd);
+    }
+    clients.clear();
+}
+
+void MetricsServer::acceptClients() {
+    while (true) {
+        int fd = accept(listenFd, nullptr, nullptr);
+        if (fd < 0) {
+            if ((errno != EAGAIN) && (errno != EWOULDBLOCK) && (errno != EINTR)) {
+                LogFileWriter::getInstance().logError("MetricsServer accept failed: {}", strerror(errno));
+            }
+            return;
+        }
+        fcntl(fd, F_SETFL, fcntl(fd, F_GETFL, 0) | O_NONBLOCK);
+
+        Client client;
+        client.fd = fd;
+        client.accepted = std::chrono::steady_clock::now();
+        clients.push_back(std::move(client));
+    }
+}
+
+// the request is only read to its blank line, its path and headers are ignored
+void MetricsServer::readRequest(Client& client) {
+    char buffer[1024];
+    bool peerClosed = false;
+    while (true) {
+        ssize_t received = recv(client.fd, buffer, sizeof(buffer), 0);
+        if (received > 0) {
+            client.request.append(buffer, received);
+            if (client.request.size() > MAX_REQUEST_BYTES) {
+                client.closed = true;
+                return;
+            }
+            continue;
+        }
+        peerClosed = (received == 0) || ((errno != EAGAIN) && (errno != EWOULDBLOCK) && (errno != EINTR));
+        break;
+    }
+    if ((client.request.find("\r\n\r\n") == std::string::npos) && (client.request.find("\n\n") == std::string::npos)) {
+        client.closed = peerClosed; // closed before finishing its request
+        return;
+    }
+
+    std::string body = renderMetrics(config.quicklook);
+    client.response = "HTTP/1.0 200 OK\r\nContent-Type: text/plain; version=0.0.4\r\nContent-Length: " +
+        std::to_string(body.size()) + "\r\nConnection: close\r\n\r\n" + body;
+    scrapeCount.fetch_add(1, std::memory_order_relaxed);
+}
+
+void MetricsServer::flushClient(Client& client) {
+    while (client.sendOffset < client.response.size()) {
+        ssize_t sent = send(client.fd, client.response.data() + client.sendOffset,
+            client.response.size() - client.sendOffset, MSG_NOSIGNAL);
+        if (sent < 0) {
+            if ((errno != EAGAIN) && (errno != EWOULDBLOCK) && (errno != EINTR)) {
+                client.closed = true;
+            }
+            return;
+        }
+        client.sendOffset += sent;
+    }
+    client.closed = true; // HTTP/1.0, one response per connection
+}
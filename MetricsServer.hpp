@@ -0,0 +1,70 @@
+#ifndef METRICS_SERVER_HPP
+#define METRICS_SERVER_HPP
+
+// Plain-text metrics endpoint for acquisition health, in the Prometheus text exposition format.
+// Every scrape is answered from atomics, SeqlockSnapshot copies and statvfs, never from mtx,
+// so scraping cannot stall the packet thread. Any request path gets the metrics, HTTP/1.0 style,
+// and the connection is closed after the response.
+//
+// Test with: ./rl0b_main file.rtlm -metrics -skipRecord, then curl -s localhost:55013/metrics
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include <thread>
+#include <vector>
+
+class QuicklookServer;
+
+constexpr uint16_t METRICS_DEFAULT_PORT = 55013; // quicklook uses 55012
+
+struct MetricsConfig {
+    uint16_t port = METRICS_DEFAULT_PORT; // 0 picks a free port, see getPort
+    bool loopbackOnly = true;
+    uint32_t requestTimeoutMs = 2000; // clients that send no complete request in time are closed
+    const QuicklookServer* quicklook = nullptr; // optional, reports its client queue depth
+};
+
+// the response body, public so tests and other transports can share it
+std::string renderMetrics(const QuicklookServer* quicklook);
+
+class MetricsServer {
+public:
+    explicit MetricsServer(const MetricsConfig& config = MetricsConfig());
+    ~MetricsServer();
+
+    MetricsServer(const MetricsServer&) = delete;
+    MetricsServer& operator=(const MetricsServer&) = delete;
+
+    bool start(); // binds, listens and starts the server thread
+    void stop();
+
+    uint16_t getPort() const { return boundPort; }
+    uint64_t getScrapeCount() const { return scrapeCount.load(std::memory_order_relaxed); }
+
+private:
+    struct Client {
+        int fd = -1;
+        std::string request;
+        std::string response;
+        size_t sendOffset = 0;
+        std::chrono::steady_clock::time_point accepted;
+        bool closed = false;
+    };
+
+    void run();
+    void acceptClients();
+    void readRequest(Client& client);
+    void flushClient(Client& client);
+
+    MetricsConfig config;
+    int listenFd = -1;
+    uint16_t boundPort = 0;
+    std::atomic<bool> stopRequested{false};
+    std::atomic<uint64_t> scrapeCount{0};
+    std::thread serverThread;
+    std::vector<Client> clients;
+};
+
+#endif // METRICS_SERVER_HPP
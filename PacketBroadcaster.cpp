@@ -0,0 +1,118 @@
+#include "PacketBroadcaster.hpp"
+#include "LogFileWriter.hpp"
+
+#include <cerrno>
+#include <cstring>
+#include <iostream>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+PacketBroadcaster::~PacketBroadcaster() {
+    close();
+}
+
+bool PacketBroadcaster::open(const std::string& segmentName, uint64_t requestedBytes) {
+    if (header != nullptr) {
+        return true;
+    }
+    if ((requestedBytes < 4096) || (requestedBytes % PACKET_RING_ALIGN != 0)) {
+        std::cerr << "ERROR: packet ring size " << requestedBytes << " must be at least 4096 and a multiple of " << PACKET_RING_ALIGN << std::endl;
+        LogFileWriter::getInstance().logError("packet ring size {} is invalid", requestedBytes);
+        return false;
+    }
+
+    // start from a fresh segment so subscribers never see a stale writer's records
+    shm_unlink(segmentName.c_str());
+    int fd = shm_open(segmentName.c_str(), O_CREAT | O_RDWR, 0644);
+    if (fd < 0) {
+        std::cerr << "ERROR: shm_open " << segmentName << " failed: " << strerror(errno) << std::endl;
+        LogFileWriter::getInstance().logError("shm_open {} failed: {}", segmentName, strerror(errno));
+        return false;
+    }
+    size_t totalBytes = sizeof(PacketRingHeader) + requestedBytes;
+    if (ftruncate(fd, totalBytes) != 0) {
+        std::cerr << "ERROR: ftruncate " << segmentName << " failed: " << strerror(errno) << std::endl;
+        LogFileWriter::getInstance().logError("ftruncate {} failed: {}", segmentName, strerror(errno));
+        ::close(fd);
+        shm_unlink(segmentName.c_str());
+        return false;
+    }
+    void* mapped = mmap(nullptr, totalBytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    ::close(fd); // the mapping keeps the segment alive
+    if (mapped == MAP_FAILED) {
+        std::cerr << "ERROR: mmap " << segmentName << " failed: " << strerror(errno) << std::endl;
+        LogFileWriter::getInstance().logError("mmap {} failed: {}", segmentName, strerror(errno));
+        shm_unlink(segmentName.c_str());
+        return false;
+    }
+
+    // ftruncate zero fills, so every position starts at 0
+    header = static_cast<PacketRingHeader*>(mapped);
+    data = static_cast<uint8_t*>(mapped) + sizeof(PacketRingHeader);
+    dataBytes = requestedBytes;
+    mappedBytes = totalBytes;
+    head = tail = packetCount = 0;
+    name = segmentName;
+
+    header->version = PACKET_RING_VERSION;
+    header->dataBytes = dataBytes;
+    header->writerPid.store(getpid(), std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    header->magic = PACKET_RING_MAGIC;
+
+    std::cout << "Broadcasting packets to shared memory " << name << " (" << dataBytes / (1024 * 1024) << " MB ring)" << std::endl;
+    LogFileWriter::getInstance().logInfo("Broadcasting packets to shared memory {} ({} byte ring)", name, dataBytes);
+    return true;
+}
+
+void PacketBroadcaster::close() {
+    if (header == nullptr) {
+        return;
+    }
+    header->writerPid.store(0, std::memory_order_release);
+    munmap(header, mappedBytes);
+    shm_unlink(name.c_str());
+    header = nullptr;
+    data = nullptr;
+}
+
+bool PacketBroadcaster::publish(const uint8_t* packet, uint32_t packetBytes) {
+    if (header == nullptr) {
+        return false;
+    }
+    const uint32_t recordBytes = packetRingRecordBytes(packetBytes);
+    if ((packetBytes == 0) || (recordBytes > dataBytes / 2)) {
+        LogFileWriter::getInstance().logError("packet ring cannot hold a {} byte packet", packetBytes);
+        return false;
+    }
+
+    // records never wrap, pad out the end of the buffer when this one does not fit
+    const uint64_t offset = head % dataBytes;
+    const uint64_t padBytes = (dataBytes - offset < recordBytes) ? (dataBytes - offset) : 0;
+    const uint64_t newHead = head + padBytes + recordBytes;
+
+    // every record between tail and newHead - dataBytes is about to be overwritten
+    while (newHead - tail > dataBytes) {
+        const PacketRingRecord* oldest = reinterpret_cast<const PacketRingRecord*>(data + tail % dataBytes);
+        tail += oldest->recordBytes;
+    }
+    header->tail.store(tail, std::memory_order_relaxed);
+    header->reserved.store(newHead, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+
+    if (padBytes > 0) {
+        PacketRingRecord pad = {0, static_cast<uint32_t>(padBytes), packetCount};
+        std::memcpy(data + offset, &pad, sizeof(pad));
+    }
+    PacketRingRecord record = {packetBytes, recordBytes, packetCount};
+    uint8_t* destination = data + (head + padBytes) % dataBytes;
+    std::memcpy(destination, &record, sizeof(record));
+    std::memcpy(destination + sizeof(record), packet, packetBytes);
+
+    head = newHead;
+    ++packetCount;
+    header->packetCount.store(packetCount, std::memory_order_relaxed);
+    header->committed.store(head, std::memory_order_release);
+    return true;
+}
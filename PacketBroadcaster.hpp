@@ -0,0 +1,45 @@
+#ifndef PACKET_BROADCASTER_HPP
+#define PACKET_BROADCASTER_HPP
+
+// Writer side of the PacketRing.hpp broadcast ring, uses Singleton pattern.
+// processOnePacket calls publish for every packet, it does nothing until open() succeeds.
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "PacketRing.hpp"
+
+class PacketBroadcaster {
+public:
+    static PacketBroadcaster& getInstance() {
+        static PacketBroadcaster instance;
+        return instance;
+    }
+
+    bool open(const std::string& segmentName = PACKET_RING_DEFAULT_NAME, uint64_t dataBytes = PACKET_RING_DEFAULT_BYTES);
+    void close(); // unmaps and unlinks, subscribers that already mapped the ring keep their view
+    bool isOpen() const { return header != nullptr; }
+
+    // copies one complete CCSDS packet (primary header onward) into the ring
+    bool publish(const uint8_t* packet, uint32_t packetBytes);
+    bool publish(const std::vector<uint8_t>& packet) { return publish(packet.data(), static_cast<uint32_t>(packet.size())); }
+
+    uint64_t getPacketCount() const { return packetCount; }
+
+private:
+    PacketBroadcaster() = default;
+    ~PacketBroadcaster();
+    PacketBroadcaster(const PacketBroadcaster&) = delete;
+    PacketBroadcaster& operator=(const PacketBroadcaster&) = delete;
+
+    PacketRingHeader* header = nullptr;
+    uint8_t* data = nullptr;
+    uint64_t dataBytes = 0;
+    size_t mappedBytes = 0;
+    uint64_t head = 0;        // writer copy of committed
+    uint64_t tail = 0;        // writer copy of tail
+    uint64_t packetCount = 0;
+    std::string name;
+};
+
+#endif // PACKET_BROADCASTER_HPP
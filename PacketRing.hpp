@@ -0,0 +1,54 @@
+#ifndef PACKET_RING_HPP
+#define PACKET_RING_HPP
+
+// Layout of the raw packet broadcast ring published by rl0b_main -packetRing.
+// The capture path copies every CCSDS packet into the ring once, any number of local
+// subscribers (PacketRingSubscriber) read it with their own cursor and never slow the writer.
+//
+// Positions are byte offsets that only grow, the data offset is position % dataBytes.
+// Each record is a PacketRingRecord followed by the packet bytes, padded to PACKET_RING_ALIGN.
+// A record never wraps, the writer fills the end of the buffer with a pad record (packetBytes 0) instead.
+//
+// Writer order: advance tail past records it is about to overwrite, store reserved (end of the new record),
+// release fence, copy the record, store committed with release.
+// Reader order: load committed, copy a record, acquire fence, load reserved.
+// If reserved - cursor > dataBytes the copy may be torn and the reader has been overrun.
+//
+// Any change to these structures must bump PACKET_RING_VERSION.
+
+#include <atomic>
+#include <cstdint>
+
+constexpr char PACKET_RING_DEFAULT_NAME[] = "/eve_rocket_l0b_packets";
+constexpr uint32_t PACKET_RING_MAGIC = 0x45564550; // "PEVE" in memory
+constexpr uint32_t PACKET_RING_VERSION = 1;
+constexpr uint64_t PACKET_RING_DEFAULT_BYTES = 32 * 1024 * 1024; // about 40 seconds at the full MEGS-A + MEGS-B rate
+constexpr uint32_t PACKET_RING_ALIGN = 16;
+
+struct alignas(64) PacketRingHeader {
+    uint32_t magic;     // written last by the writer, readers check it first
+    uint32_t version;
+    uint64_t dataBytes; // ring capacity, a multiple of PACKET_RING_ALIGN, data follows this header
+    std::atomic<int32_t> writerPid;
+    uint32_t reserved0;
+    std::atomic<uint64_t> tail;      // position of the oldest record that is still intact
+    std::atomic<uint64_t> reserved;  // end position of the record being written
+    std::atomic<uint64_t> committed; // end position of the last complete record
+    std::atomic<uint64_t> packetCount;
+};
+
+struct PacketRingRecord {
+    uint32_t packetBytes; // 0 for a pad record at the end of the buffer
+    uint32_t recordBytes; // header + packet + padding, the distance to the next record
+    uint64_t packetIndex; // counts packets since the writer opened the ring, gaps mean lost packets
+};
+
+static_assert(sizeof(PacketRingRecord) == PACKET_RING_ALIGN, "a record header must fill one alignment unit");
+static_assert(std::atomic<uint64_t>::is_always_lock_free,
+    "shared-memory atomics must be lock free to work across processes");
+
+inline uint32_t packetRingRecordBytes(uint32_t packetBytes) {
+    return (sizeof(PacketRingRecord) + packetBytes + PACKET_RING_ALIGN - 1) & ~(PACKET_RING_ALIGN - 1);
+}
+
+#endif // PACKET_RING_HPP
@@ -0,0 +1,141 @@
+#include "PacketRingSubscriber.hpp"
+
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <thread>
+#include <fcntl.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+PacketRingSubscriber::~PacketRingSubscriber() {
+    close();
+}
+
+bool PacketRingSubscriber::open(const std::string& segmentName, bool fromOldest) {
+    close();
+
+    int fd = shm_open(segmentName.c_str(), O_RDONLY, 0);
+    if (fd < 0) {
+        error = "shm_open " + segmentName + " failed: " + strerror(errno);
+        return false;
+    }
+    struct stat status;
+    if ((fstat(fd, &status) != 0) || (status.st_size <= static_cast<off_t>(sizeof(PacketRingHeader)))) {
+        error = "segment " + segmentName + " is too small to be a packet ring";
+        ::close(fd);
+        return false;
+    }
+    size_t totalBytes = status.st_size;
+    void* mapped = mmap(nullptr, totalBytes, PROT_READ, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if (mapped == MAP_FAILED) {
+        error = "mmap " + segmentName + " failed: " + strerror(errno);
+        return false;
+    }
+
+    const PacketRingHeader* candidate = static_cast<const PacketRingHeader*>(mapped);
+    if (candidate->magic != PACKET_RING_MAGIC) {
+        error = "segment " + segmentName + " has no valid header yet";
+    } else if (candidate->version != PACKET_RING_VERSION) {
+        error = "segment " + segmentName + " version " + std::to_string(candidate->version) +
+            " does not match subscriber version " + std::to_string(PACKET_RING_VERSION);
+    } else if (candidate->dataBytes + sizeof(PacketRingHeader) != totalBytes) {
+        error = "segment " + segmentName + " size does not match its header";
+    } else {
+        std::atomic_thread_fence(std::memory_order_acquire);
+        header = candidate;
+        data = static_cast<const uint8_t*>(mapped) + sizeof(PacketRingHeader);
+        dataBytes = candidate->dataBytes;
+        mappedBytes = totalBytes;
+        cursor = fromOldest ? header->tail.load(std::memory_order_acquire) : header->committed.load(std::memory_order_acquire);
+        haveIndex = false;
+        packetsRead = packetsLost = overruns = 0;
+        error.clear();
+        return true;
+    }
+    munmap(mapped, totalBytes);
+    return false;
+}
+
+void PacketRingSubscriber::close() {
+    if (header != nullptr) {
+        munmap(const_cast<PacketRingHeader*>(header), mappedBytes);
+        header = nullptr;
+        data = nullptr;
+    }
+}
+
+bool PacketRingSubscriber::writerAlive() const {
+    if (header == nullptr) {
+        return false;
+    }
+    int32_t pid = header->writerPid.load(std::memory_order_acquire);
+    return pid > 0 && (kill(pid, 0) == 0 || errno == EPERM);
+}
+
+PacketRingReadStatus PacketRingSubscriber::overrun() {
+    // resume at the oldest record, the packetIndex gap on the next read counts what was lost
+    cursor = header->tail.load(std::memory_order_acquire);
+    ++overruns;
+    return PACKET_RING_OVERRUN;
+}
+
+PacketRingReadStatus PacketRingSubscriber::readNext(std::vector<uint8_t>& packet) {
+    if (header == nullptr) {
+        return PACKET_RING_EMPTY;
+    }
+    while (true) {
+        uint64_t committed = header->committed.load(std::memory_order_acquire);
+        if (cursor >= committed) {
+            return PACKET_RING_EMPTY;
+        }
+        if (committed - cursor > dataBytes) {
+            return overrun();
+        }
+
+        const uint64_t offset = cursor % dataBytes;
+        PacketRingRecord record;
+        std::memcpy(&record, data + offset, sizeof(record));
+        // a torn header could hold anything, bound it before using it to copy
+        bool plausible = (record.recordBytes >= sizeof(PacketRingRecord)) && (record.recordBytes % PACKET_RING_ALIGN == 0) &&
+            (record.recordBytes <= dataBytes - offset) && (record.packetBytes <= record.recordBytes - sizeof(PacketRingRecord));
+        if (plausible && (record.packetBytes > 0)) {
+            packet.resize(record.packetBytes);
+            std::memcpy(packet.data(), data + offset + sizeof(PacketRingRecord), record.packetBytes);
+        }
+
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (!plausible || (header->reserved.load(std::memory_order_relaxed) - cursor > dataBytes)) {
+            return overrun();
+        }
+
+        cursor += record.recordBytes;
+        if (record.packetBytes == 0) {
+            continue; // pad record at the end of the buffer
+        }
+        if (haveIndex && (record.packetIndex > expectedIndex)) {
+            packetsLost += record.packetIndex - expectedIndex;
+        }
+        expectedIndex = record.packetIndex + 1;
+        haveIndex = true;
+        ++packetsRead;
+        return PACKET_RING_PACKET;
+    }
+}
+
+bool PacketRingSubscriber::waitForPacket(int timeoutMs) const {
+    if (header == nullptr) {
+        return false;
+    }
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeoutMs);
+    while (header->committed.load(std::memory_order_acquire) <= cursor) {
+        if (std::chrono::steady_clock::now() >= deadline) {
+            return false;
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    return true;
+}
@@ -0,0 +1,57 @@
+#ifndef PACKET_RING_SUBSCRIBER_HPP
+#define PACKET_RING_SUBSCRIBER_HPP
+
+// Reader side of the PacketRing.hpp broadcast ring.
+// Each subscriber keeps its own cursor in its own process, the writer never waits for it.
+// Depends only on the standard library and POSIX, like EveShmReader.
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "PacketRing.hpp"
+
+enum PacketRingReadStatus {
+    PACKET_RING_PACKET,  // packet holds the next packet
+    PACKET_RING_EMPTY,   // caught up with the writer
+    PACKET_RING_OVERRUN  // the writer lapped this subscriber, the cursor moved to the oldest intact record
+};
+
+class PacketRingSubscriber {
+public:
+    PacketRingSubscriber() = default;
+    ~PacketRingSubscriber();
+    PacketRingSubscriber(const PacketRingSubscriber&) = delete;
+    PacketRingSubscriber& operator=(const PacketRingSubscriber&) = delete;
+
+    // maps the ring read-only, fromOldest starts with everything still in the ring instead of new packets only
+    bool open(const std::string& segmentName = PACKET_RING_DEFAULT_NAME, bool fromOldest = false);
+    void close();
+    bool isOpen() const { return header != nullptr; }
+    const std::string& lastError() const { return error; }
+    bool writerAlive() const;
+
+    PacketRingReadStatus readNext(std::vector<uint8_t>& packet);
+    // sleeps in short steps until a packet is available, true if one arrived before timeoutMs
+    bool waitForPacket(int timeoutMs) const;
+
+    uint64_t getPacketsRead() const { return packetsRead; }
+    uint64_t getPacketsLost() const { return packetsLost; } // from gaps in packetIndex, includes overruns
+    uint64_t getOverruns() const { return overruns; }
+
+private:
+    PacketRingReadStatus overrun();
+
+    const PacketRingHeader* header = nullptr;
+    const uint8_t* data = nullptr;
+    uint64_t dataBytes = 0;
+    size_t mappedBytes = 0;
+    uint64_t cursor = 0;
+    uint64_t expectedIndex = 0;
+    bool haveIndex = false;
+    uint64_t packetsRead = 0;
+    uint64_t packetsLost = 0;
+    uint64_t overruns = 0;
+    std::string error;
+};
+
+#endif // PACKET_RING_SUBSCRIBER_HPP
@@ -0,0 +1,230 @@
+#include "PacketStats.hpp"
+#include "LogFileWriter.hpp"
+#include "ProgramState.hpp"
+#include "eve_l0b.hpp"
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+#include <iomanip>
+#include <sstream>
+
+namespace {
+thread_local ApidSlot currentSlot = APID_SLOT_UNKNOWN;
+}
+
+PacketStats& PacketStats::getInstance() {
+    static PacketStats instance;
+    return instance;
+}
+
+PacketStats::PacketStats()
+    : previousLatency(new LatencyCounts[APID_SLOT_COUNT * PIPELINE_STAGE_COUNT]),
+      previousTime(std::chrono::steady_clock::now()) {}
+
+PacketStats::~PacketStats() {
+    stopReporter();
+}
+
+ApidSlot PacketStats::slotForAPID(uint16_t apid) {
+    switch (apid) {
+        case MEGSA_APID: return APID_SLOT_MA;
+        case MEGSB_APID: return APID_SLOT_MB;
+        case ESP_APID:   return APID_SLOT_ESP;
+        case MEGSP_APID: return APID_SLOT_MP;
+        case SHK_APID:   return APID_SLOT_SHK;
+        default:         return APID_SLOT_UNKNOWN;
+    }
+}
+
+const char* PacketStats::slotName(ApidSlot slot) {
+    switch (slot) {
+        case APID_SLOT_MA:  return "MA";
+        case APID_SLOT_MB:  return "MB";
+        case APID_SLOT_ESP: return "ESP";
+        case APID_SLOT_MP:  return "MP";
+        case APID_SLOT_SHK: return "SHK";
+        default:            return "unknown";
+    }
+}
+
+const char* PacketStats::counterName(PacketCounter counter) {
+    switch (counter) {
+        case COUNTER_PACKETS:       return "packets";
+        case COUNTER_BYTES:         return "bytes";
+        case COUNTER_GAPS:          return "gaps";
+        case COUNTER_PARITY_ERRORS: return "parity_errors";
+        case COUNTER_LENGTH_ERRORS: return "length_errors";
+        case COUNTER_DROPS:         return "drops";
+        case COUNTER_DUPLICATES:    return "duplicates";
+        case COUNTER_LATE:          return "late";
+        case COUNTER_MISSING:       return "missing";
+        default:                    return "unknown";
+    }
+}
+
+// the shard lives until exit so counts from threads that have finished are still reported
+PacketStats::ThreadShard& PacketStats::localShard() {
+    thread_local ThreadShard* shard = nullptr;
+    if (shard == nullptr) {
+        std::lock_guard<std::mutex> lock(shardMutex);
+        shards.emplace_back(new ThreadShard());
+        shard = shards.back().get();
+    }
+    return *shard;
+}
+
+void PacketStats::setCurrentAPID(uint16_t apid) {
+    currentSlot = slotForAPID(apid);
+}
+
+// only this thread writes its shard, so a relaxed load and store replaces the locked add
+void PacketStats::count(uint16_t apid, PacketCounter counter, uint64_t n) {
+    if (!isEnabled()) {
+        return;
+    }
+    std::atomic<uint64_t>& value = localShard().counters[slotForAPID(apid)][counter];
+    value.store(value.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+}
+
+void PacketStats::recordLatency(PipelineStage stage, uint64_t nanoseconds) {
+    if (!isEnabled()) {
+        return;
+    }
+    localShard().latency[currentSlot][stage].record(nanoseconds);
+}
+
+PacketStatsInterval PacketStats::aggregate() {
+    PacketStatsInterval stats;
+    std::unique_ptr<LatencyCounts[]> latency(new LatencyCounts[APID_SLOT_COUNT * PIPELINE_STAGE_COUNT]);
+    {
+        std::lock_guard<std::mutex> lock(shardMutex);
+        for (const auto& shard : shards) {
+            for (int slot = 0; slot < APID_SLOT_COUNT; ++slot) {
+                for (int counter = 0; counter < PACKET_COUNTER_COUNT; ++counter) {
+                    stats.totals[slot][counter] += shard->counters[slot][counter].load(std::memory_order_relaxed);
+                }
+                for (int stage = 0; stage < PIPELINE_STAGE_COUNT; ++stage) {
+                    latency[slot * PIPELINE_STAGE_COUNT + stage].add(shard->latency[slot][stage]);
+                }
+            }
+        }
+    }
+
+    std::lock_guard<std::mutex> lock(aggregateMutex);
+    auto now = std::chrono::steady_clock::now();
+    stats.intervalSeconds = std::chrono::duration<double>(now - previousTime).count();
+    stats.sequence = ++sequence;
+    previousTime = now;
+
+    for (int slot = 0; slot < APID_SLOT_COUNT; ++slot) {
+        for (int counter = 0; counter < PACKET_COUNTER_COUNT; ++counter) {
+            stats.interval[slot][counter] = stats.totals[slot][counter] - previousTotals[slot][counter];
+            previousTotals[slot][counter] = stats.totals[slot][counter];
+        }
+        for (int stage = 0; stage < PIPELINE_STAGE_COUNT; ++stage) {
+            LatencyCounts& current = latency[slot * PIPELINE_STAGE_COUNT + stage];
+            LatencyCounts& previous = previousLatency[slot * PIPELINE_STAGE_COUNT + stage];
+            LatencyCounts delta;
+            delta.count = current.count - previous.count;
+            delta.totalNanoseconds = current.totalNanoseconds - previous.totalNanoseconds;
+            for (uint32_t i = 0; i < LatencyHistogram::BUCKET_COUNT; ++i) {
+                delta.buckets[i] = current.buckets[i] - previous.buckets[i];
+                if (delta.buckets[i] != 0) {
+                    delta.maxNanoseconds = std::min(LatencyHistogram::bucketMidpoint(i), current.maxNanoseconds);
+                }
+            }
+            stats.latency[slot][stage] = delta.summarize();
+            previous = current;
+        }
+    }
+
+    latestInterval.publish(stats);
+    return stats;
+}
+
+std::string PacketStats::summaryLine(const PacketStatsInterval& stats) {
+    std::ostringstream line;
+    line << std::fixed << std::setprecision(1) << "PacketStats " << stats.intervalSeconds << "s";
+    for (int slot = 0; slot < APID_SLOT_COUNT; ++slot) {
+        const uint64_t* interval = stats.interval[slot];
+        if ((interval[COUNTER_PACKETS] == 0) && (interval[COUNTER_DROPS] == 0) && (interval[COUNTER_LENGTH_ERRORS] == 0)) {
+            continue;
+        }
+        line << " | " << slotName(static_cast<ApidSlot>(slot)) << " pkts " << interval[COUNTER_PACKETS]
+             << " bytes " << interval[COUNTER_BYTES];
+        for (int counter = COUNTER_GAPS; counter < PACKET_COUNTER_COUNT; ++counter) {
+            if (interval[counter] != 0) {
+                line << " " << counterName(static_cast<PacketCounter>(counter)) << " " << interval[counter];
+            }
+        }
+        const StageLatencySummary& decode = stats.latency[slot][STAGE_DECODE];
+        if (decode.count != 0) {
+            line << " decode p50/p99/max us " << decode.p50Microsec << "/" << decode.p99Microsec << "/" << decode.maxMicrosec;
+        }
+    }
+    return line.str();
+}
+
+// written to a temporary file and renamed so readers never see a partial file
+bool PacketStats::writeJson(const PacketStatsInterval& stats, const std::string& filename) {
+    std::string tmpName = filename + ".tmp";
+    {
+        std::ofstream json(tmpName);
+        json << std::fixed << std::setprecision(3);
+        json << "{\n  \"sequence\": " << stats.sequence << ",\n  \"interval_s\": " << stats.intervalSeconds
+             << ",\n  \"apids\": {\n";
+        for (int slot = 0; slot < APID_SLOT_COUNT; ++slot) {
+            json << "    \"" << slotName(static_cast<ApidSlot>(slot)) << "\": {\n";
+            for (int counter = 0; counter < PACKET_COUNTER_COUNT; ++counter) {
+                json << "      \"" << counterName(static_cast<PacketCounter>(counter)) << "\": {\"total\": "
+                     << stats.totals[slot][counter] << ", \"interval\": " << stats.interval[slot][counter] << "},\n";
+            }
+            json << "      \"latency_us\": {";
+            for (int stage = 0; stage < PIPELINE_STAGE_COUNT; ++stage) {
+                const StageLatencySummary& s = stats.latency[slot][stage];
+                json << (stage ? ", " : "") << "\"" << StageTimers::stageName(static_cast<PipelineStage>(stage))
+                     << "\": {\"count\": " << s.count << ", \"p50\": " << s.p50Microsec
+                     << ", \"p99\": " << s.p99Microsec << ", \"max\": " << s.maxMicrosec << "}";
+            }
+            json << "}\n    }" << (slot + 1 < APID_SLOT_COUNT ? "," : "") << "\n";
+        }
+        json << "  }\n}\n";
+        if (!json.good()) {
+            return false;
+        }
+    }
+    return std::rename(tmpName.c_str(), filename.c_str()) == 0;
+}
+
+bool PacketStats::startReporter(uint32_t intervalSeconds, const std::string& jsonFilename) {
+    if (reporterThread.joinable() || (intervalSeconds == 0)) {
+        return false;
+    }
+    stopRequested.store(false);
+    reporterThread = std::thread(&PacketStats::runReporter, this, intervalSeconds, jsonFilename);
+    return true;
+}
+
+void PacketStats::stopReporter() {
+    stopRequested.store(true);
+    if (reporterThread.joinable()) {
+        reporterThread.join();
+    }
+}
+
+void PacketStats::runReporter(uint32_t intervalSeconds, std::string jsonFilename) {
+    auto next = std::chrono::steady_clock::now() + std::chrono::seconds(intervalSeconds);
+    while (!stopRequested.load(std::memory_order_relaxed) && globalState.running.load(std::memory_order_relaxed)) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+        if (std::chrono::steady_clock::now() < next) {
+            continue;
+        }
+        next += std::chrono::seconds(intervalSeconds);
+
+        PacketStatsInterval stats = aggregate();
+        LogFileWriter::getInstance().logInfo("{}", summaryLine(stats));
+        if (!jsonFilename.empty() && !writeJson(stats, jsonFilename)) {
+            LogFileWriter::getInstance().logError("PacketStats failed to write {}", jsonFilename);
+        }
+    }
+}
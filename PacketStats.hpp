@@ -0,0 +1,114 @@
+#ifndef PACKET_STATS_HPP
+#define PACKET_STATS_HPP
+
+// Per-APID packet counters and stage latency histograms, replacing per-packet timing log lines.
+// Every thread records into its own shard, so recording never takes a lock or shares a cache line.
+// aggregate() sums the shards once per interval, publishes the result for the GUI,
+// logs one summary line and optionally rewrites a JSON stats file.
+// Nothing is recorded until enable(true), rl0b_main enables it at startup.
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "SeqlockSnapshot.hpp"
+#include "StageTimer.hpp"
+
+enum ApidSlot : uint8_t {
+    APID_SLOT_MA = 0,
+    APID_SLOT_MB,
+    APID_SLOT_ESP,
+    APID_SLOT_MP,
+    APID_SLOT_SHK,
+    APID_SLOT_UNKNOWN,
+    APID_SLOT_COUNT
+};
+
+enum PacketCounter : uint8_t {
+    COUNTER_PACKETS = 0,
+    COUNTER_BYTES,
+    COUNTER_GAPS,           // sequence counter discontinuities
+    COUNTER_PARITY_ERRORS,  // MEGS pixel parity errors
+    COUNTER_LENGTH_ERRORS,  // de-framed packet size does not match the APID packet length
+    COUNTER_DROPS,          // packets discarded before processing
+    COUNTER_DUPLICATES,     // exact repeats dropped by the reorder window
+    COUNTER_LATE,           // arrived after the reorder window gave up on their counter
+    COUNTER_MISSING,        // counters the reorder window gave up on
+    PACKET_COUNTER_COUNT
+};
+
+// one aggregation interval, trivially copyable so it can be published through a SeqlockSnapshot
+struct PacketStatsInterval {
+    uint64_t sequence = 0;       // 0 until the first aggregation
+    double intervalSeconds = 0.0;
+    uint64_t totals[APID_SLOT_COUNT][PACKET_COUNTER_COUNT] = {};    // since enable
+    uint64_t interval[APID_SLOT_COUNT][PACKET_COUNTER_COUNT] = {};  // during this interval
+    StageLatencySummary latency[APID_SLOT_COUNT][PIPELINE_STAGE_COUNT] = {}; // during this interval
+};
+
+class PacketStats {
+public:
+    static PacketStats& getInstance();
+
+    void enable(bool on) { enabled.store(on, std::memory_order_relaxed); }
+    bool isEnabled() const { return enabled.load(std::memory_order_relaxed); }
+
+    static ApidSlot slotForAPID(uint16_t apid);
+    static const char* slotName(ApidSlot slot);
+    static const char* counterName(PacketCounter counter);
+
+    // stage latencies recorded on the calling thread are keyed by this APID until it is set again
+    void setCurrentAPID(uint16_t apid);
+
+    void count(uint16_t apid, PacketCounter counter, uint64_t n = 1);
+    void recordLatency(PipelineStage stage, uint64_t nanoseconds);
+
+    // sums every thread's shard, differences it against the previous call and publishes the result
+    // the interval max latency is the top occupied histogram bucket, accurate to about 6%
+    PacketStatsInterval aggregate();
+    void readLatest(PacketStatsInterval& stats) const { latestInterval.read(stats); }
+
+    static bool writeJson(const PacketStatsInterval& stats, const std::string& filename);
+    static std::string summaryLine(const PacketStatsInterval& stats);
+
+    // aggregates, logs and writes jsonFilename (when not empty) every intervalSeconds
+    bool startReporter(uint32_t intervalSeconds, const std::string& jsonFilename);
+    void stopReporter();
+
+private:
+    PacketStats();
+    ~PacketStats();
+    PacketStats(const PacketStats&) = delete;
+    PacketStats& operator=(const PacketStats&) = delete;
+
+    // written only by its own thread, read by aggregate()
+    struct ThreadShard {
+        std::atomic<uint64_t> counters[APID_SLOT_COUNT][PACKET_COUNTER_COUNT] = {};
+        LatencyHistogram latency[APID_SLOT_COUNT][PIPELINE_STAGE_COUNT];
+    };
+
+    ThreadShard& localShard();
+    void runReporter(uint32_t intervalSeconds, std::string jsonFilename);
+
+    std::atomic<bool> enabled{false};
+
+    std::mutex shardMutex; // guards shards, taken once per thread and by aggregate()
+    std::vector<std::unique_ptr<ThreadShard>> shards;
+
+    std::mutex aggregateMutex; // guards the previous* members
+    uint64_t sequence = 0;
+    uint64_t previousTotals[APID_SLOT_COUNT][PACKET_COUNTER_COUNT] = {};
+    std::unique_ptr<LatencyCounts[]> previousLatency; // APID_SLOT_COUNT * PIPELINE_STAGE_COUNT
+    std::chrono::steady_clock::time_point previousTime;
+
+    SeqlockSnapshot<PacketStatsInterval> latestInterval;
+
+    std::thread reporterThread;
+    std::atomic<bool> stopRequested{false};
+};
+
+#endif // PACKET_STATS_HPP
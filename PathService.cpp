@@ -0,0 +1,136 @@
+#include "PathService.hpp"
+
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <fcntl.h>
+#include <iostream>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace {
+constexpr long SECONDS_PER_DAY = 86400;
+}
+
+PathService& PathService::getInstance() {
+    static PathService instance;
+    return instance;
+}
+
+PathService::~PathService() {
+    if (dataRootFd >= 0) {
+        close(dataRootFd);
+    }
+}
+
+bool PathService::initDataRoot() {
+    std::lock_guard<std::mutex> lock(mutex);
+    return initDataRootLocked();
+}
+
+bool PathService::initDataRootLocked() {
+    if (dataRootResolved) {
+        return dataRootFd >= 0;
+    }
+    dataRootResolved = true;
+    const char* envDataRoot = std::getenv("eve_data_root");
+    if (envDataRoot == nullptr) {
+        return false;
+    }
+    dataRootPath = envDataRoot;
+    // the FITS paths have always been eve_data_root + "level0b/", so setup scripts end it with a slash
+    if (!dataRootPath.empty() && (dataRootPath.back() != '/')) {
+        dataRootPath += '/';
+    }
+    // a new data disk may not have the root yet, it was always created along with the first FITS directory
+    if (!makeSegments(AT_FDCWD, dataRootPath, 0)) {
+        return false;
+    }
+    dataRootFd = open(dataRootPath.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (dataRootFd < 0) {
+        std::cerr << "ERROR: Could not open eve_data_root " << dataRootPath << ": " << strerror(errno) << std::endl;
+        return false;
+    }
+    return true;
+}
+
+const std::string& PathService::dataRoot() {
+    std::lock_guard<std::mutex> lock(mutex);
+    initDataRootLocked();
+    return dataRootPath;
+}
+
+bool PathService::ensureDirectory(const std::string& path) {
+    std::lock_guard<std::mutex> lock(mutex);
+
+    long today = static_cast<long>(std::time(nullptr)) / SECONDS_PER_DAY;
+    if ((today != knownDay) || (knownPaths.size() >= PATH_SERVICE_MAX_KNOWN_DIRECTORIES)) {
+        knownPaths.clear();
+        knownDay = today;
+    }
+    if (knownPaths.count(path) != 0) {
+        return true;
+    }
+
+    initDataRootLocked();
+    int dirFd = AT_FDCWD;
+    size_t relativeStart = 0;
+    if ((dataRootFd >= 0) && (path.compare(0, dataRootPath.size(), dataRootPath) == 0)) {
+        dirFd = dataRootFd;
+        relativeStart = dataRootPath.size();
+    }
+
+    if (!makeSegments(dirFd, path, relativeStart)) {
+        return false;
+    }
+    knownPaths.insert(path);
+    return true;
+}
+
+// makes each missing segment after relativeStart, parents already known skip the system call
+bool PathService::makeSegments(int dirFd, const std::string& path, size_t relativeStart) {
+    size_t end = relativeStart;
+    while (end < path.size()) {
+        size_t slash = path.find('/', end);
+        if (slash == std::string::npos) {
+            slash = path.size();
+        }
+        std::string prefix = path.substr(0, slash);
+        std::string segment = path.substr(end, slash - end);
+        end = slash + 1;
+        if (segment.empty() || (segment == ".") || (knownPaths.count(prefix) != 0)) {
+            continue;
+        }
+        const char* relative = prefix.c_str() + relativeStart;
+        if (mkdirat(dirFd, relative, 0755) != 0) {
+            if (errno != EEXIST) {
+                std::cerr << "ERROR: Could not create directory: " << prefix << ": " << strerror(errno) << std::endl;
+                return false;
+            }
+            struct stat info;
+            if ((fstatat(dirFd, relative, &info, 0) != 0) || !S_ISDIR(info.st_mode)) {
+                std::cerr << "ERROR: Path exists but is not a directory: " << prefix << std::endl;
+                return false;
+            }
+        }
+        knownPaths.insert(prefix);
+    }
+    return true;
+}
+
+void PathService::forget() {
+    std::lock_guard<std::mutex> lock(mutex);
+    knownPaths.clear();
+    if (dataRootFd >= 0) {
+        close(dataRootFd);
+        dataRootFd = -1;
+    }
+    dataRootPath.clear();
+    dataRootResolved = false;
+}
+
+size_t PathService::knownDirectories() {
+    std::lock_guard<std::mutex> lock(mutex);
+    return knownPaths.size();
+}
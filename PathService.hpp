@@ -0,0 +1,52 @@
+#ifndef PATH_SERVICE_HPP
+#define PATH_SERVICE_HPP
+
+// Creates the %Y/%j output directories for FITS, record, log and trace files.
+// eve_data_root is resolved once and kept open as a directory fd, directories below it are made
+// with mkdirat relative to that fd. Every directory made or found is remembered, so in steady state
+// a path costs one hash lookup and no system calls. The set is cleared when the UTC day changes,
+// which retries directories that were moved away, and when it reaches PATH_SERVICE_MAX_KNOWN_DIRECTORIES,
+// which bounds it during replays of many telemetry days.
+// Thread safe, the packet, log and trace threads all create directories.
+
+#include <mutex>
+#include <string>
+#include <unordered_set>
+
+constexpr size_t PATH_SERVICE_MAX_KNOWN_DIRECTORIES = 1024;   // a few hundred days of output directories
+
+class PathService {
+public:
+    static PathService& getInstance();
+
+    // resolves eve_data_root from the environment once and opens it, false if unset or not a directory
+    bool initDataRoot();
+    // eve_data_root with a trailing slash, empty if it is unset
+    const std::string& dataRoot();
+
+    // like mkdir -p, paths under eve_data_root are made relative to its fd, others relative to the working directory
+    bool ensureDirectory(const std::string& path);
+
+    // drops the remembered directories and eve_data_root, the next call resolves the root
+    // from the environment and checks the disk again
+    void forget();
+    size_t knownDirectories();
+
+private:
+    PathService() = default;
+    ~PathService();
+    PathService(const PathService&) = delete;
+    PathService& operator=(const PathService&) = delete;
+
+    bool initDataRootLocked();
+    bool makeSegments(int dirFd, const std::string& path, size_t relativeStart);
+
+    std::mutex mutex;
+    bool dataRootResolved = false;
+    std::string dataRootPath;
+    int dataRootFd = -1;
+    long knownDay = -1;  // UTC days since the epoch when knownPaths was started
+    std::unordered_set<std::string> knownPaths;
+};
+
+#endif // PATH_SERVICE_HPP
@@ -4,6 +4,25 @@
 
 #include "eve_l0b.hpp"
 #include "LogFileWriter.hpp"
+#include "MegsSpectrum.hpp"
+#include "SeqlockSnapshot.hpp"
+#include "SequenceReorder.hpp"
+
+// Time tags from the first packet of the MEGS image being assembled.
+// The pixels themselves stay in megsa/megsb.image and are tracked by the dirty row bitmaps.
+struct MEGS_IMAGE_METADATA {
+	uint32_t tai_time_seconds;
+	uint32_t tai_time_subseconds;
+	uint32_t rec_tai_seconds;
+	uint32_t rec_tai_subseconds;
+	uint32_t sod;
+	uint32_t yyyydoy;
+};
+
+// Copy of the most recent packet payload for one APID, shown in the raw packet window
+struct RAW_PAYLOAD_BYTES {
+	uint8_t bytes[STANDARD_MEGSAB_PACKET_LENGTH+1];
+};
 
 // There is only one programState structure, and it is defined in main.cpp as a global to pass info to the imgui instance.
 struct ProgramState {
@@ -17,6 +36,27 @@ struct ProgramState {
 		std::atomic<bool> slowReplay{false};
 		std::atomic<bool> writeBinaryRxBuff{false};
 		std::atomic<bool> readBinAsUSB{false};
+		std::atomic<bool> quicklook{false};
+		std::atomic<bool> quicklookRemote{false};
+		std::atomic<bool> metrics{false};
+		std::atomic<bool> metricsRemote{false};
+		std::atomic<bool> trace{false};
+		std::atomic<bool> sharedMemory{false};
+		std::atomic<bool> packetRing{false};
+		std::atomic<bool> skipFITS{false};
+		std::atomic<bool> skipCompress{false};
+		std::atomic<bool> skipCatalog{false}; // no catalog.l0bc records for the FITS files
+		std::atomic<bool> skipColumns{false}; // no ColumnStore day columns for ESP, MEGS-P and SHK
+		std::atomic<bool> skipSpectra{false}; // no MEGS spectrum extraction, GUI spectra or spectrum tables
+		std::string spectrumRegionsA{MEGS_SPECTRUM_DEFAULT_REGIONS}; // validated by main, read at the start of each image
+		std::string spectrumRegionsB{MEGS_SPECTRUM_DEFAULT_REGIONS};
+		std::atomic<bool> darkSubtract{false}; // subtract the matching dark from the start, the GUI can turn it off
+		std::atomic<bool> transposeFITS{false}; // MEGS image HDUs 1024 wide by 2048 tall
+		std::atomic<uint32_t> statsIntervalSeconds{10};
+		std::string statsFilename; // empty means no JSON stats file
+		std::atomic<uint16_t> reorderWindowPackets{REORDER_DEFAULT_WINDOW_PACKETS}; // 0 processes packets as they arrive
+		std::atomic<uint32_t> reorderTimeoutMs{REORDER_DEFAULT_TIMEOUT_MS};
+		std::atomic<uint32_t> imageTimeoutSeconds{5}; // a MEGS image with no packets for this long is written as partial
 	} args;
 	bool guiEnabled = false;
 	std::atomic<int8_t> slowReplayWaitTime{1};
@@ -33,20 +73,32 @@ struct ProgramState {
 
     std::atomic<bool> running{true}; // Whether the program is still running
 	bool initComplete = false;
-	MEGS_IMAGE_REC megsa; 
-	uint8_t megsAPayloadBytes[STANDARD_MEGSAB_PACKET_LENGTH+1];
+	MEGS_IMAGE_REC megsa; // only image is used, written by the packet thread without locking
+	SeqlockSnapshot<MEGS_IMAGE_METADATA> megsAMetadata;
+	SeqlockSnapshot<RAW_PAYLOAD_BYTES> megsAPayloadBytes;
 	std::atomic<bool> megsAUpdated{true};
 	std::atomic<bool> isFirstMAImage{true};
 	std::atomic<uint32_t> megsAImageCount{0};
 	std::atomic<bool> isMATestPattern{false};
+	std::atomic<uint16_t> megsAImagePackets{0}; // packets in the image being assembled
+	std::atomic<float> megsALastCompleteness{0.0f}; // percent of packets in the last image written
+	std::atomic<uint32_t> megsAPartialImages{0};
+	SeqlockSnapshot<MEGS_SPECTRUM> megsASpectrum; // spectra of the last image written
 	std::atomic<int> MAypos{0};
+	std::atomic<uint32_t> megsADirtyRows[MEGS_DIRTY_ROW_WORDS] = {}; // rows written since the GUI last rendered them
 	MEGS_IMAGE_REC megsb;
-	uint8_t megsBPayloadBytes[STANDARD_MEGSAB_PACKET_LENGTH+1];
+	SeqlockSnapshot<MEGS_IMAGE_METADATA> megsBMetadata;
+	SeqlockSnapshot<RAW_PAYLOAD_BYTES> megsBPayloadBytes;
 	std::atomic<bool> megsBUpdated{true};
 	std::atomic<bool> isFirstMBImage{true};
 	std::atomic<uint32_t> megsBImageCount{0};
 	std::atomic<bool> isMBTestPattern{false};
+	std::atomic<uint16_t> megsBImagePackets{0};
+	std::atomic<float> megsBLastCompleteness{0.0f};
+	std::atomic<uint32_t> megsBPartialImages{0};
+	SeqlockSnapshot<MEGS_SPECTRUM> megsBSpectrum;
 	std::atomic<int> MBypos{0};
+	std::atomic<uint32_t> megsBDirtyRows[MEGS_DIRTY_ROW_WORDS] = {};
 	PKT_COUNT_REC packetsReceived;
 	std::atomic<int64_t> parityErrorsMA{0};
 	std::atomic<int64_t> parityErrorsMB{0};
@@ -59,14 +111,16 @@ struct ProgramState {
 	std::atomic<uint32_t> saturatedPixelsMABottom{0};
 	std::atomic<uint32_t> saturatedPixelsMBTop{0};
 	std::atomic<uint32_t> saturatedPixelsMBBottom{0};
-	ESP_PACKET esp;
-	std::atomic<uint16_t> espIndex{0};
-	uint8_t espPayloadBytes[STANDARD_ESP_PACKET_LENGTH+1];
-	MEGSP_PACKET megsp;
-	uint8_t megsPPayloadBytes[STANDARD_MEGSP_PACKET_LENGTH+1];
-	SHK_PACKET shk;
-	SHK_CONVERTED_PACKET shkConv;
-	uint8_t shkPayloadBytes[STANDARD_SHK_PACKET_LENGTH+1];
+	std::atomic<int64_t> fitsPublishFailures{0}; // products FITSPublisher could not write, after write*FITS returned
+	// Published once per packet by the packet thread, readers copy out a consistent snapshot
+	SeqlockSnapshot<ESP_PACKET> esp; // circular buffer of the latest ESP_INTEGRATIONS_PER_FILE integrations
+	std::atomic<uint16_t> espIndex{0}; // newest integration in esp, stored after esp is published
+	SeqlockSnapshot<RAW_PAYLOAD_BYTES> espPayloadBytes;
+	SeqlockSnapshot<MEGSP_PACKET> megsp;
+	SeqlockSnapshot<RAW_PAYLOAD_BYTES> megsPPayloadBytes;
+	SeqlockSnapshot<SHK_PACKET> shk;
+	SeqlockSnapshot<SHK_CONVERTED_PACKET> shkConv;
+	SeqlockSnapshot<RAW_PAYLOAD_BYTES> shkPayloadBytes;
 };
 
 // Extern declaration
@@ -0,0 +1,487 @@
+#include "QuicklookServer.hpp"
+#include "LogFileWriter.hpp"
+#include "MegsDark.hpp"
+#include "ProgramState.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstddef>
+#include <cstring>
+#include <iostream>
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+extern ProgramState globalState;
+
+namespace {
+
+// Appends values in host order (little-endian on the acquisition machines) behind a header
+// whose payloadBytes is filled in by finish()
+class FrameWriter {
+public:
+    FrameWriter(uint16_t type, uint32_t sequence, size_t payloadBytes) {
+        buffer.reserve(sizeof(QuicklookHeader) + payloadBytes);
+        QuicklookHeader header = {QUICKLOOK_MAGIC, QUICKLOOK_VERSION, type, sequence, 0};
+        append(&header, sizeof(header));
+    }
+
+    template <typename T>
+    void put(T value) {
+        append(&value, sizeof(T));
+    }
+
+    void append(const void* data, size_t size) {
+        const uint8_t* bytes = static_cast<const uint8_t*>(data);
+        buffer.insert(buffer.end(), bytes, bytes + size);
+    }
+
+    QuicklookFrame finish() {
+        uint32_t payloadBytes = static_cast<uint32_t>(buffer.size() - sizeof(QuicklookHeader));
+        std::memcpy(buffer.data() + offsetof(QuicklookHeader, payloadBytes), &payloadBytes, sizeof(payloadBytes));
+        return std::make_shared<const std::vector<uint8_t>>(std::move(buffer));
+    }
+
+private:
+    std::vector<uint8_t> buffer;
+};
+
+// append a circular buffer oldest first, newestIndex is the last integration written
+void putChronological(FrameWriter& writer, const uint16_t* values, uint16_t count, uint16_t newestIndex) {
+    uint16_t head = (newestIndex + 1) % count;
+    for (uint16_t i = 0; i < count; ++i) {
+        writer.put<uint16_t>(values[(head + i) % count]);
+    }
+}
+
+} // namespace
+
+void downsampleMegsImage(const uint16_t image[MEGS_IMAGE_HEIGHT][MEGS_IMAGE_WIDTH], uint16_t binning, uint16_t* out,
+    const uint16_t (*dark)[MEGS_IMAGE_WIDTH]) {
+    const uint32_t outWidth = MEGS_IMAGE_WIDTH / binning;
+    const uint32_t outHeight = MEGS_IMAGE_HEIGHT / binning;
+    const uint32_t pixelsPerBlock = uint32_t(binning) * binning;
+    std::vector<uint32_t> rowSums(outWidth);
+    std::vector<uint16_t> darkRow(dark ? MEGS_IMAGE_WIDTH : 0);
+
+    for (uint32_t outY = 0; outY < outHeight; ++outY) {
+        std::fill(rowSums.begin(), rowSums.end(), 0);
+        for (uint32_t y = outY * binning; y < (outY + 1) * binning; ++y) {
+            const uint16_t* row = image[y];
+            if (dark) {
+                subtractMegsDark(row, dark[y], darkRow.data(), MEGS_IMAGE_WIDTH);
+                row = darkRow.data();
+            }
+            for (uint32_t x = 0; x < MEGS_IMAGE_WIDTH; ++x) {
+                rowSums[x / binning] += row[x] & 0x3FFF;
+            }
+        }
+        for (uint32_t outX = 0; outX < outWidth; ++outX) {
+            out[outY * outWidth + outX] = static_cast<uint16_t>(rowSums[outX] / pixelsPerBlock);
+        }
+    }
+}
+
+QuicklookFrame encodeQuicklookCounters(uint32_t sequence) {
+    const int64_t counters[] = {
+        globalState.packetsReceived.MA.load(std::memory_order_relaxed),
+        globalState.packetsReceived.MB.load(std::memory_order_relaxed),
+        globalState.packetsReceived.ESP.load(std::memory_order_relaxed),
+        globalState.packetsReceived.MP.load(std::memory_order_relaxed),
+        globalState.packetsReceived.SHK.load(std::memory_order_relaxed),
+        globalState.packetsReceived.Unknown.load(std::memory_order_relaxed),
+        globalState.dataGapsMA.load(std::memory_order_relaxed),
+        globalState.dataGapsMB.load(std::memory_order_relaxed),
+        globalState.dataGapsMP.load(std::memory_order_relaxed),
+        globalState.dataGapsESP.load(std::memory_order_relaxed),
+        globalState.dataGapsSHK.load(std::memory_order_relaxed),
+        globalState.parityErrorsMA.load(std::memory_order_relaxed),
+        globalState.parityErrorsMB.load(std::memory_order_relaxed),
+        globalState.megsAImageCount.load(std::memory_order_relaxed),
+        globalState.megsBImageCount.load(std::memory_order_relaxed),
+        globalState.saturatedPixelsMATop.load(std::memory_order_relaxed),
+        globalState.saturatedPixelsMABottom.load(std::memory_order_relaxed),
+        globalState.saturatedPixelsMBTop.load(std::memory_order_relaxed),
+        globalState.saturatedPixelsMBBottom.load(std::memory_order_relaxed),
+        globalState.shortPacketCounter.load(std::memory_order_relaxed),
+        globalState.packetsPerSecond.load(std::memory_order_relaxed),
+    };
+    constexpr uint16_t numCounters = sizeof(counters) / sizeof(counters[0]);
+
+    FrameWriter writer(QL_MSG_COUNTERS, sequence, sizeof(uint16_t) + sizeof(counters));
+    writer.put<uint16_t>(numCounters);
+    writer.append(counters, sizeof(counters));
+    return writer.finish();
+}
+
+QuicklookFrame encodeQuicklookImage(uint16_t type, uint32_t sequence, const uint16_t image[MEGS_IMAGE_HEIGHT][MEGS_IMAGE_WIDTH],
+    uint32_t imageCount, uint32_t taiSeconds, uint32_t taiSubseconds, uint16_t binning,
+    const uint16_t (*dark)[MEGS_IMAGE_WIDTH]) {
+
+    const uint16_t width = MEGS_IMAGE_WIDTH / binning;
+    const uint16_t height = MEGS_IMAGE_HEIGHT / binning;
+    std::vector<uint16_t> pixels(size_t(width) * height);
+    downsampleMegsImage(image, binning, pixels.data(), dark);
+
+    FrameWriter writer(type, sequence, 3 * sizeof(uint32_t) + 3 * sizeof(uint16_t) + pixels.size() * sizeof(uint16_t));
+    writer.put<uint32_t>(imageCount);
+    writer.put<uint32_t>(taiSeconds);
+    writer.put<uint32_t>(taiSubseconds);
+    writer.put<uint16_t>(width);
+    writer.put<uint16_t>(height);
+    writer.put<uint16_t>(binning);
+    writer.append(pixels.data(), pixels.size() * sizeof(uint16_t));
+    return writer.finish();
+}
+
+QuicklookFrame encodeQuicklookESP(uint32_t sequence, const ESP_PACKET& esp, uint16_t newestIndex) {
+    constexpr uint16_t n = ESP_INTEGRATIONS_PER_FILE;
+    FrameWriter writer(QL_MSG_ESP, sequence, 2 * sizeof(uint32_t) + sizeof(uint16_t) + 10 * n * sizeof(uint16_t));
+    writer.put<uint32_t>(esp.tai_time_seconds);
+    writer.put<uint32_t>(esp.tai_time_subseconds);
+    writer.put<uint16_t>(n);
+    for (const uint16_t* values : {esp.ESP_xfer_cnt, esp.ESP_q0, esp.ESP_q1, esp.ESP_q2, esp.ESP_q3,
+                                   esp.ESP_171, esp.ESP_257, esp.ESP_304, esp.ESP_366, esp.ESP_dark}) {
+        putChronological(writer, values, n, newestIndex);
+    }
+    return writer.finish();
+}
+
+QuicklookFrame encodeQuicklookMEGSP(uint32_t sequence, const MEGSP_PACKET& megsp, uint16_t newestIndex) {
+    constexpr uint16_t n = MEGSP_INTEGRATIONS_PER_FILE;
+    FrameWriter writer(QL_MSG_MEGSP, sequence, 2 * sizeof(uint32_t) + sizeof(uint16_t) + 2 * n * sizeof(uint16_t));
+    writer.put<uint32_t>(megsp.tai_time_seconds);
+    writer.put<uint32_t>(megsp.tai_time_subseconds);
+    writer.put<uint16_t>(n);
+    putChronological(writer, megsp.MP_lya, n, newestIndex % n);
+    putChronological(writer, megsp.MP_dark, n, newestIndex % n);
+    return writer.finish();
+}
+
+QuicklookFrame encodeQuicklookSHK(uint32_t sequence, const SHK_CONVERTED_PACKET& shkConv) {
+    // every field is a double[SHK_INTEGRATIONS_PER_FILE], send element 0 of each like the GUI does
+    constexpr size_t fieldBytes = sizeof(double) * SHK_INTEGRATIONS_PER_FILE;
+    static_assert(sizeof(SHK_CONVERTED_PACKET) % fieldBytes == 0, "SHK_CONVERTED_PACKET must only hold double arrays");
+    constexpr uint16_t numFields = sizeof(SHK_CONVERTED_PACKET) / fieldBytes;
+
+    FrameWriter writer(QL_MSG_SHK, sequence, sizeof(uint16_t) + numFields * sizeof(float));
+    writer.put<uint16_t>(numFields);
+    const uint8_t* base = reinterpret_cast<const uint8_t*>(&shkConv);
+    for (uint16_t field = 0; field < numFields; ++field) {
+        double value;
+        std::memcpy(&value, base + field * fieldBytes, sizeof(value));
+        writer.put<float>(static_cast<float>(value));
+    }
+    return writer.finish();
+}
+
+bool parseQuicklookHeader(const uint8_t* data, size_t size, QuicklookHeader& header) {
+    if (size < sizeof(QuicklookHeader)) {
+        return false;
+    }
+    std::memcpy(&header, data, sizeof(QuicklookHeader));
+    return (header.magic == QUICKLOOK_MAGIC) && (header.version == QUICKLOOK_VERSION);
+}
+
+QuicklookServer::QuicklookServer(const QuicklookConfig& config) : config(config) {
+    if ((this->config.binning == 0) || (MEGS_IMAGE_WIDTH % this->config.binning != 0) || (MEGS_IMAGE_HEIGHT % this->config.binning != 0)) {
+        std::cerr << "QuicklookServer binning " << this->config.binning << " does not divide the image, using 4" << std::endl;
+        this->config.binning = 4;
+    }
+}
+
+QuicklookServer::~QuicklookServer() {
+    stop();
+}
+
+bool QuicklookServer::start() {
+    listenFd = socket(AF_INET, SOCK_STREAM, 0);
+    if (listenFd < 0) {
+        std::cerr << "QuicklookServer error creating socket: " << strerror(errno) << std::endl;
+        LogFileWriter::getInstance().logError("QuicklookServer error creating socket: {}", strerror(errno));
+        return false;
+    }
+
+    // Enable SO_REUSEADDR to avoid "address already in use" after a restart
+    int opt = 1;
+    setsockopt(listenFd, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt));
+
+    sockaddr_in serverAddr = {};
+    serverAddr.sin_family = AF_INET;
+    serverAddr.sin_addr.s_addr = htonl(config.loopbackOnly ? INADDR_LOOPBACK : INADDR_ANY);
+    serverAddr.sin_port = htons(config.port);
+
+    if ((bind(listenFd, reinterpret_cast<sockaddr*>(&serverAddr), sizeof(serverAddr)) < 0) || (listen(listenFd, 8) < 0)) {
+        std::cerr << "QuicklookServer error binding port " << config.port << ": " << strerror(errno) << std::endl;
+        LogFileWriter::getInstance().logError("QuicklookServer error binding port {}: {}", config.port, strerror(errno));
+        close(listenFd);
+        listenFd = -1;
+        return false;
+    }
+
+    socklen_t addrLen = sizeof(serverAddr);
+    getsockname(listenFd, reinterpret_cast<sockaddr*>(&serverAddr), &addrLen);
+    boundPort = ntohs(serverAddr.sin_port);
+    fcntl(listenFd, F_SETFL, fcntl(listenFd, F_GETFL, 0) | O_NONBLOCK);
+
+    std::cout << "Quicklook server listening on port " << boundPort << std::endl;
+    LogFileWriter::getInstance().logInfo("Quicklook server listening on port {}", boundPort);
+
+    stopRequested.store(false);
+    serverThread = std::thread(&QuicklookServer::run, this);
+    return true;
+}
+
+void QuicklookServer::stop() {
+    stopRequested.store(true);
+    if (serverThread.joinable()) {
+        serverThread.join();
+    }
+    if (listenFd >= 0) {
+        close(listenFd);
+        listenFd = -1;
+    }
+}
+
+void QuicklookServer::run() {
+    const int pollTimeoutMs = static_cast<int>(std::max<uint32_t>(10, std::min(config.imageIntervalMs, config.telemetryIntervalMs) / 2));
+    std::vector<pollfd> fds;
+
+    while (!stopRequested.load(std::memory_order_relaxed) && globalState.running.load(std::memory_order_relaxed)) {
+        fds.clear();
+        fds.push_back({listenFd, POLLIN, 0});
+        for (const Client& client : clients) {
+            fds.push_back({client.fd, static_cast<short>(POLLIN | (client.queue.empty() ? 0 : POLLOUT)), 0});
+        }
+
+        if ((poll(fds.data(), fds.size(), pollTimeoutMs) < 0) && (errno != EINTR)) {
+            LogFileWriter::getInstance().logError("QuicklookServer poll failed: {}", strerror(errno));
+            break;
+        }
+
+        for (size_t i = 1; i < fds.size(); ++i) {
+            Client& client = clients[i - 1];
+            if (fds[i].revents & (POLLERR | POLLHUP | POLLNVAL)) {
+                client.closed = true;
+            } else if (fds[i].revents & POLLIN) {
+                readRequests(client);
+            }
+        }
+        if (fds[0].revents & POLLIN) {
+            acceptClients();
+        }
+
+        // decide who is due before encoding, so nothing is encoded that nobody will receive
+        auto now = std::chrono::steady_clock::now();
+        auto isDue = [&now](std::chrono::steady_clock::time_point last, uint32_t intervalMs) {
+            return (now - last) >= std::chrono::milliseconds(intervalMs);
+        };
+        bool imagesDue = false;
+        bool telemetryDue = false;
+        for (const Client& client : clients) {
+            imagesDue |= isDue(client.lastImage, client.imageIntervalMs);
+            telemetryDue |= isDue(client.lastTelemetry, client.telemetryIntervalMs);
+        }
+        refreshChannels(imagesDue, telemetryDue);
+
+        for (Client& client : clients) {
+            if (client.closed) {
+                continue;
+            }
+            if (isDue(client.lastImage, client.imageIntervalMs)) {
+                client.lastImage = now;
+                queueFrame(client, QL_MSG_MEGSA_IMAGE, true);
+                queueFrame(client, QL_MSG_MEGSB_IMAGE, true);
+            }
+            if (isDue(client.lastTelemetry, client.telemetryIntervalMs)) {
+                client.lastTelemetry = now;
+                queueFrame(client, QL_MSG_COUNTERS, false);
+                queueFrame(client, QL_MSG_ESP, false);
+                queueFrame(client, QL_MSG_MEGSP, false);
+                queueFrame(client, QL_MSG_SHK, false);
+            }
+            flushClient(client);
+        }
+
+        auto firstClosed = std::remove_if(clients.begin(), clients.end(), [](const Client& client) {
+            if (client.closed) {
+                close(client.fd);
+                LogFileWriter::getInstance().logInfo("Quicklook client disconnected fd={}", client.fd);
+            }
+            return client.closed;
+        });
+        clients.erase(firstClosed, clients.end());
+        clientCount.store(clients.size(), std::memory_order_relaxed);
+        size_t totalQueuedBytes = 0;
+        for (const Client& client : clients) {
+            totalQueuedBytes += client.queuedBytes;
+        }
+        queuedBytes.store(totalQueuedBytes, std::memory_order_relaxed);
+    }
+
+    for (const Client& client : clients) {
+        close(client.fd);
+    }
+    clients.clear();
+    clientCount.store(0, std::memory_order_relaxed);
+    queuedBytes.store(0, std::memory_order_relaxed);
+}
+
+void QuicklookServer::acceptClients() {
+    while (true) {
+        int fd = accept(listenFd, nullptr, nullptr);
+        if (fd < 0) {
+            if ((errno != EAGAIN) && (errno != EWOULDBLOCK) && (errno != EINTR)) {
+                LogFileWriter::getInstance().logError("QuicklookServer accept failed: {}", strerror(errno));
+            }
+            return;
+        }
+        fcntl(fd, F_SETFL, fcntl(fd, F_GETFL, 0) | O_NONBLOCK);
+
+        Client client;
+        client.fd = fd;
+        client.imageIntervalMs = config.imageIntervalMs;
+        client.telemetryIntervalMs = config.telemetryIntervalMs;
+        // new clients are due immediately
+        client.lastImage = std::chrono::steady_clock::time_point();
+        client.lastTelemetry = std::chrono::steady_clock::time_point();
+        clients.push_back(std::move(client));
+        LogFileWriter::getInstance().logInfo("Quicklook client connected fd={}", fd);
+    }
+}
+
+void QuicklookServer::readRequests(Client& client) {
+    uint8_t buffer[256];
+    ssize_t bytesReceived = recv(client.fd, buffer, sizeof(buffer), MSG_DONTWAIT);
+    if (bytesReceived == 0) {
+        client.closed = true;
+        return;
+    }
+    if (bytesReceived < 0) {
+        if ((errno != EAGAIN) && (errno != EWOULDBLOCK) && (errno != EINTR)) {
+            client.closed = true;
+        }
+        return;
+    }
+    client.rxBuffer.insert(client.rxBuffer.end(), buffer, buffer + bytesReceived);
+
+    QuicklookHeader header;
+    while (client.rxBuffer.size() >= sizeof(QuicklookHeader)) {
+        if (!parseQuicklookHeader(client.rxBuffer.data(), client.rxBuffer.size(), header) || (header.payloadBytes > sizeof(buffer))) {
+            LogFileWriter::getInstance().logError("Quicklook client fd={} sent an invalid request, closing", client.fd);
+            client.closed = true;
+            return;
+        }
+        size_t messageBytes = sizeof(QuicklookHeader) + header.payloadBytes;
+        if (client.rxBuffer.size() < messageBytes) {
+            return; // wait for the rest
+        }
+        if ((header.type == QL_MSG_RATE) && (header.payloadBytes >= 2 * sizeof(uint32_t))) {
+            uint32_t intervals[2];
+            std::memcpy(intervals, client.rxBuffer.data() + sizeof(QuicklookHeader), sizeof(intervals));
+            client.imageIntervalMs = std::max(intervals[0], config.imageIntervalMs);
+            client.telemetryIntervalMs = std::max(intervals[1], config.telemetryIntervalMs);
+        }
+        client.rxBuffer.erase(client.rxBuffer.begin(), client.rxBuffer.begin() + messageBytes);
+    }
+}
+
+void QuicklookServer::refreshChannels(bool imagesDue, bool telemetryDue) {
+    if (imagesDue) {
+        uint32_t versionMA = static_cast<uint32_t>(globalState.packetsReceived.MA.load(std::memory_order_relaxed));
+        Channel& channelMA = channels[QL_MSG_MEGSA_IMAGE];
+        if (!channelMA.frame || (channelMA.sourceVersion != versionMA)) {
+            MEGS_IMAGE_METADATA metadata;
+            globalState.megsAMetadata.read(metadata);
+            std::shared_ptr<const MegsDarkFrame> dark = MegsDarkLibrary::getInstance().active(MEGSA_APID);
+            channelMA.frame = encodeQuicklookImage(QL_MSG_MEGSA_IMAGE, ++channelMA.sequence, globalState.megsa.image,
+                globalState.megsAImageCount.load(std::memory_order_relaxed), metadata.tai_time_seconds, metadata.tai_time_subseconds, config.binning,
+                dark ? dark->image : nullptr);
+            channelMA.sourceVersion = versionMA;
+        }
+
+        uint32_t versionMB = static_cast<uint32_t>(globalState.packetsReceived.MB.load(std::memory_order_relaxed));
+        Channel& channelMB = channels[QL_MSG_MEGSB_IMAGE];
+        if (!channelMB.frame || (channelMB.sourceVersion != versionMB)) {
+            MEGS_IMAGE_METADATA metadata;
+            globalState.megsBMetadata.read(metadata);
+            std::shared_ptr<const MegsDarkFrame> dark = MegsDarkLibrary::getInstance().active(MEGSB_APID);
+            channelMB.frame = encodeQuicklookImage(QL_MSG_MEGSB_IMAGE, ++channelMB.sequence, globalState.megsb.image,
+                globalState.megsBImageCount.load(std::memory_order_relaxed), metadata.tai_time_seconds, metadata.tai_time_subseconds, config.binning,
+                dark ? dark->image : nullptr);
+            channelMB.sourceVersion = versionMB;
+        }
+    }
+
+    if (!telemetryDue) {
+        return;
+    }
+
+    // counters change with every packet, always re-encode
+    Channel& counters = channels[QL_MSG_COUNTERS];
+    counters.frame = encodeQuicklookCounters(++counters.sequence);
+
+    // the index is stored after each publish, load it before the snapshots
+    uint16_t espIndex = globalState.espIndex.load(std::memory_order_acquire);
+
+    Channel& espChannel = channels[QL_MSG_ESP];
+    if (!espChannel.frame || (espChannel.sourceVersion != globalState.esp.version())) {
+        ESP_PACKET esp;
+        espChannel.sourceVersion = globalState.esp.read(esp);
+        espChannel.frame = encodeQuicklookESP(++espChannel.sequence, esp, espIndex);
+    }
+
+    Channel& megspChannel = channels[QL_MSG_MEGSP];
+    if (!megspChannel.frame || (megspChannel.sourceVersion != globalState.megsp.version())) {
+        MEGSP_PACKET megsp;
+        megspChannel.sourceVersion = globalState.megsp.read(megsp);
+        megspChannel.frame = encodeQuicklookMEGSP(++megspChannel.sequence, megsp, espIndex);
+    }
+
+    Channel& shkChannel = channels[QL_MSG_SHK];
+    if (!shkChannel.frame || (shkChannel.sourceVersion != globalState.shkConv.version())) {
+        SHK_CONVERTED_PACKET shkConv;
+        shkChannel.sourceVersion = globalState.shkConv.read(shkConv);
+        shkChannel.frame = encodeQuicklookSHK(++shkChannel.sequence, shkConv);
+    }
+}
+
+void QuicklookServer::queueFrame(Client& client, uint16_t type, bool isImage) {
+    const Channel& channel = channels[type];
+    if (!channel.frame || (client.sentSequence[type] == channel.sequence)) {
+        return; // nothing new for this client
+    }
+    if (client.queuedBytes + channel.frame->size() > config.maxQueuedBytesPerClient) {
+        // the client is not keeping up, skip this frame and offer the newest one next time
+        if (isImage) {
+            LogFileWriter::getInstance().logInfo("Quicklook client fd={} is behind, dropped image type {}", client.fd, type);
+        }
+        return;
+    }
+    client.sentSequence[type] = channel.sequence;
+    client.queuedBytes += channel.frame->size();
+    client.queue.push_back(channel.frame);
+}
+
+void QuicklookServer::flushClient(Client& client) {
+    while (!client.queue.empty()) {
+        const std::vector<uint8_t>& frame = *client.queue.front();
+        ssize_t sent = send(client.fd, frame.data() + client.sendOffset, frame.size() - client.sendOffset, MSG_NOSIGNAL | MSG_DONTWAIT);
+        if (sent < 0) {
+            if ((errno != EAGAIN) && (errno != EWOULDBLOCK) && (errno != EINTR)) {
+                client.closed = true;
+            }
+            return;
+        }
+        client.sendOffset += sent;
+        if (client.sendOffset < frame.size()) {
+            return; // socket buffer is full, finish on the next POLLOUT
+        }
+        client.queuedBytes -= frame.size();
+        client.sendOffset = 0;
+        client.queue.pop_front();
+    }
+}
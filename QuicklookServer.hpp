@@ -0,0 +1,139 @@
+#ifndef QUICKLOOK_SERVER_HPP
+#define QUICKLOOK_SERVER_HPP
+
+// Headless quicklook server. Streams downsampled MEGS images, ESP/MEGS-P time series,
+// converted SHK values and packet counters to any number of TCP clients.
+// Each frame is encoded once and the same buffer is queued to every client that is due for it,
+// so adding viewers costs socket writes only. All data comes from the lock-free snapshots in
+// ProgramState, the packet thread never waits on a client.
+//
+// Wire format, little-endian:
+//   QuicklookHeader (16 bytes) followed by payloadBytes of payload
+//   QL_MSG_COUNTERS    uint16 n, int64[n] in the order listed in encodeQuicklookCounters
+//   QL_MSG_MEGSA_IMAGE uint32 imageCount, uint32 tai_seconds, uint32 tai_subseconds,
+//   QL_MSG_MEGSB_IMAGE uint16 width, uint16 height, uint16 binning, uint16 pixels[height][width]
+//   QL_MSG_ESP         uint32 tai_seconds, uint32 tai_subseconds, uint16 n,
+//                      uint16[n] each of xfer_cnt, q0, q1, q2, q3, 171, 257, 304, 366, dark, oldest first
+//   QL_MSG_MEGSP       uint32 tai_seconds, uint32 tai_subseconds, uint16 n, uint16[n] lya, uint16[n] dark, oldest first
+//   QL_MSG_SHK         uint16 n, float[n] newest converted values in SHK_CONVERTED_PACKET field order
+// A client may send QL_MSG_RATE (header + uint32 imageIntervalMs, uint32 telemetryIntervalMs)
+// to slow its own stream down, requests faster than the server limits are clamped.
+//
+// Test with: ./rl0b_main file.rtlm -quicklook -skipRecord, then nc localhost 55012 | xxd | head
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <thread>
+#include <vector>
+#include "eve_l0b.hpp"
+
+constexpr uint16_t QUICKLOOK_DEFAULT_PORT = 55012; // surfSerialServer uses 55011
+constexpr uint32_t QUICKLOOK_MAGIC = 0x4C514556; // "VEQL" on the wire
+constexpr uint16_t QUICKLOOK_VERSION = 1;
+
+enum QuicklookMessageType : uint16_t {
+    QL_MSG_COUNTERS = 1,
+    QL_MSG_MEGSA_IMAGE = 2,
+    QL_MSG_MEGSB_IMAGE = 3,
+    QL_MSG_ESP = 4,
+    QL_MSG_MEGSP = 5,
+    QL_MSG_SHK = 6,
+    QL_MSG_RATE = 100, // client to server
+};
+
+#pragma pack(push, 1)
+struct QuicklookHeader {
+    uint32_t magic;
+    uint16_t version;
+    uint16_t type;
+    uint32_t sequence; // increments each time this message type is re-encoded
+    uint32_t payloadBytes;
+};
+#pragma pack(pop)
+static_assert(sizeof(QuicklookHeader) == 16, "QuicklookHeader must stay 16 bytes on the wire");
+
+struct QuicklookConfig {
+    uint16_t port = QUICKLOOK_DEFAULT_PORT; // 0 picks a free port, see getPort
+    bool loopbackOnly = true; // false accepts remote viewers on every interface
+    uint32_t imageIntervalMs = 1000; // fastest image rate any client gets
+    uint32_t telemetryIntervalMs = 100; // fastest counters/ESP/MEGS-P/SHK rate any client gets
+    uint16_t binning = 4; // 2048x1024 becomes 512x256 block means
+    size_t maxQueuedBytesPerClient = 4 * 1024 * 1024; // slow clients drop images beyond this
+};
+
+using QuicklookFrame = std::shared_ptr<const std::vector<uint8_t>>;
+
+// encoders are public so tests and other transports can share them
+QuicklookFrame encodeQuicklookCounters(uint32_t sequence);
+QuicklookFrame encodeQuicklookImage(uint16_t type, uint32_t sequence, const uint16_t image[MEGS_IMAGE_HEIGHT][MEGS_IMAGE_WIDTH],
+    uint32_t imageCount, uint32_t taiSeconds, uint32_t taiSubseconds, uint16_t binning,
+    const uint16_t (*dark)[MEGS_IMAGE_WIDTH] = nullptr);
+QuicklookFrame encodeQuicklookESP(uint32_t sequence, const ESP_PACKET& esp, uint16_t newestIndex);
+QuicklookFrame encodeQuicklookMEGSP(uint32_t sequence, const MEGSP_PACKET& megsp, uint16_t newestIndex);
+QuicklookFrame encodeQuicklookSHK(uint32_t sequence, const SHK_CONVERTED_PACKET& shkConv);
+
+// block mean of the 14-bit pixel values, binning must divide both image dimensions,
+// each row has the dark subtracted first when there is one
+void downsampleMegsImage(const uint16_t image[MEGS_IMAGE_HEIGHT][MEGS_IMAGE_WIDTH], uint16_t binning, uint16_t* out,
+    const uint16_t (*dark)[MEGS_IMAGE_WIDTH] = nullptr);
+
+bool parseQuicklookHeader(const uint8_t* data, size_t size, QuicklookHeader& header);
+
+class QuicklookServer {
+public:
+    explicit QuicklookServer(const QuicklookConfig& config = QuicklookConfig());
+    ~QuicklookServer();
+
+    QuicklookServer(const QuicklookServer&) = delete;
+    QuicklookServer& operator=(const QuicklookServer&) = delete;
+
+    bool start(); // binds, listens and starts the server thread
+    void stop();
+
+    uint16_t getPort() const { return boundPort; }
+    size_t getClientCount() const { return clientCount.load(std::memory_order_relaxed); }
+    size_t getQueuedBytes() const { return queuedBytes.load(std::memory_order_relaxed); } // summed over clients
+
+private:
+    struct Client {
+        int fd = -1;
+        uint32_t imageIntervalMs = 0;
+        uint32_t telemetryIntervalMs = 0;
+        std::chrono::steady_clock::time_point lastImage;
+        std::chrono::steady_clock::time_point lastTelemetry;
+        uint32_t sentSequence[QL_MSG_SHK + 1] = {0};
+        std::deque<QuicklookFrame> queue;
+        size_t queuedBytes = 0;
+        size_t sendOffset = 0; // bytes of queue.front() already sent
+        std::vector<uint8_t> rxBuffer;
+        bool closed = false;
+    };
+
+    struct Channel {
+        uint32_t sourceVersion = 0; // what the frame was encoded from
+        uint32_t sequence = 0;
+        QuicklookFrame frame;
+    };
+
+    void run();
+    void acceptClients();
+    void readRequests(Client& client);
+    void refreshChannels(bool imagesDue, bool telemetryDue);
+    void queueFrame(Client& client, uint16_t type, bool isImage);
+    void flushClient(Client& client);
+
+    QuicklookConfig config;
+    int listenFd = -1;
+    uint16_t boundPort = 0;
+    std::atomic<bool> stopRequested{false};
+    std::atomic<size_t> clientCount{0};
+    std::atomic<size_t> queuedBytes{0};
+    std::thread serverThread;
+    std::vector<Client> clients;
+    Channel channels[QL_MSG_SHK + 1];
+};
+
+#endif // QUICKLOOK_SERVER_HPP
@@ -1,6 +1,7 @@
 #include "RecordFileWriter.hpp"
 #include "TimeInfo.hpp"
 #include "FileCompressor.hpp"
+#include "PathService.hpp"
 
 int recordFileMinute=-1;
 
@@ -78,9 +79,8 @@ std::string RecordFileWriter::generateRecordFilename() {
         // create directory
     oss << std::put_time(&buf, "./record/%Y/%j/");
     std::string dirPath = oss.str();
-    // Create the directories if they don't exist, use system call
-    std::string mkdirCommand = "mkdir -p " + dirPath;
-    if (system(mkdirCommand.c_str()) != 0) {
+    // Create the directories if they don't exist
+    if (!PathService::getInstance().ensureDirectory(dirPath)) {
         std::cerr << "ERROR: Could not create directories for record file." << std::endl;
         return "";
     }
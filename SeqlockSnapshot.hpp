@@ -0,0 +1,77 @@
+#ifndef SEQLOCK_SNAPSHOT_HPP
+#define SEQLOCK_SNAPSHOT_HPP
+
+// Single writer, many reader snapshot of a trivially copyable structure.
+// The packet thread publishes a complete copy once per packet and never waits.
+// Readers copy out the latest complete value and retry only if a publish
+// overlapped the copy, so the GUI can never stall ingestion.
+
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <thread>
+#include <type_traits>
+
+template <typename T>
+class SeqlockSnapshot {
+    static_assert(std::is_trivially_copyable<T>::value, "SeqlockSnapshot requires a trivially copyable type");
+
+public:
+    SeqlockSnapshot() {
+        for (auto& word : words) {
+            word.store(0, std::memory_order_relaxed);
+        }
+    }
+
+    SeqlockSnapshot(const SeqlockSnapshot&) = delete;
+    SeqlockSnapshot& operator=(const SeqlockSnapshot&) = delete;
+
+    // Only one thread may publish. The sequence is odd while the copy is in progress.
+    void publish(const T& value) {
+        uint64_t buffer[WORDS] = {0};
+        std::memcpy(buffer, &value, sizeof(T));
+
+        uint32_t seq = sequence.load(std::memory_order_relaxed);
+        sequence.store(seq + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        for (size_t i = 0; i < WORDS; ++i) {
+            words[i].store(buffer[i], std::memory_order_relaxed);
+        }
+        sequence.store(seq + 2, std::memory_order_release);
+    }
+
+    // Copies the latest published value into out and returns the number of publishes it reflects
+    // (0 means nothing has been published yet and out holds zeros).
+    uint32_t read(T& out) const {
+        uint64_t buffer[WORDS];
+        uint32_t before, after;
+        do {
+            before = sequence.load(std::memory_order_acquire);
+            while (before & 1) {
+                std::this_thread::yield();
+                before = sequence.load(std::memory_order_acquire);
+            }
+            for (size_t i = 0; i < WORDS; ++i) {
+                buffer[i] = words[i].load(std::memory_order_relaxed);
+            }
+            std::atomic_thread_fence(std::memory_order_acquire);
+            after = sequence.load(std::memory_order_relaxed);
+        } while (before != after);
+
+        std::memcpy(&out, buffer, sizeof(T));
+        return before / 2;
+    }
+
+    // Number of completed publishes, cheap enough to poll before deciding to read
+    uint32_t version() const {
+        return sequence.load(std::memory_order_acquire) / 2;
+    }
+
+private:
+    static constexpr size_t WORDS = (sizeof(T) + sizeof(uint64_t) - 1) / sizeof(uint64_t);
+
+    std::atomic<uint32_t> sequence{0};
+    std::atomic<uint64_t> words[WORDS];
+};
+
+#endif // SEQLOCK_SNAPSHOT_HPP
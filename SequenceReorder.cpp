@@ -0,0 +1,163 @@
+#include "SequenceReorder.hpp"
+#include "LogFileWriter.hpp"
+#include "PacketStats.hpp"
+
+#include <algorithm>
+
+SequenceReorderWindow::SequenceReorderWindow(uint16_t apid, uint16_t sequenceModulus, uint16_t windowPackets, std::chrono::milliseconds timeout)
+    : apid(apid), modulus(std::max<uint16_t>(sequenceModulus, 2)),
+      window(std::min<uint16_t>(windowPackets, modulus / 2)), timeout(timeout),
+      pending(window), passed((window > 0) ? modulus : 0) {}
+
+uint64_t SequenceReorderWindow::packetHash(const std::vector<uint8_t>& packet) {
+    uint64_t hash = 0xcbf29ce484222325ULL;
+    for (uint8_t byte : packet) {
+        hash = (hash ^ byte) * 0x100000001b3ULL;
+    }
+    return hash;
+}
+
+// moves past the expected counter, emitting its packet or giving it up as missing
+void SequenceReorderWindow::advance(std::vector<std::vector<uint8_t>>& ready) {
+    PendingPacket& slot = pending[head];
+    PassedCounter& entry = passed[expected];
+    entry.serial = ++passedSerial;
+    entry.emitted = slot.occupied;
+    entry.hash = slot.hash;
+    if (slot.occupied) {
+        ready.push_back(std::move(slot.packet));
+        slot.packet.clear();
+        slot.occupied = false;
+        --waitingCount;
+    } else {
+        ++missingCount;
+        PacketStats::getInstance().count(apid, COUNTER_MISSING);
+    }
+    head = (head + 1) % window;
+    expected = static_cast<uint16_t>((expected + 1) % modulus);
+}
+
+void SequenceReorderWindow::releaseInOrder(std::vector<std::vector<uint8_t>>& ready) {
+    while ((waitingCount > 0) && pending[head].occupied) {
+        advance(ready);
+    }
+}
+
+void SequenceReorderWindow::releaseAll(std::vector<std::vector<uint8_t>>& ready) {
+    while (waitingCount > 0) {
+        advance(ready);
+    }
+}
+
+// the counters before the jump are not counted missing, the per-APID gap counters already see them
+void SequenceReorderWindow::resync(uint16_t sourceSequenceCounter, std::vector<std::vector<uint8_t>>& ready) {
+    if (synced) {
+        ++restartCount;
+        LogFileWriter::getInstance().logInfo("APID {} sequence restarted at SSC {}, expected {}", apid, sourceSequenceCounter, expected);
+    }
+    releaseAll(ready);
+    synced = true;
+    expected = sourceSequenceCounter;
+    head = 0;
+    historyStart = passedSerial;
+}
+
+void SequenceReorderWindow::forgetSequence(std::vector<std::vector<uint8_t>>& ready) {
+    releaseAll(ready);
+    synced = false;
+    historyStart = passedSerial;
+}
+
+// the entry for a counter passed since the last resync and less than half the modulus ago
+const SequenceReorderWindow::PassedCounter* SequenceReorderWindow::findPassed(uint16_t sourceSequenceCounter) const {
+    const PassedCounter& entry = passed[sourceSequenceCounter];
+    if ((entry.serial <= historyStart) || (passedSerial - entry.serial >= static_cast<uint64_t>(modulus / 2))) {
+        return nullptr;
+    }
+    return &entry;
+}
+
+void SequenceReorderWindow::push(uint16_t sourceSequenceCounter, std::vector<uint8_t> packet, Clock::time_point now,
+                                 std::vector<std::vector<uint8_t>>& ready) {
+    if (window == 0) {
+        ready.push_back(std::move(packet));
+        return;
+    }
+    sourceSequenceCounter %= modulus;
+    uint64_t hash = packetHash(packet);
+    // after a silence the counter may have restarted anywhere, even just behind where it stopped
+    if (synced && (now - lastArrival > timeout)) {
+        forgetSequence(ready);
+    }
+    lastArrival = now;
+    if (!synced) {
+        resync(sourceSequenceCounter, ready);
+    }
+
+    uint16_t ahead = static_cast<uint16_t>((sourceSequenceCounter + modulus - expected) % modulus);
+    if (ahead >= modulus - modulus / 2) {
+        // behind the expected counter, emitting it now would put it out of order
+        const PassedCounter* entry = findPassed(sourceSequenceCounter);
+        if ((entry != nullptr) && !entry->emitted) {
+            ++lateCount;
+            PacketStats::getInstance().count(apid, COUNTER_LATE);
+            return;
+        }
+        if ((entry != nullptr) && (entry->hash == hash)) {
+            ++duplicateCount;
+            PacketStats::getInstance().count(apid, COUNTER_DUPLICATES);
+            return;
+        }
+        // emitted with different bytes, or never passed: the counter went back
+        resync(sourceSequenceCounter, ready);
+        ahead = 0;
+    } else if (ahead >= window) {
+        // too far ahead to hold, give up the oldest counters until it fits
+        while ((ahead >= window) && (waitingCount > 0)) {
+            advance(ready);
+            --ahead;
+        }
+        if (ahead >= window) {
+            // nothing is held, the counters before the jump are left to the per-APID gap counters
+            expected = sourceSequenceCounter;
+            ahead = 0;
+        }
+    }
+
+    PendingPacket* slot = &pending[(head + ahead) % window];
+    if (slot->occupied) {
+        if (slot->hash == hash) {
+            ++duplicateCount;
+            PacketStats::getInstance().count(apid, COUNTER_DUPLICATES);
+            return;
+        }
+        resync(sourceSequenceCounter, ready);
+        slot = &pending[head];
+    }
+    slot->occupied = true;
+    slot->hash = hash;
+    slot->arrival = now;
+    slot->packet = std::move(packet);
+    ++waitingCount;
+    releaseInOrder(ready);
+}
+
+void SequenceReorderWindow::releaseExpired(Clock::time_point now, std::vector<std::vector<uint8_t>>& ready) {
+    while (waitingCount > 0) {
+        // the packet that has waited longest, the counters in front of it are given up
+        size_t oldest = window;
+        for (size_t n = 0; n < window; ++n) {
+            const PendingPacket& slot = pending[(head + n) % window];
+            if (slot.occupied && ((oldest == window) || (slot.arrival < pending[(head + oldest) % window].arrival))) {
+                oldest = n;
+            }
+        }
+        if (now - pending[(head + oldest) % window].arrival < timeout) {
+            return;
+        }
+        for (size_t n = 0; n <= oldest; ++n) {
+            advance(ready);
+        }
+        releaseInOrder(ready);
+    }
+}
@@ -0,0 +1,95 @@
+#ifndef SEQUENCE_REORDER_HPP
+#define SEQUENCE_REORDER_HPP
+
+// Per-APID reorder and duplicate window on the 14-bit source sequence counter.
+// Packets up to windowPackets ahead of the next expected counter wait for the missing ones,
+// so the MEGS image boundary checks only ever see counters in order.
+// A missing counter is given up once a packet behind it has waited longer than the timeout,
+// or when a packet arrives too far ahead to hold, which releases just enough of the window to fit it.
+// Every counter passed in the last half of the modulus is remembered, emitted or given up. A packet
+// behind the next expected counter is dropped as a duplicate when its bytes match the packet emitted
+// with that counter, or as late when that counter was given up. Any other packet behind, one emitted
+// with different bytes or one the window never passed, means the sequence restarted (an instrument
+// reset or a link outage across a MEGS image), so the window releases everything and resyncs.
+// An APID silent for longer than the timeout, or whose MEGS image timed out, starts its sequence again.
+// Late, duplicate and missing packets are counted in PacketStats.
+// Not thread safe, processOnePacket owns one window per APID on the packet thread.
+
+#include <chrono>
+#include <cstdint>
+#include <vector>
+
+constexpr uint16_t REORDER_DEFAULT_WINDOW_PACKETS = 32;   // about 130 ms of MEGS-A plus MEGS-B packets
+constexpr uint32_t REORDER_DEFAULT_TIMEOUT_MS = 250;
+constexpr uint16_t CCSDS_SEQUENCE_MODULUS = 16384;        // 14-bit source sequence counter
+
+class SequenceReorderWindow {
+public:
+    using Clock = std::chrono::steady_clock;
+
+    // sequenceModulus is where the counter wraps, N_PKT_PER_IMAGE for MEGS-A/B
+    // windowPackets 0 passes every packet straight through, it is limited to half the modulus
+    SequenceReorderWindow(uint16_t apid, uint16_t sequenceModulus, uint16_t windowPackets, std::chrono::milliseconds timeout);
+
+    // appends the packets that are now in order to ready, oldest counter first
+    void push(uint16_t sourceSequenceCounter, std::vector<uint8_t> packet, Clock::time_point now,
+              std::vector<std::vector<uint8_t>>& ready);
+    // gives up on the counters in front of any packet that has waited longer than the timeout
+    void releaseExpired(Clock::time_point now, std::vector<std::vector<uint8_t>>& ready);
+    // end of input, gives up on every missing counter
+    void releaseAll(std::vector<std::vector<uint8_t>>& ready);
+    // releases everything and forgets the history, the next packet starts the sequence without counting a restart
+    void forgetSequence(std::vector<std::vector<uint8_t>>& ready);
+
+    size_t waiting() const { return waitingCount; }
+    uint64_t duplicates() const { return duplicateCount; }
+    uint64_t late() const { return lateCount; }
+    uint64_t missing() const { return missingCount; }
+    uint64_t restarts() const { return restartCount; }
+
+    // FNV-1a, cheap enough to run on every packet
+    static uint64_t packetHash(const std::vector<uint8_t>& packet);
+
+private:
+    struct PendingPacket {
+        bool occupied = false;
+        uint64_t hash = 0;
+        Clock::time_point arrival;
+        std::vector<uint8_t> packet;
+    };
+
+    // what the window did with a counter the last time it moved past it
+    struct PassedCounter {
+        uint64_t serial = 0;   // passedSerial when it was passed, 0 never
+        uint64_t hash = 0;
+        bool emitted = false;
+    };
+
+    void advance(std::vector<std::vector<uint8_t>>& ready);
+    void releaseInOrder(std::vector<std::vector<uint8_t>>& ready);
+    void resync(uint16_t sourceSequenceCounter, std::vector<std::vector<uint8_t>>& ready);
+    const PassedCounter* findPassed(uint16_t sourceSequenceCounter) const;
+
+    uint16_t apid;
+    uint16_t modulus;
+    uint16_t window;
+    Clock::duration timeout;
+
+    bool synced = false;
+    uint16_t expected = 0;   // next counter to emit
+    size_t head = 0;         // pending[head] holds expected, pending[(head + n) % window] holds expected + n
+    size_t waitingCount = 0;
+    std::vector<PendingPacket> pending;
+
+    std::vector<PassedCounter> passed; // indexed by counter, modulus entries
+    uint64_t passedSerial = 0;         // counters passed since construction
+    uint64_t historyStart = 0;         // entries passed at or before this serial are forgotten
+    Clock::time_point lastArrival;
+
+    uint64_t duplicateCount = 0;
+    uint64_t lateCount = 0;
+    uint64_t missingCount = 0;
+    uint64_t restartCount = 0;
+};
+
+#endif // SEQUENCE_REORDER_HPP
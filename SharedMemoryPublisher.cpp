@@ -0,0 +1,181 @@
+#include "SharedMemoryPublisher.hpp"
+#include "commonFunctions.hpp"
+#include "LogFileWriter.hpp"
+
+#include <cerrno>
+#include <cstring>
+#include <iostream>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+namespace {
+
+template <typename Ring, typename Entry>
+void pushRing(Ring& ring, const Entry& entry) {
+    uint64_t count = ring.writeCount.load(std::memory_order_relaxed);
+    ring.entries[count % Ring::capacity] = entry;
+    ring.writeCount.store(count + 1, std::memory_order_release);
+}
+
+void fillImageInfo(EveShmImageInfo& info, const MEGS_IMAGE_REC& image, uint32_t imageCount, bool testPattern) {
+    info.imageCount = imageCount;
+    info.tai_time_seconds = image.tai_time_seconds;
+    info.tai_time_subseconds = image.tai_time_subseconds;
+    info.yyyydoy = image.yyyydoy;
+    info.sod = image.sod;
+    info.testPattern = testPattern ? 1 : 0;
+    info.packetsReceived = image.packets_received;
+}
+
+} // namespace
+
+SharedMemoryPublisher::~SharedMemoryPublisher() {
+    close();
+}
+
+bool SharedMemoryPublisher::open(const std::string& segmentName) {
+    if (segment != nullptr) {
+        return true;
+    }
+
+    // start from a fresh segment so a layout change never mixes with a stale one
+    shm_unlink(segmentName.c_str());
+    int fd = shm_open(segmentName.c_str(), O_CREAT | O_RDWR, 0644);
+    if (fd < 0) {
+        std::cerr << "ERROR: shm_open " << segmentName << " failed: " << strerror(errno) << std::endl;
+        LogFileWriter::getInstance().logError("shm_open {} failed: {}", segmentName, strerror(errno));
+        return false;
+    }
+    if (ftruncate(fd, sizeof(EveShmSegment)) != 0) {
+        std::cerr << "ERROR: ftruncate " << segmentName << " failed: " << strerror(errno) << std::endl;
+        LogFileWriter::getInstance().logError("ftruncate {} failed: {}", segmentName, strerror(errno));
+        ::close(fd);
+        shm_unlink(segmentName.c_str());
+        return false;
+    }
+
+    void* mapped = mmap(nullptr, sizeof(EveShmSegment), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    ::close(fd); // the mapping keeps the segment alive
+    if (mapped == MAP_FAILED) {
+        std::cerr << "ERROR: mmap " << segmentName << " failed: " << strerror(errno) << std::endl;
+        LogFileWriter::getInstance().logError("mmap {} failed: {}", segmentName, strerror(errno));
+        shm_unlink(segmentName.c_str());
+        return false;
+    }
+
+    // ftruncate zero fills, so every sequence, generation and writeCount starts at 0
+    segment = static_cast<EveShmSegment*>(mapped);
+    segment->version = EVE_SHM_VERSION;
+    segment->segmentBytes = sizeof(EveShmSegment);
+    segment->writerPid.store(getpid(), std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    segment->magic = EVE_SHM_MAGIC;
+    name = segmentName;
+
+    std::cout << "Publishing to shared memory " << name << " (" << sizeof(EveShmSegment) / (1024 * 1024) << " MB)" << std::endl;
+    LogFileWriter::getInstance().logInfo("Publishing to shared memory {} ({} bytes)", name, sizeof(EveShmSegment));
+    return true;
+}
+
+void SharedMemoryPublisher::close() {
+    if (segment == nullptr) {
+        return;
+    }
+    segment->writerPid.store(0, std::memory_order_release);
+    munmap(segment, sizeof(EveShmSegment));
+    shm_unlink(name.c_str());
+    segment = nullptr;
+}
+
+void SharedMemoryPublisher::beginWrite(EveShmImage& slot) {
+    slot.sequence.store(slot.sequence.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+}
+
+void SharedMemoryPublisher::endWrite(EveShmImage& slot, EveShmChannel channel) {
+    slot.sequence.store(slot.sequence.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+    segment->generation[channel].fetch_add(1, std::memory_order_release);
+}
+
+void SharedMemoryPublisher::startImage(EveShmChannel inProgressSlot, const MEGS_IMAGE_REC& image, uint32_t imageCount, bool testPattern) {
+    if (segment == nullptr) {
+        return;
+    }
+    EveShmImage& slot = segment->images[inProgressSlot];
+    beginWrite(slot);
+    fillImageInfo(slot.info, image, imageCount, testPattern);
+    slot.info.lastSourceSequenceCounter = 0;
+    endWrite(slot, inProgressSlot);
+}
+
+void SharedMemoryPublisher::publishImageRows(EveShmChannel inProgressSlot, const uint16_t image[MEGS_IMAGE_HEIGHT][MEGS_IMAGE_WIDTH], uint16_t sourceSequenceCounter) {
+    if (segment == nullptr) {
+        return;
+    }
+    uint32_t firstRow, lastRow;
+    megsTopRowsForPacket(sourceSequenceCounter, firstRow, lastRow);
+    const size_t rowBytes = (lastRow - firstRow + 1) * MEGS_IMAGE_WIDTH * sizeof(uint16_t);
+    const uint32_t firstBottomRow = MEGS_IMAGE_HEIGHT - 1 - lastRow; // mirrored rows are contiguous too
+
+    EveShmImage& slot = segment->images[inProgressSlot];
+    beginWrite(slot);
+    std::memcpy(slot.pixels[firstRow], image[firstRow], rowBytes);
+    std::memcpy(slot.pixels[firstBottomRow], image[firstBottomRow], rowBytes);
+    slot.info.lastSourceSequenceCounter = sourceSequenceCounter;
+    endWrite(slot, inProgressSlot);
+}
+
+void SharedMemoryPublisher::publishCompleteImage(EveShmChannel completeSlot, const MEGS_IMAGE_REC& image, uint32_t imageCount, bool testPattern) {
+    if (segment == nullptr) {
+        return;
+    }
+    EveShmImage& slot = segment->images[completeSlot];
+    beginWrite(slot);
+    fillImageInfo(slot.info, image, imageCount, testPattern);
+    slot.info.lastSourceSequenceCounter = N_PKT_PER_IMAGE - 1;
+    std::memcpy(slot.pixels, image.image, sizeof(slot.pixels));
+    endWrite(slot, completeSlot);
+}
+
+void SharedMemoryPublisher::publishESP(const ESP_PACKET& esp, int firstIndex, int count) {
+    if (segment == nullptr) {
+        return;
+    }
+    for (int index = firstIndex; index < firstIndex + count; ++index) {
+        EveShmESPEntry entry = {esp.tai_time_seconds, esp.tai_time_subseconds,
+            esp.ESP_xfer_cnt[index], esp.ESP_q0[index], esp.ESP_q1[index], esp.ESP_q2[index], esp.ESP_q3[index],
+            esp.ESP_171[index], esp.ESP_257[index], esp.ESP_304[index], esp.ESP_366[index], esp.ESP_dark[index]};
+        pushRing(segment->esp, entry);
+    }
+    segment->generation[EVE_SHM_ESP].fetch_add(1, std::memory_order_release);
+}
+
+void SharedMemoryPublisher::publishMEGSP(const MEGSP_PACKET& megsp, int firstIndex, int count) {
+    if (segment == nullptr) {
+        return;
+    }
+    for (int index = firstIndex; index < firstIndex + count; ++index) {
+        EveShmMEGSPEntry entry = {megsp.tai_time_seconds, megsp.tai_time_subseconds, megsp.MP_lya[index], megsp.MP_dark[index]};
+        pushRing(segment->megsp, entry);
+    }
+    segment->generation[EVE_SHM_MEGSP].fetch_add(1, std::memory_order_release);
+}
+
+void SharedMemoryPublisher::publishSHK(const SHK_CONVERTED_PACKET& shkConv, uint32_t taiSeconds) {
+    if (segment == nullptr) {
+        return;
+    }
+    // every field is a double[SHK_INTEGRATIONS_PER_FILE], gather one column per entry
+    const double* fields = reinterpret_cast<const double*>(&shkConv);
+    for (int integration = 0; integration < SHK_INTEGRATIONS_PER_FILE; ++integration) {
+        EveShmSHKEntry entry;
+        entry.tai_time_seconds = taiSeconds;
+        entry.integration = integration;
+        for (uint32_t field = 0; field < EVE_SHM_SHK_FIELDS; ++field) {
+            entry.values[field] = fields[field * SHK_INTEGRATIONS_PER_FILE + integration];
+        }
+        pushRing(segment->shk, entry);
+    }
+    segment->generation[EVE_SHM_SHK].fetch_add(1, std::memory_order_release);
+}
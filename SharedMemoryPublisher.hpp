@@ -0,0 +1,45 @@
+#ifndef SHARED_MEMORY_PUBLISHER_HPP
+#define SHARED_MEMORY_PUBLISHER_HPP
+
+// Writer side of the EveSharedMemory.hpp segment, uses Singleton pattern.
+// Only the packet thread calls the publish methods, they do nothing until open() succeeds.
+
+#include <string>
+#include "EveSharedMemory.hpp"
+
+class SharedMemoryPublisher {
+public:
+    static SharedMemoryPublisher& getInstance() {
+        static SharedMemoryPublisher instance;
+        return instance;
+    }
+
+    bool open(const std::string& segmentName = EVE_SHM_DEFAULT_NAME);
+    void close(); // unmaps and unlinks, readers that already mapped the segment keep their view
+    bool isOpen() const { return segment != nullptr; }
+
+    // first packet of a new image, resets the in-progress slot info
+    void startImage(EveShmChannel inProgressSlot, const MEGS_IMAGE_REC& image, uint32_t imageCount, bool testPattern);
+    // copy the rows written by one packet into the in-progress slot
+    void publishImageRows(EveShmChannel inProgressSlot, const uint16_t image[MEGS_IMAGE_HEIGHT][MEGS_IMAGE_WIDTH], uint16_t sourceSequenceCounter);
+    void publishCompleteImage(EveShmChannel completeSlot, const MEGS_IMAGE_REC& image, uint32_t imageCount, bool testPattern);
+
+    // integrations firstIndex to firstIndex+count-1 of the structure being filled
+    void publishESP(const ESP_PACKET& esp, int firstIndex, int count);
+    void publishMEGSP(const MEGSP_PACKET& megsp, int firstIndex, int count);
+    void publishSHK(const SHK_CONVERTED_PACKET& shkConv, uint32_t taiSeconds);
+
+private:
+    SharedMemoryPublisher() = default;
+    ~SharedMemoryPublisher();
+    SharedMemoryPublisher(const SharedMemoryPublisher&) = delete;
+    SharedMemoryPublisher& operator=(const SharedMemoryPublisher&) = delete;
+
+    void beginWrite(EveShmImage& slot);
+    void endWrite(EveShmImage& slot, EveShmChannel channel);
+
+    EveShmSegment* segment = nullptr;
+    std::string name;
+};
+
+#endif // SHARED_MEMORY_PUBLISHER_HPP
@@ -0,0 +1,139 @@
+#include "StageTimer.hpp"
+#include "PacketStats.hpp"
+#include "TraceRecorder.hpp"
+#include <algorithm>
+
+thread_local ScopedStageTimer* ScopedStageTimer::current = nullptr;
+
+StageTimers& StageTimers::getInstance() {
+    static StageTimers instance;
+    return instance;
+}
+
+const char* StageTimers::stageName(PipelineStage stage) {
+    switch (stage) {
+        case STAGE_READ:       return "read";
+        case STAGE_DECODE:     return "decode";
+        case STAGE_ASSEMBLE:   return "assemble";
+        case STAGE_SPECTRUM:   return "spectrum";
+        case STAGE_FITS_WRITE: return "fits_write";
+        case STAGE_COMPRESS:   return "compress";
+        default:               return "unknown";
+    }
+}
+
+// values below SUB_BUCKETS get their own bucket, above that the top 5 bits select the bucket
+uint32_t LatencyHistogram::bucketIndex(uint64_t nanoseconds) {
+    if (nanoseconds < SUB_BUCKETS) {
+        return static_cast<uint32_t>(nanoseconds);
+    }
+    uint32_t msb = 63 - __builtin_clzll(nanoseconds);
+    uint32_t shift = msb - SUB_BUCKET_BITS;
+    uint32_t sub = static_cast<uint32_t>(nanoseconds >> shift) & (SUB_BUCKETS - 1);
+    return (shift + 1) * SUB_BUCKETS + sub;
+}
+
+uint64_t LatencyHistogram::bucketMidpoint(uint32_t index) {
+    if (index < SUB_BUCKETS) {
+        return index;
+    }
+    uint32_t shift = index / SUB_BUCKETS - 1;
+    uint64_t lower = static_cast<uint64_t>(SUB_BUCKETS + index % SUB_BUCKETS) << shift;
+    return lower + ((uint64_t(1) << shift) >> 1);
+}
+
+void LatencyHistogram::record(uint64_t nanoseconds) {
+    buckets[bucketIndex(nanoseconds)].fetch_add(1, std::memory_order_relaxed);
+    count.fetch_add(1, std::memory_order_relaxed);
+    totalNanoseconds.fetch_add(nanoseconds, std::memory_order_relaxed);
+    uint64_t previousMax = maxNanoseconds.load(std::memory_order_relaxed);
+    while (nanoseconds > previousMax &&
+           !maxNanoseconds.compare_exchange_weak(previousMax, nanoseconds, std::memory_order_relaxed)) {
+    }
+}
+
+void LatencyHistogram::reset() {
+    for (auto& bucket : buckets) {
+        bucket.store(0, std::memory_order_relaxed);
+    }
+    count.store(0, std::memory_order_relaxed);
+    totalNanoseconds.store(0, std::memory_order_relaxed);
+    maxNanoseconds.store(0, std::memory_order_relaxed);
+}
+
+void LatencyCounts::add(const LatencyHistogram& histogram) {
+    for (uint32_t i = 0; i < LatencyHistogram::BUCKET_COUNT; ++i) {
+        buckets[i] += histogram.buckets[i].load(std::memory_order_relaxed);
+    }
+    count += histogram.count.load(std::memory_order_relaxed);
+    totalNanoseconds += histogram.totalNanoseconds.load(std::memory_order_relaxed);
+    maxNanoseconds = std::max(maxNanoseconds, histogram.maxNanoseconds.load(std::memory_order_relaxed));
+}
+
+StageLatencySummary LatencyCounts::summarize() const {
+    StageLatencySummary summary;
+    summary.count = count;
+    summary.totalSeconds = totalNanoseconds * 1.e-9;
+    summary.maxMicrosec = maxNanoseconds * 1.e-3;
+    if (count == 0) {
+        return summary;
+    }
+
+    // smallest sample with at least p of the samples at or below it
+    uint64_t rank50 = (count * 50 + 99) / 100;
+    uint64_t rank99 = (count * 99 + 99) / 100;
+    uint64_t cumulative = 0;
+    bool found50 = false;
+    for (uint32_t i = 0; i < LatencyHistogram::BUCKET_COUNT; ++i) {
+        cumulative += buckets[i];
+        if (!found50 && cumulative >= rank50) {
+            summary.p50Microsec = std::min(LatencyHistogram::bucketMidpoint(i), maxNanoseconds) * 1.e-3;
+            found50 = true;
+        }
+        if (cumulative >= rank99) {
+            summary.p99Microsec = std::min(LatencyHistogram::bucketMidpoint(i), maxNanoseconds) * 1.e-3;
+            break;
+        }
+    }
+    return summary;
+}
+
+void StageTimers::reset() {
+    for (LatencyHistogram& histogram : stages) {
+        histogram.reset();
+    }
+}
+
+StageLatencySummary StageTimers::summarize(PipelineStage stage) const {
+    LatencyCounts counts;
+    counts.add(stages[stage]);
+    return counts.summarize();
+}
+
+ScopedStageTimer::ScopedStageTimer(PipelineStage stage)
+    : stage(stage), active(StageTimers::getInstance().isEnabled() || PacketStats::getInstance().isEnabled() ||
+                           TraceRecorder::getInstance().isEnabled()) {
+    if (active) {
+        parent = current;
+        current = this;
+        start = std::chrono::steady_clock::now();
+    }
+}
+
+ScopedStageTimer::~ScopedStageTimer() {
+    if (!active) {
+        return;
+    }
+    auto end = std::chrono::steady_clock::now();
+    uint64_t elapsed = std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count();
+    uint64_t exclusive = (elapsed > childNanoseconds) ? elapsed - childNanoseconds : 0;
+    if (StageTimers::getInstance().isEnabled()) {
+        StageTimers::getInstance().record(stage, exclusive);
+    }
+    PacketStats::getInstance().recordLatency(stage, exclusive);
+    TraceRecorder::getInstance().record(StageTimers::stageName(stage), start, end); // the timeline shows nesting itself
+    if (parent) {
+        parent->childNanoseconds += elapsed;
+    }
+    current = parent;
+}
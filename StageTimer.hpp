@@ -0,0 +1,104 @@
+#ifndef STAGE_TIMER_HPP
+#define STAGE_TIMER_HPP
+
+// Latency of each stage of the packet path (read, decode, assemble, spectrum, FITS write, compress).
+// Nothing is recorded until StageTimers, PacketStats or TraceRecorder is enabled, a disabled ScopedStageTimer
+// only tests three flags. PacketStats keeps the same samples keyed by APID, TraceRecorder adds them to the timeline.
+// Stages nest, a sample is the time spent in that stage minus the time spent in the stages it called,
+// so decode does not include assemble_image and FITS write does not include compression.
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+
+enum PipelineStage : uint8_t {
+    STAGE_READ = 0,     // CCSDSReader::readNextPacket
+    STAGE_DECODE,       // processOnePacket and the per-APID processing
+    STAGE_ASSEMBLE,     // assemble_image
+    STAGE_SPECTRUM,     // MegsSpectrumAccumulator rows and spectra
+    STAGE_FITS_WRITE,   // FITSWriter::write*FITS
+    STAGE_COMPRESS,     // FileCompressor::compressBuffer, zlib gzip of each FITS product on the FITSPublisher thread
+    PIPELINE_STAGE_COUNT
+};
+
+struct StageLatencySummary {
+    uint64_t count = 0;
+    double totalSeconds = 0.0;
+    double p50Microsec = 0.0;
+    double p99Microsec = 0.0;
+    double maxMicrosec = 0.0;
+};
+
+// Log-linear latency histogram, 16 buckets per power of two, any number of threads may record
+struct LatencyHistogram {
+    static constexpr uint32_t SUB_BUCKET_BITS = 4;
+    static constexpr uint32_t SUB_BUCKETS = 1u << SUB_BUCKET_BITS;
+    static constexpr uint32_t BUCKET_COUNT = 64 * SUB_BUCKETS;
+
+    static uint32_t bucketIndex(uint64_t nanoseconds);
+    static uint64_t bucketMidpoint(uint32_t index);
+
+    void record(uint64_t nanoseconds);
+    void reset();
+
+    std::atomic<uint64_t> buckets[BUCKET_COUNT] = {};
+    std::atomic<uint64_t> count{0};
+    std::atomic<uint64_t> totalNanoseconds{0};
+    std::atomic<uint64_t> maxNanoseconds{0};
+};
+
+// Plain copy of one or more LatencyHistograms, used to sum histograms and to difference two copies
+struct LatencyCounts {
+    uint64_t buckets[LatencyHistogram::BUCKET_COUNT] = {};
+    uint64_t count = 0;
+    uint64_t totalNanoseconds = 0;
+    uint64_t maxNanoseconds = 0;
+
+    void add(const LatencyHistogram& histogram);
+    // percentiles are accurate to about 6%, max is exact
+    StageLatencySummary summarize() const;
+};
+
+class StageTimers {
+public:
+    static StageTimers& getInstance();
+
+    void enable(bool on) { enabled.store(on, std::memory_order_relaxed); }
+    bool isEnabled() const { return enabled.load(std::memory_order_relaxed); }
+
+    void record(PipelineStage stage, uint64_t nanoseconds) { stages[stage].record(nanoseconds); }
+    void reset();
+
+    // percentiles come from the histogram and are accurate to about 6%, max is exact
+    StageLatencySummary summarize(PipelineStage stage) const;
+
+    static const char* stageName(PipelineStage stage);
+
+private:
+    StageTimers() = default;
+    StageTimers(const StageTimers&) = delete;
+    StageTimers& operator=(const StageTimers&) = delete;
+
+    LatencyHistogram stages[PIPELINE_STAGE_COUNT];
+    std::atomic<bool> enabled{false};
+};
+
+class ScopedStageTimer {
+public:
+    explicit ScopedStageTimer(PipelineStage stage);
+    ~ScopedStageTimer();
+
+    ScopedStageTimer(const ScopedStageTimer&) = delete;
+    ScopedStageTimer& operator=(const ScopedStageTimer&) = delete;
+
+private:
+    PipelineStage stage;
+    bool active;
+    ScopedStageTimer* parent = nullptr;
+    uint64_t childNanoseconds = 0;
+    std::chrono::steady_clock::time_point start;
+
+    static thread_local ScopedStageTimer* current; // innermost running timer on this thread
+};
+
+#endif // STAGE_TIMER_HPP
@@ -0,0 +1,292 @@
+#include "TelemetryGenerator.hpp"
+#include "eve_megs_pixel_parity.h"
+#include "eve_megs_twoscomp.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace {
+
+constexpr uint32_t PACKET_BYTES = PACKET_HEADER_SIZE + STANDARD_MEGSAB_PACKET_LENGTH + 1;
+constexpr uint32_t PAYLOAD_DATA_OFFSET = 10; // 8 byte time, 2 byte mode
+constexpr uint32_t MEGS_PIXELS_PER_PACKET = 2 * MEGS_PIXELS_PER_HALF_PACKET;
+constexpr uint32_t MEGS_PIXELS_IN_LAST_PACKET = 8; // 16 bytes in SSC 2394
+
+// splitmix64, good enough to decorrelate packets and cheap to seed per packet
+uint64_t mix(uint64_t x) {
+    x += 0x9E3779B97F4A7C15ULL;
+    x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    x = (x ^ (x >> 27)) * 0x94D049BB133111EBULL;
+    return x ^ (x >> 31);
+}
+
+struct Random {
+    uint64_t state;
+    Random(uint64_t seed, uint16_t apid, uint64_t index) : state(mix(seed ^ (uint64_t(apid) << 48) ^ mix(index))) {}
+    uint64_t next() { state = mix(state); return state; }
+    double uniform() { return (next() >> 11) * (1.0 / 9007199254740992.0); }
+};
+
+struct PacketEvent {
+    uint32_t subseconds; // 1/65536 s
+    uint16_t apid;
+    uint64_t index;      // image index * N_PKT_PER_IMAGE + SSC for MEGS, packet count otherwise
+};
+
+void putUint16(uint8_t* p, uint16_t value) {
+    p[0] = value >> 8;
+    p[1] = value & 0xFF;
+}
+
+void putUint32(uint8_t* p, uint32_t value) {
+    p[0] = value >> 24;
+    p[1] = (value >> 16) & 0xFF;
+    p[2] = (value >> 8) & 0xFF;
+    p[3] = value & 0xFF;
+}
+
+// sync marker, primary header and secondary header time, returns the payload start
+uint8_t* startPacket(std::vector<uint8_t>& out, uint16_t apid, uint16_t ssc, uint32_t taiSeconds, uint16_t subseconds) {
+    size_t start = out.size();
+    out.resize(start + TELEMETRY_RECORD_BYTES, 0);
+    uint8_t* p = out.data() + start;
+    putUint32(p, SYNC_MARKER);
+    p += sizeof(SYNC_MARKER);
+    p[0] = 0x08 | ((apid >> 8) & 0x07); // version 0, telemetry, secondary header present
+    p[1] = apid & 0xFF;
+    p[2] = 0xC0 | ((ssc >> 8) & 0x3F);  // unsegmented
+    p[3] = ssc & 0xFF;
+    putUint16(p + 4, STANDARD_MEGSAB_PACKET_LENGTH);
+    uint8_t* payload = p + PACKET_HEADER_SIZE;
+    putUint32(payload, taiSeconds);
+    putUint16(payload + 4, subseconds);
+    return payload;
+}
+
+// slit illumination across the rows of one half, soft edged
+double slitWeight(uint32_t rowInHalf) {
+    constexpr double center = 300.0, halfWidth = 140.0, edge = 12.0;
+    double distance = std::fabs(rowInHalf - center) - halfWidth;
+    return distance <= 0.0 ? 1.0 : std::exp(-0.5 * (distance / edge) * (distance / edge));
+}
+
+// emission lines along the dispersion direction on a dark level, fixed for a given channel
+void buildSpectrum(std::vector<uint16_t>& image, uint64_t channelSeed, uint16_t dark) {
+    std::vector<double> spectrum(MEGS_IMAGE_WIDTH, 0.0);
+    Random random(channelSeed, 0, 0);
+    for (int line = 0; line < 60; ++line) {
+        double center = X_DARK_COLUMNS + random.uniform() * (MEGS_IMAGE_WIDTH - 2 * X_DARK_COLUMNS);
+        double amplitude = 200.0 + 9000.0 * std::pow(random.uniform(), 3.0);
+        for (int x = std::max(0, int(center) - 6); x < std::min(int(MEGS_IMAGE_WIDTH), int(center) + 7); ++x) {
+            double d = (x - center) / 1.3;
+            spectrum[x] += amplitude * std::exp(-0.5 * d * d);
+        }
+    }
+    for (uint32_t x = 0; x < MEGS_IMAGE_WIDTH; ++x) {
+        spectrum[x] += 150.0; // continuum
+    }
+
+    image.resize(MEGS_TOTAL_PIXELS);
+    for (uint32_t y = 0; y < MEGS_IMAGE_HEIGHT; ++y) {
+        // the bottom half is a second slit, mirrored like the readout
+        double weight = slitWeight(y < MEGS_IMAGE_HEIGHT / 2 ? y : MEGS_IMAGE_HEIGHT - 1 - y);
+        for (uint32_t x = 0; x < MEGS_IMAGE_WIDTH; ++x) {
+            bool darkColumn = (x < X_DARK_COLUMNS) || (x >= X_DARK_START_RIGHT);
+            double value = dark + (darkColumn ? 0.0 : spectrum[x] * weight);
+            image[y * MEGS_IMAGE_WIDTH + x] = static_cast<uint16_t>(std::min(value, 16383.0));
+        }
+    }
+}
+
+} // namespace
+
+void TelemetryGeneratorStats::add(const TelemetryGeneratorStats& other) {
+    packets += other.packets;
+    bytes += other.bytes;
+    dropped += other.dropped;
+    corrupted += other.corrupted;
+    megsA += other.megsA;
+    megsB += other.megsB;
+    esp += other.esp;
+    megsp += other.megsp;
+    shk += other.shk;
+}
+
+TelemetryGenerator::TelemetryGenerator(const TelemetryGeneratorConfig& generatorConfig)
+    : config(generatorConfig), rawForValue(16384) {
+    config.imageSeconds = std::max(config.imageSeconds, 1u);
+    for (uint16_t raw = 0; raw < 16384; ++raw) {
+        rawForValue[twoscomp_table[raw]] = raw;
+    }
+    if (!config.testPattern) {
+        buildSpectrum(spectrumA, config.seed ^ MEGSA_APID, 100);
+        buildSpectrum(spectrumB, config.seed ^ MEGSB_APID, 120);
+    }
+}
+
+uint16_t TelemetryGenerator::syntheticPixel(uint16_t apid, uint32_t x, uint32_t y) const {
+    const std::vector<uint16_t>& spectrum = (apid == MEGSA_APID) ? spectrumA : spectrumB;
+    return spectrum.empty() ? 0 : spectrum[y * MEGS_IMAGE_WIDTH + x];
+}
+
+void TelemetryGenerator::appendMegsPacket(uint16_t apid, uint64_t imageIndex, uint16_t ssc, uint32_t taiSeconds, uint16_t subseconds,
+                                          std::vector<uint8_t>& out) const {
+    uint8_t* pixels = startPacket(out, apid, ssc, taiSeconds, subseconds) + PAYLOAD_DATA_OFFSET;
+
+    const uint16_t* spectrum = (apid == MEGSA_APID) ? spectrumA.data() : spectrumB.data();
+    const uint32_t columnOffset = config.testPattern ? 0 : 2044; // assemble_image compensates for virtual columns
+    const uint32_t pixelCount = (ssc == N_PKT_PER_IMAGE - 1) ? MEGS_PIXELS_IN_LAST_PACKET : MEGS_PIXELS_PER_PACKET;
+    const uint32_t firstPixel = ssc * MEGS_PIXELS_PER_HALF_PACKET;
+    // the spectrum brightens and dims slowly from image to image, with a few DN of noise per pixel
+    const int32_t scale256 = 256 + static_cast<int32_t>(24.0 * std::sin(0.3 * imageIndex));
+    Random noise(config.seed, apid + 1000, imageIndex * N_PKT_PER_IMAGE + ssc);
+    uint64_t noiseBits = 0;
+
+    for (uint32_t jrel = 0; jrel < pixelCount; ++jrel) {
+        uint32_t kk = firstPixel + (jrel >> 1);
+        bool top = (jrel & 1) == 0;
+        uint16_t raw;
+        if (config.testPattern) {
+            raw = (top ? 2 * kk : kk) & 0x3FFF;
+        } else {
+            uint32_t y = top ? (kk >> 11) : (MEGS_IMAGE_HEIGHT - 1) - (kk >> 11);
+            uint32_t x = (kk + columnOffset) & (MEGS_IMAGE_WIDTH - 1);
+            if (!top) {
+                x = (MEGS_IMAGE_WIDTH - 1) - x;
+            }
+            if ((jrel & 7) == 0) {
+                noiseBits = noise.next();
+            }
+            int32_t base = spectrum[y * MEGS_IMAGE_WIDTH + x];
+            int32_t value = 100 + (((base - 100) * scale256) >> 8) + static_cast<int32_t>((noiseBits >> (8 * (jrel & 7))) & 7) - 4;
+            raw = rawForValue[std::min(std::max(value, 0), 16383)];
+        }
+        uint16_t pixval16 = raw | (odd_parity_15bit_table[raw] << 15);
+        putUint16(pixels + 2 * jrel, pixval16);
+    }
+}
+
+void TelemetryGenerator::appendESPPacket(uint64_t packetIndex, uint32_t taiSeconds, uint16_t subseconds, std::vector<uint8_t>& out) const {
+    uint16_t ssc = packetIndex & 0x3FFF;
+    uint8_t* data = startPacket(out, ESP_APID, ssc, taiSeconds, subseconds) + PAYLOAD_DATA_OFFSET;
+    Random noise(config.seed, ESP_APID, packetIndex);
+    constexpr int bytesPerIntegration = 20;
+    for (int i = 0; i < ESP_INTEGRATIONS_PER_PACKET; ++i) {
+        uint64_t integration = packetIndex * ESP_INTEGRATIONS_PER_PACKET + i;
+        double variation = 1.0 + 0.05 * std::sin(integration * 0.01);
+        auto diode = [&](double level) { return static_cast<uint16_t>(level * variation + (noise.next() & 63)); };
+        uint8_t* p = data + i * bytesPerIntegration;
+        // same order processESPPacket decodes
+        putUint16(p, integration & 0xFFFF);
+        putUint16(p + 2, diode(12000));  // 366
+        putUint16(p + 4, diode(15000));  // 257
+        putUint16(p + 6, static_cast<uint16_t>(500 + (noise.next() & 15))); // dark
+        putUint16(p + 8, diode(8000));   // q2
+        putUint16(p + 10, diode(8200));  // q0
+        putUint16(p + 12, diode(7900));  // q1
+        putUint16(p + 14, diode(8100));  // q3
+        putUint16(p + 16, diode(20000)); // 171
+        putUint16(p + 18, diode(30000)); // 304
+    }
+}
+
+void TelemetryGenerator::appendMEGSPPacket(uint64_t packetIndex, uint32_t taiSeconds, uint16_t subseconds, std::vector<uint8_t>& out) const {
+    uint16_t ssc = packetIndex & 0x3FFF;
+    uint8_t* data = startPacket(out, MEGSP_APID, ssc, taiSeconds, subseconds) + PAYLOAD_DATA_OFFSET;
+    Random noise(config.seed, MEGSP_APID, packetIndex);
+    for (int i = 0; i < MEGSP_INTEGRATIONS_PER_PACKET; ++i) {
+        uint64_t integration = packetIndex * MEGSP_INTEGRATIONS_PER_PACKET + i;
+        putUint16(data + 4 * i, static_cast<uint16_t>(25000.0 * (1.0 + 0.05 * std::sin(integration * 0.01)) + (noise.next() & 63)));
+        putUint16(data + 4 * i + 2, static_cast<uint16_t>(400 + (noise.next() & 15)));
+    }
+}
+
+void TelemetryGenerator::appendSHKPacket(uint64_t packetIndex, uint32_t taiSeconds, uint16_t subseconds, std::vector<uint8_t>& out) const {
+    uint16_t ssc = packetIndex & 0x3FFF;
+    uint8_t* payload = startPacket(out, SHK_APID, ssc, taiSeconds, subseconds);
+    payload[9] = 1; // mode, integration rate in seconds
+    Random noise(config.seed, SHK_APID, packetIndex);
+    // 32-bit DN values from payload[14], mid-scale with a little noise, 61 slots including spares
+    for (uint32_t slot = 1; slot <= 61; ++slot) {
+        putUint32(payload + PAYLOAD_DATA_OFFSET + 4 * slot, 2048 + 16 * slot + (noise.next() & 7));
+    }
+}
+
+void TelemetryGenerator::generateSecond(uint64_t second, std::vector<uint8_t>& out, TelemetryGeneratorStats& stats) const {
+    std::vector<PacketEvent> events;
+    events.reserve(2 * (N_PKT_PER_IMAGE / config.imageSeconds + 2) + config.espPacketsPerSecond +
+                   config.megspPacketsPerSecond + config.shkPacketsPerSecond);
+
+    // MEGS packets are spread evenly over the image cadence
+    const uint64_t imageIndex = second / config.imageSeconds;
+    const uint64_t secondInImage = second % config.imageSeconds;
+    const uint32_t firstSSC = (secondInImage * N_PKT_PER_IMAGE + config.imageSeconds - 1) / config.imageSeconds;
+    const uint32_t endSSC = ((secondInImage + 1) * N_PKT_PER_IMAGE + config.imageSeconds - 1) / config.imageSeconds;
+    for (uint16_t apid : {MEGSA_APID, MEGSB_APID}) {
+        if ((apid == MEGSA_APID) ? !config.megsA : !config.megsB) {
+            continue;
+        }
+        for (uint32_t ssc = firstSSC; ssc < endSSC; ++ssc) {
+            double offset = double(ssc) * config.imageSeconds / N_PKT_PER_IMAGE - secondInImage;
+            events.push_back({static_cast<uint32_t>(offset * 65536.0), apid, imageIndex * N_PKT_PER_IMAGE + ssc});
+        }
+    }
+    auto addPeriodic = [&](uint16_t apid, uint32_t perSecond) {
+        for (uint32_t k = 0; k < perSecond; ++k) {
+            events.push_back({static_cast<uint32_t>((uint64_t(k) << 16) / perSecond), apid, second * perSecond + k});
+        }
+    };
+    addPeriodic(ESP_APID, config.espPacketsPerSecond);
+    addPeriodic(MEGSP_APID, config.megspPacketsPerSecond);
+    addPeriodic(SHK_APID, config.shkPacketsPerSecond);
+    std::stable_sort(events.begin(), events.end(),
+        [](const PacketEvent& a, const PacketEvent& b) { return a.subseconds < b.subseconds; });
+
+    const uint32_t taiSeconds = config.startTai + static_cast<uint32_t>(second);
+    for (const PacketEvent& event : events) {
+        Random fault(config.seed, event.apid + 2000, event.index);
+        if ((config.gapRate > 0.0) && (fault.uniform() < config.gapRate)) {
+            stats.dropped++;
+            continue;
+        }
+
+        size_t start = out.size();
+        uint16_t subseconds = static_cast<uint16_t>(std::min(event.subseconds, 65535u));
+        uint32_t dataBytes = PACKET_BYTES - PACKET_HEADER_SIZE - PAYLOAD_DATA_OFFSET;
+        switch (event.apid) {
+            case MEGSA_APID:
+            case MEGSB_APID: {
+                uint16_t ssc = event.index % N_PKT_PER_IMAGE;
+                appendMegsPacket(event.apid, event.index / N_PKT_PER_IMAGE, ssc, taiSeconds, subseconds, out);
+                dataBytes = 2 * ((ssc == N_PKT_PER_IMAGE - 1) ? MEGS_PIXELS_IN_LAST_PACKET : MEGS_PIXELS_PER_PACKET);
+                if (event.apid == MEGSA_APID) {
+                    stats.megsA++;
+                } else {
+                    stats.megsB++;
+                }
+                break;
+            }
+            case ESP_APID:
+                appendESPPacket(event.index, taiSeconds, subseconds, out);
+                stats.esp++;
+                break;
+            case MEGSP_APID:
+                appendMEGSPPacket(event.index, taiSeconds, subseconds, out);
+                stats.megsp++;
+                break;
+            case SHK_APID:
+                appendSHKPacket(event.index, taiSeconds, subseconds, out);
+                stats.shk++;
+                break;
+        }
+
+        if ((config.corruptRate > 0.0) && (fault.uniform() < config.corruptRate)) {
+            // one flipped bit in the data, a MEGS pixel then fails its parity check
+            uint64_t bit = fault.next() % (dataBytes * 8);
+            out[start + sizeof(SYNC_MARKER) + PACKET_HEADER_SIZE + PAYLOAD_DATA_OFFSET + bit / 8] ^= uint8_t(1u << (bit % 8));
+            stats.corrupted++;
+        }
+        stats.packets++;
+        stats.bytes += TELEMETRY_RECORD_BYTES;
+    }
+}
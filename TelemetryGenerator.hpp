@@ -0,0 +1,69 @@
+#ifndef TELEMETRY_GENERATOR_HPP
+#define TELEMETRY_GENERATOR_HPP
+
+// Synthetic telemetry in record file format (sync marker then CCSDS packet) for every APID in eve_l0b.hpp.
+// MEGS-A/B images are encoded the way assemble_image decodes them (odd parity, two's complement,
+// virtual column offset), either as the FPGA test pattern or as a synthetic line spectrum.
+// Every simulated second is generated independently, so callers can fill seconds on many threads
+// and write them out in order.
+
+#include <cstdint>
+#include <vector>
+#include "eve_l0b.hpp"
+
+struct TelemetryGeneratorConfig {
+    uint32_t startTai = 2114380837;   // 2025-01-01T00:00:00 UTC
+    uint32_t imageSeconds = 10;        // MEGS-A and MEGS-B cadence, 2395 packets per image
+    bool megsA = true;
+    bool megsB = true;
+    bool testPattern = false;          // FPGA test pattern instead of a synthetic spectrum
+    uint32_t espPacketsPerSecond = 1;
+    uint32_t megspPacketsPerSecond = 1;
+    uint32_t shkPacketsPerSecond = 1;
+    double gapRate = 0.0;              // probability that a packet is dropped, its SSC is still used
+    double corruptRate = 0.0;          // probability that one bit of a packet is flipped
+    uint64_t seed = 1;
+};
+
+struct TelemetryGeneratorStats {
+    uint64_t packets = 0;
+    uint64_t bytes = 0;
+    uint64_t dropped = 0;
+    uint64_t corrupted = 0;
+    uint64_t megsA = 0;
+    uint64_t megsB = 0;
+    uint64_t esp = 0;
+    uint64_t megsp = 0;
+    uint64_t shk = 0;
+
+    void add(const TelemetryGeneratorStats& other);
+};
+
+constexpr size_t TELEMETRY_RECORD_BYTES = sizeof(SYNC_MARKER) + PACKET_HEADER_SIZE + STANDARD_MEGSAB_PACKET_LENGTH + 1;
+
+class TelemetryGenerator {
+public:
+    explicit TelemetryGenerator(const TelemetryGeneratorConfig& config);
+
+    // appends every packet timed within simulated second (0 is startTai) to out in time order, thread safe
+    void generateSecond(uint64_t second, std::vector<uint8_t>& out, TelemetryGeneratorStats& stats) const;
+
+    // the decoded value assemble_image should produce before noise, for checks
+    uint16_t syntheticPixel(uint16_t apid, uint32_t x, uint32_t y) const;
+
+    const TelemetryGeneratorConfig& getConfig() const { return config; }
+
+private:
+    void appendMegsPacket(uint16_t apid, uint64_t imageIndex, uint16_t ssc, uint32_t taiSeconds, uint16_t subseconds,
+                          std::vector<uint8_t>& out) const;
+    void appendESPPacket(uint64_t packetIndex, uint32_t taiSeconds, uint16_t subseconds, std::vector<uint8_t>& out) const;
+    void appendMEGSPPacket(uint64_t packetIndex, uint32_t taiSeconds, uint16_t subseconds, std::vector<uint8_t>& out) const;
+    void appendSHKPacket(uint64_t packetIndex, uint32_t taiSeconds, uint16_t subseconds, std::vector<uint8_t>& out) const;
+
+    TelemetryGeneratorConfig config;
+    std::vector<uint16_t> rawForValue;  // inverse of twoscomp_table
+    std::vector<uint16_t> spectrumA;    // synthetic decoded images, MEGS_TOTAL_PIXELS each
+    std::vector<uint16_t> spectrumB;
+};
+
+#endif // TELEMETRY_GENERATOR_HPP
@@ -0,0 +1,169 @@
+#include "TraceRecorder.hpp"
+#include "LogFileWriter.hpp"
+#include "PathService.hpp"
+#include "ProgramState.hpp"
+
+#include <algorithm>
+#include <cstdio>
+#include <ctime>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+namespace {
+thread_local bool hasRing = false; // rings are only allocated by threads that record
+thread_local const char* pendingThreadName = nullptr; // applied when the ring is created
+}
+
+TraceRecorder& TraceRecorder::getInstance() {
+    static TraceRecorder instance;
+    return instance;
+}
+
+TraceRecorder::TraceRecorder() : epoch(std::chrono::steady_clock::now()) {}
+
+TraceRecorder::~TraceRecorder() {
+    stop();
+}
+
+// the ring lives until exit so events from threads that have finished can still be dumped
+TraceRecorder::ThreadRing& TraceRecorder::localRing() {
+    thread_local ThreadRing* ring = nullptr;
+    if (ring == nullptr) {
+        std::unique_ptr<ThreadRing> newRing(new ThreadRing());
+        newRing->tid = static_cast<int32_t>(syscall(SYS_gettid));
+        newRing->threadName.store(pendingThreadName, std::memory_order_relaxed);
+        std::lock_guard<std::mutex> lock(ringMutex);
+        rings.push_back(std::move(newRing));
+        ring = rings.back().get();
+        hasRing = true;
+    }
+    return *ring;
+}
+
+void TraceRecorder::setThreadName(const char* name) {
+    pendingThreadName = name;
+    if (hasRing) {
+        localRing().threadName.store(name, std::memory_order_relaxed);
+    }
+}
+
+void TraceRecorder::record(const char* name, std::chrono::steady_clock::time_point begin, std::chrono::steady_clock::time_point end) {
+    if (!isEnabled()) {
+        return;
+    }
+    ThreadRing& ring = localRing();
+    uint64_t index = ring.written.load(std::memory_order_relaxed);
+    TraceSlot& slot = ring.slots[index % TRACE_EVENTS_PER_THREAD];
+    slot.name.store(name, std::memory_order_relaxed);
+    slot.beginNanoseconds.store(std::chrono::duration_cast<std::chrono::nanoseconds>(begin - epoch).count(), std::memory_order_relaxed);
+    slot.durationNanoseconds.store(std::chrono::duration_cast<std::chrono::nanoseconds>(end - begin).count(), std::memory_order_relaxed);
+    ring.written.store(index + 1, std::memory_order_release);
+}
+
+// copies each ring newest last, then drops the events the owner may have overwritten during the copy
+bool TraceRecorder::writeChromeTrace(const std::string& filename) {
+    struct CopiedEvent {
+        const char* name;
+        uint64_t beginNanoseconds;
+        uint64_t durationNanoseconds;
+    };
+
+    std::ofstream json(filename);
+    if (!json.is_open()) {
+        return false;
+    }
+    const int pid = static_cast<int>(getpid());
+    json << std::fixed << std::setprecision(3);
+    json << "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [\n";
+    json << "{\"name\": \"process_name\", \"ph\": \"M\", \"pid\": " << pid << ", \"args\": {\"name\": \"rl0b_main\"}}";
+
+    std::lock_guard<std::mutex> lock(ringMutex);
+    std::vector<CopiedEvent> events;
+    for (const auto& ring : rings) {
+        uint64_t end = ring->written.load(std::memory_order_acquire);
+        uint64_t begin = (end > TRACE_EVENTS_PER_THREAD) ? end - TRACE_EVENTS_PER_THREAD : 0;
+        events.clear();
+        for (uint64_t i = begin; i < end; ++i) {
+            const TraceSlot& slot = ring->slots[i % TRACE_EVENTS_PER_THREAD];
+            events.push_back({slot.name.load(std::memory_order_relaxed),
+                slot.beginNanoseconds.load(std::memory_order_relaxed),
+                slot.durationNanoseconds.load(std::memory_order_relaxed)});
+        }
+        std::atomic_thread_fence(std::memory_order_acquire);
+        uint64_t after = ring->written.load(std::memory_order_relaxed);
+        // the owner may be part way through overwriting event after - size, so drop one more than it has finished
+        uint64_t firstIntact = (after + 1 > TRACE_EVENTS_PER_THREAD) ? after + 1 - TRACE_EVENTS_PER_THREAD : 0;
+        size_t skip = static_cast<size_t>(std::min<uint64_t>(events.size(), (firstIntact > begin) ? firstIntact - begin : 0));
+
+        const char* threadName = ring->threadName.load(std::memory_order_relaxed);
+        if (threadName != nullptr) {
+            json << ",\n{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": " << pid << ", \"tid\": " << ring->tid
+                 << ", \"args\": {\"name\": \"" << threadName << "\"}}";
+        }
+        for (size_t i = skip; i < events.size(); ++i) {
+            json << ",\n{\"name\": \"" << events[i].name << "\", \"cat\": \"eve\", \"ph\": \"X\", \"pid\": " << pid
+                 << ", \"tid\": " << ring->tid << ", \"ts\": " << events[i].beginNanoseconds * 1.e-3
+                 << ", \"dur\": " << events[i].durationNanoseconds * 1.e-3 << "}";
+        }
+    }
+    json << "\n]}\n";
+    return json.good();
+}
+
+// next to the log files, see LogFileWriter::generateLogFilename
+std::string TraceRecorder::generateTraceFilename() {
+    auto now = std::chrono::system_clock::now();
+    auto in_time_t = std::chrono::system_clock::to_time_t(now);
+
+    std::tm buf;
+    localtime_r(&in_time_t, &buf);
+
+    std::ostringstream oss;
+    oss << std::put_time(&buf, "./logs/%Y/%j/");
+    if (!PathService::getInstance().ensureDirectory(oss.str())) {
+        std::cerr << "ERROR: Could not create directories for trace file." << std::endl;
+    }
+    oss << std::put_time(&buf, "trace_%Y_%j_%m_%d_%H_%M_%S") << ".json";
+    return oss.str();
+}
+
+bool TraceRecorder::start() {
+    enable(true);
+    std::lock_guard<std::mutex> lock(threadMutex);
+    if (dumpThread.joinable()) {
+        return true;
+    }
+    stopRequested.store(false);
+    dumpThread = std::thread(&TraceRecorder::runDumpThread, this);
+    return true;
+}
+
+void TraceRecorder::stop() {
+    enable(false);
+    stopRequested.store(true);
+    std::lock_guard<std::mutex> lock(threadMutex);
+    if (dumpThread.joinable()) {
+        dumpThread.join();
+    }
+}
+
+void TraceRecorder::runDumpThread() {
+    while (!stopRequested.load(std::memory_order_relaxed) && globalState.running.load(std::memory_order_relaxed)) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+        if (!dumpRequested.exchange(false, std::memory_order_relaxed)) {
+            continue;
+        }
+        std::string filename = generateTraceFilename();
+        if (writeChromeTrace(filename)) {
+            std::cout << "Trace written: " << filename << std::endl;
+            LogFileWriter::getInstance().logInfo("Trace written: {}", filename);
+        } else {
+            std::cerr << "ERROR: Failed to write trace " << filename << std::endl;
+            LogFileWriter::getInstance().logError("Failed to write trace {}", filename);
+        }
+    }
+}
@@ -0,0 +1,104 @@
+#ifndef TRACE_RECORDER_HPP
+#define TRACE_RECORDER_HPP
+
+// Timeline capture of the USB, packet, GUI and compressor threads in Chrome trace JSON,
+// open the dump in ui.perfetto.dev or chrome://tracing.
+// Each thread appends complete events to its own ring of TRACE_EVENTS_PER_THREAD events,
+// so a marker costs two clock reads and three relaxed stores, and the ring keeps the newest events.
+// Nothing is recorded until enable(true). ScopedStageTimer stages are traced as well.
+// rl0b_main -trace starts recording, SIGUSR1 or the GUI Timeline Trace button writes
+// ./logs/YYYY/DOY/trace_*.json from the dump thread.
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+constexpr uint32_t TRACE_EVENTS_PER_THREAD = 65536; // 1.5 MB per traced thread
+
+class TraceRecorder {
+public:
+    static TraceRecorder& getInstance();
+
+    void enable(bool on) { enabled.store(on, std::memory_order_relaxed); }
+    bool isEnabled() const { return enabled.load(std::memory_order_relaxed); }
+
+    // enables recording and starts the dump thread, does nothing if it is already running
+    bool start();
+    void stop();
+
+    // labels the calling thread's track, name must outlive the program (a string literal)
+    void setThreadName(const char* name);
+
+    // name must be a string literal, the dump reads it after the caller has returned
+    void record(const char* name, std::chrono::steady_clock::time_point begin, std::chrono::steady_clock::time_point end);
+
+    // async-signal-safe, the dump thread writes the file
+    void requestDump() { dumpRequested.store(true, std::memory_order_relaxed); }
+
+    bool writeChromeTrace(const std::string& filename);
+    static std::string generateTraceFilename();
+
+private:
+    TraceRecorder();
+    ~TraceRecorder();
+    TraceRecorder(const TraceRecorder&) = delete;
+    TraceRecorder& operator=(const TraceRecorder&) = delete;
+
+    // slots are atomics so the dump can copy them while the owner keeps writing
+    struct TraceSlot {
+        std::atomic<const char*> name{nullptr};
+        std::atomic<uint64_t> beginNanoseconds{0};
+        std::atomic<uint64_t> durationNanoseconds{0};
+    };
+
+    struct ThreadRing {
+        std::atomic<uint64_t> written{0}; // events ever recorded, the newest is at (written - 1) % size
+        std::atomic<const char*> threadName{nullptr};
+        int32_t tid = 0;
+        TraceSlot slots[TRACE_EVENTS_PER_THREAD];
+    };
+
+    ThreadRing& localRing();
+    void runDumpThread();
+
+    std::atomic<bool> enabled{false};
+    std::atomic<bool> dumpRequested{false};
+    std::atomic<bool> stopRequested{false};
+    std::chrono::steady_clock::time_point epoch; // trace timestamps count from here
+
+    std::mutex ringMutex; // guards rings, taken once per thread and by writeChromeTrace
+    std::vector<std::unique_ptr<ThreadRing>> rings;
+
+    std::mutex threadMutex; // guards dumpThread between the main and GUI threads
+    std::thread dumpThread;
+};
+
+class ScopedTrace {
+public:
+    explicit ScopedTrace(const char* name)
+        : name(name), active(TraceRecorder::getInstance().isEnabled()) {
+        if (active) {
+            begin = std::chrono::steady_clock::now();
+        }
+    }
+    ~ScopedTrace() {
+        if (active) {
+            TraceRecorder::getInstance().record(name, begin, std::chrono::steady_clock::now());
+        }
+    }
+
+    ScopedTrace(const ScopedTrace&) = delete;
+    ScopedTrace& operator=(const ScopedTrace&) = delete;
+
+private:
+    const char* name;
+    bool active;
+    std::chrono::steady_clock::time_point begin;
+};
+
+#endif // TRACE_RECORDER_HPP
@@ -1,6 +1,8 @@
 #include "USBInputSource.hpp"
 #include "RecordFileWriter.hpp"
 #include "FITSWriter.hpp"
+#include "PacketStats.hpp"
+#include "TraceRecorder.hpp"
 
 #include <fstream>   // For file I/O
 #include <cstdint>   // For uint32_t
@@ -34,6 +36,7 @@ extern ProgramState globalState;
 extern void handleSigint(int signal);
 
 void extern processOnePacket(CCSDSReader& pktReader, const std::vector<uint8_t>& packet);
+void extern tickPacketProcessing(CCSDSReader& pktReader, std::chrono::steady_clock::time_point now);
 
 // Function to log device information using spdlog
 void logDeviceInfo(const okTDeviceInfo& devInfo) {
@@ -174,6 +177,7 @@ bool readFromCapturedFile(const std::string& filename, uint32_t* buffer, size_t
 
 // if a capturedFilename is provided, read from the captured file, otherwise read from the USB device
 int32_t USBInputSource::readDataFromUSB(const char * capturedFilename) {
+    ScopedTrace trace("readDataFromUSB");
     constexpr int16_t blockSize = 1024; // bytes
     constexpr int32_t transferLength = blockSize * 64; // bytes to read
     if (capturedFilename) {
@@ -503,6 +507,7 @@ void USBInputSource::replaceCGProxRx(CCSDSReader& usbReader)
     while (isReceiveFIFOEmpty()) {
         handleReceiveFIFOError();
         std::cout<<"Waiting for data..."<<std::endl;
+        tickPacketProcessing(usbReader, std::chrono::steady_clock::now());
     }
 
     // LSB register bit is stat_tx_empty - don't need that bit
@@ -629,6 +634,9 @@ void USBInputSource::replaceCGProxRx(CCSDSReader& usbReader)
 
         } // the while continueLookingForPackets loop
 
+        // a read with no packets still times out missing packets and stalled MEGS images
+        tickPacketProcessing(usbReader, std::chrono::steady_clock::now());
+
         // we need to store the rest for the next read
         numberOfRemainingUnusedBytes = totalValidBytes - byteIdx;
         if (numberOfRemainingUnusedBytes > 0) 
@@ -676,6 +684,7 @@ void USBInputSource::CGProcRx(CCSDSReader& usbReader)
         while (isReceiveFIFOEmpty()) {
             handleReceiveFIFOError();
             std::cout<<"Waiting for data..."<<std::endl;
+            tickPacketProcessing(usbReader, std::chrono::steady_clock::now());
         }
     }
 
@@ -718,6 +727,7 @@ void USBInputSource::CGProcRx(CCSDSReader& usbReader)
         }
 
 	    // cycle through 64 blocks
+        ScopedTrace deframeTrace("CGProcRx deframe"); // includes processing of the packets it completes
 	    for (blk = 0; blk <= 63; ++blk)
 	    {
 		    // get amount of data in block
@@ -773,6 +783,7 @@ void USBInputSource::CGProcRx(CCSDSReader& usbReader)
                             uint32_t expectedNumBytes = LUT_PktLen[APIDidx] + 1 + PACKET_HEADER_SIZE;
                             if (bytesCopiedToPktBuff != (expectedNumBytes)) {
                                 std::cerr << "***ERROR: CGProxRx case 1 bytesCopiedToPktBuff does not match expectedNumBytes" << std::endl;
+                                PacketStats::getInstance().count(APID, COUNTER_LENGTH_ERRORS);
                             }
     						GSEProcessPacket(PktBuff, APID, usbReader);
                             bytesCopiedToPktBuff = 0; // reset the count
@@ -795,6 +806,7 @@ void USBInputSource::CGProcRx(CCSDSReader& usbReader)
 	    			{
 	    				state = 0;
                         LogFileWriter::getInstance().logError("CGProxRx: Unrecognized APID {}",APID);
+                        PacketStats::getInstance().count(APID, COUNTER_DROPS);
 	    			}
 	    			break;
 
@@ -819,6 +831,7 @@ void USBInputSource::CGProcRx(CCSDSReader& usbReader)
                         if (bytesCopiedToPktBuff != (expectedNumBytes)) {
                         //    std::cerr << "***ERROR: CGProxRx case 2 bytesCopiedToPktBuff "<< bytesCopiedToPktBuff<<" does not match expectedNumBytes "<< expectedNumBytes << std::endl;
                             LogFileWriter::getInstance().logError("CGProxRx case 2 bytesCopiedToPktBuff {} does not match LUT_PktLen",bytesCopiedToPktBuff);
+                            PacketStats::getInstance().count(APID, COUNTER_LENGTH_ERRORS);
                         }
     					GSEProcessPacket(PktBuff, APID, usbReader);
                         bytesCopiedToPktBuff = 0; // reset the count
@@ -842,6 +855,9 @@ void USBInputSource::CGProcRx(CCSDSReader& usbReader)
     		}
         } // iloop
 
+        // a read with no packets still times out missing packets and stalled MEGS images
+        tickPacketProcessing(usbReader, std::chrono::steady_clock::now());
+
 	}
 }
 
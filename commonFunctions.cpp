@@ -2,8 +2,11 @@
 
 #include "commonFunctions.hpp"
 
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
 extern ProgramState globalState;
-extern std::mutex mtx;
 
 // Function returns false if filename is empty
 bool isValidFilename(const std::string& filename) {
@@ -45,7 +48,8 @@ bool create_directory_if_not_exists(const std::string& path) {
     return true;
 }
 
-// Convert 2d image into 1d image in transpose order for writing to a FITS image HDU
+// Copy the 2d image into a 1d vector in row order, this flattens rather than transposes
+// FITSWriter writes straight from the image, see transposeImage for the transposed layout
 std::vector<uint16_t> transposeImageTo1D(const uint16_t image[MEGS_IMAGE_HEIGHT][MEGS_IMAGE_WIDTH]) {
     const uint32_t width = MEGS_IMAGE_WIDTH;
     const uint32_t height = MEGS_IMAGE_HEIGHT;
@@ -60,6 +64,71 @@ std::vector<uint16_t> transposeImageTo1D(const uint16_t image[MEGS_IMAGE_HEIGHT]
     return transposedData;
 }
 
+namespace {
+constexpr uint32_t TRANSPOSE_TILE = 64; // a 64x64 tile of source and destination is 16 KB, inside L1
+
+// transposes the 8x8 block at src into dst, strides are in pixels
+inline void transposeBlock8x8(const uint16_t* src, size_t srcStride, uint16_t* dst, size_t dstStride) {
+#if defined(__SSE2__)
+    __m128i a0 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + 0 * srcStride));
+    __m128i a1 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + 1 * srcStride));
+    __m128i a2 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + 2 * srcStride));
+    __m128i a3 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + 3 * srcStride));
+    __m128i a4 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + 4 * srcStride));
+    __m128i a5 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + 5 * srcStride));
+    __m128i a6 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + 6 * srcStride));
+    __m128i a7 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + 7 * srcStride));
+
+    // interleave 16-bit pairs, then 32-bit pairs, then 64-bit halves
+    __m128i t0 = _mm_unpacklo_epi16(a0, a1), t1 = _mm_unpackhi_epi16(a0, a1);
+    __m128i t2 = _mm_unpacklo_epi16(a2, a3), t3 = _mm_unpackhi_epi16(a2, a3);
+    __m128i t4 = _mm_unpacklo_epi16(a4, a5), t5 = _mm_unpackhi_epi16(a4, a5);
+    __m128i t6 = _mm_unpacklo_epi16(a6, a7), t7 = _mm_unpackhi_epi16(a6, a7);
+
+    __m128i u0 = _mm_unpacklo_epi32(t0, t2), u1 = _mm_unpackhi_epi32(t0, t2);
+    __m128i u2 = _mm_unpacklo_epi32(t1, t3), u3 = _mm_unpackhi_epi32(t1, t3);
+    __m128i u4 = _mm_unpacklo_epi32(t4, t6), u5 = _mm_unpackhi_epi32(t4, t6);
+    __m128i u6 = _mm_unpacklo_epi32(t5, t7), u7 = _mm_unpackhi_epi32(t5, t7);
+
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + 0 * dstStride), _mm_unpacklo_epi64(u0, u4));
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + 1 * dstStride), _mm_unpackhi_epi64(u0, u4));
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + 2 * dstStride), _mm_unpacklo_epi64(u1, u5));
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + 3 * dstStride), _mm_unpackhi_epi64(u1, u5));
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + 4 * dstStride), _mm_unpacklo_epi64(u2, u6));
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + 5 * dstStride), _mm_unpackhi_epi64(u2, u6));
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + 6 * dstStride), _mm_unpacklo_epi64(u3, u7));
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + 7 * dstStride), _mm_unpackhi_epi64(u3, u7));
+#else
+    for (size_t y = 0; y < 8; ++y) {
+        for (size_t x = 0; x < 8; ++x) {
+            dst[x * dstStride + y] = src[y * srcStride + x];
+        }
+    }
+#endif
+}
+} // namespace
+
+// Real transpose into the MEGS_IMAGE_T_HEIGHT x MEGS_IMAGE_T_WIDTH layout, transposed[x][y] = image[y][x]
+// transposed is only resized the first time, so callers can keep one buffer for every image
+void transposeImage(const uint16_t image[MEGS_IMAGE_HEIGHT][MEGS_IMAGE_WIDTH], std::vector<uint16_t>& transposed) {
+    static_assert((MEGS_IMAGE_T_WIDTH == MEGS_IMAGE_HEIGHT) && (MEGS_IMAGE_T_HEIGHT == MEGS_IMAGE_WIDTH), "transposed layout");
+    static_assert((MEGS_IMAGE_HEIGHT % TRANSPOSE_TILE == 0) && (MEGS_IMAGE_WIDTH % TRANSPOSE_TILE == 0), "whole tiles");
+    transposed.resize(MEGS_TOTAL_PIXELS);
+    const uint16_t* src = &image[0][0];
+    uint16_t* dst = transposed.data();
+
+    for (uint32_t tileY = 0; tileY < MEGS_IMAGE_HEIGHT; tileY += TRANSPOSE_TILE) {
+        for (uint32_t tileX = 0; tileX < MEGS_IMAGE_WIDTH; tileX += TRANSPOSE_TILE) {
+            for (uint32_t y = tileY; y < tileY + TRANSPOSE_TILE; y += 8) {
+                for (uint32_t x = tileX; x < tileX + TRANSPOSE_TILE; x += 8) {
+                    transposeBlock8x8(src + size_t(y) * MEGS_IMAGE_WIDTH + x, MEGS_IMAGE_WIDTH,
+                                      dst + size_t(x) * MEGS_IMAGE_T_WIDTH + y, MEGS_IMAGE_T_WIDTH);
+                }
+            }
+        }
+    }
+}
+
 // reads a packet and writes it to the recordfile
 void processPackets(CCSDSReader& pktReader, std::unique_ptr<RecordFileWriter>& recordWriter, bool skipRecord) {
     std::vector<uint8_t> packet;
@@ -80,17 +149,33 @@ void processPackets(CCSDSReader& pktReader, std::unique_ptr<RecordFileWriter>& r
         processOnePacket(pktReader, packet);
 
     }
+    // end of the file, process whatever is still held back
+    finishPacketProcessing(pktReader);
 }
 
-void processOnePacket(CCSDSReader& pktReader, const std::vector<uint8_t>& packet) {
-    auto start = std::chrono::system_clock::now();
+namespace {
+// one reorder window per APID, built from globalState.args on first use, only the packet thread touches them
+std::unique_ptr<SequenceReorderWindow> reorderWindows[APID_SLOT_COUNT];
+bool reorderWindowsBuilt = false;
+std::vector<std::vector<uint8_t>> reorderedPackets; // reused so steady state does not allocate
+
+SequenceReorderWindow* reorderWindowFor(uint16_t apid) {
+    if (!reorderWindowsBuilt) {
+        resetPacketReorder();
+    }
+    ApidSlot slot = PacketStats::slotForAPID(apid);
+    return (slot == APID_SLOT_UNKNOWN) ? nullptr : reorderWindows[slot].get();
+}
 
+void dispatchPacket(CCSDSReader& pktReader, const std::vector<uint8_t>& packet) {
     auto header = std::vector<uint8_t>(packet.cbegin(), packet.cbegin() + PACKET_HEADER_SIZE);
 
     uint16_t apid = pktReader.getAPID(header);
     uint16_t sourceSequenceCounter = pktReader.getSourceSequenceCounter(header);
     uint16_t packetLength = pktReader.getPacketLength(header);
 
+    PacketStats::getInstance().setCurrentAPID(apid);
+
     auto payload = std::vector<uint8_t>(packet.cbegin() + PACKET_HEADER_SIZE, packet.cend());
     double timeStamp = pktReader.getPacketTimeStamp(payload);
 
@@ -114,18 +199,12 @@ void processOnePacket(CCSDSReader& pktReader, const std::vector<uint8_t>& packet
             processMegsBPacket(payload, sourceSequenceCounter, packetLength, timeStamp);
             break;
         case ESP_APID:
-            LogFileWriter::getInstance().logInfo("APID {} SSC {} pktLen {} time {}", apid,
-                sourceSequenceCounter, packetLength, timeStamp );
             processESPPacket(payload, sourceSequenceCounter, packetLength, timeStamp);
             break;
         case MEGSP_APID:
-            LogFileWriter::getInstance().logInfo("APID {} SSC {} pktLen {} time {}", apid,
-                sourceSequenceCounter, packetLength, timeStamp );
             processMegsPPacket(payload, sourceSequenceCounter, packetLength, timeStamp);
             break;
         case SHK_APID:
-            LogFileWriter::getInstance().logInfo("APID {} SSC {} pktLen {} time {}", apid,
-                sourceSequenceCounter, packetLength, timeStamp );
             processHKPacket(payload, sourceSequenceCounter, packetLength, timeStamp);
             break;
         default:
@@ -136,12 +215,79 @@ void processOnePacket(CCSDSReader& pktReader, const std::vector<uint8_t>& packet
             globalState.packetsReceived.Unknown.fetch_add(1, std::memory_order_relaxed);
             break;
     }
+}
+
+void dispatchReorderedPackets(CCSDSReader& pktReader) {
+    for (const auto& packet : reorderedPackets) {
+        dispatchPacket(pktReader, packet);
+    }
+    reorderedPackets.clear();
+}
+}
+
+// MEGS counters wrap at the end of each image, the others use the full 14 bits
+void resetPacketReorder() {
+    uint16_t windowPackets = globalState.args.reorderWindowPackets.load(std::memory_order_relaxed);
+    std::chrono::milliseconds timeout(globalState.args.reorderTimeoutMs.load(std::memory_order_relaxed));
+    const uint16_t apids[APID_SLOT_UNKNOWN] = {MEGSA_APID, MEGSB_APID, ESP_APID, MEGSP_APID, SHK_APID};
+    for (uint16_t apid : apids) {
+        uint16_t modulus = ((apid == MEGSA_APID) || (apid == MEGSB_APID)) ? N_PKT_PER_IMAGE : CCSDS_SEQUENCE_MODULUS;
+        reorderWindows[PacketStats::slotForAPID(apid)] = std::unique_ptr<SequenceReorderWindow>(
+            new SequenceReorderWindow(apid, modulus, windowPackets, timeout));
+    }
+    reorderWindowsBuilt = true;
+}
+
+// end of input, processes what the reorder windows still hold and writes the MEGS images still in progress
+void finishPacketProcessing(CCSDSReader& pktReader) {
+    ScopedStageTimer decodeTimer(STAGE_DECODE);
+    for (auto& window : reorderWindows) {
+        if (window) {
+            window->releaseAll(reorderedPackets);
+        }
+    }
+    dispatchReorderedPackets(pktReader);
+    flushPartialMegsImages();
+    // the products are compressed and written on their own thread, wait for the last of them
+    FITSPublisher::getInstance().flush();
+}
+
+// arrival counters and the broadcast see every packet, processing sees each APID in sequence counter order
+void processOnePacket(CCSDSReader& pktReader, const std::vector<uint8_t>& packet) {
+    ScopedStageTimer decodeTimer(STAGE_DECODE);
+
+    // every other local consumer reads its own copy from the broadcast ring
+    PacketBroadcaster::getInstance().publish(packet);
+
+    auto header = std::vector<uint8_t>(packet.cbegin(), packet.cbegin() + PACKET_HEADER_SIZE);
+    uint16_t apid = pktReader.getAPID(header);
 
-    auto end = std::chrono::system_clock::now();
-    std::chrono::duration<double> elapsed_seconds = end - start;
+    PacketStats& packetStats = PacketStats::getInstance();
+    packetStats.setCurrentAPID(apid);
+    packetStats.count(apid, COUNTER_PACKETS);
+    packetStats.count(apid, COUNTER_BYTES, packet.size());
+
+    // a packet of any APID also times out what the other APIDs are missing, the read loops do it when none arrive
+    auto now = std::chrono::steady_clock::now();
+    SequenceReorderWindow* reorderWindow = reorderWindowFor(apid);
+    if (reorderWindow == nullptr) {
+        dispatchPacket(pktReader, packet);
+    } else {
+        reorderWindow->push(pktReader.getSourceSequenceCounter(header), packet, now, reorderedPackets);
+    }
+    tickPacketProcessing(pktReader, now);
+}
 
-    uint64_t elapsedMicrosec = 1.e6 * elapsed_seconds.count();
-    LogFileWriter::getInstance().logInfo("processOnePacket for APID: {} Elapsed mics {}",apid, elapsedMicrosec);
+// gives up on missing packets and writes stalled MEGS images once they time out,
+// so neither waits for more traffic to arrive
+void tickPacketProcessing(CCSDSReader& pktReader, std::chrono::steady_clock::time_point now) {
+    for (auto& window : reorderWindows) {
+        if (window && (window->waiting() > 0)) {
+            window->releaseExpired(now, reorderedPackets);
+        }
+    }
+    dispatchReorderedPackets(pktReader);
+    flushTimedOutMegsImages(now);
 }
 
 // payloadBytesToUint32 creates a 32-bit int from 4 bytes in TAI time order starting at offsetByte
@@ -219,6 +365,108 @@ void populateStructureTimes(T& oneStructure, const std::vector<uint8_t>& payload
     oneStructure.yyyydoy = (uint32_t)(year * 1000 + doy);
 }
 
+// Top half rows written by one MEGS packet.
+// The top half fills from row 0 down and the bottom half from row 1023 up,
+// so each packet touches the same row numbers mirrored across the middle.
+void megsTopRowsForPacket(uint16_t sourceSequenceCounter, uint32_t& firstRow, uint32_t& lastRow) {
+    constexpr uint32_t lastTopRow = MEGS_IMAGE_HEIGHT / 2 - 1;
+    const uint32_t firstPixel = sourceSequenceCounter * MEGS_PIXELS_PER_HALF_PACKET;
+    firstRow = std::min(firstPixel / MEGS_IMAGE_WIDTH, lastTopRow);
+    lastRow = std::min((firstPixel + MEGS_PIXELS_PER_HALF_PACKET - 1) / MEGS_IMAGE_WIDTH, lastTopRow);
+}
+
+// Set the bits for the image rows written by one MEGS packet in a dirty row bitmap
+void markMegsDirtyRows(std::atomic<uint32_t>* dirtyRows, uint16_t sourceSequenceCounter) {
+    uint32_t firstRow, lastRow;
+    megsTopRowsForPacket(sourceSequenceCounter, firstRow, lastRow);
+
+    for (uint32_t row = firstRow; row <= lastRow; ++row) {
+        uint32_t bottomRow = MEGS_IMAGE_HEIGHT - 1 - row;
+        dirtyRows[row >> 5].fetch_or(1u << (row & 31), std::memory_order_release);
+        dirtyRows[bottomRow >> 5].fetch_or(1u << (bottomRow & 31), std::memory_order_release);
+    }
+}
+
+// Publish the payload of the latest packet for the raw packet window, bytes past the payload are zero
+static void publishPayloadBytes(SeqlockSnapshot<RAW_PAYLOAD_BYTES>& snapshot, const std::vector<uint8_t>& payload) {
+    RAW_PAYLOAD_BYTES raw = {};
+    std::memcpy(raw.bytes, payload.data(), std::min(payload.size(), sizeof(raw.bytes)));
+    snapshot.publish(raw);
+}
+
+// Map each 14-bit value to 0-255 from the cumulative distribution of one image half
+static void buildEqualizationMap(const uint32_t* histogram, uint32_t numPixels, uint8_t* map) {
+    constexpr uint32_t numBins = 16384;
+
+    // the first nonzero CDF value is the count in the first occupied bin
+    const uint32_t* firstOccupied = std::find_if(histogram, histogram + numBins, [](uint32_t count) { return count > 0; });
+    float cdfMin = (firstOccupied == histogram + numBins) ? 0.0f : static_cast<float>(*firstOccupied);
+    float cdfRange = numPixels - cdfMin;
+    float scale = (cdfRange > 0.0f) ? 255.0f / cdfRange : 0.0f; // a constant image maps to 0
+
+    uint32_t cdf = 0;
+    for (uint32_t i = 0; i < numBins; ++i) {
+        cdf += histogram[i];
+        map[i] = (cdf > 0) ? static_cast<uint8_t>(scale * (cdf - cdfMin)) : 0;
+    }
+}
+
+// Histogram equalize the top and bottom halves of a MEGS image separately into 8-bit texture data.
+// Each thread fills private histograms that are merged once, so there are no atomics per pixel.
+void histogramEqualization(const uint16_t (*image)[MEGS_IMAGE_HEIGHT][MEGS_IMAGE_WIDTH],
+                           std::vector<uint8_t>& textureData) {
+    constexpr uint32_t numBins = 16384;
+    constexpr uint32_t halfHeight = MEGS_IMAGE_HEIGHT / 2;
+    constexpr uint32_t halfPixels = MEGS_IMAGE_WIDTH * halfHeight;
+
+    textureData.resize(MEGS_TOTAL_PIXELS);
+
+    // Step 1: Calculate the histogram for the top and bottom halves
+    uint32_t topHistogram[numBins] = {0};
+    uint32_t bottomHistogram[numBins] = {0};
+
+    #pragma omp parallel
+    {
+        // persistent per-thread storage, 128kB is too much to put on each thread stack
+        static thread_local uint32_t localHistogram[2][numBins];
+        std::memset(localHistogram, 0, sizeof(localHistogram));
+
+        #pragma omp for schedule(static) nowait
+        for (uint32_t y = 0; y < MEGS_IMAGE_HEIGHT; ++y) {
+            uint32_t* histogram = localHistogram[y < halfHeight ? 0 : 1];
+            const uint16_t* row = (*image)[y];
+            for (uint32_t x = 0; x < MEGS_IMAGE_WIDTH; ++x) {
+                histogram[row[x] & 0x3FFF]++;
+            }
+        }
+
+        #pragma omp critical
+        {
+            for (uint32_t i = 0; i < numBins; ++i) {
+                topHistogram[i] += localHistogram[0][i];
+                bottomHistogram[i] += localHistogram[1][i];
+            }
+        }
+    }
+
+    // Step 2: Build a value to 8-bit map for each half from its CDF
+    uint8_t topMap[numBins];
+    uint8_t bottomMap[numBins];
+    buildEqualizationMap(topHistogram, halfPixels, topMap);
+    buildEqualizationMap(bottomHistogram, halfPixels, bottomMap);
+
+    // Step 3: Map each pixel, row by row
+    #pragma omp parallel for
+    for (uint32_t y = 0; y < MEGS_IMAGE_HEIGHT; ++y) {
+        const uint8_t* map = (y < halfHeight) ? topMap : bottomMap;
+        const uint16_t* row = (*image)[y];
+        uint8_t* textureRow = textureData.data() + y * MEGS_IMAGE_WIDTH;
+        for (uint32_t x = 0; x < MEGS_IMAGE_WIDTH; ++x) {
+            textureRow[x] = map[row[x] & 0x3FFF];
+        }
+    }
+}
+
 // Generic function to count saturated pixels in MEGS images
 void countSaturatedPixels(const uint16_t image[MEGS_IMAGE_HEIGHT][MEGS_IMAGE_WIDTH],
                           uint32_t& saturatedPixelsTop,
@@ -245,146 +493,263 @@ void countSaturatedPixels(const uint16_t image[MEGS_IMAGE_HEIGHT][MEGS_IMAGE_WID
     }
 }
 
-// the payload starts with the secondary header timestamp
-void processMegsAPacket(std::vector<uint8_t> payload, 
-    uint16_t sourceSequenceCounter, uint16_t packetLength, double timeStamp) {
-
-    // insert pixels into image
-
-    static uint16_t processedPacketCounter=0;
-    int8_t status=0;
-    static bool testPattern;
-    static bool isFirstImage = true;
-    static int32_t previousSrcSeqCount = -1;
-    static MEGS_IMAGE_REC oneMEGSStructure;
-    int vcdu_offset_to_sec_hdr = 20; // 6 bytes from packet start to timestamp, 8 byte IMPDU hdr, 6 byte CVCDU hdr is 20
-    int32_t xpos, ypos;
-
-    // payload starts at secondary header
-    // 6-byte VCDU header, 8-byte IMPDU header, 6-byte primary packet header
-    // data to copy starts at secondary header, includes 8-byte timestamp, 2 byte mode, then 2-byte pixel pairs (1752 bytes except for last packet)
-
-    uint8_t vcdu[STANDARD_MEGSAB_PACKET_LENGTH + vcdu_offset_to_sec_hdr] = {0};
-
-    // vcdu has 14 bytes before the packet start (vcdu=6, impdu=8)
-    // pkthdr is 6 bytes before the payload starts at the 2nd hdr timestamp
-    // copy from payload into vcdu starting at byte 20 from the start of sync, 16 from start of VCDU
-    std::copy(payload.begin(), payload.end(), vcdu + vcdu_offset_to_sec_hdr);
-
-    // vcdu should look like a fake VCDU, with garbage before the timestamp
-    // and it does, just without the primary header, impdu hdr, and vcdu hdr
-
-    if ((previousSrcSeqCount == -1) || (sourceSequenceCounter == 0) || 
-        (sourceSequenceCounter <= previousSrcSeqCount)) {
-        // packet is from a new image
-        LogFileWriter::getInstance().logInfo("MA starting new image first SrcSeqCounter: {}", sourceSequenceCounter);
-
-        //reset oneMEGSStructure
-        oneMEGSStructure = MEGS_IMAGE_REC{0}; // c++11 
+void MegsSaturationCounter::start() {
+    counted.reset();
+    top = 0;
+    bottom = 0;
+}
 
-        testPattern = false; // default is not a test pattern
-        if ((vcdu[34] == 0) && (vcdu[35] == 2) && (vcdu[36] == 0) && (vcdu[37] == 1)) {
-            testPattern = true; // use vcdu[34]==0 vcdu[35]=2 vcdu[36]=0 vcdu[37]=1 to identify TP (first 2 pixesl are bad so skip 30-33)
-            std::cout << "processMegsAPacket identified a test pattern" <<std::endl;
+// packets arrive in counter order, so a row is complete when the packet that ends it arrives with the others
+void MegsSaturationCounter::addPacketRows(const MEGS_IMAGE_REC& image, uint16_t sourceSequenceCounter) {
+    if (sourceSequenceCounter >= N_PKT_PER_IMAGE) {
+        return;
+    }
+    uint32_t firstRow, lastRow;
+    megsTopRowsForPacket(sourceSequenceCounter, firstRow, lastRow);
+    for (uint32_t y = firstRow; y <= lastRow; ++y) {
+        const uint32_t firstPacket = (y * MEGS_IMAGE_WIDTH) / MEGS_PIXELS_PER_HALF_PACKET;
+        const uint32_t lastPacket = std::min((y * MEGS_IMAGE_WIDTH + MEGS_IMAGE_WIDTH - 1) / MEGS_PIXELS_PER_HALF_PACKET,
+            N_PKT_PER_IMAGE - 1u);
+        if ((lastPacket != sourceSequenceCounter) || counted.test(y)) {
+            continue;
+        }
+        bool complete = true;
+        for (uint32_t ssc = firstPacket; complete && (ssc <= lastPacket); ++ssc) {
+            complete = isMegsPacketReceived(image, static_cast<uint16_t>(ssc));
         }
-        globalState.isMATestPattern.store(testPattern);
+        if (complete) {
+            countRows(image, y);
+        }
+    }
+}
 
-        populateStructureTimes(oneMEGSStructure, payload);
+void MegsSaturationCounter::finish(const MEGS_IMAGE_REC& image, bool testPattern,
+                                   uint32_t& saturatedPixelsTop, uint32_t& saturatedPixelsBottom) {
+    for (uint32_t y = 0; y < MEGS_IMAGE_HEIGHT / 2; ++y) {
+        if (!counted.test(y)) {
+            countRows(image, y);
+        }
+    }
+    // same exception as countSaturatedPixels, the first test pattern pixel is not a saturated one
+    const bool skipFirst = testPattern && ((image.image[0][0] & 0x3fff) == 0x3fff);
+    saturatedPixelsTop = top - (skipFirst ? 1 : 0);
+    saturatedPixelsBottom = bottom;
+}
 
-        mtx.lock();
-        globalState.megsa.tai_time_seconds = oneMEGSStructure.tai_time_seconds;
-        globalState.megsa.tai_time_subseconds = oneMEGSStructure.tai_time_subseconds;
-        globalState.megsa.rec_tai_seconds = oneMEGSStructure.rec_tai_seconds;
-        globalState.megsa.rec_tai_subseconds = oneMEGSStructure.rec_tai_subseconds;
-        globalState.megsa.sod = oneMEGSStructure.sod;
-        globalState.megsa.yyyydoy = oneMEGSStructure.yyyydoy;
+void MegsSaturationCounter::countRows(const MEGS_IMAGE_REC& image, uint32_t topRow) {
+    const uint16_t* topPixels = image.image[topRow];
+    const uint16_t* bottomPixels = image.image[MEGS_IMAGE_HEIGHT - 1 - topRow];
+    for (uint32_t x = 0; x < MEGS_IMAGE_WIDTH; ++x) {
+        top += ((topPixels[x] & 0x3fff) == 0x3fff);
+        bottom += ((bottomPixels[x] & 0x3fff) == 0x3fff);
+    }
+    counted.set(topRow);
+}
 
-        std::memcpy(globalState.megsAPayloadBytes, payload.data(), payload.size());
+// bit (sourceSequenceCounter % 8) of byte sourceSequenceCounter / 8, returns false if the packet was already in the image
+bool markMegsPacketReceived(MEGS_IMAGE_REC& image, uint16_t sourceSequenceCounter) {
+    if (sourceSequenceCounter >= N_PKT_PER_IMAGE) {
+        return false;
+    }
+    uint8_t mask = static_cast<uint8_t>(1u << (sourceSequenceCounter % 8));
+    uint8_t& byte = image.received_packets[sourceSequenceCounter / 8];
+    if (byte & mask) {
+        return false;
+    }
+    byte |= mask;
+    image.packets_received++;
+    return true;
+}
 
-        mtx.unlock();
+bool isMegsPacketReceived(const MEGS_IMAGE_REC& image, uint16_t sourceSequenceCounter) {
+    return (sourceSequenceCounter < N_PKT_PER_IMAGE) &&
+        ((image.received_packets[sourceSequenceCounter / 8] >> (sourceSequenceCounter % 8)) & 1);
+}
 
-        processedPacketCounter=0;
-    }
-    if ((!isFirstImage) && (((previousSrcSeqCount + 1) % N_PKT_PER_IMAGE) != sourceSequenceCounter)) {
-        // there is a gap in the data
-        LogFileWriter::getInstance().logError("MA packet out of sequence SSC: {} previous SSC: {}", sourceSequenceCounter, previousSrcSeqCount);
-        std::cout << "MEGS-A packet out of sequence: " << previousSrcSeqCount << " " << sourceSequenceCounter << std::endl;
+float megsImageCompleteness(const MEGS_IMAGE_REC& image) {
+    return 100.0f * image.packets_received / N_PKT_PER_IMAGE;
+}
 
-        globalState.dataGapsMA.fetch_add(1, std::memory_order_relaxed);
+namespace {
+// Assembly state of one MEGS channel. An image is in progress from its first packet until
+// SSC 2394 arrives, the next image starts, no packet arrives for -imageTimeout seconds,
+// or the input ends. Only the first case is a complete image, the others write what was received.
+struct MegsImageState {
+    MEGS_IMAGE_REC image;   // the one written to FITS, reset for each image
+    bool inProgress = false;
+    bool testPattern = false;
+    bool isFirstImage = true;
+    int32_t previousSrcSeqCount = -1;
+    uint16_t processedPacketCounter = 0;
+    std::chrono::steady_clock::time_point lastPacketTime;
+    bool extractSpectrum = false;   // -skipSpectra is read once per image
+    MegsSpectrumAccumulator spectrumAccumulator;
+    MEGS_SPECTRUM spectrum;
+    MegsSaturationCounter saturation;
+    MegsDarkKey darkKey;            // integration register and CEB temperature at the first packet
+    std::shared_ptr<const MegsDarkFrame> dark;  // held until the image is written, so a new dark cannot free it
+};
+
+MegsImageState megsAState;
+MegsImageState megsBState;
+
+// looks up the dark for the channel's current integration register and CEB temperature
+void startMegsDark(MegsImageState& state, uint16_t apid) {
+    SHK_PACKET shk;
+    SHK_CONVERTED_PACKET shkConv;
+    globalState.shk.read(shk);
+    globalState.shkConv.read(shkConv);
+    const bool isMegsA = (apid == MEGSA_APID);
+    state.darkKey = megsDarkKey(apid, isMegsA ? shk.MEGSA_Integration_Register[0] : shk.MEGSB_Integration_Register[0],
+        static_cast<float>(isMegsA ? shkConv.MEGSA_CEB_Temperature[0] : shkConv.MEGSB_CEB_Temperature[0]));
+    MegsDarkLibrary& darkLibrary = MegsDarkLibrary::getInstance();
+    darkLibrary.setCurrentKey(state.darkKey);
+    state.dark = darkLibrary.active(apid);
+}
 
+// the regions were validated by main, so parsing them again only fails if they were never set
+void startMegsSpectrum(MegsImageState& state, uint16_t apid) {
+    state.extractSpectrum = !globalState.args.skipSpectra.load(std::memory_order_relaxed);
+    if (!state.extractSpectrum) {
+        return;
+    }
+    std::vector<MegsSpectrumRegion> regions;
+    std::string error;
+    parseMegsSpectrumRegions((apid == MEGSA_APID) ? globalState.args.spectrumRegionsA : globalState.args.spectrumRegionsB, regions, error);
+    if (state.dark) {
+        state.spectrumAccumulator.start(regions, state.dark->image, state.dark->frames);
+    } else {
+        state.spectrumAccumulator.start(regions);
     }
-    previousSrcSeqCount = sourceSequenceCounter;
+}
 
-    // begin assigning data into oneMEGSStructure
+// the top and bottom rows completed by this packet, timed on their own so the cost per packet shows in the stage stats
+void addMegsSpectrumRows(MegsImageState& state, uint16_t sourceSequenceCounter) {
+    if (state.extractSpectrum) {
+        ScopedStageTimer spectrumTimer(STAGE_SPECTRUM);
+        state.spectrumAccumulator.addPacketRows(state.image, sourceSequenceCounter);
+    }
+}
 
-    // assing pixel values from the packet into the proper locations in the image
-    // The oneMEGSStructure is the one that is written to FITS and is initialized to 0
-    int parityErrors = assemble_image(vcdu, &oneMEGSStructure, sourceSequenceCounter, testPattern, xpos, ypos, &status);
+void finishMegsImage(MegsImageState& state, uint16_t apid) {
+    const bool isMegsA = (apid == MEGSA_APID);
+    const char* channel = isMegsA ? "MEGS-A" : "MEGS-B";
+    const float completeness = megsImageCompleteness(state.image);
+    if (state.image.packets_received == N_PKT_PER_IMAGE) {
+        LogFileWriter::getInstance().logInfo("end of {} image ssc=2394", channel);
+    } else {
+        LogFileWriter::getInstance().logError("writing partial {} image, {} of {} packets ({:.1f}%) last SSC {}", channel,
+            state.image.packets_received, N_PKT_PER_IMAGE, completeness, state.previousSrcSeqCount);
+        std::cout << "Writing partial " << channel << " image with " << state.image.packets_received << " of "
+            << N_PKT_PER_IMAGE << " packets" << std::endl;
+        (isMegsA ? globalState.megsAPartialImages : globalState.megsBPartialImages).fetch_add(1, std::memory_order_relaxed);
+    }
+    (isMegsA ? globalState.megsALastCompleteness : globalState.megsBLastCompleteness).store(completeness, std::memory_order_relaxed);
+
+    state.isFirstImage = false;
+
+    uint32_t imageCount = (isMegsA ? globalState.megsAImageCount : globalState.megsBImageCount).fetch_add(1, std::memory_order_relaxed);
+
+    SHK_CONVERTED_PACKET shkConv;
+    globalState.shkConv.read(shkConv);
+    state.image.FPGA_Board_Temperature = shkConv.FPGA_Board_Temperature[0];
+    if (isMegsA) {
+        state.image.CEB_Temperature = shkConv.MEGSA_CEB_Temperature[0];
+        state.image.CPR_Temperature = shkConv.MEGSA_CPR_Temperature[0];
+        state.image.PRT_Temperature = shkConv.MEGSA_PRT[0];
+    } else {
+        state.image.CEB_Temperature = shkConv.MEGSB_CEB_Temperature[0];
+        state.image.CPR_Temperature = shkConv.MEGSB_CPR_Temperature[0];
+        state.image.PRT_Temperature = shkConv.MEGSB_PRT[0];
+    }
+    SharedMemoryPublisher::getInstance().publishCompleteImage(isMegsA ? EVE_SHM_MEGSA_COMPLETE : EVE_SHM_MEGSB_COMPLETE,
+        state.image, imageCount, state.testPattern);
+
+    const MEGS_SPECTRUM* spectrum = nullptr;
+    if (state.extractSpectrum) {
+        ScopedStageTimer spectrumTimer(STAGE_SPECTRUM);
+        state.spectrumAccumulator.finish(state.spectrum);
+        state.spectrum.tai_time_seconds = state.image.tai_time_seconds;
+        state.spectrum.tai_time_subseconds = state.image.tai_time_subseconds;
+        state.spectrum.imageCount = imageCount;
+        (isMegsA ? globalState.megsASpectrum : globalState.megsBSpectrum).publish(state.spectrum);
+        spectrum = &state.spectrum;
+    }
 
-    {
-        globalState.packetsReceived.MA.fetch_add(1);
-        globalState.isFirstMAImage.store(isFirstImage, std::memory_order_relaxed);
-        // The globalState.megsa image is NOT initialized and just overwrites each packet location as it is received
-        globalState.parityErrorsMA.fetch_add(assemble_image(vcdu, &globalState.megsa, sourceSequenceCounter, testPattern, xpos, ypos, &status), std::memory_order_relaxed);
-        globalState.isMATestPattern.store(testPattern);
-        if ((processedPacketCounter % IMAGE_UPDATE_INTERVAL) == 0) {
-            globalState.megsAUpdated.store(true, std::memory_order_relaxed);
-            globalState.MAypos.store(ypos, std::memory_order_relaxed); // ypos is atomic
+    // a dark being collected only takes complete images of the scene, never a test pattern
+    if ((state.image.packets_received == N_PKT_PER_IMAGE) && !state.testPattern) {
+        MegsDarkLibrary::getInstance().addImage(state.image, state.darkKey);
+    }
+    state.dark.reset();
+
+    // the GUI, quicklook and metrics all show the counts of the latest finished image
+    uint32_t saturatedTop, saturatedBottom;
+    state.saturation.finish(state.image, state.testPattern, saturatedTop, saturatedBottom);
+    (isMegsA ? globalState.saturatedPixelsMATop : globalState.saturatedPixelsMBTop).store(saturatedTop, std::memory_order_relaxed);
+    (isMegsA ? globalState.saturatedPixelsMABottom : globalState.saturatedPixelsMBBottom).store(saturatedBottom, std::memory_order_relaxed);
+
+    // may need to run this in another thread
+
+    // Write packet data to a FITS file if applicable
+    std::unique_ptr<FITSWriter> fitsFileWriter;
+    fitsFileWriter = std::unique_ptr<FITSWriter>(new FITSWriter());
+    // the c++14 way fitsFileWriter = std::make_unique<FITSWriter>();
+    if (fitsFileWriter) {
+        const uint32_t saturatedPixels = saturatedTop + saturatedBottom;
+        bool written = isMegsA ? fitsFileWriter->writeMegsAFITS(state.image, saturatedPixels, spectrum)
+                               : fitsFileWriter->writeMegsBFITS(state.image, saturatedPixels, spectrum);
+        if (!written) {
+            LogFileWriter::getInstance().logInfo("write {} FITS error", channel);
+            std::cout << "ERROR: writing " << channel << " FITS returned an error" << std::endl;
         }
     }
+    state.processedPacketCounter = 0;
+    // reset the structure immediately after writing
+    state.image = MEGS_IMAGE_REC{0}; // c++11 
+    state.inProgress = false;
+    (isMegsA ? globalState.megsAImagePackets : globalState.megsBImagePackets).store(0, std::memory_order_relaxed);
+}
+}
 
-    if ( parityErrors > 0 ) {
-        LogFileWriter::getInstance().logError("MA parity errors: {} SSC: {}", parityErrors, sourceSequenceCounter);
+// the tail of an image that never arrives would otherwise hold the image in memory until the next one discards it
+void flushTimedOutMegsImages(std::chrono::steady_clock::time_point now) {
+    const std::chrono::seconds timeout(globalState.args.imageTimeoutSeconds.load(std::memory_order_relaxed));
+    // the next image may start at any counter, its window must not hold it against the last one
+    if (megsAState.inProgress && (now - megsAState.lastPacketTime > timeout)) {
+        finishMegsImage(megsAState, MEGSA_APID);
+        if (reorderWindows[APID_SLOT_MA]) {
+            reorderWindows[APID_SLOT_MA]->forgetSequence(reorderedPackets);
+        }
     }
-    processedPacketCounter++; // count packets processed
-
-    if ( sourceSequenceCounter == 2394) {
-        //std::cout<<"end of MEGS-A at 2394"<<"\n";
-        LogFileWriter::getInstance().logInfo("end of MEGS-A image ssc=2394");
-
-        isFirstImage = false;
-
-        globalState.megsAImageCount.fetch_add(1, std::memory_order_relaxed);
-
-        mtx.lock();
-        oneMEGSStructure.FPGA_Board_Temperature = globalState.shkConv.FPGA_Board_Temperature[0];
-        oneMEGSStructure.CEB_Temperature = globalState.shkConv.MEGSA_CEB_Temperature[0];
-        oneMEGSStructure.CPR_Temperature = globalState.shkConv.MEGSA_CPR_Temperature[0];
-        oneMEGSStructure.PRT_Temperature = globalState.shkConv.MEGSA_PRT[0];
-        mtx.unlock();
-
-        // may need to run this in another thread
-
-        // Write packet data to a FITS file if applicable
-        std::unique_ptr<FITSWriter> fitsFileWriter;
-        fitsFileWriter = std::unique_ptr<FITSWriter>(new FITSWriter());
-        // the c++14 way fitsFileWriter = std::make_unique<FITSWriter>();
-        if (fitsFileWriter) {
-
-            if (!fitsFileWriter->writeMegsAFITS( oneMEGSStructure )) {
-                LogFileWriter::getInstance().logInfo("writeMegsAFITS write error");
-                std::cout << "ERROR: writeMegsAFITS returned an error" << std::endl;
-            }
-            processedPacketCounter=0;
-            // reset the structure immediately after writing
-            oneMEGSStructure = MEGS_IMAGE_REC{0}; // c++11 
+    if (megsBState.inProgress && (now - megsBState.lastPacketTime > timeout)) {
+        finishMegsImage(megsBState, MEGSB_APID);
+        if (reorderWindows[APID_SLOT_MB]) {
+            reorderWindows[APID_SLOT_MB]->forgetSequence(reorderedPackets);
         }
     }
 }
 
-void processMegsBPacket(std::vector<uint8_t> payload, uint16_t sourceSequenceCounter, uint16_t packetLength, double timeStamp) {
+void flushPartialMegsImages() {
+    if (megsAState.inProgress) {
+        finishMegsImage(megsAState, MEGSA_APID);
+    }
+    if (megsBState.inProgress) {
+        finishMegsImage(megsBState, MEGSB_APID);
+    }
+}
 
-    // insert pixels into image
+namespace {
+// Assembles one MEGS-A or MEGS-B packet into the image of its channel, the payload starts with the
+// secondary header timestamp. Both channels share this path and differ only in the globals they publish to.
+void processMegsPacket(MegsImageState& state, uint16_t apid, const std::vector<uint8_t>& payload, uint16_t sourceSequenceCounter) {
+    const bool isMegsA = (apid == MEGSA_APID);
+    const char* channel = isMegsA ? "MA" : "MB";
+    MEGS_IMAGE_REC& liveImage = isMegsA ? globalState.megsa : globalState.megsb;
+    std::atomic<bool>& isTestPattern = isMegsA ? globalState.isMATestPattern : globalState.isMBTestPattern;
 
-    static uint16_t processedPacketCounter=0;
     int8_t status=0;
-    static bool testPattern;
-    static bool isFirstImage = true;
-    static int32_t previousSrcSeqCount = -1;
-    static MEGS_IMAGE_REC oneMEGSStructure;
-    int32_t xpos, ypos;
-
     int vcdu_offset_to_sec_hdr = 20; // 6 bytes from packet start to timestamp, 8 byte IMPDU hdr, 6 byte CVCDU hdr is 20
+    int32_t xpos, ypos;
 
     // payload starts at secondary header
     // 6-byte VCDU header, 8-byte IMPDU header, 6-byte primary packet header
@@ -393,109 +758,115 @@ void processMegsBPacket(std::vector<uint8_t> payload, uint16_t sourceSequenceCou
     uint8_t vcdu[STANDARD_MEGSAB_PACKET_LENGTH + vcdu_offset_to_sec_hdr] = {0};
 
     // vcdu has 14 bytes before the packet start (vcdu=6, impdu=8)
-    // pkthdr=6 bytes before the payload starts at the 2nd hdr timestamp
+    // pkthdr is 6 bytes before the payload starts at the 2nd hdr timestamp
     // copy from payload into vcdu starting at byte 20 from the start of sync, 16 from start of VCDU
     std::copy(payload.begin(), payload.end(), vcdu + vcdu_offset_to_sec_hdr);
 
-    if ((previousSrcSeqCount == -1) || (sourceSequenceCounter == 0) || 
-        (sourceSequenceCounter <= previousSrcSeqCount)) {
-        // packet is from a new image
-        LogFileWriter::getInstance().logInfo("MB starting new image first SrcSeqCounter: {}", sourceSequenceCounter);
-
-        //reset oneMEGSStructure
-        oneMEGSStructure = MEGS_IMAGE_REC{0}; // c++11 
-
-        testPattern = false; // default is not a test pattern
-        if ((vcdu[34] == 0x8f) && (vcdu[35] == 0xfc) && (vcdu[36] == 0x87) && (vcdu[37] == 0xfe)) { //changed for MEGS-B
-            testPattern = true; // identify TP (first 2 pixels are bad so skip 30-33)
+    // vcdu should look like a fake VCDU, with garbage before the timestamp
+    // and it does, just without the primary header, impdu hdr, and vcdu hdr
 
-            // David sets the first pixels to ff ff aa aa - these 2 pixels fail parity
-            std::cout << "processMegsBPacket identified a test pattern" <<std::endl;
+    // packets arrive here in counter order without duplicates, so a counter that does not increase starts a new image
+    if ((!state.inProgress) || (sourceSequenceCounter == 0) || 
+        (sourceSequenceCounter <= state.previousSrcSeqCount)) {
+        // the previous image lost its tail, write what was received before starting over
+        if (state.inProgress) {
+            finishMegsImage(state, apid);
+        }
+        // packet is from a new image
+        LogFileWriter::getInstance().logInfo("{} starting new image first SrcSeqCounter: {}", channel, sourceSequenceCounter);
+
+        //reset state.image
+        state.image = MEGS_IMAGE_REC{0}; // c++11 
+        state.inProgress = true;
+        state.saturation.start();
+        startMegsDark(state, apid);
+        startMegsSpectrum(state, apid);
+
+        // first 2 pixels are bad so skip 30-33, MEGS-A test patterns start 00 02 00 01,
+        // MEGS-B ones 8f fc 87 fe after David's ff ff aa aa, which fail parity
+        static const uint8_t testPatternStartA[4] = {0x00, 0x02, 0x00, 0x01};
+        static const uint8_t testPatternStartB[4] = {0x8f, 0xfc, 0x87, 0xfe};
+        state.testPattern = (std::memcmp(vcdu + 34, isMegsA ? testPatternStartA : testPatternStartB, 4) == 0);
+        if (state.testPattern) {
+            std::cout << "processMegsPacket identified a " << channel << " test pattern" << std::endl;
         }
-        globalState.isMBTestPattern.store(testPattern);
+        isTestPattern.store(state.testPattern);
 
-        populateStructureTimes(oneMEGSStructure, payload);
+        populateStructureTimes(state.image, payload);
 
         // only assign the time from the first packet, the rest keep changing
-
-        mtx.lock();
-        globalState.megsb.tai_time_seconds = oneMEGSStructure.tai_time_seconds;
-        globalState.megsb.tai_time_subseconds = oneMEGSStructure.tai_time_subseconds;
-        globalState.megsb.rec_tai_seconds = oneMEGSStructure.rec_tai_seconds;
-        globalState.megsb.rec_tai_subseconds = oneMEGSStructure.rec_tai_subseconds;
-        globalState.megsb.sod = oneMEGSStructure.sod;
-        globalState.megsb.yyyydoy = oneMEGSStructure.yyyydoy;
-
-        std::memcpy(globalState.megsBPayloadBytes, payload.data(), payload.size());
-
-        mtx.unlock();
-
-        processedPacketCounter=0;
+        MEGS_IMAGE_METADATA metadata = {state.image.tai_time_seconds, state.image.tai_time_subseconds,
+            state.image.rec_tai_seconds, state.image.rec_tai_subseconds,
+            state.image.sod, state.image.yyyydoy};
+        (isMegsA ? globalState.megsAMetadata : globalState.megsBMetadata).publish(metadata);
+        SharedMemoryPublisher::getInstance().startImage(isMegsA ? EVE_SHM_MEGSA_IN_PROGRESS : EVE_SHM_MEGSB_IN_PROGRESS, state.image,
+            (isMegsA ? globalState.megsAImageCount : globalState.megsBImageCount).load(std::memory_order_relaxed), state.testPattern);
+        publishPayloadBytes(isMegsA ? globalState.megsAPayloadBytes : globalState.megsBPayloadBytes, payload);
+
+        state.processedPacketCounter=0;
     }
-    if ((!isFirstImage) && (((previousSrcSeqCount + 1) % N_PKT_PER_IMAGE) != sourceSequenceCounter)) {
-        LogFileWriter::getInstance().logError("MEGS-B packet out of sequence SSC: {} {}", previousSrcSeqCount, sourceSequenceCounter);
-        std::cout << "MEGS-B packet out of sequence: " << previousSrcSeqCount << " " << sourceSequenceCounter << std::endl;
-        globalState.dataGapsMB.fetch_add(1, std::memory_order_relaxed);
+    if ((!state.isFirstImage) && (((state.previousSrcSeqCount + 1) % N_PKT_PER_IMAGE) != sourceSequenceCounter)) {
+        // there is a gap in the data
+        LogFileWriter::getInstance().logError("{} packet out of sequence SSC: {} previous SSC: {}", channel, sourceSequenceCounter, state.previousSrcSeqCount);
+        std::cout << "MEGS-" << channel[1] << " packet out of sequence: " << state.previousSrcSeqCount << " " << sourceSequenceCounter << std::endl;
+
+        (isMegsA ? globalState.dataGapsMA : globalState.dataGapsMB).fetch_add(1, std::memory_order_relaxed);
+        PacketStats::getInstance().count(apid, COUNTER_GAPS);
     }
-    previousSrcSeqCount = sourceSequenceCounter;
+    state.previousSrcSeqCount = sourceSequenceCounter;
 
-    // begin assigning data into oneMEGSStructure
+    // begin assigning data into state.image
 
     // assing pixel values from the packet into the proper locations in the image
-    int parityErrors = assemble_image(vcdu, &oneMEGSStructure, sourceSequenceCounter, testPattern, xpos, ypos, &status);
+    // The state.image is the one that is written to FITS and is initialized to 0
+    int parityErrors;
+    {
+        ScopedStageTimer assembleTimer(STAGE_ASSEMBLE);
+        parityErrors = assemble_image(vcdu, &state.image, sourceSequenceCounter, state.testPattern, xpos, ypos, &status);
+    }
+    markMegsPacketReceived(state.image, sourceSequenceCounter);
+    state.saturation.addPacketRows(state.image, sourceSequenceCounter);
+    addMegsSpectrumRows(state, sourceSequenceCounter);
+    (isMegsA ? globalState.megsAImagePackets : globalState.megsBImagePackets).store(state.image.packets_received, std::memory_order_relaxed);
+    state.lastPacketTime = std::chrono::steady_clock::now();
 
     {
-        globalState.packetsReceived.MB.fetch_add(1);
-        if (isFirstImage) {
-            if (globalState.packetsReceived.MB.load() > 2395) {
-                isFirstImage = false;
-            }
+        (isMegsA ? globalState.packetsReceived.MA : globalState.packetsReceived.MB).fetch_add(1);
+        (isMegsA ? globalState.isFirstMAImage : globalState.isFirstMBImage).store(state.isFirstImage, std::memory_order_relaxed);
+        // the live image is NOT initialized and just overwrites each packet location as it is received
+        {
+            ScopedStageTimer assembleTimer(STAGE_ASSEMBLE);
+            (isMegsA ? globalState.parityErrorsMA : globalState.parityErrorsMB).fetch_add(
+                assemble_image(vcdu, &liveImage, sourceSequenceCounter, state.testPattern, xpos, ypos, &status), std::memory_order_relaxed);
         }
-        globalState.isFirstMBImage.store(isFirstImage, std::memory_order_relaxed);
-        // The globalState.megsa image is NOT re-initialized and just overwrites each packet location as it is received
-        globalState.parityErrorsMB.fetch_add(assemble_image(vcdu, &globalState.megsb, sourceSequenceCounter, testPattern, xpos, ypos, &status), std::memory_order_relaxed);
-
-        if ((processedPacketCounter % IMAGE_UPDATE_INTERVAL) == 0) {
-            globalState.megsBUpdated.store(true, std::memory_order_relaxed);
-            globalState.MBypos.store(ypos, std::memory_order_relaxed);  // MBypos is atomic
+        markMegsDirtyRows(isMegsA ? globalState.megsADirtyRows : globalState.megsBDirtyRows, sourceSequenceCounter);
+        SharedMemoryPublisher::getInstance().publishImageRows(isMegsA ? EVE_SHM_MEGSA_IN_PROGRESS : EVE_SHM_MEGSB_IN_PROGRESS,
+            state.image.image, sourceSequenceCounter);
+        if ((state.processedPacketCounter % IMAGE_UPDATE_INTERVAL) == 0) {
+            (isMegsA ? globalState.megsAUpdated : globalState.megsBUpdated).store(true, std::memory_order_relaxed);
+            (isMegsA ? globalState.MAypos : globalState.MBypos).store(ypos, std::memory_order_relaxed); // ypos is atomic
         }
     }
+
     if ( parityErrors > 0 ) {
-        LogFileWriter::getInstance().logError("MB parity errors: {} in SSC:", parityErrors,sourceSequenceCounter);
+        PacketStats::getInstance().count(apid, COUNTER_PARITY_ERRORS, parityErrors);
+        LogFileWriter::getInstance().logError("{} parity errors: {} SSC: {}", channel, parityErrors, sourceSequenceCounter);
     }
-
-    processedPacketCounter++; // count packets processed
+    state.processedPacketCounter++; // count packets processed
 
     if ( sourceSequenceCounter == 2394) {
-        LogFileWriter::getInstance().logInfo("end of MEGS-B image ssc=2394");
-
-        isFirstImage = false;
-
-        globalState.megsBImageCount.fetch_add(1, std::memory_order_relaxed);
-
-        mtx.lock();
-        oneMEGSStructure.FPGA_Board_Temperature = globalState.shkConv.FPGA_Board_Temperature[0];
-        oneMEGSStructure.CEB_Temperature = globalState.shkConv.MEGSB_CEB_Temperature[0];
-        oneMEGSStructure.CPR_Temperature = globalState.shkConv.MEGSB_CPR_Temperature[0];
-        oneMEGSStructure.PRT_Temperature = globalState.shkConv.MEGSB_PRT[0];
-        mtx.unlock();
+        finishMegsImage(state, apid);
+    }
+}
+} // namespace
 
-        // may need to run this in another thread
+void processMegsAPacket(std::vector<uint8_t> payload, 
+    uint16_t sourceSequenceCounter, uint16_t packetLength, double timeStamp) {
+    processMegsPacket(megsAState, MEGSA_APID, payload, sourceSequenceCounter);
+}
 
-        // Write packet data to a FITS file if applicable
-        std::unique_ptr<FITSWriter> fitsFileWriter;
-        fitsFileWriter = std::unique_ptr<FITSWriter>(new FITSWriter());
-        // the c++14 way fitsFileWriter = std::make_unique<FITSWriter>();
-        if (fitsFileWriter) {
-            if (!fitsFileWriter->writeMegsBFITS( oneMEGSStructure )) {
-                LogFileWriter::getInstance().logInfo("writeMegsBFITS write error");
-                std::cout << "ERROR: writeMegsBFITS returned an error" << std::endl;
-            }
-            processedPacketCounter = 0;
-            // reset the structure immediately after writing
-            oneMEGSStructure = MEGS_IMAGE_REC{0}; // c++11 
-        }
-    }
+void processMegsBPacket(std::vector<uint8_t> payload, uint16_t sourceSequenceCounter, uint16_t packetLength, double timeStamp) {
+    processMegsPacket(megsBState, MEGSB_APID, payload, sourceSequenceCounter);
 }
 
 // MEGS-P packet
@@ -503,6 +874,7 @@ void processMegsPPacket(std::vector<uint8_t> payload,
     uint16_t sourceSequenceCounter, uint16_t packetLength, double timeStamp) {
     
     static MEGSP_PACKET oneMEGSPStructure = {0};
+    static MEGSP_PACKET displayMEGSP = {0}; // not reset after each file, published for the GUI
     static uint16_t processedPacketCounter = 0;
     static uint16_t lastSourceSequenceCounter = sourceSequenceCounter - 1;
 
@@ -510,6 +882,7 @@ void processMegsPPacket(std::vector<uint8_t> payload,
         LogFileWriter::getInstance().logError("MEGS-P packet out of sequence: {} {}", lastSourceSequenceCounter, sourceSequenceCounter);
         std::cout << "MEGS-P packet out of sequence: " << lastSourceSequenceCounter << " " << sourceSequenceCounter << std::endl;
         globalState.dataGapsMP.fetch_add(1, std::memory_order_relaxed);
+        PacketStats::getInstance().count(MEGSP_APID, COUNTER_GAPS);
     }
     lastSourceSequenceCounter = sourceSequenceCounter;
 
@@ -526,32 +899,30 @@ void processMegsPPacket(std::vector<uint8_t> payload,
 
         oneMEGSPStructure.MP_lya[index] = (uint16_t (payload[incr]) << 8) | (uint16_t (payload[incr + 1]));
         oneMEGSPStructure.MP_dark[index] = (uint16_t (payload[incr+2]) << 8) | (uint16_t (payload[incr+3]));
-        mtx.lock();
-        globalState.megsp.MP_lya[index] = oneMEGSPStructure.MP_lya[index];
-        globalState.megsp.MP_dark[index] = oneMEGSPStructure.MP_dark[index];
-        mtx.unlock();
+        displayMEGSP.MP_lya[index] = oneMEGSPStructure.MP_lya[index];
+        displayMEGSP.MP_dark[index] = oneMEGSPStructure.MP_dark[index];
     }
 
     processedPacketCounter++;
 
     {
         globalState.packetsReceived.MP.fetch_add(1);
-        mtx.lock();
-        globalState.megsp.tai_time_seconds = oneMEGSPStructure.tai_time_seconds;
-        globalState.megsp.tai_time_subseconds = oneMEGSPStructure.tai_time_subseconds;
-        globalState.megsp.rec_tai_seconds = oneMEGSPStructure.rec_tai_seconds;
-        globalState.megsp.rec_tai_subseconds = oneMEGSPStructure.rec_tai_subseconds;
-        std::memcpy(globalState.megsPPayloadBytes, payload.data(), payload.size());
-        mtx.unlock();
+        displayMEGSP.tai_time_seconds = oneMEGSPStructure.tai_time_seconds;
+        displayMEGSP.tai_time_subseconds = oneMEGSPStructure.tai_time_subseconds;
+        displayMEGSP.rec_tai_seconds = oneMEGSPStructure.rec_tai_seconds;
+        displayMEGSP.rec_tai_subseconds = oneMEGSPStructure.rec_tai_subseconds;
+        globalState.megsp.publish(displayMEGSP);
+        SharedMemoryPublisher::getInstance().publishMEGSP(oneMEGSPStructure, packetoffset, MEGSP_INTEGRATIONS_PER_PACKET);
+        publishPayloadBytes(globalState.megsPPayloadBytes, payload);
     }
 
     // ONLY WRITE WHEN STRUCTURE IS FULL
     if ( processedPacketCounter == MEGSP_PACKETS_PER_FILE ) {
 
-        mtx.lock();
-        oneMEGSPStructure.FPGA_Board_Temperature = globalState.shkConv.FPGA_Board_Temperature[0];
-        oneMEGSPStructure.MEGSP_Temperature = globalState.shkConv.MEGSP_Temperature[0];
-        mtx.unlock();
+        SHK_CONVERTED_PACKET shkConv;
+        globalState.shkConv.read(shkConv);
+        oneMEGSPStructure.FPGA_Board_Temperature = shkConv.FPGA_Board_Temperature[0];
+        oneMEGSPStructure.MEGSP_Temperature = shkConv.MEGSP_Temperature[0];
 
         // Write packet data to a FITS file if applicable
         std::unique_ptr<FITSWriter> fitsFileWriter;
@@ -576,6 +947,7 @@ void processESPPacket(std::vector<uint8_t> payload,
     uint16_t sourceSequenceCounter, uint16_t packetLength, double timeStamp) {
 
     static ESP_PACKET oneESPStructure = {0};
+    static ESP_PACKET displayESP = {0}; // not reset after each file, published for the GUI
     static uint16_t processedESPPacketCounter = 0;
     static uint16_t lastSourceSequenceCounter = sourceSequenceCounter - 1;
 
@@ -583,6 +955,7 @@ void processESPPacket(std::vector<uint8_t> payload,
         LogFileWriter::getInstance().logError("ESP packet out of sequence: {} {}", lastSourceSequenceCounter, sourceSequenceCounter);
         std::cout << "ESP packet out of sequence: " << lastSourceSequenceCounter << " " << sourceSequenceCounter << std::endl;
         globalState.dataGapsESP.fetch_add(1, std::memory_order_relaxed);
+        PacketStats::getInstance().count(ESP_APID, COUNTER_GAPS);
         }
     lastSourceSequenceCounter = sourceSequenceCounter;
 
@@ -615,20 +988,16 @@ void processESPPacket(std::vector<uint8_t> payload,
         oneESPStructure.ESP_171[index] = (uint16_t (payload[incr+16]) << 8) | (uint16_t (payload[incr+17]));
         oneESPStructure.ESP_304[index] = (uint16_t (payload[incr+18]) << 8) | (uint16_t (payload[incr+19]));
 
-        globalState.espIndex.store(index, std::memory_order_relaxed);
-        
-        mtx.lock();
-        globalState.esp.ESP_xfer_cnt[index] = oneESPStructure.ESP_xfer_cnt[index];
-        globalState.esp.ESP_q0[index] = oneESPStructure.ESP_q0[index];
-        globalState.esp.ESP_q1[index] = oneESPStructure.ESP_q1[index];
-        globalState.esp.ESP_q2[index] = oneESPStructure.ESP_q2[index];
-        globalState.esp.ESP_q3[index] = oneESPStructure.ESP_q3[index];
-        globalState.esp.ESP_171[index] = oneESPStructure.ESP_171[index];
-        globalState.esp.ESP_257[index] = oneESPStructure.ESP_257[index];
-        globalState.esp.ESP_304[index] = oneESPStructure.ESP_304[index];
-        globalState.esp.ESP_366[index] = oneESPStructure.ESP_366[index];
-        globalState.esp.ESP_dark[index] = oneESPStructure.ESP_dark[index];
-        mtx.unlock();
+        displayESP.ESP_xfer_cnt[index] = oneESPStructure.ESP_xfer_cnt[index];
+        displayESP.ESP_q0[index] = oneESPStructure.ESP_q0[index];
+        displayESP.ESP_q1[index] = oneESPStructure.ESP_q1[index];
+        displayESP.ESP_q2[index] = oneESPStructure.ESP_q2[index];
+        displayESP.ESP_q3[index] = oneESPStructure.ESP_q3[index];
+        displayESP.ESP_171[index] = oneESPStructure.ESP_171[index];
+        displayESP.ESP_257[index] = oneESPStructure.ESP_257[index];
+        displayESP.ESP_304[index] = oneESPStructure.ESP_304[index];
+        displayESP.ESP_366[index] = oneESPStructure.ESP_366[index];
+        displayESP.ESP_dark[index] = oneESPStructure.ESP_dark[index];
 
     }
 
@@ -638,24 +1007,26 @@ void processESPPacket(std::vector<uint8_t> payload,
     {
         globalState.packetsReceived.ESP.fetch_add(1, std::memory_order_relaxed);
 
-        mtx.lock();
-        globalState.esp.tai_time_seconds = oneESPStructure.tai_time_seconds;
-        globalState.esp.tai_time_subseconds = oneESPStructure.tai_time_subseconds;
-        globalState.esp.rec_tai_seconds = oneESPStructure.rec_tai_seconds;
-        globalState.esp.rec_tai_subseconds = oneESPStructure.rec_tai_subseconds;
-        std::memcpy(globalState.espPayloadBytes, payload.data(), payload.size());
-        mtx.unlock();
+        displayESP.tai_time_seconds = oneESPStructure.tai_time_seconds;
+        displayESP.tai_time_subseconds = oneESPStructure.tai_time_subseconds;
+        displayESP.rec_tai_seconds = oneESPStructure.rec_tai_seconds;
+        displayESP.rec_tai_subseconds = oneESPStructure.rec_tai_subseconds;
+        globalState.esp.publish(displayESP);
+        SharedMemoryPublisher::getInstance().publishESP(oneESPStructure, packetoffset, ESP_INTEGRATIONS_PER_PACKET);
+        // stored after the publish and loaded first by readers, so it never points past the snapshot they read
+        globalState.espIndex.store(packetoffset + ESP_INTEGRATIONS_PER_PACKET - 1, std::memory_order_release);
+        publishPayloadBytes(globalState.espPayloadBytes, payload);
     }
 
 
     // ONLY WRITE WHEN STRUCTURE IS FULL
     if ( processedESPPacketCounter == ESP_PACKETS_PER_FILE ) {
 
-        mtx.lock();
-        oneESPStructure.FPGA_Board_Temperature = globalState.shkConv.FPGA_Board_Temperature[0];
-        oneESPStructure.ESP_Electrometer_Temperature = globalState.shkConv.ESP_Electrometer_Temperature[0];
-        oneESPStructure.ESP_Detector_Temperature = globalState.shkConv.ESP_Detector_Temperature[0];
-        mtx.unlock();
+        SHK_CONVERTED_PACKET shkConv;
+        globalState.shkConv.read(shkConv);
+        oneESPStructure.FPGA_Board_Temperature = shkConv.FPGA_Board_Temperature[0];
+        oneESPStructure.ESP_Electrometer_Temperature = shkConv.ESP_Electrometer_Temperature[0];
+        oneESPStructure.ESP_Detector_Temperature = shkConv.ESP_Detector_Temperature[0];
 
         // Write packet data to a FITS file if applicable
         std::unique_ptr<FITSWriter> fitsFileWriter;
@@ -802,6 +1173,7 @@ void processHKPacket(std::vector<uint8_t> payload,
     uint16_t sourceSequenceCounter, uint16_t packetLength, double timeStamp) {
     
     static SHK_PACKET oneSHKStructure = {0};
+    static SHK_PACKET displaySHK = {0}; // not reset after each file, published for the GUI
     static uint16_t processedPacketCounter=0;
     static uint16_t lastSourceSequenceCounter = sourceSequenceCounter - 1;
 
@@ -811,6 +1183,7 @@ void processHKPacket(std::vector<uint8_t> payload,
         LogFileWriter::getInstance().logError("SHK packet out of sequence: {} {}", lastSourceSequenceCounter, sourceSequenceCounter);
         std::cout << "SHK packet out of sequence: " << lastSourceSequenceCounter << " " << sourceSequenceCounter << std::endl;
         globalState.dataGapsSHK.fetch_add(1, std::memory_order_relaxed);
+        PacketStats::getInstance().count(SHK_APID, COUNTER_GAPS);
     }
     lastSourceSequenceCounter = sourceSequenceCounter;
 
@@ -890,66 +1263,63 @@ void processHKPacket(std::vector<uint8_t> payload,
         oneSHKStructure.MEGSP_Temperature[index] = payloadBytesToUint32(payload, incr+240); // 60*4
         // additional 4 spares at the end
 
-        mtx.lock();
-        globalState.shk.mode[index] = oneSHKStructure.mode[index];
-        globalState.shk.FPGA_Board_Temperature[index] = oneSHKStructure.FPGA_Board_Temperature[index];
-        globalState.shk.FPGA_Board_p5_0_Voltage[index] = oneSHKStructure.FPGA_Board_p5_0_Voltage[index];
-        globalState.shk.FPGA_Board_p3_3_Voltage[index] = oneSHKStructure.FPGA_Board_p3_3_Voltage[index];
-        globalState.shk.FPGA_Board_p2_5_Voltage[index] = oneSHKStructure.FPGA_Board_p2_5_Voltage[index];
-        globalState.shk.FPGA_Board_p1_2_Voltage[index] = oneSHKStructure.FPGA_Board_p1_2_Voltage[index];
-        globalState.shk.MEGSA_CEB_Temperature[index] = oneSHKStructure.MEGSA_CEB_Temperature[index];
-        globalState.shk.MEGSA_CPR_Temperature[index] = oneSHKStructure.MEGSA_CPR_Temperature[index];
-        globalState.shk.MEGSA_p24_Voltage[index] = oneSHKStructure.MEGSA_p24_Voltage[index];
-        globalState.shk.MEGSA_p15_Voltage[index] = oneSHKStructure.MEGSA_p15_Voltage[index];
-        globalState.shk.MEGSA_m15_Voltage[index] = oneSHKStructure.MEGSA_m15_Voltage[index];
-        globalState.shk.MEGSA_p5_0_Analog_Voltage[index] = oneSHKStructure.MEGSA_p5_0_Analog_Voltage[index];
-        globalState.shk.MEGSA_m5_0_Voltage[index] = oneSHKStructure.MEGSA_m5_0_Voltage[index];
-        globalState.shk.MEGSA_p5_0_Digital_Voltage[index] = oneSHKStructure.MEGSA_p5_0_Digital_Voltage[index];
-        globalState.shk.MEGSA_p2_5_Voltage[index] = oneSHKStructure.MEGSA_p2_5_Voltage[index];
-        globalState.shk.MEGSA_p24_Current[index] = oneSHKStructure.MEGSA_p24_Current[index];
-        globalState.shk.MEGSA_p15_Current[index] = oneSHKStructure.MEGSA_p15_Current[index];
-        globalState.shk.MEGSA_m15_Current[index] = oneSHKStructure.MEGSA_m15_Current[index];
-        globalState.shk.MEGSA_p5_0_Analog_Current[index] = oneSHKStructure.MEGSA_p5_0_Analog_Current[index];
-        globalState.shk.MEGSA_m5_0_Current[index] = oneSHKStructure.MEGSA_m5_0_Current[index];
-        globalState.shk.MEGSA_p5_0_Digital_Current[index] = oneSHKStructure.MEGSA_p5_0_Digital_Current[index];
-        globalState.shk.MEGSA_p2_5_Current[index] = oneSHKStructure.MEGSA_p2_5_Current[index];
-        globalState.shk.MEGSA_Integration_Register[index] = oneSHKStructure.MEGSA_Integration_Register[index];
-        globalState.shk.MEGSA_Analog_Mux_Register[index] = oneSHKStructure.MEGSA_Analog_Mux_Register[index];
-        globalState.shk.MEGSA_Digital_Status_Register[index] = oneSHKStructure.MEGSA_Digital_Status_Register[index];
-        globalState.shk.MEGSA_Integration_Timer_Register[index] = oneSHKStructure.MEGSA_Integration_Timer_Register[index];
-        globalState.shk.MEGSA_Command_Error_Count_Register[index] = oneSHKStructure.MEGSA_Command_Error_Count_Register[index];
-        globalState.shk.MEGSA_CEB_FPGA_Version_Register[index] = oneSHKStructure.MEGSA_CEB_FPGA_Version_Register[index];
-        globalState.shk.MEGSB_CEB_Temperature[index] = oneSHKStructure.MEGSB_CEB_Temperature[index];
-        globalState.shk.MEGSB_CPR_Temperature[index] = oneSHKStructure.MEGSB_CPR_Temperature[index];
-        globalState.shk.MEGSB_p24_Voltage[index] = oneSHKStructure.MEGSB_p24_Voltage[index];
-        globalState.shk.MEGSB_p15_Voltage[index] = oneSHKStructure.MEGSB_p15_Voltage[index];
-        globalState.shk.MEGSB_m15_Voltage[index] = oneSHKStructure.MEGSB_m15_Voltage[index];
-        globalState.shk.MEGSB_p5_0_Analog_Voltage[index] = oneSHKStructure.MEGSB_p5_0_Analog_Voltage[index];
-        globalState.shk.MEGSB_m5_0_Voltage[index] = oneSHKStructure.MEGSB_m5_0_Voltage[index];
-        globalState.shk.MEGSB_p5_0_Digital_Voltage[index] = oneSHKStructure.MEGSB_p5_0_Digital_Voltage[index];
-        globalState.shk.MEGSB_p2_5_Voltage[index] = oneSHKStructure.MEGSB_p2_5_Voltage[index];
-        globalState.shk.MEGSB_p24_Current[index] = oneSHKStructure.MEGSB_p24_Current[index];
-        globalState.shk.MEGSB_p15_Current[index] = oneSHKStructure.MEGSB_p15_Current[index];
-        globalState.shk.MEGSB_m15_Current[index] = oneSHKStructure.MEGSB_m15_Current[index];
-        globalState.shk.MEGSB_p5_0_Analog_Current[index] = oneSHKStructure.MEGSB_p5_0_Analog_Current[index];
-        globalState.shk.MEGSB_m5_0_Current[index] = oneSHKStructure.MEGSB_m5_0_Current[index];
-        globalState.shk.MEGSB_p5_0_Digital_Current[index] = oneSHKStructure.MEGSB_p5_0_Digital_Current[index];
-        globalState.shk.MEGSB_p2_5_Current[index] = oneSHKStructure.MEGSB_p2_5_Current[index];
-        globalState.shk.MEGSB_Integration_Register[index] = oneSHKStructure.MEGSB_Integration_Register[index];
-        globalState.shk.MEGSB_Analog_Mux_Register[index] = oneSHKStructure.MEGSB_Analog_Mux_Register[index];
-        globalState.shk.MEGSB_Digital_Status_Register[index] = oneSHKStructure.MEGSB_Digital_Status_Register[index];
-        globalState.shk.MEGSB_Integration_Timer_Register[index] = oneSHKStructure.MEGSB_Integration_Timer_Register[index];
-        globalState.shk.MEGSB_Command_Error_Count_Register[index] = oneSHKStructure.MEGSB_Command_Error_Count_Register[index];
-        globalState.shk.MEGSB_CEB_FPGA_Version_Register[index] = oneSHKStructure.MEGSB_CEB_FPGA_Version_Register[index];
-        globalState.shk.MEGSA_Thermistor_Diode[index] = oneSHKStructure.MEGSA_Thermistor_Diode[index];
-        globalState.shk.MEGSA_PRT[index] = oneSHKStructure.MEGSA_PRT[index];
-        globalState.shk.MEGSB_Thermistor_Diode[index] = oneSHKStructure.MEGSB_Thermistor_Diode[index];
-        globalState.shk.MEGSB_PRT[index] = oneSHKStructure.MEGSB_PRT[index];
-        globalState.shk.ESP_Electrometer_Temperature[index] = oneSHKStructure.ESP_Electrometer_Temperature[index];
-        globalState.shk.ESP_Detector_Temperature[index] = oneSHKStructure.ESP_Detector_Temperature[index];
-        globalState.shk.MEGSP_Temperature[index] = oneSHKStructure.MEGSP_Temperature[index];
-
-        mtx.unlock();
+        displaySHK.mode[index] = oneSHKStructure.mode[index];
+        displaySHK.FPGA_Board_Temperature[index] = oneSHKStructure.FPGA_Board_Temperature[index];
+        displaySHK.FPGA_Board_p5_0_Voltage[index] = oneSHKStructure.FPGA_Board_p5_0_Voltage[index];
+        displaySHK.FPGA_Board_p3_3_Voltage[index] = oneSHKStructure.FPGA_Board_p3_3_Voltage[index];
+        displaySHK.FPGA_Board_p2_5_Voltage[index] = oneSHKStructure.FPGA_Board_p2_5_Voltage[index];
+        displaySHK.FPGA_Board_p1_2_Voltage[index] = oneSHKStructure.FPGA_Board_p1_2_Voltage[index];
+        displaySHK.MEGSA_CEB_Temperature[index] = oneSHKStructure.MEGSA_CEB_Temperature[index];
+        displaySHK.MEGSA_CPR_Temperature[index] = oneSHKStructure.MEGSA_CPR_Temperature[index];
+        displaySHK.MEGSA_p24_Voltage[index] = oneSHKStructure.MEGSA_p24_Voltage[index];
+        displaySHK.MEGSA_p15_Voltage[index] = oneSHKStructure.MEGSA_p15_Voltage[index];
+        displaySHK.MEGSA_m15_Voltage[index] = oneSHKStructure.MEGSA_m15_Voltage[index];
+        displaySHK.MEGSA_p5_0_Analog_Voltage[index] = oneSHKStructure.MEGSA_p5_0_Analog_Voltage[index];
+        displaySHK.MEGSA_m5_0_Voltage[index] = oneSHKStructure.MEGSA_m5_0_Voltage[index];
+        displaySHK.MEGSA_p5_0_Digital_Voltage[index] = oneSHKStructure.MEGSA_p5_0_Digital_Voltage[index];
+        displaySHK.MEGSA_p2_5_Voltage[index] = oneSHKStructure.MEGSA_p2_5_Voltage[index];
+        displaySHK.MEGSA_p24_Current[index] = oneSHKStructure.MEGSA_p24_Current[index];
+        displaySHK.MEGSA_p15_Current[index] = oneSHKStructure.MEGSA_p15_Current[index];
+        displaySHK.MEGSA_m15_Current[index] = oneSHKStructure.MEGSA_m15_Current[index];
+        displaySHK.MEGSA_p5_0_Analog_Current[index] = oneSHKStructure.MEGSA_p5_0_Analog_Current[index];
+        displaySHK.MEGSA_m5_0_Current[index] = oneSHKStructure.MEGSA_m5_0_Current[index];
+        displaySHK.MEGSA_p5_0_Digital_Current[index] = oneSHKStructure.MEGSA_p5_0_Digital_Current[index];
+        displaySHK.MEGSA_p2_5_Current[index] = oneSHKStructure.MEGSA_p2_5_Current[index];
+        displaySHK.MEGSA_Integration_Register[index] = oneSHKStructure.MEGSA_Integration_Register[index];
+        displaySHK.MEGSA_Analog_Mux_Register[index] = oneSHKStructure.MEGSA_Analog_Mux_Register[index];
+        displaySHK.MEGSA_Digital_Status_Register[index] = oneSHKStructure.MEGSA_Digital_Status_Register[index];
+        displaySHK.MEGSA_Integration_Timer_Register[index] = oneSHKStructure.MEGSA_Integration_Timer_Register[index];
+        displaySHK.MEGSA_Command_Error_Count_Register[index] = oneSHKStructure.MEGSA_Command_Error_Count_Register[index];
+        displaySHK.MEGSA_CEB_FPGA_Version_Register[index] = oneSHKStructure.MEGSA_CEB_FPGA_Version_Register[index];
+        displaySHK.MEGSB_CEB_Temperature[index] = oneSHKStructure.MEGSB_CEB_Temperature[index];
+        displaySHK.MEGSB_CPR_Temperature[index] = oneSHKStructure.MEGSB_CPR_Temperature[index];
+        displaySHK.MEGSB_p24_Voltage[index] = oneSHKStructure.MEGSB_p24_Voltage[index];
+        displaySHK.MEGSB_p15_Voltage[index] = oneSHKStructure.MEGSB_p15_Voltage[index];
+        displaySHK.MEGSB_m15_Voltage[index] = oneSHKStructure.MEGSB_m15_Voltage[index];
+        displaySHK.MEGSB_p5_0_Analog_Voltage[index] = oneSHKStructure.MEGSB_p5_0_Analog_Voltage[index];
+        displaySHK.MEGSB_m5_0_Voltage[index] = oneSHKStructure.MEGSB_m5_0_Voltage[index];
+        displaySHK.MEGSB_p5_0_Digital_Voltage[index] = oneSHKStructure.MEGSB_p5_0_Digital_Voltage[index];
+        displaySHK.MEGSB_p2_5_Voltage[index] = oneSHKStructure.MEGSB_p2_5_Voltage[index];
+        displaySHK.MEGSB_p24_Current[index] = oneSHKStructure.MEGSB_p24_Current[index];
+        displaySHK.MEGSB_p15_Current[index] = oneSHKStructure.MEGSB_p15_Current[index];
+        displaySHK.MEGSB_m15_Current[index] = oneSHKStructure.MEGSB_m15_Current[index];
+        displaySHK.MEGSB_p5_0_Analog_Current[index] = oneSHKStructure.MEGSB_p5_0_Analog_Current[index];
+        displaySHK.MEGSB_m5_0_Current[index] = oneSHKStructure.MEGSB_m5_0_Current[index];
+        displaySHK.MEGSB_p5_0_Digital_Current[index] = oneSHKStructure.MEGSB_p5_0_Digital_Current[index];
+        displaySHK.MEGSB_p2_5_Current[index] = oneSHKStructure.MEGSB_p2_5_Current[index];
+        displaySHK.MEGSB_Integration_Register[index] = oneSHKStructure.MEGSB_Integration_Register[index];
+        displaySHK.MEGSB_Analog_Mux_Register[index] = oneSHKStructure.MEGSB_Analog_Mux_Register[index];
+        displaySHK.MEGSB_Digital_Status_Register[index] = oneSHKStructure.MEGSB_Digital_Status_Register[index];
+        displaySHK.MEGSB_Integration_Timer_Register[index] = oneSHKStructure.MEGSB_Integration_Timer_Register[index];
+        displaySHK.MEGSB_Command_Error_Count_Register[index] = oneSHKStructure.MEGSB_Command_Error_Count_Register[index];
+        displaySHK.MEGSB_CEB_FPGA_Version_Register[index] = oneSHKStructure.MEGSB_CEB_FPGA_Version_Register[index];
+        displaySHK.MEGSA_Thermistor_Diode[index] = oneSHKStructure.MEGSA_Thermistor_Diode[index];
+        displaySHK.MEGSA_PRT[index] = oneSHKStructure.MEGSA_PRT[index];
+        displaySHK.MEGSB_Thermistor_Diode[index] = oneSHKStructure.MEGSB_Thermistor_Diode[index];
+        displaySHK.MEGSB_PRT[index] = oneSHKStructure.MEGSB_PRT[index];
+        displaySHK.ESP_Electrometer_Temperature[index] = oneSHKStructure.ESP_Electrometer_Temperature[index];
+        displaySHK.ESP_Detector_Temperature[index] = oneSHKStructure.ESP_Detector_Temperature[index];
+        displaySHK.MEGSP_Temperature[index] = oneSHKStructure.MEGSP_Temperature[index];
 
     }
 
@@ -957,13 +1327,12 @@ void processHKPacket(std::vector<uint8_t> payload,
 
     {
         globalState.packetsReceived.SHK.fetch_add(1, std::memory_order_relaxed);
-        mtx.lock();        
-        globalState.shk.tai_time_seconds = oneSHKStructure.tai_time_seconds;
-        globalState.shk.tai_time_subseconds = oneSHKStructure.tai_time_subseconds;
-        globalState.shk.rec_tai_seconds = oneSHKStructure.rec_tai_seconds;
-        globalState.shk.rec_tai_subseconds = oneSHKStructure.rec_tai_subseconds;
-        std::memcpy(globalState.shkPayloadBytes, payload.data(), payload.size());
-        mtx.unlock();
+        displaySHK.tai_time_seconds = oneSHKStructure.tai_time_seconds;
+        displaySHK.tai_time_subseconds = oneSHKStructure.tai_time_subseconds;
+        displaySHK.rec_tai_seconds = oneSHKStructure.rec_tai_seconds;
+        displaySHK.rec_tai_subseconds = oneSHKStructure.rec_tai_subseconds;
+        globalState.shk.publish(displaySHK);
+        publishPayloadBytes(globalState.shkPayloadBytes, payload);
     }
 
     // ONLY WRITE WHEN STRUCTURE IS FULL
@@ -975,9 +1344,8 @@ void processHKPacket(std::vector<uint8_t> payload,
 
         // perform conversions
         SHK_CONVERTED_PACKET oneSHKConvertedData = convertSHKData(oneSHKStructure);
-        mtx.lock();
-        globalState.shkConv = oneSHKConvertedData;
-        mtx.unlock();
+        globalState.shkConv.publish(oneSHKConvertedData);
+        SharedMemoryPublisher::getInstance().publishSHK(oneSHKConvertedData, oneSHKStructure.tai_time_seconds);
 
         if (fitsFileWriter) {
 
@@ -10,8 +10,15 @@
 #include "RecordFileWriter.hpp"
 #include "USBInputSource.hpp"
 #include "ProgramState.hpp"
+#include "SharedMemoryPublisher.hpp"
+#include "PacketBroadcaster.hpp"
+#include "StageTimer.hpp"
+#include "MegsDark.hpp"
+#include "PacketStats.hpp"
+#include "SequenceReorder.hpp"
 #include <functional> // for convertSHKData lambda polynomial function
 #include <array> // for std::array
+#include <bitset> // for MegsSaturationCounter
 #include <omp.h> // for OpenMP
 
 //#include <chrono> // included in RecordFileWriter.hpp
@@ -30,6 +37,9 @@ bool isValidFilename(const std::string& filename);
 
 void processPackets(CCSDSReader& pktReader, std::unique_ptr<RecordFileWriter>& recordWriter, bool skipRecord);
 void processOnePacket(CCSDSReader& pktReader, const std::vector<uint8_t>& packet);
+void finishPacketProcessing(CCSDSReader& pktReader);
+void tickPacketProcessing(CCSDSReader& pktReader, std::chrono::steady_clock::time_point now);
+void resetPacketReorder();
 
 void processMegsAPacket(std::vector<uint8_t> payload, 
     uint16_t sourceSequenceCounter, uint16_t packetLength, double timeStamp);
@@ -49,15 +59,47 @@ void printUint16ToStdOut(const uint16_t* image, size_t size, size_t count);
 bool create_directory_if_not_exists(const std::string& dirPath);
 bool create_single_directory(const std::string& path);
 std::vector<uint16_t> transposeImageTo1D(const uint16_t image[MEGS_IMAGE_HEIGHT][MEGS_IMAGE_WIDTH]);
+void transposeImage(const uint16_t image[MEGS_IMAGE_HEIGHT][MEGS_IMAGE_WIDTH], std::vector<uint16_t>& transposed);
 uint32_t payloadBytesToUint32(const std::vector<uint8_t>& payload, const int32_t offsetByte);
 uint32_t payloadToTAITimeSeconds(const std::vector<uint8_t>& payload);
 uint32_t payloadToTAITimeSubseconds(const std::vector<uint8_t>& payload);
 
 double tai_ss(uint32_t tai_secods, uint32_t tai_subseconds);
 
+void megsTopRowsForPacket(uint16_t sourceSequenceCounter, uint32_t& firstRow, uint32_t& lastRow);
+void markMegsDirtyRows(std::atomic<uint32_t>* dirtyRows, uint16_t sourceSequenceCounter);
+
+bool markMegsPacketReceived(MEGS_IMAGE_REC& image, uint16_t sourceSequenceCounter);
+bool isMegsPacketReceived(const MEGS_IMAGE_REC& image, uint16_t sourceSequenceCounter);
+float megsImageCompleteness(const MEGS_IMAGE_REC& image);
+void flushTimedOutMegsImages(std::chrono::steady_clock::time_point now);
+void flushPartialMegsImages();
+
+void histogramEqualization(const uint16_t (*image)[MEGS_IMAGE_HEIGHT][MEGS_IMAGE_WIDTH],
+                           std::vector<uint8_t>& textureData);
+
 void countSaturatedPixels(const uint16_t image[MEGS_IMAGE_HEIGHT][MEGS_IMAGE_WIDTH],
                           uint32_t& saturatedPixelsTop,
                           uint32_t& saturatedPixelsBottom,
                           bool testPattern = false);
 
+// Counts the saturated pixels of a MEGS image while it is assembled, so writing it does not scan the whole image.
+// A top row and its mirrored bottom row are counted when the last packet writing them arrives with the others
+// received, finish() counts the rows a partial image never completed.
+class MegsSaturationCounter {
+public:
+    void start();
+    void addPacketRows(const MEGS_IMAGE_REC& image, uint16_t sourceSequenceCounter);
+    void finish(const MEGS_IMAGE_REC& image, bool testPattern, uint32_t& saturatedPixelsTop, uint32_t& saturatedPixelsBottom);
+
+private:
+    void countRows(const MEGS_IMAGE_REC& image, uint32_t topRow);
+
+    std::bitset<MEGS_IMAGE_HEIGHT / 2> counted;
+    uint32_t top = 0;
+    uint32_t bottom = 0;
+};
+
+SHK_CONVERTED_PACKET convertSHKData(SHK_PACKET& rawSHK);
+
 #endif // COMMONFUNCTIONS_H
\ No newline at end of file
@@ -54,6 +54,8 @@ constexpr int32_t SECONDS_PER_SHK_FILE = 10;
 constexpr int32_t SHK_PACKETS_PER_FILE = SECONDS_PER_SHK_FILE;
 constexpr int32_t SHK_INTEGRATIONS_PER_FILE = SHK_INTEGRATIONS_PER_PACKET * SECONDS_PER_SHK_FILE;
 
+constexpr int32_t SECONDS_PER_MEGS_IMAGE = 10; // MEGS-A and MEGS-B image cadence
+
 constexpr uint16_t IMAGE_UPDATE_INTERVAL = 114; //266; // best values are evenly divisible into 2394: 1,2,3,6,7,9,14,18,19,21,38,42,57,63,114,126,133,171,266,342,399,798,1197
 
 #define BAD_PIXEL 16384 			// 2^14	- Image fill value
@@ -64,6 +66,7 @@ constexpr uint16_t IMAGE_UPDATE_INTERVAL = 114; //266; // best values are evenly
 #define n_bytes_per_vcdu_data 1756		// Each vcdu is 1756 bytes
 
 #define N_PKT_PER_IMAGE 		2395	// There are 2395 packets in each image
+#define MEGS_RECEIVED_BITMAP_BYTES ((N_PKT_PER_IMAGE + 7) / 8)	// one bit per packet of an image
 
 constexpr uint32_t MEGS_IMAGE_WIDTH = 2048;	// The CCD images are 2048 x 1024 pixels
 constexpr uint32_t MEGS_IMAGE_HEIGHT = 1024;
@@ -72,6 +75,9 @@ constexpr uint32_t MEGS_TOTAL_PIXELS = MEGS_IMAGE_WIDTH * MEGS_IMAGE_HEIGHT;
 constexpr uint32_t MEGS_IMAGE_T_WIDTH = 1024; //transposed
 constexpr uint32_t MEGS_IMAGE_T_HEIGHT = 2048; //transposed
 
+constexpr uint32_t MEGS_PIXELS_PER_HALF_PACKET = 438; // each MEGS packet has 438 top and 438 bottom pixels
+constexpr uint32_t MEGS_DIRTY_ROW_WORDS = MEGS_IMAGE_HEIGHT / 32; // one bit per image row
+
 #define PHOTO_SAMPLES_PER_10SEC 	40		// ESP is sampled at 4 Hz
 #define Y_TOP 						0		// Image orientation
 #define Y_MIDDLE 					511		//  The middle row
@@ -422,6 +428,8 @@ struct MEGS_IMAGE_REC {
   float CEB_Temperature;
   float CPR_Temperature;
   float PRT_Temperature;
+  uint16_t packets_received; // distinct packets assembled, N_PKT_PER_IMAGE for a complete image
+  uint8_t received_packets[MEGS_RECEIVED_BITMAP_BYTES]; // bit (SSC % 8) of byte SSC / 8 is set when packet SSC is assembled
   uint16_t image[MEGS_IMAGE_HEIGHT][MEGS_IMAGE_WIDTH];
 };
 
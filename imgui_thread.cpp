@@ -6,6 +6,8 @@
 #include "imgui/backends/imgui_impl_glfw.h"
 #include "imgui/backends/imgui_impl_opengl3.h"
 #include "implot.h"
+#include "ColormapLUT.hpp"
+#include "TraceRecorder.hpp"
 #include "eve_esp_x_angle.h"
 #include "eve_esp_y_angle.h"
 #include <stdio.h>
@@ -23,22 +25,39 @@
 #include <GLFW/glfw3.h> 
 
 extern ProgramState globalState;
-extern std::mutex mtx;
 
 const char* Image_Display_Scale_Items[] = { "Mod 256", "Full Scale", "HistEqual" };
 
+// display settings used for the last full texture render, any change forces a full refresh
+struct TextureRenderState
+{
+    bool valid = false;
+    int scale = 0;
+    ImPlotColormap colormap = ImPlotColormap_Jet;
+    std::shared_ptr<const MegsDarkFrame> dark;  // held while the texture shows it
+    bool flipVertical = false;
+    bool flipHorizontal = false;
+};
+
+// persistent buffers and state for rendering one MEGS texture, reused on every refresh
+struct MegsRenderContext
+{
+    std::vector<uint8_t> textureData = std::vector<uint8_t>(MEGS_TOTAL_PIXELS);          // 8-bit scaled image
+    std::vector<uint8_t> colorTextureData = std::vector<uint8_t>(MEGS_TOTAL_PIXELS * 3); // r,g,b
+    ColormapLUT lut;
+    TextureRenderState rendered;
+};
+
 struct GlobalGUI
 {
     int Image_Display_Scale_MA = 0;
     int Image_Display_Scale_MB = 0;
     float mazoom = 0.2f;
     float mbzoom = 0.2f;         // Zoom level (1.0 = full resolution)
-    uint16_t MADark[MEGS_IMAGE_HEIGHT][MEGS_IMAGE_WIDTH] = {0};
-    uint16_t MBDark[MEGS_IMAGE_HEIGHT][MEGS_IMAGE_WIDTH] = {0};
     uint16_t displayableMAImage[MEGS_IMAGE_HEIGHT][MEGS_IMAGE_WIDTH] = {0};
     uint16_t displayableMBImage[MEGS_IMAGE_HEIGHT][MEGS_IMAGE_WIDTH] = {0};
-    bool removeMADark = false;
-    bool removeMBDark = false;
+    int darkFrames = MEGS_DARK_DEFAULT_FRAMES;
+    int darkMode = MEGS_DARK_MEAN;
     bool flipMAVertical = true; //03/21/25 set default to flip to be consistent with previous displays
     // display is desired to be flipped vertically
     // bottom left is slit 2, bottom right is SAM
@@ -46,6 +65,8 @@ struct GlobalGUI
     bool flipMBVertical = true;
     bool flipMAHorizontal = false;
     bool flipMBHorizontal = false;
+    MegsRenderContext renderMA;
+    MegsRenderContext renderMB;
 };
 
 static GlobalGUI globalGUI;
@@ -86,19 +107,6 @@ ImVec4 getColorForState(LimitState state) {
     }
 }
 
-void differenceAndClip(const uint16_t measurement[MEGS_IMAGE_HEIGHT][MEGS_IMAGE_WIDTH],
-                       const uint16_t background[MEGS_IMAGE_HEIGHT][MEGS_IMAGE_WIDTH],
-                       uint16_t result[MEGS_IMAGE_HEIGHT][MEGS_IMAGE_WIDTH]) {
-    //#pragma omp parallel for
-    for (size_t i = 0; i < MEGS_IMAGE_HEIGHT; ++i) {
-        //#pragma omp simd
-        for (size_t j = 0; j < MEGS_IMAGE_WIDTH; ++j) {
-            int diff = measurement[i][j] - background[i][j];
-            result[i][j] = diff > 0 ? diff : 0;
-        }
-    }
-}
-
 void addFilledCircleToTreeNode(LimitState state) {
     // Position elements on the same line
     ImGui::SameLine();
@@ -287,75 +295,20 @@ void SetRainbowCustomColormap(bool isMA) {
     // after using it,need to use ImPlot::PopColormap();
 }   
 
-void histogramEqualization(uint16_t (*image)[MEGS_IMAGE_HEIGHT][MEGS_IMAGE_WIDTH], std::vector<uint8_t>& textureData) {
-    constexpr uint32_t halfHeight = MEGS_IMAGE_HEIGHT / 2;
-    constexpr uint32_t topHalfPixels = MEGS_IMAGE_WIDTH * halfHeight;
-    constexpr uint32_t bottomHalfPixels = MEGS_IMAGE_WIDTH * halfHeight;
-
-    // brace initialization for zeroing out the arrays is the fastest way to initialize a large array to zero
-    // since the compiler can optimize this to either a memset or rep stosd call
-    int topHistogram[16384] = {0};
-    int bottomHistogram[16384] = {0};
-
-    // Step 1: Calculate the histogram for the top and bottom halves
-    // use all threads available to calculate the histogram
-
-    // -faster code-
-    #pragma omp parallel for
-    for (uint32_t idx = 0; idx < MEGS_TOTAL_PIXELS; ++idx) {
-        // Calculate x and y coordinates
-        uint32_t y = idx / MEGS_IMAGE_WIDTH;
-        uint32_t x = idx % MEGS_IMAGE_WIDTH;
-
-        // Determine which histogram to use based on the row
-        int* currentHistogram = (y < halfHeight) ? topHistogram : bottomHistogram;
-
-        // Extract pixel value and increment the appropriate histogram
-        uint16_t pixelValue = (*image)[y][x] & 0x3FFF;
-
-        // Use atomic increment to avoid race conditions
-        #pragma omp atomic
-        currentHistogram[pixelValue]++;
-    }
-
-    // Step 2: Compute the cumulative distribution function (CDF) for each half
-    int topCDF[16384] = {0};
-    int bottomCDF[16384] = {0};
-
-    topCDF[0] = topHistogram[0];
-    bottomCDF[0] = bottomHistogram[0];
-
-    for (int i = 1; i < 16384; ++i) {
-        topCDF[i] = topCDF[i - 1] + topHistogram[i];
-        bottomCDF[i] = bottomCDF[i - 1] + bottomHistogram[i];
+// rebuild the lookup table only when the colormap changes
+void updateColormapLUT(ColormapLUT& lut, ImPlotColormap colormap) {
+    if (lut.valid && (lut.colormap == colormap)) {
+        return;
     }
 
-    // Step 3: Normalize the CDF for each half
-    float top_cdf_min = *std::find_if(topCDF, topCDF + 16384, [](int value) { return value > 0; });
-    float bottom_cdf_min = *std::find_if(bottomCDF, bottomCDF + 16384, [](int value) { return value > 0; });
-
-    float top_cdf_range = topHalfPixels - top_cdf_min;
-    float bottom_cdf_range = bottomHalfPixels - bottom_cdf_min;
-
-    // Step 4: Scale the CDF to 0-255 and map to textureData
-    float topScale = 255.0f / top_cdf_range;
-    float bottomScale = 255.0f / bottom_cdf_range;
-
-    // - faster code-
-    #pragma omp parallel for
-    for (uint32_t idx = 0; idx < MEGS_TOTAL_PIXELS; ++idx) {
-        uint32_t y = idx / MEGS_IMAGE_WIDTH;  // Compute the row
-        uint32_t x = idx % MEGS_IMAGE_WIDTH;  // Compute the column
-
-        bool isTopHalf = (y < halfHeight);  // Determine if this pixel is in the top half
-
-        // Access pixel and apply histogram equalization scaling
-        int pixelValue = (*image)[y][x] & 0x3FFF;
-        textureData[idx] = isTopHalf
-            ? static_cast<uint8_t>(topScale * (topCDF[pixelValue] - top_cdf_min))
-            : static_cast<uint8_t>(bottomScale * (bottomCDF[pixelValue] - bottom_cdf_min));
+    for (int i = 0; i < 256; ++i) {
+        ImVec4 color = ImPlot::SampleColormap(i / 255.0f, colormap);
+        lut.rgb[i * 3 + 0] = static_cast<uint8_t>(color.x * 255.0f); // Red
+        lut.rgb[i * 3 + 1] = static_cast<uint8_t>(color.y * 255.0f); // Green
+        lut.rgb[i * 3 + 2] = static_cast<uint8_t>(color.z * 255.0f); // Blue
     }
-
+    lut.colormap = colormap;
+    lut.valid = true;
 }
 
 void scaleImageToTexture(uint16_t (*megsImage)[MEGS_IMAGE_HEIGHT][MEGS_IMAGE_WIDTH], std::vector<uint8_t>& textureData, int Image_Display_Scale) {
@@ -389,6 +342,21 @@ void scaleImageToTexture(uint16_t (*megsImage)[MEGS_IMAGE_HEIGHT][MEGS_IMAGE_WID
     }
 }
 
+// scale one image row to 8-bits, only Mod 256 and Full Scale are per-pixel
+void scaleRowToTexture(const uint16_t* imageRow, uint8_t* textureRow, int Image_Display_Scale) {
+    if (Image_Display_Scale == 1) {
+        #pragma omp simd
+        for (uint32_t x = 0; x < MEGS_IMAGE_WIDTH; ++x) {
+            textureRow[x] = static_cast<uint8_t>((imageRow[x] & 0x3FFF) >> 6);
+        }
+    } else {
+        #pragma omp simd
+        for (uint32_t x = 0; x < MEGS_IMAGE_WIDTH; ++x) {
+            textureRow[x] = static_cast<uint8_t>(imageRow[x] & 0xFF);
+        }
+    }
+}
+
 template<typename T>
 void renderInputTextWithColor(const char* label, T value, size_t bufferSize, bool limitCheck,
                               float yHiLimit, float rHiLimit, float yLoLimit = -100.0f, float rLoLimit = -200.0f,
@@ -493,8 +461,10 @@ void ShowColormapSelector(bool isMA) {
 
     if ( isMA ) {
         selectedMAColormap = selectedColormap;
+        updateColormapLUT(globalGUI.renderMA.lut, selectedMAColormap);
     } else {
         selectedMBColormap = selectedColormap;
+        updateColormapLUT(globalGUI.renderMB.lut, selectedMBColormap);
     }
 }
 
@@ -507,42 +477,33 @@ void GenerateColorizedTexture(const std::vector<unsigned char>& intensityData,
                               int width, 
                               int height, 
                               std::vector<unsigned char>& colorizedData,
-                              ImPlotColormap colormap) {
-    // Ensure the output vector is sized correctly (RGB = 3 channels)
-    colorizedData.resize(width * height * 3);
+                              const ColormapLUT& lut) {
+    const int numPixels = width * height;
+    // Ensure the output vector is sized correctly (RGB = 3 channels), no-op for the persistent buffers
+    colorizedData.resize(numPixels * 3);
 
-    // Map intensity values (0-255) to colormap
-    for (int i = 0; i < width * height; ++i) {
-        float normalizedValue = intensityData[i] / 255.0f; // Normalize to [0, 1]
-        ImVec4 color = ImPlot::SampleColormap(normalizedValue, colormap);
+    const uint8_t* intensity = intensityData.data();
+    uint8_t* rgbOut = colorizedData.data();
+    const uint8_t* table = lut.rgb;
 
-        // Convert ImVec4 to RGB (assumes no alpha channel for the texture)
-        colorizedData[i * 3 + 0] = static_cast<unsigned char>(color.x * 255.0f); // Red
-        colorizedData[i * 3 + 1] = static_cast<unsigned char>(color.y * 255.0f); // Green
-        colorizedData[i * 3 + 2] = static_cast<unsigned char>(color.z * 255.0f); // Blue
+    // Map intensity values (0-255) to colormap with a table gather
+    #pragma omp parallel for
+    for (int i = 0; i < numPixels; ++i) {
+        const uint8_t* color = table + intensity[i] * 3;
+        rgbOut[i * 3 + 0] = color[0];
+        rgbOut[i * 3 + 1] = color[1];
+        rgbOut[i * 3 + 2] = color[2];
     }
 }
 
 // initialize a texture for a MEGS image
 GLuint createProperTextureFromMEGSImage(uint16_t (*data)[MEGS_IMAGE_HEIGHT][MEGS_IMAGE_WIDTH], int Image_Display_Scale, bool isMA) {
-    std::vector<uint8_t> textureData(MEGS_TOTAL_PIXELS); // 8-bit data for display
-
-    // uint16_t tmpdata[MEGS_IMAGE_HEIGHT][MEGS_IMAGE_WIDTH];
-
-    // // remove background if box is checked
-    // if ((isMA) && (globalGUI.removeMADark)) {
-    //     std::memcpy(tmpdata, data, MEGS_IMAGE_HEIGHT * MEGS_IMAGE_WIDTH * sizeof(uint16_t));
-    //     differenceAndClip(tmpdata, globalGUI.MADark, *data);
-    //     std::cout<<"MA dark removed "<<tmpdata[0][0]<<" "<<globalGUI.MADark[0][0]<<" "<< *data[0][0] << std::endl;
-    // } else if ((!isMA) && (globalGUI.removeMBDark)) {
-    //     std::memcpy(tmpdata, data, MEGS_IMAGE_HEIGHT * MEGS_IMAGE_WIDTH * sizeof(uint16_t));
-    //     differenceAndClip(tmpdata, globalGUI.MBDark, *data);
-    //     std::cout<<"MB dark removed "<<tmpdata[0][0]<<" "<<globalGUI.MBDark[0][0]<<" "<< *data[0][0] << std::endl;
-    // }
+    MegsRenderContext& context = isMA ? globalGUI.renderMA : globalGUI.renderMB;
 
-    scaleImageToTexture(data, textureData, Image_Display_Scale);
+    scaleImageToTexture(data, context.textureData, Image_Display_Scale);
 
-    GenerateColorizedTexture(textureData, MEGS_IMAGE_WIDTH, MEGS_IMAGE_HEIGHT, textureData, isMA ? selectedMAColormap : selectedMBColormap);
+    updateColormapLUT(context.lut, isMA ? selectedMAColormap : selectedMBColormap);
+    GenerateColorizedTexture(context.textureData, MEGS_IMAGE_WIDTH, MEGS_IMAGE_HEIGHT, context.colorTextureData, context.lut);
     ImPlot::PopColormap();
 
     // Generate and bind a new texture
@@ -557,7 +518,7 @@ GLuint createProperTextureFromMEGSImage(uint16_t (*data)[MEGS_IMAGE_HEIGHT][MEGS
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
 
     // Upload the texture data to OpenGL
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_RED, MEGS_IMAGE_WIDTH, MEGS_IMAGE_HEIGHT, 0, GL_RED, GL_UNSIGNED_BYTE, textureData.data());
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, MEGS_IMAGE_WIDTH, MEGS_IMAGE_HEIGHT, 0, GL_RGB, GL_UNSIGNED_BYTE, context.colorTextureData.data());
 
     // Unbind the texture
     glBindTexture(GL_TEXTURE_2D, 0);
@@ -567,18 +528,161 @@ GLuint createProperTextureFromMEGSImage(uint16_t (*data)[MEGS_IMAGE_HEIGHT][MEGS
 
 
 
+// collect a dark from the next images, turn subtraction on or off, and say which dark is in use
+void showMegsDarkControls(uint16_t apid) {
+    MegsDarkLibrary& darkLibrary = MegsDarkLibrary::getInstance();
+    const char* channel = (apid == MEGSA_APID) ? "MA" : "MB";
+    uint16_t added = 0;
+    uint16_t wanted = 0;
+    darkLibrary.collectionProgress(apid, added, wanted);
+    ImGui::PushID(channel);
+    if (wanted == 0) {
+        if (ImGui::Button((std::string("Collect ") + channel + " Dark").c_str())) {
+            darkLibrary.startCollecting(apid, static_cast<uint16_t>(globalGUI.darkFrames), static_cast<MegsDarkMode>(globalGUI.darkMode));
+        }
+    } else {
+        if (ImGui::Button("Stop")) {
+            darkLibrary.stopCollecting(apid);
+        }
+        ImGui::SameLine();
+        ImGui::Text("%s dark %u of %u", channel, added, wanted);
+    }
+    ImGui::SameLine();
+    ImGui::SetNextItemWidth(80);
+    if (ImGui::InputInt("Frames", &globalGUI.darkFrames)) {
+        globalGUI.darkFrames = std::max(1, std::min(globalGUI.darkFrames, static_cast<int>(MEGS_DARK_MAX_FRAMES)));
+    }
+    ImGui::SameLine();
+    ImGui::SetNextItemWidth(120);
+    const char* darkModes[] = { "Mean", "Clipped median" };
+    ImGui::Combo("Dark", &globalGUI.darkMode, darkModes, IM_ARRAYSIZE(darkModes));
+    ImGui::SameLine();
+    bool remove = darkLibrary.enabled(apid);
+    if (ImGui::Checkbox((std::string("Remove ") + channel + " Dark").c_str(), &remove)) {
+        darkLibrary.setEnabled(apid, remove);
+    }
+    if (remove) {
+        ImGui::SameLine();
+        std::shared_ptr<const MegsDarkFrame> dark = darkLibrary.active(apid);
+        if (dark) {
+            ImGui::Text("%s, %u frames", MegsDarkLibrary::filename(dark->key).c_str(), dark->frames);
+        } else {
+            ImGui::TextColored(ImVec4(1.0f, 0.6f, 0.0f, 1.0f), "no dark for this integration and temperature");
+        }
+    }
+    ImGui::PopID();
+}
+
+bool needsFullTextureRefresh(const TextureRenderState& rendered, const TextureRenderState& current) {
+    // HistEqual depends on the whole image histogram, so it cannot be done by rows
+    return (!rendered.valid) || (current.scale == 2) ||
+        (rendered.scale != current.scale) || (rendered.colormap != current.colormap) ||
+        (rendered.dark != current.dark) ||
+        (rendered.flipVertical != current.flipVertical) || (rendered.flipHorizontal != current.flipHorizontal);
+}
+
+// clear the dirty row bitmap before a full refresh reads the image
+void clearDirtyRows(std::atomic<uint32_t>* dirtyRows) {
+    for (uint32_t word = 0; word < MEGS_DIRTY_ROW_WORDS; ++word) {
+        dirtyRows[word].store(0, std::memory_order_relaxed);
+    }
+}
+
+// Rescale, colorize and upload only the rows the packet processor marked dirty.
+// Dark subtraction and flips are applied per row in the same order as the full refresh.
+void renderDirtyRowsToTexture(GLuint textureID,
+                              const uint16_t (*image)[MEGS_IMAGE_HEIGHT][MEGS_IMAGE_WIDTH],
+                              uint16_t (*displayable)[MEGS_IMAGE_HEIGHT][MEGS_IMAGE_WIDTH],
+                              std::atomic<uint32_t>* dirtyRows,
+                              const TextureRenderState& settings,
+                              MegsRenderContext& context) {
+    uint32_t rows[MEGS_IMAGE_HEIGHT];
+    uint32_t numRows = 0;
+    for (uint32_t word = 0; word < MEGS_DIRTY_ROW_WORDS; ++word) {
+        uint32_t bits = dirtyRows[word].exchange(0, std::memory_order_acquire);
+        while (bits) {
+            rows[numRows++] = (word << 5) + __builtin_ctz(bits);
+            bits &= bits - 1; // clear lowest set bit
+        }
+    }
+    if (numRows == 0) {
+        return;
+    }
+
+    bool displayRowDirty[MEGS_IMAGE_HEIGHT] = {false};
+
+    #pragma omp parallel for
+    for (uint32_t i = 0; i < numRows; ++i) {
+        const uint32_t y = rows[i];
+        const uint32_t displayRow = settings.flipVertical ? (MEGS_IMAGE_HEIGHT - 1 - y) : y;
+        uint16_t* out = (*displayable)[displayRow];
+
+        if (settings.dark) {
+            subtractMegsDark((*image)[y], settings.dark->image[y], out, MEGS_IMAGE_WIDTH);
+        } else {
+            std::memcpy(out, (*image)[y], MEGS_IMAGE_WIDTH * sizeof(uint16_t));
+        }
+        if (settings.flipHorizontal) {
+            std::reverse(out, out + MEGS_IMAGE_WIDTH);
+        }
+
+        uint8_t* textureRow = context.textureData.data() + displayRow * MEGS_IMAGE_WIDTH;
+        scaleRowToTexture(out, textureRow, settings.scale);
+
+        uint8_t* rgbOut = context.colorTextureData.data() + displayRow * MEGS_IMAGE_WIDTH * 3;
+        for (uint32_t x = 0; x < MEGS_IMAGE_WIDTH; ++x) {
+            const uint8_t* color = context.lut.rgb + textureRow[x] * 3;
+            rgbOut[x * 3 + 0] = color[0];
+            rgbOut[x * 3 + 1] = color[1];
+            rgbOut[x * 3 + 2] = color[2];
+        }
+        displayRowDirty[displayRow] = true;
+    }
+
+    // upload each contiguous run of display rows
+    glBindTexture(GL_TEXTURE_2D, textureID);
+    uint32_t y = 0;
+    while (y < MEGS_IMAGE_HEIGHT) {
+        if (!displayRowDirty[y]) {
+            ++y;
+            continue;
+        }
+        uint32_t firstRow = y;
+        while ((y < MEGS_IMAGE_HEIGHT) && displayRowDirty[y]) {
+            ++y;
+        }
+        glTexSubImage2D(GL_TEXTURE_2D, 0, 0, firstRow, MEGS_IMAGE_WIDTH, y - firstRow, GL_RGB, GL_UNSIGNED_BYTE,
+            context.colorTextureData.data() + firstRow * MEGS_IMAGE_WIDTH * 3);
+    }
+}
+
 //update the texture whenever MEGS-A changes
 void renderUpdatedTextureFromMEGSAImage(GLuint textureID)
 {
-    int width=MEGS_IMAGE_WIDTH;
-    int height=MEGS_IMAGE_HEIGHT;
-    std::vector<uint8_t> textureData(width * height);
+    ScopedTrace trace("MEGS-A texture update");
+    MegsRenderContext& context = globalGUI.renderMA;
+    updateColormapLUT(context.lut, selectedMAColormap);
+    TextureRenderState current;
+    current.valid = true;
+    current.scale = globalGUI.Image_Display_Scale_MA;
+    current.colormap = selectedMAColormap;
+    current.dark = MegsDarkLibrary::getInstance().active(MEGSA_APID);
+    current.flipVertical = globalGUI.flipMAVertical;
+    current.flipHorizontal = globalGUI.flipMAHorizontal;
+
+    if (!needsFullTextureRefresh(context.rendered, current)) {
+        renderDirtyRowsToTexture(textureID, &globalState.megsa.image, &globalGUI.displayableMAImage,
+            globalState.megsADirtyRows, current, context);
+        return;
+    }
+    clearDirtyRows(globalState.megsADirtyRows);
+    context.rendered = current;
 
-    // remove background if box is checked
-    std::memcpy(globalGUI.displayableMAImage, globalState.megsa.image, MEGS_IMAGE_HEIGHT * MEGS_IMAGE_WIDTH * sizeof(uint16_t));
-    if (globalGUI.removeMADark) {
-        differenceAndClip(globalState.megsa.image, globalGUI.MADark, globalGUI.displayableMAImage); // switch order
-        //std::cout<<"MA dark removed "<<globalGUI.displayableMAImage[0][0]<<" "<<globalGUI.MADark[0][0]<<" "<< globalState.megsa.image[0][0] << std::endl;
+    // remove the library's dark for the current integration and temperature while subtraction is on
+    if (current.dark) {
+        subtractMegsDark(&globalState.megsa.image[0][0], &current.dark->image[0][0], &globalGUI.displayableMAImage[0][0], MEGS_TOTAL_PIXELS);
+    } else {
+        std::memcpy(globalGUI.displayableMAImage, globalState.megsa.image, MEGS_IMAGE_HEIGHT * MEGS_IMAGE_WIDTH * sizeof(uint16_t));
     }
 
     if (globalGUI.flipMAVertical) {
@@ -588,30 +692,44 @@ void renderUpdatedTextureFromMEGSAImage(GLuint textureID)
         flipHorizontal(globalGUI.displayableMAImage);
     }
 
-    scaleImageToTexture(&globalGUI.displayableMAImage, textureData, globalGUI.Image_Display_Scale_MA);
+    scaleImageToTexture(&globalGUI.displayableMAImage, context.textureData, globalGUI.Image_Display_Scale_MA);
     //scaleImageToTexture(&globalState.megsa.image, textureData, globalGUI.Image_Display_Scale_MA);
 
     SetRainbowCustomColormap(true);
-    std::vector<uint8_t> colorTextureData( width * height * 3); //r,g,b
-    GenerateColorizedTexture(textureData, MEGS_IMAGE_WIDTH, MEGS_IMAGE_HEIGHT, colorTextureData, selectedMAColormap); //ColormapSelectedCustom);
+    GenerateColorizedTexture(context.textureData, MEGS_IMAGE_WIDTH, MEGS_IMAGE_HEIGHT, context.colorTextureData, context.lut); //ColormapSelectedCustom);
 
     glBindTexture(GL_TEXTURE_2D, textureID);
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, MEGS_IMAGE_WIDTH, MEGS_IMAGE_HEIGHT, 0, GL_RGB, GL_UNSIGNED_BYTE, colorTextureData.data());
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, MEGS_IMAGE_WIDTH, MEGS_IMAGE_HEIGHT, 0, GL_RGB, GL_UNSIGNED_BYTE, context.colorTextureData.data());
 
     ImPlot::PopColormap();
 }
 
 void renderUpdatedTextureFromMEGSBImage(GLuint megsBTextureID)
 {
-    int width=MEGS_IMAGE_WIDTH;
-    int height=MEGS_IMAGE_HEIGHT;
-    std::vector<uint8_t> textureData(width * height);
+    ScopedTrace trace("MEGS-B texture update");
+    MegsRenderContext& context = globalGUI.renderMB;
+    updateColormapLUT(context.lut, selectedMBColormap);
+    TextureRenderState current;
+    current.valid = true;
+    current.scale = globalGUI.Image_Display_Scale_MB;
+    current.colormap = selectedMBColormap;
+    current.dark = MegsDarkLibrary::getInstance().active(MEGSB_APID);
+    current.flipVertical = globalGUI.flipMBVertical;
+    current.flipHorizontal = globalGUI.flipMBHorizontal;
+
+    if (!needsFullTextureRefresh(context.rendered, current)) {
+        renderDirtyRowsToTexture(megsBTextureID, &globalState.megsb.image, &globalGUI.displayableMBImage,
+            globalState.megsBDirtyRows, current, context);
+        return;
+    }
+    clearDirtyRows(globalState.megsBDirtyRows);
+    context.rendered = current;
 
-    // remove background if box is checked
-    std::memcpy(globalGUI.displayableMBImage, globalState.megsb.image, MEGS_IMAGE_HEIGHT * MEGS_IMAGE_WIDTH * sizeof(uint16_t));
-    if (globalGUI.removeMBDark) {
-        differenceAndClip(globalState.megsb.image, globalGUI.MBDark, globalGUI.displayableMBImage); // switch order
-        //std::cout<<"MB dark removed "<<globalGUI.displayableMBImage[0][0]<<" "<<globalGUI.MBDark[0][0]<<" "<< globalState.megsb.image[0][0] << std::endl;
+    // remove the library's dark for the current integration and temperature while subtraction is on
+    if (current.dark) {
+        subtractMegsDark(&globalState.megsb.image[0][0], &current.dark->image[0][0], &globalGUI.displayableMBImage[0][0], MEGS_TOTAL_PIXELS);
+    } else {
+        std::memcpy(globalGUI.displayableMBImage, globalState.megsb.image, MEGS_IMAGE_HEIGHT * MEGS_IMAGE_WIDTH * sizeof(uint16_t));
     }
 
     if (globalGUI.flipMBVertical) {
@@ -621,15 +739,14 @@ void renderUpdatedTextureFromMEGSBImage(GLuint megsBTextureID)
         flipHorizontal(globalGUI.displayableMBImage);
     }
 
-    scaleImageToTexture(&globalGUI.displayableMBImage, textureData, globalGUI.Image_Display_Scale_MB);
+    scaleImageToTexture(&globalGUI.displayableMBImage, context.textureData, globalGUI.Image_Display_Scale_MB);
     //scaleImageToTexture(&globalState.megsb.image, textureData, globalGUI.Image_Display_Scale_MB);
     SetRainbowCustomColormap(false);
 
-    std::vector<uint8_t> colorTextureData( width * height * 3); //r,g,b
-    GenerateColorizedTexture(textureData, MEGS_IMAGE_WIDTH, MEGS_IMAGE_HEIGHT, colorTextureData, selectedMBColormap);
+    GenerateColorizedTexture(context.textureData, MEGS_IMAGE_WIDTH, MEGS_IMAGE_HEIGHT, context.colorTextureData, context.lut);
 
     glBindTexture(GL_TEXTURE_2D, megsBTextureID); // need to bin before glTexImage2D
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, MEGS_IMAGE_WIDTH, MEGS_IMAGE_HEIGHT, 0, GL_RGB, GL_UNSIGNED_BYTE, colorTextureData.data());
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, MEGS_IMAGE_WIDTH, MEGS_IMAGE_HEIGHT, 0, GL_RGB, GL_UNSIGNED_BYTE, context.colorTextureData.data());
 
     ImPlot::PopColormap();
 }
@@ -697,14 +814,7 @@ void displayMAImageWithControls(GLuint megsATextureID)
     ImGui::SetNextItemWidth(70);
     ShowColormapSelector(true); // false for MEGS-B
 
-    if (ImGui::Button("Collect MA Dark")) {
-        mtx.lock();
-        std::memcpy(globalGUI.MADark, globalState.megsa.image, sizeof(globalGUI.MADark));
-        mtx.unlock();
-        std::cout<<"MA Dark collected and stored"<<std::endl;
-    }
-    ImGui::SameLine();
-    ImGui::Checkbox("Remove MA Dark", &globalGUI.removeMADark);
+    showMegsDarkControls(MEGSA_APID);
     ImGui::SameLine();
     ImGui::Checkbox("X-Flip MA", &globalGUI.flipMAHorizontal);
     ImGui::SameLine();
@@ -714,9 +824,9 @@ void displayMAImageWithControls(GLuint megsATextureID)
 
     ImPlot::PopColormap();
     
-    mtx.lock();
-    std::string tmpiISO8601sss = tai_to_iso8601_with_milliseconds(globalState.megsa.tai_time_seconds, globalState.megsa.tai_time_subseconds); 
-    mtx.unlock();
+    MEGS_IMAGE_METADATA metadata;
+    globalState.megsAMetadata.read(metadata);
+    std::string tmpiISO8601sss = tai_to_iso8601_with_milliseconds(metadata.tai_time_seconds, metadata.tai_time_subseconds); 
 
     ImGui::Text("%s",tmpiISO8601sss.c_str());
 
@@ -756,7 +866,6 @@ void displayMAImageWithControls(GLuint megsATextureID)
 
     uint16_t firstRow[MEGS_IMAGE_WIDTH]={0};
     uint16_t secondRow[MEGS_IMAGE_WIDTH]={0};
-    mtx.lock();
     for (uint32_t x = 0; x < MEGS_IMAGE_WIDTH; ++x) {
         hiRowValues[x] = globalState.megsa.image[yPosHi+1][x];
         lowRowValues[x] = globalState.megsa.image[yPosLo-1][x];
@@ -765,7 +874,6 @@ void displayMAImageWithControls(GLuint megsATextureID)
         if (lowRowValues[x] > maxValue) maxValue =lowRowValues[x];
         if (lowRowValues[x] < minValue) minValue = lowRowValues[x];   
     }
-    mtx.unlock();
 
     //std::cout<< "Minvalue: " << minValue << " Maxvalue: " << maxValue << std::endl;
     ImGui::End();
@@ -793,10 +901,8 @@ void displayMAImageWithControls(GLuint megsATextureID)
 
             auto maPixelValuesLimits = ImPlot::GetPlotLimits();  // Store current limits
 
-            mtx.lock();
             std::memcpy(firstRow, globalState.megsa.image[firstRowIdx], sizeof(firstRow));
             std::memcpy(secondRow, globalState.megsa.image[secondRowIdx], sizeof(secondRow));
-            mtx.unlock();
 
             label = "MA Row "+std::to_string(firstRowIdx);
             ImPlot::SetNextLineStyle(ImVec4(235.0f / 255.0f, 137.0f / 255.0f, 52.0f / 255.0f, 1.0f));
@@ -826,7 +932,6 @@ void displayMAImageWithControls(GLuint megsATextureID)
 
         uint16_t imageSmall[xyhalfWidth[0] * 2][xyhalfWidth[1] * 2];
 
-        mtx.lock();
         // create a pointer to the selected image
         auto& selectedIMage = globalState.megsa.image;
         int value = selectedIMage[xyTarget[1]][xyTarget[0]];
@@ -835,7 +940,6 @@ void displayMAImageWithControls(GLuint megsATextureID)
             xyTarget[1] - xyhalfWidth[1], 
             xyTarget[0] - xyhalfWidth[0], 
             2 * xyhalfWidth[1], 2 * xyhalfWidth[0]);
-        mtx.unlock();
         ImGui::Text("DN at Target: %d", value);
 
         // only update when megsAUpdated is set to true
@@ -888,14 +992,7 @@ void displayMBImageWithControls(GLuint megsBTextureID)
     ImGui::SetNextItemWidth(70);
     ShowColormapSelector(false); // false for MEGS-B
 
-    if (ImGui::Button("Collect MB Dark")) {
-        mtx.lock();
-        std::memcpy(globalGUI.MBDark, globalState.megsb.image, sizeof(globalGUI.MBDark));
-        mtx.unlock();
-        std::cout<<"MB Dark collected and stored"<<std::endl;
-    }
-    ImGui::SameLine();
-    ImGui::Checkbox("Remove MB Dark", &globalGUI.removeMBDark);
+    showMegsDarkControls(MEGSB_APID);
     ImGui::SameLine();
     ImGui::Checkbox("X-Flip MB", &globalGUI.flipMBHorizontal);
     ImGui::SameLine();
@@ -905,9 +1002,9 @@ void displayMBImageWithControls(GLuint megsBTextureID)
 
     ImPlot::PopColormap();
 
-    mtx.lock();
-    std::string tmpiISO8601sss = tai_to_iso8601_with_milliseconds(globalState.megsb.tai_time_seconds, globalState.megsb.tai_time_subseconds); 
-    mtx.unlock();
+    MEGS_IMAGE_METADATA metadata;
+    globalState.megsBMetadata.read(metadata);
+    std::string tmpiISO8601sss = tai_to_iso8601_with_milliseconds(metadata.tai_time_seconds, metadata.tai_time_subseconds); 
 
     ImGui::Text("%s",tmpiISO8601sss.c_str());
 
@@ -947,7 +1044,6 @@ void displayMBImageWithControls(GLuint megsBTextureID)
 
     uint16_t firstRow[MEGS_IMAGE_WIDTH]={0};
     uint16_t secondRow[MEGS_IMAGE_WIDTH]={0};
-    mtx.lock();
     for (uint32_t x = 0; x < MEGS_IMAGE_WIDTH; ++x) {
         hiRowValues[x] = globalState.megsb.image[yPosHi+1][x];
         lowRowValues[x] = globalState.megsb.image[yPosLo-1][x];
@@ -956,7 +1052,6 @@ void displayMBImageWithControls(GLuint megsBTextureID)
         if (lowRowValues[x] > maxValue) maxValue =lowRowValues[x];
         if (lowRowValues[x] < minValue) minValue = lowRowValues[x];   
     }
-    mtx.unlock();
 
     ImGui::End();
 
@@ -979,10 +1074,8 @@ void displayMBImageWithControls(GLuint megsBTextureID)
         if (ImPlot::BeginPlot("MB Raw Pixel Values", ImVec2(-1, -1))) 
         {
 
-            mtx.lock();
             std::memcpy(firstRow, globalState.megsb.image[firstRowIdx], sizeof(firstRow));
             std::memcpy(secondRow, globalState.megsb.image[secondRowIdx], sizeof(secondRow));
-            mtx.unlock();
 
             label = "MB Row "+std::to_string(firstRowIdx);
             ImPlot::SetNextLineStyle(ImVec4(235.0f / 255.0f, 137.0f / 255.0f, 52.0f / 255.0f, 1.0f));
@@ -1011,7 +1104,6 @@ void displayMBImageWithControls(GLuint megsBTextureID)
 
         uint16_t imageSmall[xyhalfWidth[0] * 2][xyhalfWidth[1] * 2];
 
-        mtx.lock();
         // create a pointer to the selected image
         auto& selectedIMage = globalState.megsb.image;
         int value = selectedIMage[xyTarget[1]][xyTarget[0]];
@@ -1020,7 +1112,6 @@ void displayMBImageWithControls(GLuint megsBTextureID)
             xyTarget[1] - xyhalfWidth[1], 
             xyTarget[0] - xyhalfWidth[0], 
             2 * xyhalfWidth[1], 2 * xyhalfWidth[0]);
-        mtx.unlock();
         ImGui::Text("DN at Target: %d", value);
 
         // only update when megsAUpdated is set to true
@@ -1141,44 +1232,48 @@ void updateRawPacketWindow()
 {
     ImGui::Begin("Raw Packets");
 
-    mtx.lock();
+    RAW_PAYLOAD_BYTES raw;
     if ( ImGui::TreeNodeEx("Raw Packet Payloads", ImGuiTreeNodeFlags_DefaultOpen) )
     //if ( ImGui::TreeNodeEx("Raw Packet Payloads") )
     {
 
         if (ImGui::TreeNode("ESP Raw Packet"))
         {
-            ImGui::TextWrapped("%s", ByteArrayToHexString(globalState.espPayloadBytes, sizeof(globalState.espPayloadBytes)).c_str());
+            globalState.espPayloadBytes.read(raw);
+            ImGui::TextWrapped("%s", ByteArrayToHexString(raw.bytes, sizeof(raw.bytes)).c_str());
             ImGui::TreePop();
         }
 
         if (ImGui::TreeNode("MEGS-P Raw Packet"))
         {
-            ImGui::TextWrapped("%s", ByteArrayToHexString(globalState.megsPPayloadBytes, sizeof(globalState.megsPPayloadBytes)).c_str());
+            globalState.megsPPayloadBytes.read(raw);
+            ImGui::TextWrapped("%s", ByteArrayToHexString(raw.bytes, sizeof(raw.bytes)).c_str());
             ImGui::TreePop();
         }
 
         if (ImGui::TreeNode("SHK Raw Packet"))
         {
-            ImGui::TextWrapped("%s", ByteArrayToHexString(globalState.shkPayloadBytes, sizeof(globalState.shkPayloadBytes)).c_str());
+            globalState.shkPayloadBytes.read(raw);
+            ImGui::TextWrapped("%s", ByteArrayToHexString(raw.bytes, sizeof(raw.bytes)).c_str());
             ImGui::TreePop();
         }
 
         if (ImGui::TreeNode("MEGS-A Raw Packet"))
         {
-            ImGui::TextWrapped("%s", ByteArrayToHexString(globalState.megsAPayloadBytes, sizeof(globalState.megsAPayloadBytes)).c_str());
+            globalState.megsAPayloadBytes.read(raw);
+            ImGui::TextWrapped("%s", ByteArrayToHexString(raw.bytes, sizeof(raw.bytes)).c_str());
             ImGui::TreePop();
         }
 
         if (ImGui::TreeNode("MEGS-B Raw Packet"))
         {
-            ImGui::TextWrapped("%s", ByteArrayToHexString(globalState.megsBPayloadBytes, sizeof(globalState.megsBPayloadBytes)).c_str());
+            globalState.megsBPayloadBytes.read(raw);
+            ImGui::TextWrapped("%s", ByteArrayToHexString(raw.bytes, sizeof(raw.bytes)).c_str());
             ImGui::TreePop();
         }
 
         ImGui::TreePop();
     }
-    mtx.unlock();
 
     ImGui::End();
 
@@ -1243,6 +1338,21 @@ void updateControlWindow()
         }
         ImGui::TreePop();
     }
+    if (ImGui::TreeNode("Timeline Trace")) {
+        TraceRecorder& tracer = TraceRecorder::getInstance();
+        bool tracing = tracer.isEnabled();
+        if (ImGui::Checkbox("Record Trace", &tracing)) {
+            if (tracing) {
+                tracer.start();
+            } else {
+                tracer.enable(false);
+            }
+        }
+        if (ImGui::Button("Dump Trace")) {
+            tracer.requestDump(); // written to ./logs/YYYY/DOY/trace_*.json, open it in ui.perfetto.dev
+        }
+        ImGui::TreePop();
+    }
 
     ImGui::End();
 }
@@ -1260,12 +1370,12 @@ void updateStatusWindow()
         ImGui::TreePop();
     }
 
-    mtx.lock();
-    double eTAI    = globalState.esp.tai_time_seconds;
-    double eTAIsub = globalState.esp.tai_time_subseconds;
-    double rTAI    = globalState.esp.rec_tai_seconds;
-    double rTAIsub = globalState.esp.rec_tai_subseconds;
-    mtx.unlock();
+    ESP_PACKET esp;
+    globalState.esp.read(esp);
+    double eTAI    = esp.tai_time_seconds;
+    double eTAIsub = esp.tai_time_subseconds;
+    double rTAI    = esp.rec_tai_seconds;
+    double rTAIsub = esp.rec_tai_subseconds;
     
     double espTAI = tai_ss(eTAI, eTAIsub);
     double espRecTAI = tai_ss(rTAI, rTAIsub);
@@ -1302,6 +1412,23 @@ void updateStatusWindow()
     }
 
 
+    // packets in the image being assembled, and how complete the last written image was
+    state = Green;
+    if ((globalState.megsAPartialImages.load(std::memory_order_relaxed) != 0) || (globalState.megsBPartialImages.load(std::memory_order_relaxed) != 0)) {
+        state = Yellow;
+    }
+    bool isTreeNodeImageCompletenessOpen = ImGui::TreeNodeEx("MEGS Image Completeness");
+    addFilledCircleToTreeNode(state);
+    if (isTreeNodeImageCompletenessOpen) {
+        renderInputTextWithColor("MEGS-A Pkts This Image", globalState.megsAImagePackets.load(std::memory_order_relaxed), 12, false, 0.0, 0.9);
+        renderInputTextWithColor("MEGS-A Last Image %", globalState.megsALastCompleteness.load(std::memory_order_relaxed), 12, globalState.megsAImageCount.load(std::memory_order_relaxed) != 0, 200.0, 200.0, 99.99f, 90.0f, "%.2f");
+        renderInputTextWithColor("MEGS-A Partial Images", globalState.megsAPartialImages.load(std::memory_order_relaxed), 12, true, 0.0, 1.e9);
+        renderInputTextWithColor("MEGS-B Pkts This Image", globalState.megsBImagePackets.load(std::memory_order_relaxed), 12, false, 0.0, 0.9);
+        renderInputTextWithColor("MEGS-B Last Image %", globalState.megsBLastCompleteness.load(std::memory_order_relaxed), 12, globalState.megsBImageCount.load(std::memory_order_relaxed) != 0, 200.0, 200.0, 99.99f, 90.0f, "%.2f");
+        renderInputTextWithColor("MEGS-B Partial Images", globalState.megsBPartialImages.load(std::memory_order_relaxed), 12, true, 0.0, 1.e9);
+        ImGui::TreePop();
+    }
+
     state = Green; // initialize to green
     if ((globalState.dataGapsMA.load() != 0) || (globalState.dataGapsMB.load() != 0) ||
         (globalState.dataGapsESP.load() != 0) || (globalState.dataGapsMP.load() != 0) ||
@@ -1332,30 +1459,35 @@ void updateStatusWindow()
         ImGui::TreePop();
     }
 
-    // determine saturated pixels
-    {
-        uint32_t saturatedPixelsTop, saturatedPixelsBottom;
-        bool testPattern;
-
-        testPattern = globalState.isMATestPattern.load();
-        mtx.lock();
-        countSaturatedPixels(globalState.megsa.image,
-            saturatedPixelsTop,
-            saturatedPixelsBottom,
-            testPattern);
-        mtx.unlock();
-        globalState.saturatedPixelsMABottom.store(saturatedPixelsBottom, std::memory_order_relaxed);
-        globalState.saturatedPixelsMATop.store(saturatedPixelsTop, std::memory_order_relaxed);
-
-        testPattern = globalState.isMBTestPattern.load();
-        mtx.lock();
-        countSaturatedPixels(globalState.megsb.image,
-            saturatedPixelsTop,
-            saturatedPixelsBottom,
-            testPattern);
-        mtx.unlock();
-        globalState.saturatedPixelsMBBottom.store(saturatedPixelsBottom, std::memory_order_relaxed);
-        globalState.saturatedPixelsMBTop.store(saturatedPixelsTop, std::memory_order_relaxed);
+    // aggregated by the PacketStats reporter once per stats interval
+    PacketStatsInterval packetStats;
+    PacketStats::getInstance().readLatest(packetStats);
+    state = Green;
+    for (int slot = 0; slot < APID_SLOT_COUNT; ++slot) {
+        if ((packetStats.interval[slot][COUNTER_DROPS] != 0) || (packetStats.interval[slot][COUNTER_LENGTH_ERRORS] != 0)) {
+            state = Red;
+        }
+    }
+    bool isTreeNodePacketStatisticsOpen = ImGui::TreeNode("Packet Statistics");
+    addFilledCircleToTreeNode(state);
+    if (isTreeNodePacketStatisticsOpen) {
+        double seconds = std::max(packetStats.intervalSeconds, 1.e-3);
+        ImGui::Text("Last %.1f s, totals since start in ()", packetStats.intervalSeconds);
+        for (int slot = 0; slot < APID_SLOT_COUNT; ++slot) {
+            const uint64_t* interval = packetStats.interval[slot];
+            const uint64_t* totals = packetStats.totals[slot];
+            const StageLatencySummary& decode = packetStats.latency[slot][STAGE_DECODE];
+            ImGui::Text("%-7s %7.1f pkt/s %6.3f MB/s drops %llu (%llu) len err %llu (%llu) dup %llu (%llu) late %llu (%llu) missing %llu (%llu) decode p99 %.1f us max %.1f us",
+                PacketStats::slotName(static_cast<ApidSlot>(slot)),
+                interval[COUNTER_PACKETS] / seconds, interval[COUNTER_BYTES] / seconds * 1.e-6,
+                (unsigned long long) interval[COUNTER_DROPS], (unsigned long long) totals[COUNTER_DROPS],
+                (unsigned long long) interval[COUNTER_LENGTH_ERRORS], (unsigned long long) totals[COUNTER_LENGTH_ERRORS],
+                (unsigned long long) interval[COUNTER_DUPLICATES], (unsigned long long) totals[COUNTER_DUPLICATES],
+                (unsigned long long) interval[COUNTER_LATE], (unsigned long long) totals[COUNTER_LATE],
+                (unsigned long long) interval[COUNTER_MISSING], (unsigned long long) totals[COUNTER_MISSING],
+                decode.p99Microsec, decode.maxMicrosec);
+        }
+        ImGui::TreePop();
     }
 
     state = Green;
@@ -1377,7 +1509,7 @@ void updateStatusWindow()
     ImGui::End(); // end of Channel Status
 }
 
- void plotESPTarget(int lastIdx) {
+ void plotESPTarget(const ESP_PACKET& esp, int lastIdx) {
     constexpr float twoPi = 2.0f * 3.1415926535f;
     constexpr int maxPoints = 40; // Maximum number of points to store
 
@@ -1389,20 +1521,20 @@ void updateStatusWindow()
     float d3 = 39.0f; // dark offsets for the quad diodes, may need to tune these for temperature
 
     // reset dark if needed automatically
-    d0 = std::min(d0, static_cast<float>(globalState.esp.ESP_q0[lastIdx]));
-    d1 = std::min(d1, static_cast<float>(globalState.esp.ESP_q1[lastIdx]));
-    d2 = std::min(d2, static_cast<float>(globalState.esp.ESP_q2[lastIdx]));
-    d3 = std::min(d3, static_cast<float>(globalState.esp.ESP_q3[lastIdx]));
+    d0 = std::min(d0, static_cast<float>(esp.ESP_q0[lastIdx]));
+    d1 = std::min(d1, static_cast<float>(esp.ESP_q1[lastIdx]));
+    d2 = std::min(d2, static_cast<float>(esp.ESP_q2[lastIdx]));
+    d3 = std::min(d3, static_cast<float>(esp.ESP_q3[lastIdx]));
 
     // Calculate the angles from the quad diodes, this is almost a direct reuse of the code from the flight L0B code
-    float qsum = globalState.esp.ESP_q0[lastIdx] + globalState.esp.ESP_q1[lastIdx] + 
-                 globalState.esp.ESP_q2[lastIdx] + globalState.esp.ESP_q3[lastIdx] - (d0 + d1 + d2 + d3);
+    float qsum = esp.ESP_q0[lastIdx] + esp.ESP_q1[lastIdx] + 
+                 esp.ESP_q2[lastIdx] + esp.ESP_q3[lastIdx] - (d0 + d1 + d2 + d3);
     qsum = std::max(qsum, 1.e-6f); // avoid divide by zero
     float inv_qsum = 1.f / qsum;
-    float dq0 = std::max(globalState.esp.ESP_q0[lastIdx] - d0, 0.0f);
-    float dq1 = std::max(globalState.esp.ESP_q1[lastIdx] - d1, 0.0f);
-    float dq2 = std::max(globalState.esp.ESP_q2[lastIdx] - d2, 0.0f);
-    float dq3 = std::max(globalState.esp.ESP_q3[lastIdx] - d3, 0.0f);
+    float dq0 = std::max(esp.ESP_q0[lastIdx] - d0, 0.0f);
+    float dq1 = std::max(esp.ESP_q1[lastIdx] - d1, 0.0f);
+    float dq2 = std::max(esp.ESP_q2[lastIdx] - d2, 0.0f);
+    float dq3 = std::max(esp.ESP_q3[lastIdx] - d3, 0.0f);
 
     float qX = ((dq1 + dq3) - (dq0 + dq2)) * inv_qsum;
  	float qY = ((dq0 + dq1) - (dq2 + dq3)) * inv_qsum;
@@ -1529,68 +1661,73 @@ void updateSHKWindow()
 {
     ImGui::Begin("SHK Data");
 
-    mtx.lock();
+    // copy out once per frame, rendering never holds anything the packet thread waits on
+    static SHK_PACKET shk;
+    static SHK_CONVERTED_PACKET shkConv;
+    globalState.shk.read(shk);
+    globalState.shkConv.read(shkConv);
+
     bool isFPGATreeNodeOpen = ImGui::TreeNodeEx("SHK FPGA Status"); //, ImGuiTreeNodeFlags_DefaultOpen);
     if (isFPGATreeNodeOpen)
     {
-        renderInputTextWithColor("Mode", globalState.shk.mode[0], 12, false, 0.0, 0.9);
-        renderInputTextWithColor("MEGSA_Analog_Mux", globalState.shk.MEGSA_Analog_Mux_Register[0], 12, false, 0.0, 0.9);
-        renderInputTextWithColor("MEGSB_Analog_Mux", globalState.shk.MEGSB_Analog_Mux_Register[0], 12, false, 0.0, 0.9);
-        renderInputTextWithColor("MEGSA_Digital_Status", globalState.shk.MEGSA_Digital_Status_Register[0], 12, false, 0.0, 0.9);
-        renderInputTextWithColor("MEGSB_Digital_Status", globalState.shk.MEGSB_Digital_Status_Register[0], 12, false, 0.0, 0.9);
-        renderInputTextWithColor("MEGSA Integration Time", globalState.shk.MEGSA_Integration_Timer_Register[0], 12, false, 0.0, 0.9);
-        renderInputTextWithColor("MEGSB Integration Time", globalState.shk.MEGSB_Integration_Timer_Register[0], 12, false, 0.0, 0.9);
-        renderInputTextWithColor("MEGSA Command Error Count", globalState.shk.MEGSA_Command_Error_Count_Register[0], 12, false, 0.0, 0.9);
-        renderInputTextWithColor("MEGSB Command Error Count", globalState.shk.MEGSB_Command_Error_Count_Register[0], 12, false, 0.0, 0.9);
-        renderInputTextWithColor("MEGSA CEB FGA Version", globalState.shk.MEGSA_CEB_FPGA_Version_Register[0], 12, false, 0.0, 0.9);
-        renderInputTextWithColor("MEGSB CEB FGA Version", globalState.shk.MEGSB_CEB_FPGA_Version_Register[0], 12, false, 0.0, 0.9);
-        renderInputTextWithColor("FPGA Board Temp", globalState.shkConv.FPGA_Board_Temperature[0], 12, false, 0.0, 0.9);
-        renderInputTextWithColor("FPGA Board +5V", globalState.shkConv.FPGA_Board_p5_0_Voltage[0], 12, false, 0.0, 0.9);
-        renderInputTextWithColor("FPGA Board +3.3V", globalState.shkConv.FPGA_Board_p3_3_Voltage[0], 12, false, 0.0, 0.9);
-        renderInputTextWithColor("FPGA Board +2.5V", globalState.shkConv.FPGA_Board_p2_5_Voltage[0], 12, false, 0.0, 0.9);
-        renderInputTextWithColor("FPGA Board +1.2V", globalState.shkConv.FPGA_Board_p1_2_Voltage[0], 12, false, 0.0, 0.9);
+        renderInputTextWithColor("Mode", shk.mode[0], 12, false, 0.0, 0.9);
+        renderInputTextWithColor("MEGSA_Analog_Mux", shk.MEGSA_Analog_Mux_Register[0], 12, false, 0.0, 0.9);
+        renderInputTextWithColor("MEGSB_Analog_Mux", shk.MEGSB_Analog_Mux_Register[0], 12, false, 0.0, 0.9);
+        renderInputTextWithColor("MEGSA_Digital_Status", shk.MEGSA_Digital_Status_Register[0], 12, false, 0.0, 0.9);
+        renderInputTextWithColor("MEGSB_Digital_Status", shk.MEGSB_Digital_Status_Register[0], 12, false, 0.0, 0.9);
+        renderInputTextWithColor("MEGSA Integration Time", shk.MEGSA_Integration_Timer_Register[0], 12, false, 0.0, 0.9);
+        renderInputTextWithColor("MEGSB Integration Time", shk.MEGSB_Integration_Timer_Register[0], 12, false, 0.0, 0.9);
+        renderInputTextWithColor("MEGSA Command Error Count", shk.MEGSA_Command_Error_Count_Register[0], 12, false, 0.0, 0.9);
+        renderInputTextWithColor("MEGSB Command Error Count", shk.MEGSB_Command_Error_Count_Register[0], 12, false, 0.0, 0.9);
+        renderInputTextWithColor("MEGSA CEB FGA Version", shk.MEGSA_CEB_FPGA_Version_Register[0], 12, false, 0.0, 0.9);
+        renderInputTextWithColor("MEGSB CEB FGA Version", shk.MEGSB_CEB_FPGA_Version_Register[0], 12, false, 0.0, 0.9);
+        renderInputTextWithColor("FPGA Board Temp", shkConv.FPGA_Board_Temperature[0], 12, false, 0.0, 0.9);
+        renderInputTextWithColor("FPGA Board +5V", shkConv.FPGA_Board_p5_0_Voltage[0], 12, false, 0.0, 0.9);
+        renderInputTextWithColor("FPGA Board +3.3V", shkConv.FPGA_Board_p3_3_Voltage[0], 12, false, 0.0, 0.9);
+        renderInputTextWithColor("FPGA Board +2.5V", shkConv.FPGA_Board_p2_5_Voltage[0], 12, false, 0.0, 0.9);
+        renderInputTextWithColor("FPGA Board +1.2V", shkConv.FPGA_Board_p1_2_Voltage[0], 12, false, 0.0, 0.9);
         ImGui::TreePop();
     }
     // MEGS-A
     if (ImGui::TreeNode("SHK MEGS-A Status"))
     {
-        renderInputTextWithColor("MEGSA CEB Temp", globalState.shkConv.MEGSA_CEB_Temperature[0], 12, false, 0.0, 0.9);
-        renderInputTextWithColor("MEGSA CPR Temp", globalState.shkConv.MEGSA_CPR_Temperature[0], 12, false, 0.0, 0.9);    
-        renderInputTextWithColor("MEGSA +24V", globalState.shkConv.MEGSA_p24_Voltage[0], 12, false, 0.0, 0.9);
-        renderInputTextWithColor("MEGSA +15V", globalState.shkConv.MEGSA_p15_Voltage[0], 12, false, 0.0, 0.9);
-        renderInputTextWithColor("MEGSA -15V", globalState.shkConv.MEGSA_m15_Voltage[0], 12, false, 0.0, 0.9);
-        renderInputTextWithColor("MEGSA +5V analog", globalState.shkConv.MEGSA_p5_0_Analog_Voltage[0], 12, false, 0.0, 0.9);
-        renderInputTextWithColor("MEGSA -5V", globalState.shkConv.MEGSA_m5_0_Voltage[0], 12, false, 0.0, 0.9);
-        renderInputTextWithColor("MEGSA +5V digital", globalState.shkConv.MEGSA_p5_0_Digital_Voltage[0], 12, false, 0.0, 0.9);
-        renderInputTextWithColor("MEGSA +2.5V", globalState.shkConv.MEGSA_p2_5_Voltage[0], 12, false, 0.0, 0.9);
-        renderInputTextWithColor("MEGSA +24V current", globalState.shkConv.MEGSA_p24_Current[0], 12, false, 0.0, 0.9);
-        renderInputTextWithColor("MEGSA +15V current", globalState.shkConv.MEGSA_p15_Current[0], 12, false, 0.0, 0.9);
-        renderInputTextWithColor("MEGSA -15V current", globalState.shkConv.MEGSA_m15_Current[0], 12, false, 0.0, 0.9);
-        renderInputTextWithColor("MEGSA +5V analog current", globalState.shkConv.MEGSA_p5_0_Analog_Current[0], 12, false, 0.0, 0.9);
-        renderInputTextWithColor("MEGSA -5V current", globalState.shkConv.MEGSA_m5_0_Current[0], 12, false, 0.0, 0.9);
-        renderInputTextWithColor("MEGSA +5V digital current", globalState.shkConv.MEGSA_p5_0_Digital_Current[0], 12, false, 0.0, 0.9);
-        renderInputTextWithColor("MEGSA +2.5V current", globalState.shkConv.MEGSA_p2_5_Current[0], 12, false, 0.0, 0.9);
+        renderInputTextWithColor("MEGSA CEB Temp", shkConv.MEGSA_CEB_Temperature[0], 12, false, 0.0, 0.9);
+        renderInputTextWithColor("MEGSA CPR Temp", shkConv.MEGSA_CPR_Temperature[0], 12, false, 0.0, 0.9);    
+        renderInputTextWithColor("MEGSA +24V", shkConv.MEGSA_p24_Voltage[0], 12, false, 0.0, 0.9);
+        renderInputTextWithColor("MEGSA +15V", shkConv.MEGSA_p15_Voltage[0], 12, false, 0.0, 0.9);
+        renderInputTextWithColor("MEGSA -15V", shkConv.MEGSA_m15_Voltage[0], 12, false, 0.0, 0.9);
+        renderInputTextWithColor("MEGSA +5V analog", shkConv.MEGSA_p5_0_Analog_Voltage[0], 12, false, 0.0, 0.9);
+        renderInputTextWithColor("MEGSA -5V", shkConv.MEGSA_m5_0_Voltage[0], 12, false, 0.0, 0.9);
+        renderInputTextWithColor("MEGSA +5V digital", shkConv.MEGSA_p5_0_Digital_Voltage[0], 12, false, 0.0, 0.9);
+        renderInputTextWithColor("MEGSA +2.5V", shkConv.MEGSA_p2_5_Voltage[0], 12, false, 0.0, 0.9);
+        renderInputTextWithColor("MEGSA +24V current", shkConv.MEGSA_p24_Current[0], 12, false, 0.0, 0.9);
+        renderInputTextWithColor("MEGSA +15V current", shkConv.MEGSA_p15_Current[0], 12, false, 0.0, 0.9);
+        renderInputTextWithColor("MEGSA -15V current", shkConv.MEGSA_m15_Current[0], 12, false, 0.0, 0.9);
+        renderInputTextWithColor("MEGSA +5V analog current", shkConv.MEGSA_p5_0_Analog_Current[0], 12, false, 0.0, 0.9);
+        renderInputTextWithColor("MEGSA -5V current", shkConv.MEGSA_m5_0_Current[0], 12, false, 0.0, 0.9);
+        renderInputTextWithColor("MEGSA +5V digital current", shkConv.MEGSA_p5_0_Digital_Current[0], 12, false, 0.0, 0.9);
+        renderInputTextWithColor("MEGSA +2.5V current", shkConv.MEGSA_p2_5_Current[0], 12, false, 0.0, 0.9);
         ImGui::TreePop();
     }
     // MEGSB
         if (ImGui::TreeNode("SHK MEGS-B Status"))
     {
-        renderInputTextWithColor("MEGSB CEB Temp", globalState.shkConv.MEGSB_CEB_Temperature[0], 12, false, 0.0, 0.9);
-        renderInputTextWithColor("MEGSB CPR Temp", globalState.shkConv.MEGSB_CPR_Temperature[0], 12, false, 0.0, 0.9);    
-        renderInputTextWithColor("MEGSB +24V", globalState.shkConv.MEGSB_p24_Voltage[0], 12, false, 0.0, 0.9);
-        renderInputTextWithColor("MEGSB +15V", globalState.shkConv.MEGSB_p15_Voltage[0], 12, false, 0.0, 0.9);
-        renderInputTextWithColor("MEGSB -15V", globalState.shkConv.MEGSB_m15_Voltage[0], 12, false, 0.0, 0.9);
-        renderInputTextWithColor("MEGSB +5V analog", globalState.shkConv.MEGSB_p5_0_Analog_Voltage[0], 12, false, 0.0, 0.9);
-        renderInputTextWithColor("MEGSB -5V", globalState.shkConv.MEGSB_m5_0_Voltage[0], 12, false, 0.0, 0.9);
-        renderInputTextWithColor("MEGSB +5V digital", globalState.shkConv.MEGSB_p5_0_Digital_Voltage[0], 12, false, 0.0, 0.9);
-        renderInputTextWithColor("MEGSB +2.5V", globalState.shkConv.MEGSB_p2_5_Voltage[0], 12, false, 0.0, 0.9);
-        renderInputTextWithColor("MEGSB +24V current", globalState.shkConv.MEGSB_p24_Current[0], 12, false, 0.0, 0.9);
-        renderInputTextWithColor("MEGSB +15V current", globalState.shkConv.MEGSB_p15_Current[0], 12, false, 0.0, 0.9);
-        renderInputTextWithColor("MEGSB -15V current", globalState.shkConv.MEGSB_m15_Current[0], 12, false, 0.0, 0.9);
-        renderInputTextWithColor("MEGSB +5V analog current", globalState.shkConv.MEGSB_p5_0_Analog_Current[0], 12, false, 0.0, 0.9);
-        renderInputTextWithColor("MEGSB -5V current", globalState.shkConv.MEGSB_m5_0_Current[0], 12, false, 0.0, 0.9);
-        renderInputTextWithColor("MEGSB +5V digital current", globalState.shkConv.MEGSB_p5_0_Digital_Current[0], 12, false, 0.0, 0.9);
-        renderInputTextWithColor("MEGSB +2.5V current", globalState.shkConv.MEGSB_p2_5_Current[0], 12, false, 0.0, 0.9);
+        renderInputTextWithColor("MEGSB CEB Temp", shkConv.MEGSB_CEB_Temperature[0], 12, false, 0.0, 0.9);
+        renderInputTextWithColor("MEGSB CPR Temp", shkConv.MEGSB_CPR_Temperature[0], 12, false, 0.0, 0.9);    
+        renderInputTextWithColor("MEGSB +24V", shkConv.MEGSB_p24_Voltage[0], 12, false, 0.0, 0.9);
+        renderInputTextWithColor("MEGSB +15V", shkConv.MEGSB_p15_Voltage[0], 12, false, 0.0, 0.9);
+        renderInputTextWithColor("MEGSB -15V", shkConv.MEGSB_m15_Voltage[0], 12, false, 0.0, 0.9);
+        renderInputTextWithColor("MEGSB +5V analog", shkConv.MEGSB_p5_0_Analog_Voltage[0], 12, false, 0.0, 0.9);
+        renderInputTextWithColor("MEGSB -5V", shkConv.MEGSB_m5_0_Voltage[0], 12, false, 0.0, 0.9);
+        renderInputTextWithColor("MEGSB +5V digital", shkConv.MEGSB_p5_0_Digital_Voltage[0], 12, false, 0.0, 0.9);
+        renderInputTextWithColor("MEGSB +2.5V", shkConv.MEGSB_p2_5_Voltage[0], 12, false, 0.0, 0.9);
+        renderInputTextWithColor("MEGSB +24V current", shkConv.MEGSB_p24_Current[0], 12, false, 0.0, 0.9);
+        renderInputTextWithColor("MEGSB +15V current", shkConv.MEGSB_p15_Current[0], 12, false, 0.0, 0.9);
+        renderInputTextWithColor("MEGSB -15V current", shkConv.MEGSB_m15_Current[0], 12, false, 0.0, 0.9);
+        renderInputTextWithColor("MEGSB +5V analog current", shkConv.MEGSB_p5_0_Analog_Current[0], 12, false, 0.0, 0.9);
+        renderInputTextWithColor("MEGSB -5V current", shkConv.MEGSB_m5_0_Current[0], 12, false, 0.0, 0.9);
+        renderInputTextWithColor("MEGSB +5V digital current", shkConv.MEGSB_p5_0_Digital_Current[0], 12, false, 0.0, 0.9);
+        renderInputTextWithColor("MEGSB +2.5V current", shkConv.MEGSB_p2_5_Current[0], 12, false, 0.0, 0.9);
         ImGui::TreePop();
     }
 
@@ -1598,54 +1735,94 @@ void updateSHKWindow()
     if (ImGui::TreeNode("SHK Component Temperatures"))
     {
         // Thermistor_Diodes are disconnected for SURF
-        //renderInputTextWithColor("MEGSA Thermistor Diode", globalState.shkConv.MEGSA_Thermistor_Diode[0], 12, false, 0.0, 0.9);
-        renderInputTextWithColor("MEGSA PRT Temp", globalState.shkConv.MEGSA_PRT[0], 12, false, 0.0, 0.9);
-        //renderInputTextWithColor("MEGSB Thermistor Diode", globalState.shkConv.MEGSB_Thermistor_Diode[0], 12, false, 0.0, 0.9);
-        renderInputTextWithColor("MEGSB PRT Temp", globalState.shkConv.MEGSB_PRT[0], 12, false, 0.0, 0.9);
-        renderInputTextWithColor("ESP Electrometer Temp", globalState.shkConv.ESP_Electrometer_Temperature[0], 12, false, 0.0, 0.9);
-        renderInputTextWithColor("ESP_Detector Temp", globalState.shkConv.ESP_Detector_Temperature[0], 12, false, 0.0, 0.9);
-        renderInputTextWithColor("MEGSP_Temperature", globalState.shkConv.MEGSP_Temperature[0], 12, false, 0.0, 0.9);
+        //renderInputTextWithColor("MEGSA Thermistor Diode", shkConv.MEGSA_Thermistor_Diode[0], 12, false, 0.0, 0.9);
+        renderInputTextWithColor("MEGSA PRT Temp", shkConv.MEGSA_PRT[0], 12, false, 0.0, 0.9);
+        //renderInputTextWithColor("MEGSB Thermistor Diode", shkConv.MEGSB_Thermistor_Diode[0], 12, false, 0.0, 0.9);
+        renderInputTextWithColor("MEGSB PRT Temp", shkConv.MEGSB_PRT[0], 12, false, 0.0, 0.9);
+        renderInputTextWithColor("ESP Electrometer Temp", shkConv.ESP_Electrometer_Temperature[0], 12, false, 0.0, 0.9);
+        renderInputTextWithColor("ESP_Detector Temp", shkConv.ESP_Detector_Temperature[0], 12, false, 0.0, 0.9);
+        renderInputTextWithColor("MEGSP_Temperature", shkConv.MEGSP_Temperature[0], 12, false, 0.0, 0.9);
         ImGui::TreePop();
     }
 
-    mtx.unlock();
+    ImGui::End();
+}
+
+// one plot per channel of the spectra extracted from the last image written
+void plotMegsSpectra(const char* plotName, const char* channel, const MEGS_SPECTRUM& spectrum, ImVec2 plotSize)
+{
+    std::string tmpiISO8601sss = tai_to_iso8601_with_milliseconds(spectrum.tai_time_seconds, spectrum.tai_time_subseconds);
+    ImGui::Text("%s image %u %s", channel, spectrum.imageCount, tmpiISO8601sss.c_str());
+    ImPlot::SetNextAxesToFit();
+    if (ImPlot::BeginPlot(plotName, plotSize)) {
+        for (uint16_t r = 0; r < spectrum.regions; ++r) {
+            std::string label = std::string(channel) + " rows " + std::to_string(spectrum.firstRow[r]) + "-" +
+                std::to_string(spectrum.lastRow[r]) + " (" + std::to_string(spectrum.rows[r]) + " used)";
+            ImPlot::PlotLine(label.c_str(), spectrum.spectrum[r], MEGS_IMAGE_WIDTH);
+        }
+        ImPlot::EndPlot();
+    }
+}
+
+void updateSpectrumWindow()
+{
+    if (globalState.args.skipSpectra.load(std::memory_order_relaxed)) {
+        return;
+    }
+    // about 50 KB each, so they are copied out only when an image has been written
+    static MEGS_SPECTRUM megsASpectrum;
+    static MEGS_SPECTRUM megsBSpectrum;
+    static uint32_t megsAVersion = 0;
+    static uint32_t megsBVersion = 0;
+    if (globalState.megsASpectrum.version() != megsAVersion) {
+        megsAVersion = globalState.megsASpectrum.read(megsASpectrum);
+    }
+    if (globalState.megsBSpectrum.version() != megsBVersion) {
+        megsBVersion = globalState.megsBSpectrum.read(megsBSpectrum);
+    }
+
+    ImGui::Begin("MEGS Spectra");
+    ImVec2 availableSize = ImGui::GetContentRegionAvail();
+    ImVec2 plotSize(availableSize.x, availableSize.y / 2 - ImGui::GetTextLineHeightWithSpacing());
+    plotMegsSpectra("##MA Spectrum", "MA", megsASpectrum, plotSize);
+    plotMegsSpectra("##MB Spectrum", "MB", megsBSpectrum, plotSize);
     ImGui::End();
 }
 
 void updateESPWindow()
 {
  
-    uint16_t espIndex = globalState.espIndex.load();
+    // the index is stored after each publish, so loading it first keeps it within the snapshot
+    uint16_t espIndex = globalState.espIndex.load(std::memory_order_acquire);
+    static ESP_PACKET esp;
+    static MEGSP_PACKET megsp;
+    globalState.esp.read(esp);
+    globalState.megsp.read(megsp);
 
     ImGui::Begin("ESP MEGS-P Diodes");
     {
-        mtx.lock();
-
-        std::string tmpiISO8601sss = tai_to_iso8601_with_milliseconds(globalState.esp.tai_time_seconds, globalState.esp.tai_time_subseconds); 
+        std::string tmpiISO8601sss = tai_to_iso8601_with_milliseconds(esp.tai_time_seconds, esp.tai_time_subseconds); 
         ImGui::Text("pkt:%s", tmpiISO8601sss.c_str());
 
-        renderInputTextWithColor("ESP xfer cnt", globalState.esp.ESP_xfer_cnt[espIndex], 12, false, 0.0, 0.9);
-        renderInputTextWithColor("ESP q0", globalState.esp.ESP_q0[espIndex], 12, false, 0.0, 0.9);
-        renderInputTextWithColor("ESP q1", globalState.esp.ESP_q1[espIndex], 12, false, 0.0, 0.9);
-        renderInputTextWithColor("ESP q2", globalState.esp.ESP_q2[espIndex], 12, false, 0.0, 0.9);
-        renderInputTextWithColor("ESP q3", globalState.esp.ESP_q3[espIndex], 12, false, 0.0, 0.9);
-        renderInputTextWithColor("ESP 171", globalState.esp.ESP_171[espIndex], 12, false, 0.0, 0.9);
-        renderInputTextWithColor("ESP 257", globalState.esp.ESP_257[espIndex], 12, false, 0.0, 0.9);
-        renderInputTextWithColor("ESP 304", globalState.esp.ESP_304[espIndex], 12, false, 0.0, 0.9);
-        renderInputTextWithColor("ESP 366", globalState.esp.ESP_366[espIndex], 12, false, 0.0, 0.9);
-        renderInputTextWithColor("ESP dark", globalState.esp.ESP_dark[espIndex], 12, false, 0.0, 0.9);
-
-        renderInputTextWithColor("MP Ly-a", globalState.megsp.MP_lya[espIndex], 12, false, 0.0, 0.9);
-        renderInputTextWithColor("MP dark", globalState.megsp.MP_dark[espIndex], 12, false, 0.0, 0.9);
-        mtx.unlock();
+        renderInputTextWithColor("ESP xfer cnt", esp.ESP_xfer_cnt[espIndex], 12, false, 0.0, 0.9);
+        renderInputTextWithColor("ESP q0", esp.ESP_q0[espIndex], 12, false, 0.0, 0.9);
+        renderInputTextWithColor("ESP q1", esp.ESP_q1[espIndex], 12, false, 0.0, 0.9);
+        renderInputTextWithColor("ESP q2", esp.ESP_q2[espIndex], 12, false, 0.0, 0.9);
+        renderInputTextWithColor("ESP q3", esp.ESP_q3[espIndex], 12, false, 0.0, 0.9);
+        renderInputTextWithColor("ESP 171", esp.ESP_171[espIndex], 12, false, 0.0, 0.9);
+        renderInputTextWithColor("ESP 257", esp.ESP_257[espIndex], 12, false, 0.0, 0.9);
+        renderInputTextWithColor("ESP 304", esp.ESP_304[espIndex], 12, false, 0.0, 0.9);
+        renderInputTextWithColor("ESP 366", esp.ESP_366[espIndex], 12, false, 0.0, 0.9);
+        renderInputTextWithColor("ESP dark", esp.ESP_dark[espIndex], 12, false, 0.0, 0.9);
+
+        renderInputTextWithColor("MP Ly-a", megsp.MP_lya[espIndex], 12, false, 0.0, 0.9);
+        renderInputTextWithColor("MP dark", megsp.MP_dark[espIndex], 12, false, 0.0, 0.9);
     }
     ImGui::End(); // end of ESP MEGS-P Diodes
 
     // Plot the ESP data
     ImGui::Begin("ESP Target");
-    mtx.lock();
-    plotESPTarget(espIndex);
-    mtx.unlock();
+    plotESPTarget(esp, espIndex);
     ImGui::End(); // end of ESP Target
 
 
@@ -1662,12 +1839,10 @@ void updateESPWindow()
         static ImPlotLegendFlags quadLegendFlags = ImPlotLegendFlags_Horizontal | ImPlotLegendFlags_Outside;
         ImPlot::SetupLegend(ImPlotLocation_North, quadLegendFlags);
 
-        mtx.lock();
-        std::vector<uint16_t> q0 = reorderCircularBuffer(globalState.esp.ESP_q0, ESP_INTEGRATIONS_PER_FILE, headIndex);
-        std::vector<uint16_t> q1 = reorderCircularBuffer(globalState.esp.ESP_q1, ESP_INTEGRATIONS_PER_FILE, headIndex);
-        std::vector<uint16_t> q2 = reorderCircularBuffer(globalState.esp.ESP_q2, ESP_INTEGRATIONS_PER_FILE, headIndex);
-        std::vector<uint16_t> q3 = reorderCircularBuffer(globalState.esp.ESP_q3, ESP_INTEGRATIONS_PER_FILE, headIndex);
-        mtx.unlock();
+        std::vector<uint16_t> q0 = reorderCircularBuffer(esp.ESP_q0, ESP_INTEGRATIONS_PER_FILE, headIndex);
+        std::vector<uint16_t> q1 = reorderCircularBuffer(esp.ESP_q1, ESP_INTEGRATIONS_PER_FILE, headIndex);
+        std::vector<uint16_t> q2 = reorderCircularBuffer(esp.ESP_q2, ESP_INTEGRATIONS_PER_FILE, headIndex);
+        std::vector<uint16_t> q3 = reorderCircularBuffer(esp.ESP_q3, ESP_INTEGRATIONS_PER_FILE, headIndex);
 
         ImPlot::PlotLine("ESP q0", q0.data(), ESP_INTEGRATIONS_PER_FILE);
         ImPlot::PlotLine("ESP q1", q1.data(), ESP_INTEGRATIONS_PER_FILE);
@@ -1683,15 +1858,13 @@ void updateESPWindow()
         static ImPlotLegendFlags espOtherLegendFlags = ImPlotLegendFlags_Horizontal | ImPlotLegendFlags_Outside;
         ImPlot::SetupLegend(ImPlotLocation_North, espOtherLegendFlags);
 
-        mtx.lock();
-        std::vector<uint16_t> ESP_171 = reorderCircularBuffer(globalState.esp.ESP_171, ESP_INTEGRATIONS_PER_FILE, headIndex);
-        std::vector<uint16_t> ESP_257 = reorderCircularBuffer(globalState.esp.ESP_257, ESP_INTEGRATIONS_PER_FILE, headIndex);
-        std::vector<uint16_t> ESP_304 = reorderCircularBuffer(globalState.esp.ESP_304, ESP_INTEGRATIONS_PER_FILE, headIndex);
-        std::vector<uint16_t> ESP_366 = reorderCircularBuffer(globalState.esp.ESP_366, ESP_INTEGRATIONS_PER_FILE, headIndex);
-        std::vector<uint16_t> ESP_dark = reorderCircularBuffer(globalState.esp.ESP_dark, ESP_INTEGRATIONS_PER_FILE, headIndex);
-        std::vector<uint16_t> MP_Lya = reorderCircularBuffer(globalState.megsp.MP_lya, MEGSP_INTEGRATIONS_PER_FILE, headIndex);
-        std::vector<uint16_t> MP_dark = reorderCircularBuffer(globalState.megsp.MP_dark, MEGSP_INTEGRATIONS_PER_FILE, headIndex);
-        mtx.unlock();
+        std::vector<uint16_t> ESP_171 = reorderCircularBuffer(esp.ESP_171, ESP_INTEGRATIONS_PER_FILE, headIndex);
+        std::vector<uint16_t> ESP_257 = reorderCircularBuffer(esp.ESP_257, ESP_INTEGRATIONS_PER_FILE, headIndex);
+        std::vector<uint16_t> ESP_304 = reorderCircularBuffer(esp.ESP_304, ESP_INTEGRATIONS_PER_FILE, headIndex);
+        std::vector<uint16_t> ESP_366 = reorderCircularBuffer(esp.ESP_366, ESP_INTEGRATIONS_PER_FILE, headIndex);
+        std::vector<uint16_t> ESP_dark = reorderCircularBuffer(esp.ESP_dark, ESP_INTEGRATIONS_PER_FILE, headIndex);
+        std::vector<uint16_t> MP_Lya = reorderCircularBuffer(megsp.MP_lya, MEGSP_INTEGRATIONS_PER_FILE, headIndex);
+        std::vector<uint16_t> MP_dark = reorderCircularBuffer(megsp.MP_dark, MEGSP_INTEGRATIONS_PER_FILE, headIndex);
 
         ImPlot::PlotLine("ESP 17", ESP_171.data(), ESP_INTEGRATIONS_PER_FILE);
         ImPlot::PlotLine("ESP 25", ESP_257.data(), ESP_INTEGRATIONS_PER_FILE);
@@ -1833,6 +2006,7 @@ void displayFPGAStatus() {
 
 int imgui_thread() {
 
+    TraceRecorder::getInstance().setThreadName("gui");
     glfwSetErrorCallback(glfw_error_callback);
     if (!glfwInit())
         return 1;
@@ -1943,11 +2117,8 @@ int imgui_thread() {
     SetRainbowCustomColormap(true);
     SetRainbowCustomColormap(false);
     
-    //std::lock_guard<std::mutex> lock(mtx); // lock the mutex
-    mtx.lock();
     GLuint megsATextureID = createProperTextureFromMEGSImage(&globalState.megsa.image, globalGUI.Image_Display_Scale_MA, true);
     GLuint megsBTextureID = createProperTextureFromMEGSImage(&globalState.megsb.image, globalGUI.Image_Display_Scale_MB, false);
-    mtx.unlock(); // unlock the mutex
 
     // Test image for verify orientation
     // uint16_t testimg[MEGS_IMAGE_WIDTH][MEGS_IMAGE_HEIGHT];
@@ -2022,6 +2193,10 @@ int imgui_thread() {
                 updateESPWindow();
             }
 
+            {
+                updateSpectrumWindow();
+            }
+
             {
                 updateSHKWindow();
             }
@@ -2054,16 +2229,12 @@ int imgui_thread() {
         // this is the part that draws stuff to the screen
         {
             if (globalState.megsAUpdated.load(std::memory_order_relaxed)) {
-                mtx.lock();
                 renderUpdatedTextureFromMEGSAImage(megsATextureID);
-                mtx.unlock();
                 globalState.megsAUpdated.store(false, std::memory_order_relaxed);  // Reset flag after updating texture
             }
 
             if (globalState.megsBUpdated.load(std::memory_order_relaxed)) {
-                mtx.lock();
                 renderUpdatedTextureFromMEGSBImage(megsBTextureID);
-                mtx.unlock();
                 // debugging image display
                 // renderSimpleTextureMB(mbSimpleTextureID, testimg);
                 globalState.megsBUpdated.store(false, std::memory_order_relaxed);  // Reset flag after updating texture
@@ -0,0 +1,382 @@
+// Microbenchmarks for the kernels that bound packet and display throughput, separate from rl0b_test.
+// Each kernel is warmed up, then timed for repeated runs and summarized as min/median/mean/stddev
+// with cycles per pixel, byte or call. OpenMP kernels are rerun for every -threads count.
+// Use it to show that a new SIMD or parallel variant is faster on the acquisition machine before merging it.
+//
+// make kernel_benchmark          (the GUI kernels are only in the cmake build, which defines ENABLEGUI)
+// ./kernel_benchmark [-runs N] [-warmup N] [-threads 1,2,4] [-pin] [-filter name] [-json file]
+//
+// Cycles come from the time stamp counter on x86, which ticks at the nominal clock rate,
+// elsewhere they are estimated from -ghz. CGProcRx is not covered, its de-framing loop is
+// tied to the Opal Kelly FIFO reads; the CCSDSReader kernels cover sync search and de-framing
+// of record files.
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <omp.h>
+#include <pthread.h>
+#include <sched.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+#include "commonFunctions.hpp"
+#include "MegsCodec.hpp"
+#include "TelemetryGenerator.hpp"
+#ifdef ENABLEGUI
+#include "ColormapLUT.hpp"
+void extern scaleImageToTexture(uint16_t (*megsImage)[MEGS_IMAGE_HEIGHT][MEGS_IMAGE_WIDTH], std::vector<uint8_t>& textureData, int Image_Display_Scale);
+void extern GenerateColorizedTexture(const std::vector<unsigned char>& intensityData, int width, int height,
+                                     std::vector<unsigned char>& colorizedData, const ColormapLUT& lut);
+#endif
+
+// replays a record stream held in memory, so CCSDSReader kernels measure parsing and not the disk
+class MemoryInputSource : public InputSource {
+public:
+    explicit MemoryInputSource(const std::vector<uint8_t>& data) : data(data) {}
+    bool open() override { offset = 0; opened = true; return true; }
+    void close() override { opened = false; }
+    bool isOpen() const override { return opened; }
+    bool read(uint8_t* buffer, size_t size) override {
+        if (offset + size > data.size()) {
+            return false;
+        }
+        std::memcpy(buffer, data.data() + offset, size);
+        offset += size;
+        return true;
+    }
+
+private:
+    const std::vector<uint8_t>& data;
+    size_t offset = 0;
+    bool opened = false;
+};
+
+struct Kernel {
+    std::string name;
+    std::string unit;      // pixel, byte or call
+    double unitsPerRun;
+    bool parallel;         // uses OpenMP, rerun for every thread count
+    std::function<void()> run;
+};
+
+struct KernelSummary {
+    std::string name;
+    std::string unit;
+    int threads;
+    double minMicrosec;
+    double medianMicrosec;
+    double meanMicrosec;
+    double stddevMicrosec;
+    double cyclesPerUnit;  // from the median run
+};
+
+static inline uint64_t readCycleCounter() {
+#if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#else
+    return 0;
+#endif
+}
+
+// binds OpenMP thread i to the i-th cpu this process may run on
+static void pinThreads(int threads) {
+    cpu_set_t allowed;
+    CPU_ZERO(&allowed);
+    if (sched_getaffinity(0, sizeof(allowed), &allowed) != 0) {
+        std::cerr << "Warning: sched_getaffinity failed, threads are not pinned" << std::endl;
+        return;
+    }
+    std::vector<int> cpus;
+    for (int cpu = 0; cpu < CPU_SETSIZE; ++cpu) {
+        if (CPU_ISSET(cpu, &allowed)) {
+            cpus.push_back(cpu);
+        }
+    }
+    #pragma omp parallel num_threads(threads)
+    {
+        cpu_set_t one;
+        CPU_ZERO(&one);
+        CPU_SET(cpus[omp_get_thread_num() % cpus.size()], &one);
+        pthread_setaffinity_np(pthread_self(), sizeof(one), &one);
+    }
+}
+
+static KernelSummary runKernel(const Kernel& kernel, int threads, int warmupRuns, int timedRuns, double ghz) {
+    for (int i = 0; i < warmupRuns; ++i) {
+        kernel.run();
+    }
+
+    std::vector<double> microsec(timedRuns);
+    std::vector<double> cycles(timedRuns);
+    for (int i = 0; i < timedRuns; ++i) {
+        auto start = std::chrono::steady_clock::now();
+        uint64_t startCycles = readCycleCounter();
+        kernel.run();
+        uint64_t endCycles = readCycleCounter();
+        std::chrono::duration<double, std::micro> elapsed = std::chrono::steady_clock::now() - start;
+        microsec[i] = elapsed.count();
+        cycles[i] = (endCycles > startCycles) ? double(endCycles - startCycles) : elapsed.count() * 1.e3 * ghz;
+    }
+
+    KernelSummary summary;
+    summary.name = kernel.name;
+    summary.unit = kernel.unit;
+    summary.threads = threads;
+    double sum = 0.0;
+    for (double t : microsec) {
+        sum += t;
+    }
+    summary.meanMicrosec = sum / timedRuns;
+    double squares = 0.0;
+    for (double t : microsec) {
+        squares += (t - summary.meanMicrosec) * (t - summary.meanMicrosec);
+    }
+    summary.stddevMicrosec = (timedRuns > 1) ? std::sqrt(squares / (timedRuns - 1)) : 0.0;
+
+    // the median run by time, its cycle count is used so one preempted run does not skew cycles per unit
+    std::vector<int> order(timedRuns);
+    for (int i = 0; i < timedRuns; ++i) {
+        order[i] = i;
+    }
+    std::sort(order.begin(), order.end(), [&](int a, int b) { return microsec[a] < microsec[b]; });
+    summary.minMicrosec = microsec[order.front()];
+    summary.medianMicrosec = microsec[order[timedRuns / 2]];
+    summary.cyclesPerUnit = cycles[order[timedRuns / 2]] / kernel.unitsPerRun;
+    return summary;
+}
+
+static std::vector<int> parseThreadList(const std::string& list) {
+    std::vector<int> threads;
+    std::stringstream stream(list);
+    std::string item;
+    while (std::getline(stream, item, ',')) {
+        int n = std::atoi(item.c_str());
+        if (n > 0) {
+            threads.push_back(n);
+        }
+    }
+    return threads;
+}
+
+static void print_help() {
+    std::cerr << "Usage: kernel_benchmark [options]" << std::endl;
+    std::cerr << "Options: " << std::endl;
+    std::cerr << " -runs N timed runs per kernel (default 20)" << std::endl;
+    std::cerr << " -warmup N untimed runs before timing (default 3)" << std::endl;
+    std::cerr << " -threads list comma separated OpenMP thread counts (default OpenMP max)" << std::endl;
+    std::cerr << " -pin binds each OpenMP thread to its own cpu" << std::endl;
+    std::cerr << " -filter name runs only kernels whose name contains name" << std::endl;
+    std::cerr << " -ghz F clock rate used for cycles where there is no time stamp counter (default 1.0)" << std::endl;
+    std::cerr << " -json file writes the summaries to file" << std::endl;
+}
+
+int main(int argc, char* argv[]) {
+    int timedRuns = 20;
+    int warmupRuns = 3;
+    std::vector<int> threadCounts = {omp_get_max_threads()};
+    bool pin = false;
+    std::string filter;
+    std::string jsonName;
+    double ghz = 1.0;
+
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        bool hasValue = (i + 1 < argc);
+        if (arg == "-help" || arg == "--help") {
+            print_help();
+            return 0;
+        } else if (arg == "-runs" && hasValue) {
+            timedRuns = std::max(1, std::atoi(argv[++i]));
+        } else if (arg == "-warmup" && hasValue) {
+            warmupRuns = std::max(0, std::atoi(argv[++i]));
+        } else if (arg == "-threads" && hasValue) {
+            threadCounts = parseThreadList(argv[++i]);
+        } else if (arg == "-pin") {
+            pin = true;
+        } else if (arg == "-filter" && hasValue) {
+            filter = argv[++i];
+        } else if (arg == "-ghz" && hasValue) {
+            ghz = std::atof(argv[++i]);
+        } else if (arg == "-json" && hasValue) {
+            jsonName = argv[++i];
+        } else {
+            std::cerr << "Unknown option: " << arg << std::endl;
+            print_help();
+            return 1;
+        }
+    }
+    if (threadCounts.empty()) {
+        std::cerr << "ERROR: -threads needs at least one positive count" << std::endl;
+        return 1;
+    }
+
+    // one MEGS-A image cadence of synthetic telemetry
+    TelemetryGeneratorConfig config;
+    config.megsB = false;
+    TelemetryGenerator generator(config);
+    TelemetryGeneratorStats stats;
+    std::vector<uint8_t> stream;
+    for (uint64_t second = 0; second < config.imageSeconds; ++second) {
+        generator.generateSecond(second, stream, stats);
+    }
+
+    // the same stream with junk in front of every sync marker, so findSyncMarker has to search
+    std::vector<uint8_t> noisyStream;
+    for (size_t offset = 0; offset + TELEMETRY_RECORD_BYTES <= stream.size(); offset += TELEMETRY_RECORD_BYTES) {
+        noisyStream.insert(noisyStream.end(), 256, 0x55);
+        noisyStream.insert(noisyStream.end(), stream.begin() + offset, stream.begin() + offset + TELEMETRY_RECORD_BYTES);
+    }
+
+    // assemble_image expects the 20 VCDU header bytes in front of the secondary header
+    constexpr size_t vcduBytes = 20 + STANDARD_MEGSAB_PACKET_LENGTH + 1;
+    std::vector<uint8_t> vcdus;
+    std::vector<uint16_t> sourceSequenceCounters;
+    std::vector<SHK_PACKET> shkPackets;
+    {
+        MemoryInputSource source(stream);
+        CCSDSReader reader(&source);
+        reader.open();
+        std::vector<uint8_t> packet;
+        while (reader.readNextPacket(packet)) {
+            std::vector<uint8_t> header(packet.begin(), packet.begin() + PACKET_HEADER_SIZE);
+            if (reader.getAPID(header) == MEGSA_APID) {
+                size_t start = vcdus.size();
+                vcdus.resize(start + vcduBytes, 0);
+                std::copy(packet.begin() + PACKET_HEADER_SIZE, packet.end(), vcdus.begin() + start + 20);
+                sourceSequenceCounters.push_back(reader.getSourceSequenceCounter(header));
+            }
+        }
+    }
+
+    static MEGS_IMAGE_REC megsImage;
+    static SHK_PACKET shkPacket;
+    for (int i = 0; i < SHK_INTEGRATIONS_PER_FILE; ++i) {
+        shkPacket.FPGA_Board_Temperature[i] = 30000 + i;
+        shkPacket.MEGSA_CEB_Temperature[i] = 31000 + i;
+    }
+    std::vector<uint16_t> transposed;
+    std::vector<uint8_t> textureData(MEGS_TOTAL_PIXELS);
+    uint32_t saturatedTop = 0, saturatedBottom = 0;
+    SHK_CONVERTED_PACKET shkConverted;
+    std::string iso8601;
+
+    auto assembleAll = [&]() {
+        int32_t xpos, ypos;
+        int8_t status;
+        for (size_t i = 0; i < sourceSequenceCounters.size(); ++i) {
+            assemble_image(vcdus.data() + i * vcduBytes, &megsImage, sourceSequenceCounters[i], false, xpos, ypos, &status);
+        }
+    };
+    assembleAll(); // the image kernels below work on this image
+    std::vector<uint8_t> codedImage;
+    MegsCodec::encode(megsImage.image, codedImage);
+    static MEGS_IMAGE_REC decodedImage;
+    std::string codecError;
+
+    auto readStream = [](const std::vector<uint8_t>& data) {
+        MemoryInputSource source(data);
+        CCSDSReader reader(&source);
+        reader.open();
+        std::vector<uint8_t> packet;
+        while (reader.readNextPacket(packet)) {
+        }
+    };
+
+    const uint32_t taiCalls = 100000;
+    std::vector<Kernel> kernels = {
+        {"assemble_image", "pixel", double(MEGS_TOTAL_PIXELS), false, assembleAll},
+        {"countSaturatedPixels", "pixel", double(MEGS_TOTAL_PIXELS), true,
+            [&]() { countSaturatedPixels(megsImage.image, saturatedTop, saturatedBottom); }},
+        {"transposeImageTo1D", "pixel", double(MEGS_TOTAL_PIXELS), false,
+            [&]() { transposed = transposeImageTo1D(megsImage.image); }},
+        {"transposeImage", "pixel", double(MEGS_TOTAL_PIXELS), false,
+            [&]() { transposeImage(megsImage.image, transposed); }},
+        {"histogramEqualization", "pixel", double(MEGS_TOTAL_PIXELS), true,
+            [&]() { histogramEqualization(&megsImage.image, textureData); }},
+        {"MegsCodec::encode", "pixel", double(MEGS_TOTAL_PIXELS), true,
+            [&]() { MegsCodec::encode(megsImage.image, codedImage); }},
+        {"MegsCodec::decode", "pixel", double(MEGS_TOTAL_PIXELS), true,
+            [&]() { MegsCodec::decode(codedImage.data(), codedImage.size(), decodedImage.image, codecError); }},
+        {"convertSHKData", "byte", double(sizeof(SHK_PACKET)), false,
+            [&]() { shkConverted = convertSHKData(shkPacket); }},
+        {"tai_to_ydhms", "call", double(taiCalls), false,
+            [&]() {
+                uint16_t year, doy, hh, mm, ss;
+                uint32_t sod;
+                for (uint32_t i = 0; i < taiCalls; ++i) {
+                    tai_to_ydhms(config.startTai + i * 7, &year, &doy, &sod, &hh, &mm, &ss, iso8601);
+                }
+            }},
+        {"CCSDSReader::readNextPacket", "byte", double(stream.size()), false, [&]() { readStream(stream); }},
+        {"CCSDSReader::findSyncMarker", "byte", double(noisyStream.size()), false, [&]() { readStream(noisyStream); }},
+    };
+#ifdef ENABLEGUI
+    ColormapLUT lut;
+    for (int i = 0; i < 256; ++i) {
+        lut.rgb[i * 3 + 0] = uint8_t(i);
+        lut.rgb[i * 3 + 1] = uint8_t(255 - i);
+        lut.rgb[i * 3 + 2] = uint8_t(i / 2);
+    }
+    std::vector<uint8_t> colorTextureData(MEGS_TOTAL_PIXELS * 3);
+    kernels.push_back({"scaleImageToTexture", "pixel", double(MEGS_TOTAL_PIXELS), true,
+        [&]() { scaleImageToTexture(&megsImage.image, textureData, 1); }});
+    kernels.push_back({"GenerateColorizedTexture", "pixel", double(MEGS_TOTAL_PIXELS), true,
+        [&]() { GenerateColorizedTexture(textureData, MEGS_IMAGE_WIDTH, MEGS_IMAGE_HEIGHT, colorTextureData, lut); }});
+#endif
+
+    std::vector<KernelSummary> summaries;
+    std::cout << std::left << std::setw(30) << "kernel" << std::right << std::setw(8) << "threads"
+              << std::setw(12) << "min_us" << std::setw(12) << "median_us" << std::setw(12) << "mean_us"
+              << std::setw(12) << "stddev_us" << std::setw(14) << "cycles/unit" << "  unit" << std::endl;
+    for (size_t t = 0; t < threadCounts.size(); ++t) {
+        int threads = threadCounts[t];
+        omp_set_num_threads(threads);
+        if (pin) {
+            pinThreads(threads);
+        }
+        for (const Kernel& kernel : kernels) {
+            // serial kernels do not change with the thread count
+            if ((t > 0 && !kernel.parallel) || (!filter.empty() && kernel.name.find(filter) == std::string::npos)) {
+                continue;
+            }
+            KernelSummary summary = runKernel(kernel, kernel.parallel ? threads : 1, warmupRuns, timedRuns, ghz);
+            summaries.push_back(summary);
+            std::cout << std::left << std::setw(30) << summary.name << std::right << std::setw(8) << summary.threads
+                      << std::fixed << std::setprecision(1)
+                      << std::setw(12) << summary.minMicrosec << std::setw(12) << summary.medianMicrosec
+                      << std::setw(12) << summary.meanMicrosec << std::setw(12) << summary.stddevMicrosec
+                      << std::setprecision(3) << std::setw(14) << summary.cyclesPerUnit << "  " << summary.unit << std::endl;
+        }
+    }
+
+    if (!jsonName.empty()) {
+        std::ofstream json(jsonName);
+        json << std::fixed << std::setprecision(3);
+        json << "{\n  \"runs\": " << timedRuns << ",\n  \"warmup\": " << warmupRuns
+             << ",\n  \"pinned\": " << (pin ? "true" : "false") << ",\n  \"kernels\": [\n";
+        for (size_t i = 0; i < summaries.size(); ++i) {
+            const KernelSummary& s = summaries[i];
+            json << "    {\"name\": \"" << s.name << "\", \"threads\": " << s.threads
+                 << ", \"min_us\": " << s.minMicrosec << ", \"median_us\": " << s.medianMicrosec
+                 << ", \"mean_us\": " << s.meanMicrosec << ", \"stddev_us\": " << s.stddevMicrosec
+                 << ", \"cycles_per_" << s.unit << "\": " << s.cyclesPerUnit << "}"
+                 << (i + 1 < summaries.size() ? "," : "") << "\n";
+        }
+        json << "  ]\n}\n";
+        if (!json.good()) {
+            std::cerr << "ERROR: Failed to write " << jsonName << std::endl;
+            return 1;
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,172 @@
+// Queries the catalog.l0bc index rl0b_main keeps next to the Level 0B FITS files, or rebuilds it from them.
+// A query maps one catalog per channel and day and binary searches it, so a month of products
+// is listed without walking the level0b directories.
+//
+// make l0b_catalog
+// ./l0b_catalog -day 2025079 [-apid megsb] [-minComplete 0.99] [-maxSaturated N] [-maxParity N] [-count]
+// ./l0b_catalog -start TAI -end TAI -apid megsa -rebuild [-threads N]
+//
+// The data root defaults to eve_data_root, the same tree rl0b_main writes.
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <ctime>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include "ArchiveCatalog.hpp"
+#include "TimeInfo.hpp"
+
+static void print_help() {
+    std::cerr << "Usage: l0b_catalog (-day YYYYDOY | -start TAI -end TAI) [options]" << std::endl;
+    std::cerr << "Options: " << std::endl;
+    std::cerr << " -apid channel megsa, megsb, megsp, esp, shk or the APID number, repeat for more (default all)" << std::endl;
+    std::cerr << " -day YYYYDOY selects that UTC day, -days N extends it to N days" << std::endl;
+    std::cerr << " -start TAI first TAI second" << std::endl;
+    std::cerr << " -end TAI TAI second to stop before (default start plus one day)" << std::endl;
+    std::cerr << " -minComplete F lists MEGS images with at least this fraction of their packets" << std::endl;
+    std::cerr << " -maxSaturated N lists MEGS images with at most N saturated pixels" << std::endl;
+    std::cerr << " -maxParity N lists MEGS images with at most N parity errors" << std::endl;
+    std::cerr << " -count prints only the number of products" << std::endl;
+    std::cerr << " -rebuild rewrites the catalogs of the range from the FITS files" << std::endl;
+    std::cerr << " -threads N rebuild threads (default OpenMP max)" << std::endl;
+    std::cerr << " -root dir data root holding level0b/ (default eve_data_root)" << std::endl;
+}
+
+static bool parseApid(const std::string& text, uint16_t& apid) {
+    if (text == "megsa") {
+        apid = MEGSA_APID;
+    } else if (text == "megsb") {
+        apid = MEGSB_APID;
+    } else if (text == "megsp") {
+        apid = MEGSP_APID;
+    } else if (text == "esp") {
+        apid = ESP_APID;
+    } else if (text == "shk") {
+        apid = SHK_APID;
+    } else {
+        apid = static_cast<uint16_t>(std::atoi(text.c_str()));
+    }
+    return (apid == MEGSA_APID) || (apid == MEGSB_APID) || (apid == MEGSP_APID) || (apid == ESP_APID) || (apid == SHK_APID);
+}
+
+// TAI second at 00:00:00 UTC of YYYYDOY
+static bool dayToTai(const std::string& text, uint32_t& taiSeconds) {
+    if (text.size() != 7) {
+        return false;
+    }
+    std::tm tm = {};
+    tm.tm_year = std::atoi(text.substr(0, 4).c_str()) - 1900;
+    tm.tm_mday = std::atoi(text.substr(4, 3).c_str());
+    if ((tm.tm_mday < 1) || (tm.tm_mday > 366)) {
+        return false;
+    }
+    taiSeconds = static_cast<uint32_t>(static_cast<int64_t>(timegm(&tm)) + static_cast<int64_t>(TAI_EPOCH_OFFSET_TO_UNIX) +
+                                       static_cast<int64_t>(TAI_LEAP_SECONDS));
+    return true;
+}
+
+int main(int argc, char* argv[]) {
+    ArchiveCatalogQuery query;
+    bool haveStart = false;
+    uint32_t days = 1;
+    bool countOnly = false;
+    bool rebuild = false;
+    int threads = 0;
+    std::string dataRoot;
+
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        bool hasValue = (i + 1 < argc);
+        if (arg == "-help" || arg == "--help") {
+            print_help();
+            return 0;
+        } else if (arg == "-apid" && hasValue) {
+            uint16_t apid = 0;
+            if (!parseApid(argv[++i], apid)) {
+                std::cerr << "Unknown channel: " << argv[i] << std::endl;
+                return 1;
+            }
+            query.apids.push_back(apid);
+        } else if (arg == "-day" && hasValue) {
+            haveStart = dayToTai(argv[++i], query.startTai);
+        } else if (arg == "-days" && hasValue) {
+            days = static_cast<uint32_t>(std::max(1, std::atoi(argv[++i])));
+        } else if (arg == "-start" && hasValue) {
+            query.startTai = static_cast<uint32_t>(std::strtoul(argv[++i], nullptr, 10));
+            haveStart = true;
+        } else if (arg == "-end" && hasValue) {
+            query.endTai = static_cast<uint32_t>(std::strtoul(argv[++i], nullptr, 10));
+        } else if (arg == "-minComplete" && hasValue) {
+            query.minCompleteness = std::atof(argv[++i]);
+        } else if (arg == "-maxSaturated" && hasValue) {
+            query.maxSaturatedPixels = static_cast<uint32_t>(std::strtoul(argv[++i], nullptr, 10));
+        } else if (arg == "-maxParity" && hasValue) {
+            query.maxParityErrors = static_cast<uint32_t>(std::strtoul(argv[++i], nullptr, 10));
+        } else if (arg == "-count") {
+            countOnly = true;
+        } else if (arg == "-rebuild") {
+            rebuild = true;
+        } else if (arg == "-threads" && hasValue) {
+            threads = std::atoi(argv[++i]);
+        } else if (arg == "-root" && hasValue) {
+            dataRoot = argv[++i];
+        } else {
+            std::cerr << "Unknown option: " << arg << std::endl;
+            print_help();
+            return 1;
+        }
+    }
+    if (!haveStart) {
+        print_help();
+        return 1;
+    }
+    if (query.endTai <= query.startTai) {
+        query.endTai = query.startTai + days * 86400;
+    }
+    if (dataRoot.empty()) {
+        const char* envDataRoot = std::getenv("eve_data_root");
+        if (envDataRoot == nullptr) {
+            std::cerr << "ERROR: eve_data_root is undefined and there is no -root" << std::endl;
+            return 1;
+        }
+        dataRoot = envDataRoot;
+    }
+    if (dataRoot.back() != '/') {
+        dataRoot += '/';
+    }
+
+    auto begin = std::chrono::steady_clock::now();
+    if (rebuild) {
+        std::vector<uint16_t> apids = query.apids;
+        if (apids.empty()) {
+            apids = {MEGSA_APID, MEGSB_APID, MEGSP_APID, ESP_APID, SHK_APID};
+        }
+        size_t written = 0;
+        size_t failed = 0;
+        for (uint16_t apid : apids) {
+            size_t failedFiles = 0;
+            written += ArchiveCatalog::rebuild(dataRoot, apid, query.startTai, query.endTai, threads, failedFiles);
+            failed += failedFiles;
+        }
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+        std::cout << "rebuilt " << written << " records, " << failed << " files failed, in "
+                  << std::fixed << std::setprecision(2) << seconds << " s" << std::endl;
+        return (failed == 0) ? 0 : 1;
+    }
+
+    std::vector<ArchiveCatalogRecord> records = ArchiveCatalog::query(dataRoot, query);
+    double milliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - begin).count();
+    if (!countOnly) {
+        std::cout << std::fixed << std::setprecision(4);
+        for (const ArchiveCatalogRecord& record : records) {
+            std::cout << record.startTai << " " << record.endTai << " " << record.apid
+                      << " complete " << record.completeness() << " saturated " << record.saturatedPixels
+                      << " parity " << record.parityErrors << " bytes " << record.fileBytes
+                      << " " << dataRoot << record.path << std::endl;
+        }
+    }
+    std::cout << records.size() << " products in " << std::fixed << std::setprecision(3) << milliseconds << " ms" << std::endl;
+    return 0;
+}
@@ -0,0 +1,199 @@
+// Reads the Level 0B FITS files of one channel over a time range and prints a line per file,
+// then the read throughput. Files are gunzipped ahead of the parser by a pool of threads,
+// so the rate shown is what an analysis job built on Level0BReader can expect from this disk.
+//
+// make l0b_reader
+// ./l0b_reader -apid megsa -day 2025079 [-threads N] [-prefetch N] [-root dir] [-quiet]
+// ./l0b_reader -apid shk -start TAI -end TAI
+//
+// The data root defaults to eve_data_root, the same tree rl0b_main writes.
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <sstream>
+#include <string>
+#include "Level0BReader.hpp"
+#include "TimeInfo.hpp"
+
+static void print_help() {
+    std::cerr << "Usage: l0b_reader -apid channel (-day YYYYDOY | -start TAI -end TAI) [options]" << std::endl;
+    std::cerr << "Options: " << std::endl;
+    std::cerr << " -apid channel megsa, megsb, megsp, esp, shk or the APID number" << std::endl;
+    std::cerr << " -day YYYYDOY reads that UTC day" << std::endl;
+    std::cerr << " -start TAI first TAI second to read" << std::endl;
+    std::cerr << " -end TAI TAI second to stop before (default start plus one day)" << std::endl;
+    std::cerr << " -threads N decompression threads (default one per core)" << std::endl;
+    std::cerr << " -prefetch N files decompressed ahead of the parser (default " << LEVEL0B_DEFAULT_PREFETCH << ")" << std::endl;
+    std::cerr << " -root dir data root holding level0b/ (default eve_data_root)" << std::endl;
+    std::cerr << " -quiet prints only the totals" << std::endl;
+}
+
+static bool parseApid(const std::string& text, uint16_t& apid) {
+    if (text == "megsa") {
+        apid = MEGSA_APID;
+    } else if (text == "megsb") {
+        apid = MEGSB_APID;
+    } else if (text == "megsp") {
+        apid = MEGSP_APID;
+    } else if (text == "esp") {
+        apid = ESP_APID;
+    } else if (text == "shk") {
+        apid = SHK_APID;
+    } else {
+        apid = static_cast<uint16_t>(std::atoi(text.c_str()));
+    }
+    return (apid == MEGSA_APID) || (apid == MEGSB_APID) || (apid == MEGSP_APID) || (apid == ESP_APID) || (apid == SHK_APID);
+}
+
+// TAI second at 00:00:00 UTC of YYYYDOY
+static bool dayToTai(const std::string& text, uint32_t& taiSeconds) {
+    if (text.size() != 7) {
+        return false;
+    }
+    std::tm tm = {};
+    tm.tm_year = std::atoi(text.substr(0, 4).c_str()) - 1900;
+    tm.tm_mday = std::atoi(text.substr(4, 3).c_str());
+    if ((tm.tm_mday < 1) || (tm.tm_mday > 366)) {
+        return false;
+    }
+    taiSeconds = static_cast<uint32_t>(static_cast<int64_t>(timegm(&tm)) + static_cast<int64_t>(TAI_EPOCH_OFFSET_TO_UNIX) +
+                                       static_cast<int64_t>(TAI_LEAP_SECONDS));
+    return true;
+}
+
+// parses one file and prints its summary line, false if it did not parse
+static bool summarize(uint16_t apid, const Level0BFile& file, bool quiet) {
+    std::string error;
+    std::ostringstream line;
+    bool ok = false;
+    switch (apid) {
+        case MEGSA_APID:
+        case MEGSB_APID: {
+            std::unique_ptr<MEGS_IMAGE_REC> megsImage(new MEGS_IMAGE_REC);
+            ok = Level0BReader::readMegsImage(file.bytes, *megsImage, error);
+            line << "tai " << megsImage->tai_time_seconds << " packets " << megsImage->packets_received << "/" << N_PKT_PER_IMAGE
+                 << " pixel[0][0] " << megsImage->image[0][0];
+            break;
+        }
+        case MEGSP_APID: {
+            std::unique_ptr<MEGSP_PACKET> megsP(new MEGSP_PACKET);
+            ok = Level0BReader::readMegsP(file.bytes, *megsP, error);
+            line << "tai " << megsP->tai_time_seconds << " lya[0] " << megsP->MP_lya[0] << " dark[0] " << megsP->MP_dark[0];
+            break;
+        }
+        case ESP_APID: {
+            std::unique_ptr<ESP_PACKET> esp(new ESP_PACKET);
+            ok = Level0BReader::readESP(file.bytes, *esp, error);
+            line << "tai " << esp->tai_time_seconds << " q0[0] " << esp->ESP_q0[0] << " 304[0] " << esp->ESP_304[0];
+            break;
+        }
+        case SHK_APID: {
+            std::unique_ptr<SHK_PACKET> shk(new SHK_PACKET);
+            ok = Level0BReader::readSHK(file.bytes, *shk, error);
+            line << "tai " << shk->tai_time_seconds << " FPGA temperature " << shk->cFPGA_Board_Temperature[0] << " C";
+            break;
+        }
+    }
+    if (!ok) {
+        std::cerr << file.filename << ": " << error << std::endl;
+        return false;
+    }
+    if (!quiet) {
+        std::cout << file.filename << " " << file.bytes.size() << " bytes " << line.str() << std::endl;
+    }
+    return true;
+}
+
+int main(int argc, char* argv[]) {
+    uint16_t apid = 0;
+    bool haveApid = false;
+    uint32_t startTai = 0;
+    uint32_t endTai = 0;
+    bool haveStart = false;
+    unsigned threads = 0;
+    size_t prefetch = LEVEL0B_DEFAULT_PREFETCH;
+    std::string dataRoot;
+    bool quiet = false;
+
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        bool hasValue = (i + 1 < argc);
+        if (arg == "-help" || arg == "--help") {
+            print_help();
+            return 0;
+        } else if (arg == "-apid" && hasValue) {
+            haveApid = parseApid(argv[++i], apid);
+        } else if (arg == "-day" && hasValue) {
+            haveStart = dayToTai(argv[++i], startTai);
+            endTai = startTai + 86400;
+        } else if (arg == "-start" && hasValue) {
+            startTai = static_cast<uint32_t>(std::strtoul(argv[++i], nullptr, 10));
+            haveStart = true;
+        } else if (arg == "-end" && hasValue) {
+            endTai = static_cast<uint32_t>(std::strtoul(argv[++i], nullptr, 10));
+        } else if (arg == "-threads" && hasValue) {
+            threads = static_cast<unsigned>(std::max(0, std::atoi(argv[++i])));
+        } else if (arg == "-prefetch" && hasValue) {
+            prefetch = static_cast<size_t>(std::max(1, std::atoi(argv[++i])));
+        } else if (arg == "-root" && hasValue) {
+            dataRoot = argv[++i];
+        } else if (arg == "-quiet") {
+            quiet = true;
+        } else {
+            std::cerr << "Unknown option: " << arg << std::endl;
+            print_help();
+            return 1;
+        }
+    }
+    if (!haveApid || !haveStart) {
+        print_help();
+        return 1;
+    }
+    if (endTai <= startTai) {
+        endTai = startTai + 86400;
+    }
+    if (dataRoot.empty()) {
+        const char* envDataRoot = std::getenv("eve_data_root");
+        if (envDataRoot == nullptr) {
+            std::cerr << "ERROR: eve_data_root is undefined and there is no -root" << std::endl;
+            return 1;
+        }
+        dataRoot = envDataRoot;
+    }
+
+    auto begin = std::chrono::steady_clock::now();
+    Level0BStream stream(Level0BReader::findFiles(dataRoot, apid, startTai, endTai), threads, prefetch);
+    size_t filesRead = 0;
+    size_t failures = 0;
+    size_t bytesRead = 0;
+    Level0BFile file;
+    while (stream.next(file)) {
+        if (!file.error.empty()) {
+            std::cerr << file.filename << ": " << file.error << std::endl;
+            ++failures;
+            continue;
+        }
+        if (summarize(apid, file, quiet)) {
+            ++filesRead;
+            bytesRead += file.bytes.size();
+        } else {
+            ++failures;
+        }
+    }
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+
+    std::cout << std::fixed << std::setprecision(2);
+    std::cout << filesRead << " of " << stream.size() << " files read, " << failures << " failed, "
+              << bytesRead / 1.0e6 << " MB in " << seconds << " s";
+    if (seconds > 0.0) {
+        std::cout << ", " << filesRead / seconds << " files/s, " << bytesRead / 1.0e6 / seconds << " MB/s";
+    }
+    std::cout << std::endl;
+    return (failures == 0) ? 0 : 1;
+}
@@ -17,6 +17,12 @@
 #include "eve_l0b.hpp"
 #include "ProgramState.hpp"
 #include "FileCompressor.hpp"
+#include "QuicklookServer.hpp"
+#include "MetricsServer.hpp"
+#include "TraceRecorder.hpp"
+#include "PathService.hpp"
+#include "MegsDark.hpp"
+#include "MegsSpectrum.hpp"
 
 #include <csignal> // needed for SIGINT
 #include <optional>
@@ -40,6 +46,8 @@ void extern processHKPacket(std::vector<uint8_t> payload,
 
 // global variables
 std::optional<std::thread> imguiThread;
+std::unique_ptr<QuicklookServer> quicklookServer;
+std::unique_ptr<MetricsServer> metricsServer;
 
 #ifdef ENABLEGUI
 int imgui_thread();
@@ -57,6 +65,18 @@ void handleSigint(int signal) {
         imguiThread->join();
     }
 
+    // the metrics server reads the quicklook queue depth, so it stops first
+    if (metricsServer) {
+        metricsServer->stop();
+    }
+    if (quicklookServer) {
+        quicklookServer->stop();
+    }
+    SharedMemoryPublisher::getInstance().close();
+    PacketBroadcaster::getInstance().close();
+    PacketStats::getInstance().stopReporter();
+    TraceRecorder::getInstance().stop();
+
     // other threads may write to the log, so close the log last
     LogFileWriter::getInstance().logInfo("SIGINT received, flushing log and exiting.");
     // Close the log file and compress it
@@ -68,6 +88,11 @@ void handleSigint(int signal) {
     
 }
 
+// SIGUSR1 asks the trace dump thread to write the timeline, kill -USR1 <pid>
+void handleSigusr1(int signal) {
+    TraceRecorder::getInstance().requestDump();
+}
+
 int main(int argc, char* argv[]) {
 
     // initialize the programState structure contents
@@ -79,6 +104,7 @@ int main(int argc, char* argv[]) {
 
     // Register the signal handler for SIGINT
     std::signal(SIGINT, handleSigint);
+    std::signal(SIGUSR1, handleSigusr1);
 
     std::cout << "Program running. Press Ctrl-C to exit." << std::endl;
 
@@ -93,9 +119,70 @@ int main(int argc, char* argv[]) {
         handleSigint(SIGINT); // call the signal handler to clean up and exit
         exit(EXIT_FAILURE);
     }
+    // opened once, the FITS directories are made relative to it
+    if (!PathService::getInstance().initDataRoot()) {
+        std::cout << "ERROR: eve_data_root " << env_eve_data_root << " is not a usable directory - aborting" << std::endl;
+        handleSigint(SIGINT);
+        exit(EXIT_FAILURE);
+    }
 
     parseCommandLineArgs(argc, argv);
 
+    // darks collected in earlier runs, new ones are saved alongside them
+    MegsDarkLibrary& darkLibrary = MegsDarkLibrary::getInstance();
+    size_t darksLoaded = darkLibrary.load(PathService::getInstance().dataRoot() + "darks/");
+    LogFileWriter::getInstance().logInfo("loaded {} MEGS dark frames", darksLoaded);
+    darkLibrary.setEnabled(MEGSA_APID, globalState.args.darkSubtract.load());
+    darkLibrary.setEnabled(MEGSB_APID, globalState.args.darkSubtract.load());
+
+    // per-APID counters and stage latencies, summarized in the log once per interval instead of once per packet
+    PacketStats::getInstance().enable(true);
+    PacketStats::getInstance().startReporter(globalState.args.statsIntervalSeconds.load(), globalState.args.statsFilename);
+
+    // this thread reads the USB or the file and processes every packet
+    TraceRecorder::getInstance().setThreadName("packet");
+    if (globalState.args.trace.load()) {
+        TraceRecorder::getInstance().start();
+    }
+
+    // quicklook clients replace the GUI on headless acquisition machines, it also works alongside the GUI
+    if (globalState.args.quicklook.load()) {
+        QuicklookConfig quicklookConfig;
+        quicklookConfig.loopbackOnly = !globalState.args.quicklookRemote.load();
+        quicklookServer = std::unique_ptr<QuicklookServer>(new QuicklookServer(quicklookConfig));
+        // the c++14 way quicklookServer = std::make_unique<QuicklookServer>(quicklookConfig);
+        if (!quicklookServer->start()) {
+            std::cerr << "Quicklook server failed to start, continuing without it" << std::endl;
+            quicklookServer.reset();
+        }
+    }
+
+    // scraped by monitoring during a campaign, answers from atomics only
+    if (globalState.args.metrics.load()) {
+        MetricsConfig metricsConfig;
+        metricsConfig.loopbackOnly = !globalState.args.metricsRemote.load();
+        metricsConfig.quicklook = quicklookServer.get();
+        metricsServer = std::unique_ptr<MetricsServer>(new MetricsServer(metricsConfig));
+        if (!metricsServer->start()) {
+            std::cerr << "Metrics server failed to start, continuing without it" << std::endl;
+            metricsServer.reset();
+        }
+    }
+
+    // external tools map this segment to follow images and telemetry without waiting for FITS files
+    if (globalState.args.sharedMemory.load()) {
+        if (!SharedMemoryPublisher::getInstance().open(EVE_SHM_DEFAULT_NAME)) {
+            std::cerr << "Shared memory publisher failed to open, continuing without it" << std::endl;
+        }
+    }
+
+    // packet_subscriber and other local consumers read raw packets from this ring at their own pace
+    if (globalState.args.packetRing.load()) {
+        if (!PacketBroadcaster::getInstance().open(PACKET_RING_DEFAULT_NAME)) {
+            std::cerr << "Packet broadcast ring failed to open, continuing without it" << std::endl;
+        }
+    }
+
     bool skipRecord = globalState.args.skipRecord.load();
 
     std::unique_ptr<RecordFileWriter> recordWriter;
@@ -137,6 +224,7 @@ int main(int argc, char* argv[]) {
 
         //pass usbReader by reference
         usbSource.CGProcRx(usbReader); // receive, does not return until disconnect
+        finishPacketProcessing(usbReader);
         usbReader.close();
 
     }
@@ -178,11 +266,81 @@ void parseCommandLineArgs(int argc, char* argv[]) {
         } else if (arg == "--slowReplay" || arg == "-slowReplay") {
             globalState.args.slowReplay.store(true);
             LogFileWriter::getInstance().logInfo("Received : {}", arg);
+        } else if (arg == "--quicklook" || arg == "-quicklook") {
+            globalState.args.quicklook.store(true);
+            LogFileWriter::getInstance().logInfo("Received : {}", arg);
+        } else if (arg == "--quicklookRemote" || arg == "-quicklookRemote") {
+            globalState.args.quicklook.store(true);
+            globalState.args.quicklookRemote.store(true);
+            LogFileWriter::getInstance().logInfo("Received : {}", arg);
+        } else if (arg == "--metrics" || arg == "-metrics") {
+            globalState.args.metrics.store(true);
+            LogFileWriter::getInstance().logInfo("Received : {}", arg);
+        } else if (arg == "--metricsRemote" || arg == "-metricsRemote") {
+            globalState.args.metrics.store(true);
+            globalState.args.metricsRemote.store(true);
+            LogFileWriter::getInstance().logInfo("Received : {}", arg);
+        } else if (arg == "--packetRing" || arg == "-packetRing") {
+            globalState.args.packetRing.store(true);
+            LogFileWriter::getInstance().logInfo("Received : {}", arg);
+        } else if (arg == "--shm" || arg == "-shm") {
+            globalState.args.sharedMemory.store(true);
+            LogFileWriter::getInstance().logInfo("Received : {}", arg);
+        } else if ((arg == "--statsInterval" || arg == "-statsInterval") && (i + 1 < argc)) {
+            globalState.args.statsIntervalSeconds.store(std::max(1, std::atoi(argv[++i])));
+            LogFileWriter::getInstance().logInfo("Received : {} {}", arg, argv[i]);
+        } else if ((arg == "--statsFile" || arg == "-statsFile") && (i + 1 < argc)) {
+            globalState.args.statsFilename = argv[++i];
+            LogFileWriter::getInstance().logInfo("Received : {} {}", arg, argv[i]);
+        } else if ((arg == "--imageTimeout" || arg == "-imageTimeout") && (i + 1 < argc)) {
+            globalState.args.imageTimeoutSeconds.store(std::max(1, std::atoi(argv[++i])));
+            LogFileWriter::getInstance().logInfo("Received : {} {}", arg, argv[i]);
+        } else if ((arg == "--reorderWindow" || arg == "-reorderWindow") && (i + 1 < argc)) {
+            globalState.args.reorderWindowPackets.store(static_cast<uint16_t>(std::max(0, std::min(1024, std::atoi(argv[++i])))));
+            LogFileWriter::getInstance().logInfo("Received : {} {}", arg, argv[i]);
+        } else if ((arg == "--reorderTimeout" || arg == "-reorderTimeout") && (i + 1 < argc)) {
+            globalState.args.reorderTimeoutMs.store(std::max(1, std::atoi(argv[++i])));
+            LogFileWriter::getInstance().logInfo("Received : {} {}", arg, argv[i]);
+        } else if (arg == "--trace" || arg == "-trace") {
+            globalState.args.trace.store(true);
+            LogFileWriter::getInstance().logInfo("Received : {}", arg);
         } else if (arg == "--help" || arg == "-help") {
             print_help();
         } else if (arg == "--skipRecord" || arg == "-skipRecord") {
             globalState.args.skipRecord.store(true);
             LogFileWriter::getInstance().logInfo("Received : {}", arg);
+        } else if (arg == "--skipFITS" || arg == "-skipFITS") {
+            globalState.args.skipFITS.store(true);
+            LogFileWriter::getInstance().logInfo("Received : {}", arg);
+        } else if (arg == "--skipCompress" || arg == "-skipCompress") {
+            globalState.args.skipCompress.store(true);
+            LogFileWriter::getInstance().logInfo("Received : {}", arg);
+        } else if (arg == "--skipCatalog" || arg == "-skipCatalog") {
+            globalState.args.skipCatalog.store(true);
+            LogFileWriter::getInstance().logInfo("Received : {}", arg);
+        } else if (arg == "--skipColumns" || arg == "-skipColumns") {
+            globalState.args.skipColumns.store(true);
+            LogFileWriter::getInstance().logInfo("Received : {}", arg);
+        } else if (arg == "--skipSpectra" || arg == "-skipSpectra") {
+            globalState.args.skipSpectra.store(true);
+            LogFileWriter::getInstance().logInfo("Received : {}", arg);
+        } else if ((arg == "--spectrumRegionsA" || arg == "-spectrumRegionsA" ||
+                    arg == "--spectrumRegionsB" || arg == "-spectrumRegionsB") && (i + 1 < argc)) {
+            std::vector<MegsSpectrumRegion> regions;
+            std::string error;
+            if (!parseMegsSpectrumRegions(argv[i + 1], regions, error)) {
+                LogFileWriter::getInstance().logError("{} {}: {}", arg, argv[i + 1], error);
+                std::cerr << "ERROR: " << arg << " " << error << std::endl;
+                exit(EXIT_FAILURE);
+            }
+            (arg.back() == 'A' ? globalState.args.spectrumRegionsA : globalState.args.spectrumRegionsB) = argv[++i];
+            LogFileWriter::getInstance().logInfo("Received : {} {}", arg, argv[i]);
+        } else if (arg == "--darkSubtract" || arg == "-darkSubtract") {
+            globalState.args.darkSubtract.store(true);
+            LogFileWriter::getInstance().logInfo("Received : {}", arg);
+        } else if (arg == "--transposeFITS" || arg == "-transposeFITS") {
+            globalState.args.transposeFITS.store(true);
+            LogFileWriter::getInstance().logInfo("Received : {}", arg);
         } else {
             LogFileWriter::getInstance().logError("Unknown command line option: " + arg);
             std::cerr << "Unknown option: " << arg << std::endl;
@@ -201,12 +359,33 @@ void print_help() {
   std::cout << " ./rl0b_main_gui [tlmfilename] [options]" << std::endl;
   std::cout << " " << std::endl;
   std::cout << "Options: " << std::endl;
+  std::cout << " -darkSubtract subtracts the dark for each image's integration and CEB temperature from the GUI, spectra and quicklook" << std::endl;
   std::cout << " -fulLScreen sets the graphics window fill the PrimaryMonitor" << std::endl;
   std::cout << " -help runs print_help to display this message and exit" << std::endl;
+  std::cout << " -imageTimeout N seconds without packets before a MEGS image is written as partial (default 5)" << std::endl;
+  std::cout << " -metrics serves plain-text health metrics on localhost port " << METRICS_DEFAULT_PORT << " (curl localhost:" << METRICS_DEFAULT_PORT << "/metrics)" << std::endl;
+  std::cout << " -metricsRemote same as -metrics but accepts scrapes on every interface" << std::endl;
+  std::cout << " -packetRing broadcasts every raw packet to shared memory " << PACKET_RING_DEFAULT_NAME << " (see packet_subscriber)" << std::endl;
+  std::cout << " -quicklook serves live quicklook data on localhost port " << QUICKLOOK_DEFAULT_PORT << std::endl;
+  std::cout << " -quicklookRemote same as -quicklook but accepts viewers on every interface" << std::endl;
+  std::cout << " -reorderTimeout ms waits this long for a missing packet before giving up on it (default " << REORDER_DEFAULT_TIMEOUT_MS << ")" << std::endl;
+  std::cout << " -reorderWindow N holds up to N packets per APID to restore sequence counter order and drop duplicates, 0 disables (default " << REORDER_DEFAULT_WINDOW_PACKETS << ")" << std::endl;
+  std::cout << " -shm publishes images, ESP, MEGS-P and SHK to shared memory " << EVE_SHM_DEFAULT_NAME << " (see EveShmReader)" << std::endl;
+  std::cout << " -skipCatalog does not add FITS files to the daily catalog.l0bc index (see l0b_catalog)" << std::endl;
+  std::cout << " -skipColumns does not append ESP, MEGS-P and SHK to the daily columns/ files (see ColumnStore)" << std::endl;
+  std::cout << " -skipCompress leaves FITS and log files uncompressed" << std::endl;
   std::cout << " -skipESP will ignore ESP packets (apid 605)" << std::endl;
+  std::cout << " -skipFITS disable writing of level 0b FITS files" << std::endl;
   std::cout << " -skipMP will ignore MEGS-P packets (apid 604)" << std::endl;
   std::cout << " -skipRecord disable recording of telemetry to a file" << std::endl;
+  std::cout << " -skipSpectra does not extract MEGS spectra for the GUI and the MEGSA/B_SPECTRUM FITS tables" << std::endl;
   std::cout << " -slowReplay adds a sleep to slow down the processing" << std::endl;
+  std::cout << " -spectrumRegionsA first-last[,first-last] MEGS-A image rows collapsed into each spectrum, up to " << MEGS_SPECTRUM_MAX_REGIONS << " (default " << MEGS_SPECTRUM_DEFAULT_REGIONS << ")" << std::endl;
+  std::cout << " -spectrumRegionsB first-last[,first-last] the same for MEGS-B" << std::endl;
+  std::cout << " -statsFile name rewrites per-APID counters and latencies as JSON every stats interval" << std::endl;
+  std::cout << " -statsInterval N seconds between packet statistics summaries (default 10)" << std::endl;
+  std::cout << " -trace records a timeline of the pipeline stages, kill -USR1 <pid> writes it to ./logs as Chrome trace JSON" << std::endl;
+  std::cout << " -transposeFITS writes MEGS images 1024 wide by 2048 tall" << std::endl;
   std::cout << " -writeBinaryRxBuff writes the large binary file of each 64k FIFO read" << std::endl;
   std::cout << " " << std::endl;
   std::cout << "When provided, tlmfilename is a binary file of sync_marker,packet pairs. " << std::endl;
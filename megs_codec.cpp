@@ -0,0 +1,233 @@
+// Compares MegsCodec with gzip and cfitsio's RICE_1 tile compression on MEGS images from the Level 0B archive.
+// Every frame is coded and decoded by each codec and the result compared with the frame,
+// then the compression ratio and encode and decode MB/s of the image pixels are printed per codec.
+//
+// make megs_codec
+// ./megs_codec -apid megsa -day 2025079 [-frames N] [-threads N] [-root dir]
+// ./megs_codec -apid megsb -start TAI -end TAI
+//
+// The data root defaults to eve_data_root, the same tree rl0b_main writes.
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <omp.h>
+#include "FileCompressor.hpp"
+#include "Level0BReader.hpp"
+#include "MegsCodec.hpp"
+#include "TimeInfo.hpp"
+
+#include "/usr/local/include/fitsio.h"
+
+struct CodecResult {
+    std::string name;
+    size_t encodedBytes = 0;
+    double encodeSeconds = 0.0;
+    double decodeSeconds = 0.0;
+    size_t mismatches = 0;  // frames that did not decode to the original
+};
+
+static void print_help() {
+    std::cerr << "Usage: megs_codec -apid channel (-day YYYYDOY | -start TAI -end TAI) [options]" << std::endl;
+    std::cerr << "Options: " << std::endl;
+    std::cerr << " -apid channel megsa or megsb" << std::endl;
+    std::cerr << " -day YYYYDOY reads that UTC day" << std::endl;
+    std::cerr << " -start TAI first TAI second to read" << std::endl;
+    std::cerr << " -end TAI TAI second to stop before (default start plus one day)" << std::endl;
+    std::cerr << " -frames N images compared, the first N of the range (default 20)" << std::endl;
+    std::cerr << " -threads N OpenMP threads for MegsCodec (default OpenMP max)" << std::endl;
+    std::cerr << " -root dir data root holding level0b/ (default eve_data_root)" << std::endl;
+}
+
+static bool parseApid(const std::string& text, uint16_t& apid) {
+    if (text == "megsa") {
+        apid = MEGSA_APID;
+    } else if (text == "megsb") {
+        apid = MEGSB_APID;
+    } else {
+        apid = static_cast<uint16_t>(std::atoi(text.c_str()));
+    }
+    return (apid == MEGSA_APID) || (apid == MEGSB_APID);
+}
+
+// TAI second at 00:00:00 UTC of YYYYDOY
+static bool dayToTai(const std::string& text, uint32_t& taiSeconds) {
+    if (text.size() != 7) {
+        return false;
+    }
+    std::tm tm = {};
+    tm.tm_year = std::atoi(text.substr(0, 4).c_str()) - 1900;
+    tm.tm_mday = std::atoi(text.substr(4, 3).c_str());
+    if ((tm.tm_mday < 1) || (tm.tm_mday > 366)) {
+        return false;
+    }
+    taiSeconds = static_cast<uint32_t>(static_cast<int64_t>(timegm(&tm)) + static_cast<int64_t>(TAI_EPOCH_OFFSET_TO_UNIX) +
+                                       static_cast<int64_t>(TAI_LEAP_SECONDS));
+    return true;
+}
+
+static double secondsOf(const std::function<void()>& work) {
+    auto begin = std::chrono::steady_clock::now();
+    work();
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+}
+
+// the image as one RICE_1 compressed HDU in a memory FITS file, the way fpack would store it
+static bool riceEncode(const MEGS_IMAGE_REC& megsImage, std::vector<uint8_t>& encoded) {
+    int status = 0;
+    size_t size = 2880;
+    void* data = malloc(size);
+    fitsfile* fptr = nullptr;
+    long naxes[2] = {MEGS_IMAGE_WIDTH, MEGS_IMAGE_HEIGHT};
+    fits_create_memfile(&fptr, &data, &size, 1 << 20, realloc, &status);
+    fits_set_compression_type(fptr, RICE_1, &status);
+    fits_create_img(fptr, USHORT_IMG, 2, naxes, &status);
+    fits_write_img(fptr, TUSHORT, 1, MEGS_TOTAL_PIXELS, const_cast<uint16_t*>(&megsImage.image[0][0]), &status);
+    fits_close_file(fptr, &status);
+    if (status == 0) {
+        encoded.assign(static_cast<uint8_t*>(data), static_cast<uint8_t*>(data) + size);
+    }
+    free(data);
+    return status == 0;
+}
+
+static bool riceDecode(std::vector<uint8_t>& encoded, MEGS_IMAGE_REC& megsImage) {
+    int status = 0;
+    void* data = encoded.data();
+    size_t size = encoded.size();
+    fitsfile* fptr = nullptr;
+    int anynul = 0;
+    fits_open_memfile(&fptr, "rice.fits", READONLY, &data, &size, 0, nullptr, &status);
+    fits_movabs_hdu(fptr, 2, nullptr, &status);  // the compressed image follows an empty primary HDU
+    fits_read_img(fptr, TUSHORT, 1, MEGS_TOTAL_PIXELS, nullptr, &megsImage.image[0][0], &anynul, &status);
+    fits_close_file(fptr, &status);
+    return status == 0;
+}
+
+int main(int argc, char* argv[]) {
+    uint16_t apid = 0;
+    bool haveApid = false;
+    uint32_t startTai = 0;
+    uint32_t endTai = 0;
+    bool haveStart = false;
+    size_t maxFrames = 20;
+    int threads = 0;
+    std::string dataRoot;
+
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        bool hasValue = (i + 1 < argc);
+        if (arg == "-help" || arg == "--help") {
+            print_help();
+            return 0;
+        } else if (arg == "-apid" && hasValue) {
+            haveApid = parseApid(argv[++i], apid);
+        } else if (arg == "-day" && hasValue) {
+            haveStart = dayToTai(argv[++i], startTai);
+            endTai = startTai + 86400;
+        } else if (arg == "-start" && hasValue) {
+            startTai = static_cast<uint32_t>(std::strtoul(argv[++i], nullptr, 10));
+            haveStart = true;
+        } else if (arg == "-end" && hasValue) {
+            endTai = static_cast<uint32_t>(std::strtoul(argv[++i], nullptr, 10));
+        } else if (arg == "-frames" && hasValue) {
+            maxFrames = static_cast<size_t>(std::max(1, std::atoi(argv[++i])));
+        } else if (arg == "-threads" && hasValue) {
+            threads = std::atoi(argv[++i]);
+        } else if (arg == "-root" && hasValue) {
+            dataRoot = argv[++i];
+        } else {
+            std::cerr << "Unknown option: " << arg << std::endl;
+            print_help();
+            return 1;
+        }
+    }
+    if (!haveApid || !haveStart) {
+        print_help();
+        return 1;
+    }
+    if (endTai <= startTai) {
+        endTai = startTai + 86400;
+    }
+    if (dataRoot.empty()) {
+        const char* envDataRoot = std::getenv("eve_data_root");
+        if (envDataRoot == nullptr) {
+            std::cerr << "ERROR: eve_data_root is undefined and there is no -root" << std::endl;
+            return 1;
+        }
+        dataRoot = envDataRoot;
+    }
+    if (threads > 0) {
+        omp_set_num_threads(threads);
+    }
+
+    std::vector<std::unique_ptr<MEGS_IMAGE_REC>> frames;
+    for (const std::string& filename : Level0BReader::findFiles(dataRoot, apid, startTai, endTai)) {
+        if (frames.size() == maxFrames) {
+            break;
+        }
+        std::vector<uint8_t> bytes;
+        std::string error;
+        std::unique_ptr<MEGS_IMAGE_REC> megsImage(new MEGS_IMAGE_REC);
+        if (!Level0BReader::loadFile(filename, bytes, error) || !Level0BReader::readMegsImage(bytes, *megsImage, error)) {
+            std::cerr << filename << ": " << error << std::endl;
+            continue;
+        }
+        frames.push_back(std::move(megsImage));
+    }
+    if (frames.empty()) {
+        std::cerr << "ERROR: no MEGS images in the range" << std::endl;
+        return 1;
+    }
+
+    CodecResult codec{"MegsCodec"};
+    CodecResult gzip{"gzip"};
+    CodecResult rice{"cfitsio RICE_1"};
+    FileCompressor compressor;
+    std::unique_ptr<MEGS_IMAGE_REC> decoded(new MEGS_IMAGE_REC);
+    std::vector<uint8_t> encoded;
+    std::vector<uint8_t> inflated;
+    std::string error;
+    for (const std::unique_ptr<MEGS_IMAGE_REC>& frame : frames) {
+        codec.encodeSeconds += secondsOf([&]() { MegsCodec::encode(frame->image, encoded); });
+        codec.encodedBytes += encoded.size();
+        bool ok = true;
+        codec.decodeSeconds += secondsOf([&]() { ok = MegsCodec::decode(encoded.data(), encoded.size(), decoded->image, error); });
+        if (!ok || (std::memcmp(decoded->image, frame->image, sizeof(frame->image)) != 0)) {
+            ++codec.mismatches;
+        }
+
+        gzip.encodeSeconds += secondsOf([&]() { compressor.compressBuffer(frame->image, sizeof(frame->image), encoded); });
+        gzip.encodedBytes += encoded.size();
+        gzip.decodeSeconds += secondsOf([&]() { ok = Level0BReader::gunzip(encoded, inflated, error); });
+        if (!ok || (inflated.size() != sizeof(frame->image)) || (std::memcmp(inflated.data(), frame->image, inflated.size()) != 0)) {
+            ++gzip.mismatches;
+        }
+
+        rice.encodeSeconds += secondsOf([&]() { ok = riceEncode(*frame, encoded); });
+        rice.encodedBytes += encoded.size();
+        rice.decodeSeconds += secondsOf([&]() { ok = ok && riceDecode(encoded, *decoded); });
+        if (!ok || (std::memcmp(decoded->image, frame->image, sizeof(frame->image)) != 0)) {
+            ++rice.mismatches;
+        }
+    }
+
+    const double megabytes = frames.size() * sizeof(MEGS_IMAGE_REC::image) / 1.0e6;
+    std::cout << frames.size() << " frames, " << std::fixed << std::setprecision(1) << megabytes << " MB of pixels" << std::endl;
+    std::cout << std::left << std::setw(18) << "codec" << std::right << std::setw(10) << "ratio"
+              << std::setw(14) << "encode_MB/s" << std::setw(14) << "decode_MB/s" << std::setw(12) << "mismatches" << std::endl;
+    for (const CodecResult* result : {&codec, &gzip, &rice}) {
+        std::cout << std::left << std::setw(18) << result->name << std::right << std::setprecision(3)
+                  << std::setw(10) << megabytes * 1.0e6 / result->encodedBytes << std::setprecision(1)
+                  << std::setw(14) << megabytes / result->encodeSeconds << std::setw(14) << megabytes / result->decodeSeconds
+                  << std::setw(12) << result->mismatches << std::endl;
+    }
+    return ((codec.mismatches == 0) && (gzip.mismatches == 0) && (rice.mismatches == 0)) ? 0 : 1;
+}
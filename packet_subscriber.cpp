@@ -0,0 +1,119 @@
+// Subscribes to the rl0b_main -packetRing broadcast ring and writes the packets in record file format
+// (sync marker then packet), so the output replays with rl0b_main or any CCSDSReader.
+//
+// make packet_subscriber
+// ./packet_subscriber output.rtlm [-oldest] [-apid N] [-ring /segment_name]
+// ./packet_subscriber - | other_tool     (- writes to stdout)
+
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <set>
+#include <string>
+#include <vector>
+#include "PacketRingSubscriber.hpp"
+#include "eve_l0b.hpp"
+
+static volatile std::sig_atomic_t keepRunning = 1;
+
+static void handleSigint(int) {
+    keepRunning = 0;
+}
+
+static void print_help() {
+    std::cerr << "Usage: packet_subscriber output.rtlm [-oldest] [-apid N] [-ring /segment_name]" << std::endl;
+    std::cerr << " output.rtlm record file to write, - writes to stdout" << std::endl;
+    std::cerr << " -oldest starts with every packet still in the ring instead of new packets only" << std::endl;
+    std::cerr << " -apid N keeps only packets with APID N, may be repeated" << std::endl;
+    std::cerr << " -ring selects the shared-memory ring, default " << PACKET_RING_DEFAULT_NAME << std::endl;
+}
+
+int main(int argc, char* argv[]) {
+    std::string outputName;
+    std::string ringName = PACKET_RING_DEFAULT_NAME;
+    bool fromOldest = false;
+    std::set<uint16_t> apids;
+
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "-oldest" || arg == "--oldest") {
+            fromOldest = true;
+        } else if ((arg == "-apid" || arg == "--apid") && (i + 1 < argc)) {
+            apids.insert(static_cast<uint16_t>(std::atoi(argv[++i])));
+        } else if ((arg == "-ring" || arg == "--ring") && (i + 1 < argc)) {
+            ringName = argv[++i];
+        } else if (arg == "-help" || arg == "--help") {
+            print_help();
+            return 0;
+        } else if (outputName.empty()) {
+            outputName = arg;
+        } else {
+            std::cerr << "Unknown option: " << arg << std::endl;
+            print_help();
+            return 1;
+        }
+    }
+    if (outputName.empty()) {
+        print_help();
+        return 1;
+    }
+
+    std::ofstream outputFile;
+    std::ostream* output = &std::cout;
+    if (outputName != "-") {
+        outputFile.open(outputName, std::ios::binary);
+        if (!outputFile.is_open()) {
+            std::cerr << "ERROR: Failed to open output file: " << outputName << std::endl;
+            return 1;
+        }
+        output = &outputFile;
+    }
+
+    PacketRingSubscriber subscriber;
+    if (!subscriber.open(ringName, fromOldest)) {
+        std::cerr << "ERROR: " << subscriber.lastError() << std::endl;
+        return 1;
+    }
+    std::signal(SIGINT, handleSigint);
+    std::signal(SIGTERM, handleSigint);
+
+    std::vector<uint8_t> packet;
+    uint64_t packetsWritten = 0;
+    while (keepRunning) {
+        PacketRingReadStatus status = subscriber.readNext(packet);
+        if (status == PACKET_RING_OVERRUN) {
+            std::cerr << "packet_subscriber fell behind the writer, overrun " << subscriber.getOverruns() << std::endl;
+            continue;
+        }
+        if (status == PACKET_RING_EMPTY) {
+            output->flush();
+            if (!subscriber.waitForPacket(500) && !subscriber.writerAlive()) {
+                break;
+            }
+            continue;
+        }
+
+        if (!apids.empty()) {
+            // least significant 11 bits of the first 2 header bytes, same as CCSDSReader::getAPID
+            uint16_t apid = ((uint16_t (packet[0]) & 0x07) << 8) | uint16_t (packet[1]);
+            if (apids.count(apid) == 0) {
+                continue;
+            }
+        }
+        // on little endian a 32-bit write is byteswapped, use reversed sync to compensate (as RecordFileWriter)
+        output->write(reinterpret_cast<const char*>(&BSWAP_SYNC_MARKER), sizeof(BSWAP_SYNC_MARKER));
+        output->write(reinterpret_cast<const char*>(packet.data()), packet.size());
+        if (!output->good()) {
+            std::cerr << "ERROR: write to " << outputName << " failed" << std::endl;
+            break;
+        }
+        ++packetsWritten;
+    }
+    output->flush();
+
+    std::cerr << "packet_subscriber read " << subscriber.getPacketsRead() << " wrote " << packetsWritten
+              << " lost " << subscriber.getPacketsLost() << " overruns " << subscriber.getOverruns() << std::endl;
+    return 0;
+}
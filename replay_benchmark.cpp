@@ -0,0 +1,228 @@
+// End-to-end replay benchmark: CCSDSReader -> processOnePacket -> FITS files, as rl0b_main processes a file.
+// Reports packets/s, MB/s and per-stage p50/p99/max latency as JSON, and fails when throughput
+// falls more than the threshold below a baseline JSON written by an earlier run.
+//
+// make replay_benchmark
+// ./replay_benchmark input.rtlm [options]
+// ./replay_benchmark -generate 60 -json result.json                 (synthetic stream, see telemetry_generator)
+// ./replay_benchmark -generate 60 -baseline result.json -threshold 0.1
+//
+// FITS files are written under $eve_data_root as in rl0b_main. Each product is gzipped in memory
+// with zlib on the FITSPublisher thread, so the compress stage measures the whole compression,
+// off the packet thread, and the run waits for the publisher before it reports.
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include "commonFunctions.hpp"
+#include "StageTimer.hpp"
+#include "TelemetryGenerator.hpp"
+
+static void print_help() {
+    std::cerr << "Usage: replay_benchmark [input.rtlm] [options]" << std::endl;
+    std::cerr << " input.rtlm record file to replay, or use -generate" << std::endl;
+    std::cerr << "Options: " << std::endl;
+    std::cerr << " -generate N replay N seconds of synthetic telemetry instead of a file" << std::endl;
+    std::cerr << " -testPattern generate the FPGA test pattern instead of a synthetic spectrum" << std::endl;
+    std::cerr << " -skipFITS do not write FITS files (also skips compression)" << std::endl;
+    std::cerr << " -skipCompress write FITS files but do not compress them" << std::endl;
+    std::cerr << " -json file writes the result to file as well as stdout" << std::endl;
+    std::cerr << " -baseline file compares packets/s against an earlier -json result" << std::endl;
+    std::cerr << " -threshold F allowed fractional drop below the baseline (default 0.10)" << std::endl;
+}
+
+// writes seconds of synthetic telemetry to filename, true if successful
+static bool generateInput(const std::string& filename, uint64_t seconds, bool testPattern) {
+    TelemetryGeneratorConfig config;
+    config.testPattern = testPattern;
+    TelemetryGenerator generator(config);
+    TelemetryGeneratorStats stats;
+
+    std::ofstream output(filename, std::ios::binary);
+    if (!output.is_open()) {
+        std::cerr << "ERROR: Failed to open " << filename << std::endl;
+        return false;
+    }
+    std::vector<uint8_t> buffer;
+    for (uint64_t second = 0; second < seconds; ++second) {
+        buffer.clear();
+        generator.generateSecond(second, buffer, stats);
+        output.write(reinterpret_cast<const char*>(buffer.data()), buffer.size());
+    }
+    return output.good();
+}
+
+// finds "key": number in a flat JSON document, false if the key is missing
+static bool findJsonNumber(const std::string& json, const std::string& key, double& value) {
+    std::string quotedKey = "\"" + key + "\"";
+    size_t pos = json.find(quotedKey);
+    if (pos == std::string::npos) {
+        return false;
+    }
+    pos = json.find(':', pos + quotedKey.size());
+    if (pos == std::string::npos) {
+        return false;
+    }
+    const char* begin = json.c_str() + pos + 1;
+    char* end = nullptr;
+    value = std::strtod(begin, &end);
+    return end != begin;
+}
+
+int main(int argc, char* argv[]) {
+    std::string inputName;
+    std::string jsonName;
+    std::string baselineName;
+    uint64_t generateSeconds = 0;
+    bool testPattern = false;
+    double threshold = 0.10;
+
+    globalStateInit();
+
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        bool hasValue = (i + 1 < argc);
+        if (arg == "-help" || arg == "--help") {
+            print_help();
+            return 0;
+        } else if (arg == "-generate" && hasValue) {
+            generateSeconds = std::strtoull(argv[++i], nullptr, 10);
+        } else if (arg == "-testPattern") {
+            testPattern = true;
+        } else if (arg == "-skipFITS") {
+            globalState.args.skipFITS.store(true);
+        } else if (arg == "-skipCompress") {
+            globalState.args.skipCompress.store(true);
+        } else if (arg == "-json" && hasValue) {
+            jsonName = argv[++i];
+        } else if (arg == "-baseline" && hasValue) {
+            baselineName = argv[++i];
+        } else if (arg == "-threshold" && hasValue) {
+            threshold = std::atof(argv[++i]);
+        } else if (inputName.empty() && arg[0] != '-') {
+            inputName = arg;
+        } else {
+            std::cerr << "Unknown option: " << arg << std::endl;
+            print_help();
+            return 1;
+        }
+    }
+    if (inputName.empty() == (generateSeconds == 0)) {
+        std::cerr << "ERROR: give either an input file or -generate N" << std::endl;
+        print_help();
+        return 1;
+    }
+
+    const char* env_eve_data_root = std::getenv("eve_data_root");
+    if (env_eve_data_root == nullptr) {
+        std::cerr << "ERROR: environment variable eve_data_root is undefined - aborting" << std::endl;
+        return 1;
+    }
+
+    bool removeInput = false;
+    if (generateSeconds > 0) {
+        inputName = std::string(env_eve_data_root) + "replay_benchmark_input.rtlm";
+        if (!generateInput(inputName, generateSeconds, testPattern)) {
+            std::remove(inputName.c_str());
+            return 1;
+        }
+        removeInput = true;
+    }
+
+    FileInputSource fileSource(inputName);
+    CCSDSReader fileReader(&fileSource);
+    if (!fileReader.open()) {
+        std::cerr << "ERROR: Failed to open " << inputName << std::endl;
+        return 1;
+    }
+
+    StageTimers& timers = StageTimers::getInstance();
+    timers.reset();
+    timers.enable(true);
+
+    std::vector<uint8_t> packet;
+    uint64_t packets = 0;
+    uint64_t bytes = 0;
+    auto start = std::chrono::steady_clock::now();
+    while (fileReader.readNextPacket(packet)) {
+        processOnePacket(fileReader, packet);
+        ++packets;
+        bytes += sizeof(SYNC_MARKER) + packet.size();
+    }
+    finishPacketProcessing(fileReader);
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+    timers.enable(false);
+    fileReader.close();
+    if (removeInput) {
+        std::remove(inputName.c_str());
+    }
+
+    double seconds = std::max(elapsed.count(), 1.e-9);
+    double packetsPerSecond = packets / seconds;
+    double mbPerSecond = bytes / (1024.0 * 1024.0) / seconds;
+
+    std::ostringstream json;
+    json.setf(std::ios::fixed);
+    json.precision(3);
+    json << "{\n";
+    json << "  \"input\": \"" << (generateSeconds > 0 ? "generated" : inputName) << "\",\n";
+    json << "  \"fits\": " << (globalState.args.skipFITS.load() ? "false" : "true") << ",\n";
+    json << "  \"compress\": " << ((globalState.args.skipFITS.load() || globalState.args.skipCompress.load()) ? "false" : "true") << ",\n";
+    json << "  \"packets\": " << packets << ",\n";
+    json << "  \"bytes\": " << bytes << ",\n";
+    json << "  \"seconds\": " << seconds << ",\n";
+    json << "  \"packets_per_second\": " << packetsPerSecond << ",\n";
+    json << "  \"mb_per_second\": " << mbPerSecond << ",\n";
+    json << "  \"stages\": {\n";
+    for (int stage = 0; stage < PIPELINE_STAGE_COUNT; ++stage) {
+        StageLatencySummary summary = timers.summarize(static_cast<PipelineStage>(stage));
+        json << "    \"" << StageTimers::stageName(static_cast<PipelineStage>(stage)) << "\": {"
+             << "\"count\": " << summary.count
+             << ", \"total_seconds\": " << summary.totalSeconds
+             << ", \"p50_us\": " << summary.p50Microsec
+             << ", \"p99_us\": " << summary.p99Microsec
+             << ", \"max_us\": " << summary.maxMicrosec << "}"
+             << (stage + 1 < PIPELINE_STAGE_COUNT ? "," : "") << "\n";
+    }
+    json << "  }\n";
+    json << "}\n";
+
+    std::cout << json.str();
+    if (!jsonName.empty()) {
+        std::ofstream jsonFile(jsonName);
+        jsonFile << json.str();
+        if (!jsonFile.good()) {
+            std::cerr << "ERROR: Failed to write " << jsonName << std::endl;
+            return 1;
+        }
+    }
+
+    if (packets == 0) {
+        std::cerr << "ERROR: no packets were read from " << inputName << std::endl;
+        return 1;
+    }
+
+    if (!baselineName.empty()) {
+        std::ifstream baselineFile(baselineName);
+        std::stringstream baselineText;
+        baselineText << baselineFile.rdbuf();
+        double baselinePacketsPerSecond = 0.0;
+        if (!baselineFile.is_open() || !findJsonNumber(baselineText.str(), "packets_per_second", baselinePacketsPerSecond)) {
+            std::cerr << "ERROR: no packets_per_second in baseline " << baselineName << std::endl;
+            return 1;
+        }
+        double limit = baselinePacketsPerSecond * (1.0 - threshold);
+        if (packetsPerSecond < limit) {
+            std::cerr << "REGRESSION: " << packetsPerSecond << " packets/s is below " << limit
+                      << " (baseline " << baselinePacketsPerSecond << ", threshold " << threshold << ")" << std::endl;
+            return 2;
+        }
+        std::cerr << "replay_benchmark " << packetsPerSecond << " packets/s, baseline " << baselinePacketsPerSecond << std::endl;
+    }
+    return 0;
+}
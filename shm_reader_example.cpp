@@ -0,0 +1,96 @@
+// Example external tool that follows rl0b_main -shm without reading FITS files.
+// Prints each new complete MEGS image and the latest ESP, MEGS-P and SHK values.
+//
+// make shm_reader_example
+// ./shm_reader_example [/segment_name]
+
+#include <csignal>
+#include <iostream>
+#include <memory>
+#include <vector>
+#include "EveShmReader.hpp"
+
+static volatile std::sig_atomic_t keepRunning = 1;
+
+static void handleSigint(int) {
+    keepRunning = 0;
+}
+
+static void reportImage(const EveShmReader& reader, EveShmChannel slot, const char* label, uint16_t* pixels) {
+    EveShmImageInfo info;
+    if (!reader.copyImage(slot, info, pixels)) {
+        std::cout << label << " image busy, skipped" << std::endl;
+        return;
+    }
+    uint64_t sum = 0;
+    for (uint32_t i = 0; i < MEGS_TOTAL_PIXELS; ++i) {
+        sum += pixels[i];
+    }
+    std::cout << label << " image " << info.imageCount << " tai " << info.tai_time_seconds
+              << " yyyydoy " << info.yyyydoy << " sod " << info.sod
+              << " packets " << info.packetsReceived << " mean " << static_cast<double>(sum) / MEGS_TOTAL_PIXELS << std::endl;
+}
+
+int main(int argc, char* argv[]) {
+    std::string name = (argc > 1) ? argv[1] : EVE_SHM_DEFAULT_NAME;
+
+    EveShmReader reader;
+    if (!reader.open(name)) {
+        std::cerr << "ERROR: " << reader.lastError() << std::endl;
+        return 1;
+    }
+    std::signal(SIGINT, handleSigint);
+
+    // the c++14 way pixels = std::make_unique<uint16_t[]>(MEGS_TOTAL_PIXELS);
+    std::unique_ptr<uint16_t[]> pixels(new uint16_t[MEGS_TOTAL_PIXELS]);
+
+    uint64_t lastMegsA = reader.generation(EVE_SHM_MEGSA_COMPLETE);
+    uint64_t lastMegsB = reader.generation(EVE_SHM_MEGSB_COMPLETE);
+    // start with whatever is still in the rings
+    uint64_t nextESP = 0, nextMEGSP = 0, nextSHK = 0;
+    std::vector<EveShmESPEntry> esp;
+    std::vector<EveShmMEGSPEntry> megsp;
+    std::vector<EveShmSHKEntry> shk;
+
+    while (keepRunning) {
+        // one ESP packet arrives every second, so this wakes up at least that often while the writer runs
+        reader.waitForGeneration(EVE_SHM_ESP, reader.generation(EVE_SHM_ESP), 1000);
+
+        uint64_t generation = reader.generation(EVE_SHM_MEGSA_COMPLETE);
+        if (generation != lastMegsA) {
+            lastMegsA = generation;
+            reportImage(reader, EVE_SHM_MEGSA_COMPLETE, "MEGS-A", pixels.get());
+        }
+        generation = reader.generation(EVE_SHM_MEGSB_COMPLETE);
+        if (generation != lastMegsB) {
+            lastMegsB = generation;
+            reportImage(reader, EVE_SHM_MEGSB_COMPLETE, "MEGS-B", pixels.get());
+        }
+
+        esp.clear();
+        megsp.clear();
+        shk.clear();
+        uint64_t lost = reader.readESP(nextESP, esp) + reader.readMEGSP(nextMEGSP, megsp) + reader.readSHK(nextSHK, shk);
+        if (lost > 0) {
+            std::cout << "reader fell behind, " << lost << " ring entries overwritten" << std::endl;
+        }
+        if (!esp.empty()) {
+            const EveShmESPEntry& e = esp.back();
+            std::cout << "ESP " << esp.size() << " new, tai " << e.tai_time_seconds << " 171 " << e.esp171
+                      << " 257 " << e.esp257 << " 304 " << e.esp304 << " 366 " << e.esp366 << " dark " << e.dark << std::endl;
+        }
+        if (!megsp.empty()) {
+            std::cout << "MEGS-P " << megsp.size() << " new, lya " << megsp.back().lya << " dark " << megsp.back().dark << std::endl;
+        }
+        if (!shk.empty()) {
+            // values[0] is FPGA_Board_Temperature
+            std::cout << "SHK " << shk.size() << " new, FPGA board temperature " << shk.back().values[0] << std::endl;
+        }
+
+        if (!reader.writerAlive()) {
+            std::cout << "writer exited" << std::endl;
+            break;
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,128 @@
+// Writes synthetic rocket telemetry in record file format for benchmarks and soak tests.
+// The output replays with rl0b_main like any recorded .rtlm file.
+//
+// make telemetry_generator
+// ./telemetry_generator output.rtlm [options]
+// ./telemetry_generator - [options] | other_tool     (- writes to stdout)
+
+#include <chrono>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+#include <omp.h>
+#include "TelemetryGenerator.hpp"
+
+static void print_help() {
+    std::cerr << "Usage: telemetry_generator output.rtlm [options]" << std::endl;
+    std::cerr << " output.rtlm record file to write, - writes to stdout" << std::endl;
+    std::cerr << "Options: " << std::endl;
+    std::cerr << " -seconds N simulated duration (default 60)" << std::endl;
+    std::cerr << " -startTai N TAI seconds of the first packet (default 2025-01-01)" << std::endl;
+    std::cerr << " -imageSeconds N MEGS-A/B image cadence (default 10)" << std::endl;
+    std::cerr << " -noMegsA, -noMegsB leave out that camera" << std::endl;
+    std::cerr << " -testPattern encode the FPGA test pattern instead of a synthetic spectrum" << std::endl;
+    std::cerr << " -espRate N, -megspRate N, -shkRate N packets per second (default 1)" << std::endl;
+    std::cerr << " -gapRate P probability of dropping each packet (default 0)" << std::endl;
+    std::cerr << " -corruptRate P probability of flipping one bit in each packet (default 0)" << std::endl;
+    std::cerr << " -seed N random seed (default 1)" << std::endl;
+    std::cerr << " -threads N generator threads (default OpenMP max)" << std::endl;
+}
+
+int main(int argc, char* argv[]) {
+    TelemetryGeneratorConfig config;
+    std::string outputName;
+    uint64_t seconds = 60;
+    int threads = omp_get_max_threads();
+
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        bool hasValue = (i + 1 < argc);
+        if (arg == "-help" || arg == "--help") {
+            print_help();
+            return 0;
+        } else if (arg == "-seconds" && hasValue) {
+            seconds = std::strtoull(argv[++i], nullptr, 10);
+        } else if (arg == "-startTai" && hasValue) {
+            config.startTai = std::strtoul(argv[++i], nullptr, 10);
+        } else if (arg == "-imageSeconds" && hasValue) {
+            config.imageSeconds = std::strtoul(argv[++i], nullptr, 10);
+        } else if (arg == "-noMegsA") {
+            config.megsA = false;
+        } else if (arg == "-noMegsB") {
+            config.megsB = false;
+        } else if (arg == "-testPattern") {
+            config.testPattern = true;
+        } else if (arg == "-espRate" && hasValue) {
+            config.espPacketsPerSecond = std::strtoul(argv[++i], nullptr, 10);
+        } else if (arg == "-megspRate" && hasValue) {
+            config.megspPacketsPerSecond = std::strtoul(argv[++i], nullptr, 10);
+        } else if (arg == "-shkRate" && hasValue) {
+            config.shkPacketsPerSecond = std::strtoul(argv[++i], nullptr, 10);
+        } else if (arg == "-gapRate" && hasValue) {
+            config.gapRate = std::atof(argv[++i]);
+        } else if (arg == "-corruptRate" && hasValue) {
+            config.corruptRate = std::atof(argv[++i]);
+        } else if (arg == "-seed" && hasValue) {
+            config.seed = std::strtoull(argv[++i], nullptr, 10);
+        } else if (arg == "-threads" && hasValue) {
+            threads = std::max(1, std::atoi(argv[++i]));
+        } else if (outputName.empty() && (arg == "-" || arg[0] != '-')) {
+            outputName = arg;
+        } else {
+            std::cerr << "Unknown option: " << arg << std::endl;
+            print_help();
+            return 1;
+        }
+    }
+    if (outputName.empty()) {
+        print_help();
+        return 1;
+    }
+
+    std::ofstream outputFile;
+    std::ostream* output = &std::cout;
+    if (outputName != "-") {
+        outputFile.open(outputName, std::ios::binary);
+        if (!outputFile.is_open()) {
+            std::cerr << "ERROR: Failed to open output file: " << outputName << std::endl;
+            return 1;
+        }
+        output = &outputFile;
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    TelemetryGenerator generator(config);
+    TelemetryGeneratorStats total;
+
+    // each thread fills whole seconds, the block is written in order before the next one starts
+    const uint64_t secondsPerBlock = 4 * static_cast<uint64_t>(threads);
+    std::vector<std::vector<uint8_t>> buffers(secondsPerBlock);
+    std::vector<TelemetryGeneratorStats> blockStats(secondsPerBlock);
+    for (uint64_t blockStart = 0; blockStart < seconds; blockStart += secondsPerBlock) {
+        const int64_t count = static_cast<int64_t>(std::min(secondsPerBlock, seconds - blockStart));
+        #pragma omp parallel for num_threads(threads) schedule(dynamic, 1)
+        for (int64_t i = 0; i < count; ++i) {
+            buffers[i].clear();
+            blockStats[i] = TelemetryGeneratorStats();
+            generator.generateSecond(blockStart + i, buffers[i], blockStats[i]);
+        }
+        for (int64_t i = 0; i < count; ++i) {
+            output->write(reinterpret_cast<const char*>(buffers[i].data()), buffers[i].size());
+            total.add(blockStats[i]);
+        }
+        if (!output->good()) {
+            std::cerr << "ERROR: write to " << outputName << " failed" << std::endl;
+            return 1;
+        }
+    }
+    output->flush();
+
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+    std::cerr << "telemetry_generator wrote " << total.packets << " packets, " << total.bytes / (1024.0 * 1024.0) << " MB in "
+              << elapsed.count() << " s (" << total.bytes / (1024.0 * 1024.0) / elapsed.count() << " MB/s)" << std::endl;
+    std::cerr << " MEGS-A " << total.megsA << " MEGS-B " << total.megsB << " ESP " << total.esp << " MEGS-P " << total.megsp
+              << " SHK " << total.shk << " dropped " << total.dropped << " corrupted " << total.corrupted << std::endl;
+    return 0;
+}
@@ -11,8 +11,30 @@
 #include "USBInputSource.hpp"
 #include "ProgramState.hpp"
 #include "FileCompressor.hpp"
+#include "QuicklookServer.hpp"
+#include "MetricsServer.hpp"
+#include "TraceRecorder.hpp"
+#include "SharedMemoryPublisher.hpp"
+#include "EveShmReader.hpp"
+#include "PacketBroadcaster.hpp"
+#include "PacketRingSubscriber.hpp"
+#include "TelemetryGenerator.hpp"
+#include "FITSTableSchema.hpp"
+#include "PathService.hpp"
+#include "Level0BReader.hpp"
+#include "ArchiveCatalog.hpp"
+#include "ColumnStore.hpp"
+#include "MegsCodec.hpp"
+#include "MegsSpectrum.hpp"
+#include "MegsDark.hpp"
 #include <stdexcept>
+#include <algorithm>
+#include <cmath>
+#include <strings.h>
+#include <arpa/inet.h>
+#include <sys/socket.h>
 #include <omp.h>
+#include <zlib.h>
 
 //#define NORMAL_FILE "packetizer_out_2024_08_20.bin"
 //#define NORMAL_FILE "packetizer_out_2024_08_31.bin"
@@ -160,6 +182,53 @@ TEST_CASE("create_directory_if_not_exists works when directories already exist",
     rmdir("./test_dir");
 }
 
+TEST_CASE("PathService remembers directories it created", "[PathService]") {
+    PathService& paths = PathService::getInstance();
+    std::string dirPath = "./test_path_service/2026/292/";
+    rmdir("./test_path_service/2026/292");
+    rmdir("./test_path_service/2026");
+    rmdir("./test_path_service");
+    paths.forget();
+
+    REQUIRE(paths.ensureDirectory(dirPath));
+    struct stat info;
+    REQUIRE(stat("./test_path_service/2026/292", &info) == 0);
+    REQUIRE(S_ISDIR(info.st_mode));
+    REQUIRE(paths.knownDirectories() == 4); // three segments and the full path
+
+    // the second call is answered from memory, so a directory removed behind its back is not noticed
+    rmdir("./test_path_service/2026/292");
+    REQUIRE(paths.ensureDirectory(dirPath));
+    REQUIRE(stat("./test_path_service/2026/292", &info) != 0);
+
+    // a sibling only makes its own segment
+    REQUIRE(paths.ensureDirectory("./test_path_service/2026/293/"));
+    REQUIRE(stat("./test_path_service/2026/293", &info) == 0);
+
+    paths.forget();
+    REQUIRE(paths.ensureDirectory(dirPath));
+    REQUIRE(stat("./test_path_service/2026/292", &info) == 0);
+
+    std::ofstream("./test_path_service/not_a_directory") << "x";
+    REQUIRE_FALSE(paths.ensureDirectory("./test_path_service/not_a_directory/"));
+
+    remove("./test_path_service/not_a_directory");
+
+    // a replay of many days within one UTC day stays bounded
+    for (int day = 1; day <= 1100; ++day) {
+        REQUIRE(paths.ensureDirectory("./test_path_service/2026/d" + std::to_string(day) + "/"));
+        REQUIRE(paths.knownDirectories() <= PATH_SERVICE_MAX_KNOWN_DIRECTORIES);
+    }
+    for (int day = 1; day <= 1100; ++day) {
+        rmdir(("./test_path_service/2026/d" + std::to_string(day)).c_str());
+    }
+    rmdir("./test_path_service/2026/292");
+    rmdir("./test_path_service/2026/293");
+    rmdir("./test_path_service/2026");
+    rmdir("./test_path_service");
+    paths.forget();
+}
+
 TEST_CASE("transposeImageTo1D correctly transposes a single row from a large image", "[transposeImageTo1D]") {
     uint16_t image[MEGS_IMAGE_HEIGHT][MEGS_IMAGE_WIDTH] = {};
 
@@ -250,6 +319,33 @@ TEST_CASE("transposeImageTo1D performs efficiently for large images", "[transpos
     REQUIRE(duration < 1000000); // Ensure that the operation takes less than 1 second (1 million microseconds)
 }
 
+TEST_CASE("transposeImage writes the 2048 x 1024 transposed layout into a reused buffer", "[transposeImage]") {
+    static uint16_t image[MEGS_IMAGE_HEIGHT][MEGS_IMAGE_WIDTH];
+    for (uint32_t y = 0; y < MEGS_IMAGE_HEIGHT; ++y) {
+        for (uint32_t x = 0; x < MEGS_IMAGE_WIDTH; ++x) {
+            image[y][x] = static_cast<uint16_t>(y * 31 + x * 7);
+        }
+    }
+
+    std::vector<uint16_t> transposed;
+    transposeImage(image, transposed);
+    REQUIRE(transposed.size() == MEGS_TOTAL_PIXELS);
+    const uint16_t* buffer = transposed.data();
+
+    bool allMatch = true;
+    for (uint32_t y = 0; y < MEGS_IMAGE_HEIGHT; ++y) {
+        for (uint32_t x = 0; x < MEGS_IMAGE_WIDTH; ++x) {
+            allMatch = allMatch && (transposed[x * MEGS_IMAGE_T_WIDTH + y] == image[y][x]);
+        }
+    }
+    REQUIRE(allMatch);
+
+    image[5][2047] = 65535;
+    transposeImage(image, transposed);
+    REQUIRE(transposed.data() == buffer); // no reallocation for the next image
+    REQUIRE(transposed[2047 * MEGS_IMAGE_T_WIDTH + 5] == 65535);
+}
+
 
 TEST_CASE("payloadBytesToUint32 correctly converts four bytes to uint32_t", "[payloadBytesToUint32]") {
     // Test case 1: Normal conversion
@@ -443,6 +539,44 @@ TEST_CASE("countSaturatedPixels - General Test Cases") {
     }
 }
 
+TEST_CASE("MegsSaturationCounter counts an image as it is assembled the same as countSaturatedPixels") {
+    std::unique_ptr<MEGS_IMAGE_REC> image(new MEGS_IMAGE_REC{});
+    for (uint32_t i = 0; i < 5000; ++i) {
+        image->image[(i * 7919) % MEGS_IMAGE_HEIGHT][(i * 104729) % MEGS_IMAGE_WIDTH] = 0x3fff;
+    }
+    image->image[0][0] = 0x3fff;
+    uint32_t expectedTop, expectedBottom;
+    countSaturatedPixels(image->image, expectedTop, expectedBottom, true);
+
+    SECTION("every packet in order counts each row once") {
+        MegsSaturationCounter counter;
+        counter.start();
+        for (uint16_t ssc = 0; ssc < N_PKT_PER_IMAGE; ++ssc) {
+            markMegsPacketReceived(*image, ssc);
+            counter.addPacketRows(*image, ssc);
+        }
+        uint32_t top, bottom;
+        counter.finish(*image, true, top, bottom);
+        CHECK(top == expectedTop);
+        CHECK(bottom == expectedBottom);
+    }
+
+    SECTION("rows a partial image never completed are counted at the end") {
+        MegsSaturationCounter counter;
+        counter.start();
+        for (uint16_t ssc = 0; ssc < N_PKT_PER_IMAGE; ++ssc) {
+            if ((ssc % 50) != 17) {
+                markMegsPacketReceived(*image, ssc);
+                counter.addPacketRows(*image, ssc);
+            }
+        }
+        uint32_t top, bottom;
+        counter.finish(*image, true, top, bottom);
+        CHECK(top == expectedTop);
+        CHECK(bottom == expectedBottom);
+    }
+}
+
 void populateTestImage(uint16_t image[MEGS_IMAGE_HEIGHT][MEGS_IMAGE_WIDTH], uint16_t saturationValue = 0x3FFF) {
     for (uint32_t i = 0; i < MEGS_IMAGE_HEIGHT; ++i) {
         for (uint32_t j = 0; j < MEGS_IMAGE_WIDTH; ++j) {
@@ -581,6 +715,30 @@ TEST_CASE("Source Sequence Counter Impact", "[assemble_image]") {
     //REQUIRE(imageRec.image[0][0] == 0x3FFF); need to calculate pixel location based on ssc
 }
 
+TEST_CASE("markMegsDirtyRows marks every row written by assemble_image", "[markMegsDirtyRows]") {
+    uint8_t vcdu[1781] = {0};
+    MEGS_IMAGE_REC imageRec;
+    int32_t xpos, ypos;
+    int8_t status = NOERROR;
+    populateVCDU(vcdu, sizeof(vcdu), 0x000b); // nonzero after 2s complement
+
+    for (uint16_t ssc : {0, 4, 5, 1196, 1197, 2393, 2394}) {
+        std::memset(imageRec.image, 0, sizeof(imageRec.image));
+        std::atomic<uint32_t> dirtyRows[MEGS_DIRTY_ROW_WORDS] = {};
+
+        assemble_image(vcdu, &imageRec, ssc, false, xpos, ypos, &status);
+        markMegsDirtyRows(dirtyRows, ssc);
+
+        for (uint32_t y = 0; y < MEGS_IMAGE_HEIGHT; ++y) {
+            bool rowWritten = std::any_of(imageRec.image[y], imageRec.image[y] + MEGS_IMAGE_WIDTH,
+                [](uint16_t value) { return value != 0; });
+            bool rowDirty = (dirtyRows[y >> 5].load() >> (y & 31)) & 1u;
+            INFO("ssc " << ssc << " row " << y);
+            REQUIRE(rowDirty == rowWritten);
+        }
+    }
+}
+
 
 // TEST_CASE("Histogram Equalization on a simple known input image", "[histogramEqualization]") {
 //     uint16_t image[MEGS_IMAGE_HEIGHT][MEGS_IMAGE_WIDTH] = {};
@@ -607,6 +765,1595 @@ TEST_CASE("Source Sequence Counter Impact", "[assemble_image]") {
 //     // Further checks for other positions depending on your expectations
 // }
 
+// previous shared-histogram implementation, kept as the reference for the per-thread version
+void histogramEqualizationAtomicReference(uint16_t (*image)[MEGS_IMAGE_HEIGHT][MEGS_IMAGE_WIDTH], std::vector<uint8_t>& textureData) {
+    constexpr uint32_t halfHeight = MEGS_IMAGE_HEIGHT / 2;
+    constexpr uint32_t topHalfPixels = MEGS_IMAGE_WIDTH * halfHeight;
+    constexpr uint32_t bottomHalfPixels = MEGS_IMAGE_WIDTH * halfHeight;
+
+    static int topHistogram[16384];
+    static int bottomHistogram[16384];
+    std::memset(topHistogram, 0, sizeof(topHistogram));
+    std::memset(bottomHistogram, 0, sizeof(bottomHistogram));
+
+    #pragma omp parallel for
+    for (uint32_t idx = 0; idx < MEGS_TOTAL_PIXELS; ++idx) {
+        uint32_t y = idx / MEGS_IMAGE_WIDTH;
+        uint32_t x = idx % MEGS_IMAGE_WIDTH;
+        int* currentHistogram = (y < halfHeight) ? topHistogram : bottomHistogram;
+        uint16_t pixelValue = (*image)[y][x] & 0x3FFF;
+        #pragma omp atomic
+        currentHistogram[pixelValue]++;
+    }
+
+    static int topCDF[16384];
+    static int bottomCDF[16384];
+    topCDF[0] = topHistogram[0];
+    bottomCDF[0] = bottomHistogram[0];
+    for (int i = 1; i < 16384; ++i) {
+        topCDF[i] = topCDF[i - 1] + topHistogram[i];
+        bottomCDF[i] = bottomCDF[i - 1] + bottomHistogram[i];
+    }
+
+    float top_cdf_min = *std::find_if(topCDF, topCDF + 16384, [](int value) { return value > 0; });
+    float bottom_cdf_min = *std::find_if(bottomCDF, bottomCDF + 16384, [](int value) { return value > 0; });
+    float topScale = 255.0f / (topHalfPixels - top_cdf_min);
+    float bottomScale = 255.0f / (bottomHalfPixels - bottom_cdf_min);
+
+    #pragma omp parallel for
+    for (uint32_t idx = 0; idx < MEGS_TOTAL_PIXELS; ++idx) {
+        uint32_t y = idx / MEGS_IMAGE_WIDTH;
+        uint32_t x = idx % MEGS_IMAGE_WIDTH;
+        int pixelValue = (*image)[y][x] & 0x3FFF;
+        textureData[idx] = (y < halfHeight)
+            ? static_cast<uint8_t>(topScale * (topCDF[pixelValue] - top_cdf_min))
+            : static_cast<uint8_t>(bottomScale * (bottomCDF[pixelValue] - bottom_cdf_min));
+    }
+}
+
+// pseudo-random 14-bit image with a different distribution in each half
+void populateHistogramTestImage(uint16_t image[MEGS_IMAGE_HEIGHT][MEGS_IMAGE_WIDTH]) {
+    uint32_t seed = 12345;
+    for (uint32_t y = 0; y < MEGS_IMAGE_HEIGHT; ++y) {
+        for (uint32_t x = 0; x < MEGS_IMAGE_WIDTH; ++x) {
+            seed = seed * 1664525u + 1013904223u;
+            uint16_t value = (seed >> 16) & 0x3FFF;
+            image[y][x] = (y < MEGS_IMAGE_HEIGHT / 2) ? value : (value >> 3) + 100;
+        }
+    }
+}
+
+TEST_CASE("histogramEqualization matches the shared-histogram reference", "[histogramEqualization]") {
+    static uint16_t image[MEGS_IMAGE_HEIGHT][MEGS_IMAGE_WIDTH];
+    populateHistogramTestImage(image);
+
+    std::vector<uint8_t> expected(MEGS_TOTAL_PIXELS);
+    std::vector<uint8_t> result(MEGS_TOTAL_PIXELS);
+    histogramEqualizationAtomicReference(&image, expected);
+    histogramEqualization(&image, result);
+    REQUIRE(result == expected);
+
+    SECTION("Constant image maps to zero") {
+        static uint16_t flat[MEGS_IMAGE_HEIGHT][MEGS_IMAGE_WIDTH];
+        std::fill(&flat[0][0], &flat[0][0] + MEGS_TOTAL_PIXELS, 0x1234);
+        histogramEqualization(&flat, result);
+        REQUIRE(std::all_of(result.begin(), result.end(), [](uint8_t value) { return value == 0; }));
+    }
+}
+
+TEST_CASE("histogramEqualization performance against the shared-histogram reference", "[histogramEqualization][performance]") {
+    static uint16_t image[MEGS_IMAGE_HEIGHT][MEGS_IMAGE_WIDTH];
+    populateHistogramTestImage(image);
+    std::vector<uint8_t> textureData(MEGS_TOTAL_PIXELS);
+
+    // restore the thread count afterwards so later tests are not left on 16 threads
+    const int maxThreads = omp_get_max_threads();
+    int numIterations = 16;
+    for (int numThreads = 1; numThreads <= 16; numThreads *= 2) {
+        omp_set_num_threads(numThreads);
+
+        auto start = std::chrono::high_resolution_clock::now();
+        for (int i = 0; i < numIterations; ++i) {
+            histogramEqualizationAtomicReference(&image, textureData);
+        }
+        auto mid = std::chrono::high_resolution_clock::now();
+        for (int i = 0; i < numIterations; ++i) {
+            histogramEqualization(&image, textureData);
+        }
+        auto end = std::chrono::high_resolution_clock::now();
+
+        auto referenceDuration = std::chrono::duration_cast<std::chrono::microseconds>(mid - start).count() / numIterations;
+        auto duration = std::chrono::duration_cast<std::chrono::microseconds>(end - mid).count() / numIterations;
+        std::cout << "histogramEqualization with " << numThreads << " threads: " << duration
+                  << " microsec/iteration, shared-histogram reference: " << referenceDuration << " microsec/iteration" << std::endl;
+        REQUIRE(duration < 1000000);
+    }
+    omp_set_num_threads(maxThreads);
+}
+
+TEST_CASE("SeqlockSnapshot publishes complete values", "[SeqlockSnapshot]") {
+    SeqlockSnapshot<ESP_PACKET> snapshot;
+    ESP_PACKET esp;
+
+    SECTION("Nothing published reads as zeros") {
+        REQUIRE(snapshot.read(esp) == 0);
+        REQUIRE(esp.ESP_q0[0] == 0);
+        REQUIRE(esp.tai_time_seconds == 0);
+    }
+
+    SECTION("Latest publish is returned") {
+        ESP_PACKET published = {0};
+        published.tai_time_seconds = 1234;
+        published.ESP_q0[ESP_INTEGRATIONS_PER_FILE - 1] = 42;
+        snapshot.publish(published);
+        published.tai_time_seconds = 5678;
+        snapshot.publish(published);
+
+        REQUIRE(snapshot.version() == 2);
+        REQUIRE(snapshot.read(esp) == 2);
+        REQUIRE(esp.tai_time_seconds == 5678);
+        REQUIRE(esp.ESP_q0[ESP_INTEGRATIONS_PER_FILE - 1] == 42);
+    }
+
+    SECTION("Reader never sees a torn value while the writer publishes") {
+        constexpr uint32_t numPublishes = 20000;
+        std::thread writer([&snapshot]() {
+            ESP_PACKET published = {0};
+            for (uint32_t i = 1; i <= numPublishes; ++i) {
+                published.tai_time_seconds = i;
+                for (int j = 0; j < ESP_INTEGRATIONS_PER_FILE; ++j) {
+                    published.ESP_q0[j] = i;
+                    published.ESP_dark[j] = i;
+                }
+                snapshot.publish(published);
+            }
+        });
+
+        uint32_t lastSeen = 0;
+        bool consistent = true;
+        while (lastSeen < numPublishes) {
+            snapshot.read(esp);
+            for (int j = 0; j < ESP_INTEGRATIONS_PER_FILE; ++j) {
+                if ((esp.ESP_q0[j] != uint16_t(esp.tai_time_seconds)) || (esp.ESP_dark[j] != uint16_t(esp.tai_time_seconds))) {
+                    consistent = false;
+                }
+            }
+            if (esp.tai_time_seconds < lastSeen) {
+                consistent = false;
+            }
+            lastSeen = esp.tai_time_seconds;
+        }
+        writer.join();
+        REQUIRE(consistent);
+    }
+}
+
+
+TEST_CASE("downsampleMegsImage averages binning x binning blocks", "[QuicklookServer]") {
+    static uint16_t image[MEGS_IMAGE_HEIGHT][MEGS_IMAGE_WIDTH];
+    for (uint32_t y = 0; y < MEGS_IMAGE_HEIGHT; ++y) {
+        for (uint32_t x = 0; x < MEGS_IMAGE_WIDTH; ++x) {
+            image[y][x] = ((x % 2) == 0) ? 100 : 300;
+        }
+    }
+    image[0][0] = 0xC000 | 100; // parity bits are masked off
+
+    std::vector<uint16_t> out((MEGS_IMAGE_WIDTH / 4) * (MEGS_IMAGE_HEIGHT / 4));
+    downsampleMegsImage(image, 4, out.data());
+    REQUIRE(out[0] == 200);
+    REQUIRE(out.back() == 200);
+}
+
+// read exactly size bytes, false on timeout or disconnect
+static bool recvAll(int fd, uint8_t* data, size_t size) {
+    size_t received = 0;
+    while (received < size) {
+        ssize_t n = recv(fd, data + received, size - received, 0);
+        if (n <= 0) {
+            return false;
+        }
+        received += n;
+    }
+    return true;
+}
+
+TEST_CASE("QuicklookServer streams frames to a loopback client", "[QuicklookServer]") {
+    QuicklookConfig config;
+    config.port = 0; // any free port
+    config.imageIntervalMs = 20;
+    config.telemetryIntervalMs = 10;
+    QuicklookServer server(config);
+    REQUIRE(server.start());
+    REQUIRE(server.getPort() != 0);
+
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    REQUIRE(fd >= 0);
+    timeval timeout = {5, 0};
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    sockaddr_in addr = {};
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    addr.sin_port = htons(server.getPort());
+    REQUIRE(connect(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) == 0);
+
+    bool sawCounters = false, sawImage = false, sawESP = false, sawSHK = false;
+    for (int frames = 0; (frames < 50) && !(sawCounters && sawImage && sawESP && sawSHK); ++frames) {
+        uint8_t headerBytes[sizeof(QuicklookHeader)];
+        REQUIRE(recvAll(fd, headerBytes, sizeof(headerBytes)));
+        QuicklookHeader header;
+        REQUIRE(parseQuicklookHeader(headerBytes, sizeof(headerBytes), header));
+        std::vector<uint8_t> payload(header.payloadBytes);
+        REQUIRE(recvAll(fd, payload.data(), payload.size()));
+
+        if (header.type == QL_MSG_COUNTERS) {
+            uint16_t numCounters;
+            std::memcpy(&numCounters, payload.data(), sizeof(numCounters));
+            REQUIRE(payload.size() == sizeof(uint16_t) + numCounters * sizeof(int64_t));
+            sawCounters = true;
+        } else if (header.type == QL_MSG_MEGSA_IMAGE || header.type == QL_MSG_MEGSB_IMAGE) {
+            uint16_t size[3];
+            std::memcpy(size, payload.data() + 3 * sizeof(uint32_t), sizeof(size));
+            REQUIRE(size[0] == MEGS_IMAGE_WIDTH / 4);
+            REQUIRE(size[1] == MEGS_IMAGE_HEIGHT / 4);
+            REQUIRE(payload.size() == 3 * sizeof(uint32_t) + sizeof(size) + size_t(size[0]) * size[1] * sizeof(uint16_t));
+            sawImage = true;
+        } else if (header.type == QL_MSG_ESP) {
+            REQUIRE(payload.size() == 2 * sizeof(uint32_t) + sizeof(uint16_t) + 10 * ESP_INTEGRATIONS_PER_FILE * sizeof(uint16_t));
+            sawESP = true;
+        } else if (header.type == QL_MSG_SHK) {
+            sawSHK = true;
+        }
+    }
+    REQUIRE(sawCounters);
+    REQUIRE(sawImage);
+    REQUIRE(sawESP);
+    REQUIRE(sawSHK);
+    REQUIRE(server.getClientCount() == 1);
+
+    close(fd);
+    server.stop();
+    REQUIRE(server.getClientCount() == 0);
+}
+
+TEST_CASE("MetricsServer answers a scrape with ProgramState counters", "[MetricsServer]") {
+    std::string body = renderMetrics(nullptr);
+    REQUIRE(body.find("# TYPE eve_packets_received_total counter") != std::string::npos);
+    REQUIRE(body.find("eve_packets_received_total{channel=\"MA\",apid=\"601\"}") != std::string::npos);
+    REQUIRE(body.find("eve_fpga_register{reg=\"3\"}") != std::string::npos);
+    REQUIRE(body.find("# TYPE eve_fits_publish_failures_total counter") != std::string::npos);
+    REQUIRE(body.find("eve_quicklook_clients") == std::string::npos);
+
+    MetricsConfig config;
+    config.port = 0; // any free port
+    MetricsServer server(config);
+    REQUIRE(server.start());
+    REQUIRE(server.getPort() != 0);
+
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    REQUIRE(fd >= 0);
+    timeval timeout = {5, 0};
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    sockaddr_in addr = {};
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    addr.sin_port = htons(server.getPort());
+    REQUIRE(connect(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) == 0);
+
+    std::string request = "GET /metrics HTTP/1.0\r\n\r\n";
+    REQUIRE(send(fd, request.data(), request.size(), 0) == static_cast<ssize_t>(request.size()));
+    std::string response;
+    char buffer[4096];
+    ssize_t received;
+    while ((received = recv(fd, buffer, sizeof(buffer), 0)) > 0) {
+        response.append(buffer, received); // the server closes after one response
+    }
+    close(fd);
+
+    REQUIRE(response.rfind("HTTP/1.0 200 OK\r\n", 0) == 0);
+    REQUIRE(response.find("eve_packets_per_second") != std::string::npos);
+    REQUIRE(server.getScrapeCount() == 1);
+    server.stop();
+}
+
+
+TEST_CASE("SharedMemoryPublisher images and rings read back through EveShmReader", "[SharedMemoryPublisher]") {
+    const std::string name = "/eve_rocket_l0b_test_" + std::to_string(getpid());
+    SharedMemoryPublisher& publisher = SharedMemoryPublisher::getInstance();
+    REQUIRE(publisher.open(name));
+
+    EveShmReader reader;
+    REQUIRE(reader.open(name));
+    REQUIRE(reader.writerAlive());
+
+    SECTION("Complete and in-progress images") {
+        static MEGS_IMAGE_REC image;
+        for (uint32_t y = 0; y < MEGS_IMAGE_HEIGHT; ++y) {
+            for (uint32_t x = 0; x < MEGS_IMAGE_WIDTH; ++x) {
+                image.image[y][x] = (y * 7 + x) & 0x3FFF;
+            }
+        }
+        image.tai_time_seconds = 1234567;
+        image.yyyydoy = 2025001;
+
+        uint64_t generation = reader.generation(EVE_SHM_MEGSA_COMPLETE);
+        publisher.publishCompleteImage(EVE_SHM_MEGSA_COMPLETE, image, 5, false);
+        REQUIRE(reader.waitForGeneration(EVE_SHM_MEGSA_COMPLETE, generation, 100));
+
+        EveShmImageInfo info;
+        std::vector<uint16_t> pixels(MEGS_TOTAL_PIXELS);
+        REQUIRE(reader.copyImage(EVE_SHM_MEGSA_COMPLETE, info, pixels.data()));
+        REQUIRE(info.imageCount == 5);
+        REQUIRE(info.tai_time_seconds == 1234567);
+        REQUIRE(info.yyyydoy == 2025001);
+        REQUIRE(std::memcmp(pixels.data(), image.image, sizeof(image.image)) == 0);
+
+        // one packet only copies its own rows and their mirrors
+        publisher.startImage(EVE_SHM_MEGSB_IN_PROGRESS, image, 2, false);
+        publisher.publishImageRows(EVE_SHM_MEGSB_IN_PROGRESS, image.image, 1000);
+        REQUIRE(reader.copyImage(EVE_SHM_MEGSB_IN_PROGRESS, info, pixels.data()));
+        REQUIRE(info.lastSourceSequenceCounter == 1000);
+        uint32_t firstRow, lastRow;
+        megsTopRowsForPacket(1000, firstRow, lastRow);
+        for (uint32_t y = 0; y < MEGS_IMAGE_HEIGHT; ++y) {
+            bool written = (y >= firstRow && y <= lastRow) || ((MEGS_IMAGE_HEIGHT - 1 - y) >= firstRow && (MEGS_IMAGE_HEIGHT - 1 - y) <= lastRow);
+            REQUIRE(pixels[y * MEGS_IMAGE_WIDTH + 1] == (written ? image.image[y][1] : 0));
+        }
+    }
+
+    SECTION("ESP ring keeps order and reports overwritten entries") {
+        ESP_PACKET esp = {};
+        esp.tai_time_seconds = 42;
+        for (int i = 0; i < ESP_INTEGRATIONS_PER_FILE; ++i) {
+            esp.ESP_171[i] = i;
+        }
+        uint64_t nextIndex = 0;
+        std::vector<EveShmESPEntry> entries;
+
+        publisher.publishESP(esp, 0, ESP_INTEGRATIONS_PER_PACKET);
+        REQUIRE(reader.readESP(nextIndex, entries) == 0);
+        REQUIRE(entries.size() == ESP_INTEGRATIONS_PER_PACKET);
+        REQUIRE(entries[3].esp171 == 3);
+        REQUIRE(entries[3].tai_time_seconds == 42);
+        REQUIRE(nextIndex == ESP_INTEGRATIONS_PER_PACKET);
+
+        // wrap the ring once and a bit, the reader resumes at the oldest surviving entry
+        int packets = EVE_SHM_ESP_RING_SIZE / ESP_INTEGRATIONS_PER_PACKET + 2;
+        for (int p = 0; p < packets; ++p) {
+            publisher.publishESP(esp, 4, ESP_INTEGRATIONS_PER_PACKET);
+        }
+        entries.clear();
+        uint64_t lost = reader.readESP(nextIndex, entries);
+        REQUIRE(entries.size() == EVE_SHM_ESP_RING_SIZE - 1);
+        REQUIRE(lost + entries.size() == uint64_t(packets) * ESP_INTEGRATIONS_PER_PACKET);
+        REQUIRE(entries.back().esp171 == 7);
+        REQUIRE(nextIndex == uint64_t(packets + 1) * ESP_INTEGRATIONS_PER_PACKET);
+    }
+
+    SECTION("SHK ring holds one entry per integration") {
+        SHK_CONVERTED_PACKET shkConv = {};
+        shkConv.FPGA_Board_Temperature[SHK_INTEGRATIONS_PER_FILE - 1] = 31.5;
+        uint64_t nextIndex = 0;
+        std::vector<EveShmSHKEntry> entries;
+        publisher.publishSHK(shkConv, 99);
+        reader.readSHK(nextIndex, entries);
+        REQUIRE(entries.size() == SHK_INTEGRATIONS_PER_FILE);
+        REQUIRE(entries.back().values[0] == 31.5);
+        REQUIRE(entries.back().tai_time_seconds == 99);
+    }
+
+    reader.close();
+    publisher.close();
+    REQUIRE_FALSE(reader.open(name));
+}
+
+TEST_CASE("PacketBroadcaster fans packets out to independent subscribers", "[PacketBroadcaster]") {
+    const std::string name = "/eve_rocket_l0b_packets_test_" + std::to_string(getpid());
+    PacketBroadcaster& broadcaster = PacketBroadcaster::getInstance();
+    REQUIRE(broadcaster.open(name, 8192));
+
+    // packet i is i+1 bytes long and every byte holds i
+    auto makePacket = [](uint32_t i) { return std::vector<uint8_t>(i % 300 + 1, static_cast<uint8_t>(i)); };
+
+    PacketRingSubscriber fast, slow;
+    REQUIRE(fast.open(name));
+    REQUIRE(slow.open(name));
+    std::vector<uint8_t> packet;
+    REQUIRE(fast.readNext(packet) == PACKET_RING_EMPTY);
+
+    SECTION("Every subscriber sees every packet in order, across the wrap") {
+        for (uint32_t i = 0; i < 200; ++i) {
+            REQUIRE(broadcaster.publish(makePacket(i)));
+            REQUIRE(fast.readNext(packet) == PACKET_RING_PACKET);
+            REQUIRE(packet == makePacket(i));
+        }
+        REQUIRE(fast.readNext(packet) == PACKET_RING_EMPTY);
+        REQUIRE(fast.getPacketsLost() == 0);
+
+        // a subscriber opened later starting at the oldest record still sees a contiguous tail
+        PacketRingSubscriber late;
+        REQUIRE(late.open(name, true));
+        uint32_t count = 0;
+        while (late.readNext(packet) == PACKET_RING_PACKET) {
+            ++count;
+        }
+        REQUIRE(count > 0);
+        REQUIRE(packet == makePacket(199));
+        REQUIRE(late.getPacketsLost() == 0);
+    }
+
+    SECTION("A slow subscriber is overrun and counts the lost packets") {
+        for (uint32_t i = 0; i < 10; ++i) {
+            broadcaster.publish(makePacket(i));
+        }
+        REQUIRE(slow.readNext(packet) == PACKET_RING_PACKET);
+        REQUIRE(packet == makePacket(0));
+
+        for (uint32_t i = 10; i < 200; ++i) {
+            broadcaster.publish(makePacket(i));
+        }
+        REQUIRE(slow.readNext(packet) == PACKET_RING_OVERRUN);
+        uint32_t read = 1;
+        while (slow.readNext(packet) == PACKET_RING_PACKET) {
+            ++read;
+        }
+        REQUIRE(packet == makePacket(199));
+        REQUIRE(slow.getOverruns() == 1);
+        REQUIRE(read + slow.getPacketsLost() == 200);
+    }
+
+    fast.close();
+    slow.close();
+    broadcaster.close();
+    REQUIRE_FALSE(fast.open(name));
+}
+
+TEST_CASE("TelemetryGenerator output decodes through CCSDSReader and assemble_image", "[TelemetryGenerator]") {
+    const std::string filename = "telemetry_generator_test.rtlm";
+    for (bool testPattern : {false, true}) {
+        TelemetryGeneratorConfig config;
+        config.testPattern = testPattern;
+        TelemetryGenerator generator(config);
+
+        // one full image cadence
+        std::vector<uint8_t> stream;
+        TelemetryGeneratorStats stats;
+        for (uint64_t second = 0; second < config.imageSeconds; ++second) {
+            generator.generateSecond(second, stream, stats);
+        }
+        REQUIRE(stats.megsA == N_PKT_PER_IMAGE);
+        REQUIRE(stats.megsB == N_PKT_PER_IMAGE);
+        REQUIRE(stats.esp == config.imageSeconds);
+        REQUIRE(stats.bytes == stream.size());
+        {
+            std::ofstream file(filename, std::ios::binary);
+            file.write(reinterpret_cast<const char*>(stream.data()), stream.size());
+        }
+
+        FileInputSource fileSource(filename);
+        CCSDSReader reader(&fileSource);
+        REQUIRE(reader.open());
+        static MEGS_IMAGE_REC image;
+        image = MEGS_IMAGE_REC{0};
+        std::vector<uint8_t> packet;
+        uint32_t megsAPackets = 0, parityErrors = 0;
+        double lastTime = 0.0;
+        while (reader.readNextPacket(packet)) {
+            std::vector<uint8_t> header(packet.begin(), packet.begin() + PACKET_HEADER_SIZE);
+            std::vector<uint8_t> payload(packet.begin() + PACKET_HEADER_SIZE, packet.end());
+            double time = reader.getPacketTimeStamp(payload);
+            REQUIRE(time >= lastTime); // packets are in time order
+            lastTime = time;
+            if (reader.getAPID(header) != MEGSA_APID) {
+                continue;
+            }
+            uint16_t ssc = reader.getSourceSequenceCounter(header);
+            REQUIRE(ssc == megsAPackets);
+            // assemble_image expects the 20 VCDU header bytes in front of the secondary header
+            std::vector<uint8_t> vcdu(20 + STANDARD_MEGSAB_PACKET_LENGTH + 1, 0);
+            std::copy(payload.begin(), payload.end(), vcdu.begin() + 20);
+            int32_t xpos, ypos;
+            int8_t status;
+            parityErrors += assemble_image(vcdu.data(), &image, ssc, testPattern, xpos, ypos, &status);
+            megsAPackets++;
+        }
+        reader.close();
+        REQUIRE(megsAPackets == N_PKT_PER_IMAGE);
+        REQUIRE(parityErrors == 0);
+
+        if (testPattern) {
+            // top half counts up by 2 from the top left, bottom half by 1 from the bottom right
+            REQUIRE(image.image[0][5] == 10);
+            REQUIRE(image.image[1][0] == (2 * 2048) % 16384);
+            REQUIRE(image.image[1023][2047 - 5] == 5);
+        } else {
+            // within the noise of the first image, away from the two pixels the FPGA fix overwrites
+            for (uint32_t y : {10u, 300u, 700u, 1013u}) {
+                for (uint32_t x : {100u, 1024u, 2000u}) {
+                    REQUIRE(std::abs(int(image.image[y][x]) - int(generator.syntheticPixel(MEGSA_APID, x, y))) <= 4);
+                }
+            }
+        }
+    }
+
+    SECTION("Gaps and corruption are injected at the requested rates") {
+        TelemetryGeneratorConfig config;
+        config.gapRate = 0.5;
+        config.corruptRate = 1.0;
+        TelemetryGenerator generator(config);
+        std::vector<uint8_t> stream;
+        TelemetryGeneratorStats stats;
+        generator.generateSecond(0, stream, stats);
+        uint64_t total = stats.packets + stats.dropped;
+        REQUIRE(stats.dropped > total / 4);
+        REQUIRE(stats.dropped < 3 * total / 4);
+        REQUIRE(stats.corrupted == stats.packets);
+    }
+    std::remove(filename.c_str());
+}
+
+TEST_CASE("A MEGS image missing its tail is written as partial with a packet bitmap", "[MegsImage]") {
+    static MEGS_IMAGE_REC image;
+    image = MEGS_IMAGE_REC{0};
+    REQUIRE(markMegsPacketReceived(image, 0));
+    REQUIRE(markMegsPacketReceived(image, 2394));
+    REQUIRE_FALSE(markMegsPacketReceived(image, 2394)); // counted once
+    REQUIRE(image.packets_received == 2);
+    REQUIRE(isMegsPacketReceived(image, 2394));
+    REQUIRE_FALSE(isMegsPacketReceived(image, 1));
+    REQUIRE(megsImageCompleteness(image) == Approx(200.0 / N_PKT_PER_IMAGE));
+
+    TelemetryGeneratorConfig config;
+    config.megsB = false;
+    TelemetryGenerator generator(config);
+    std::vector<uint8_t> stream;
+    TelemetryGeneratorStats stats;
+    generator.generateSecond(0, stream, stats);
+
+    const bool skipFITS = globalState.args.skipFITS.load();
+    globalState.args.skipFITS.store(true);
+    const uint32_t imagesBefore = globalState.megsAImageCount.load();
+    const uint32_t partialBefore = globalState.megsAPartialImages.load();
+
+    // the first 100 packets of an image, less SSC 50, then the link goes quiet
+    size_t offset = 0;
+    while (offset + sizeof(SYNC_MARKER) + PACKET_HEADER_SIZE <= stream.size()) {
+        const uint8_t* packet = stream.data() + offset + sizeof(SYNC_MARKER);
+        uint16_t apid = ((packet[0] & 0x07) << 8) | packet[1];
+        uint16_t ssc = ((packet[2] & 0x3F) << 8) | packet[3];
+        size_t packetBytes = PACKET_HEADER_SIZE + (((packet[4] << 8) | packet[5]) + 1);
+        if ((apid == MEGSA_APID) && (ssc < 100) && (ssc != 50)) {
+            std::vector<uint8_t> payload(packet + PACKET_HEADER_SIZE, packet + packetBytes);
+            processMegsAPacket(payload, ssc, static_cast<uint16_t>(packetBytes), 0.0);
+        }
+        offset += sizeof(SYNC_MARKER) + packetBytes;
+    }
+    REQUIRE(globalState.megsAImagePackets.load() == 99);
+
+    globalState.saturatedPixelsMATop.store(UINT32_MAX); // set by finishing the image, GUI or not
+    auto now = std::chrono::steady_clock::now();
+    flushTimedOutMegsImages(now);
+    REQUIRE(globalState.megsAImageCount.load() == imagesBefore); // still waiting for the rest
+    flushTimedOutMegsImages(now + std::chrono::seconds(globalState.args.imageTimeoutSeconds.load() + 1));
+    REQUIRE(globalState.megsAImageCount.load() == imagesBefore + 1);
+    REQUIRE(globalState.megsAPartialImages.load() == partialBefore + 1);
+    REQUIRE(globalState.megsALastCompleteness.load() == Approx(9900.0 / N_PKT_PER_IMAGE));
+    REQUIRE(globalState.megsAImagePackets.load() == 0);
+    REQUIRE(globalState.saturatedPixelsMATop.load() != UINT32_MAX);
+    flushPartialMegsImages(); // nothing left in progress
+    REQUIRE(globalState.megsAImageCount.load() == imagesBefore + 1);
+
+    globalState.args.skipFITS.store(skipFITS);
+}
+
+TEST_CASE("Packets held behind a missing one are processed once it times out with no packets after it", "[SequenceReorder]") {
+    TelemetryGeneratorConfig config;
+    config.megsB = false;
+    TelemetryGenerator generator(config);
+    std::vector<uint8_t> stream;
+    TelemetryGeneratorStats stats;
+    generator.generateSecond(0, stream, stats);
+
+    const bool skipFITS = globalState.args.skipFITS.load();
+    globalState.args.skipFITS.store(true);
+    flushPartialMegsImages();
+    resetPacketReorder();
+    FileInputSource source("unused.bin");
+    CCSDSReader reader(&source);
+
+    // SSC 5 never arrives and nothing follows SSC 9
+    size_t offset = 0;
+    while (offset + sizeof(SYNC_MARKER) + PACKET_HEADER_SIZE <= stream.size()) {
+        const uint8_t* packet = stream.data() + offset + sizeof(SYNC_MARKER);
+        uint16_t apid = ((packet[0] & 0x07) << 8) | packet[1];
+        uint16_t ssc = ((packet[2] & 0x3F) << 8) | packet[3];
+        size_t packetBytes = PACKET_HEADER_SIZE + (((packet[4] << 8) | packet[5]) + 1);
+        if ((apid == MEGSA_APID) && (ssc < 10) && (ssc != 5)) {
+            processOnePacket(reader, std::vector<uint8_t>(packet, packet + packetBytes));
+        }
+        offset += sizeof(SYNC_MARKER) + packetBytes;
+    }
+    REQUIRE(globalState.megsAImagePackets.load() == 5);
+
+    auto now = std::chrono::steady_clock::now();
+    tickPacketProcessing(reader, now);
+    REQUIRE(globalState.megsAImagePackets.load() == 5); // still waiting for SSC 5
+    tickPacketProcessing(reader, now + std::chrono::milliseconds(globalState.args.reorderTimeoutMs.load() + 1));
+    REQUIRE(globalState.megsAImagePackets.load() == 9);
+
+    flushPartialMegsImages();
+    globalState.args.skipFITS.store(skipFITS);
+}
+
+TEST_CASE("A MEGS image is written when its packets stop and no packets of any APID follow", "[MegsImage]") {
+    TelemetryGeneratorConfig config;
+    config.megsB = false;
+    TelemetryGenerator generator(config);
+    std::vector<uint8_t> stream;
+    TelemetryGeneratorStats stats;
+    generator.generateSecond(0, stream, stats);
+
+    const bool skipFITS = globalState.args.skipFITS.load();
+    globalState.args.skipFITS.store(true);
+    flushPartialMegsImages();
+    resetPacketReorder();
+    FileInputSource source("unused.bin");
+    CCSDSReader reader(&source);
+    const uint32_t imagesBefore = globalState.megsAImageCount.load();
+    const uint32_t partialBefore = globalState.megsAPartialImages.load();
+
+    size_t offset = 0;
+    while (offset + sizeof(SYNC_MARKER) + PACKET_HEADER_SIZE <= stream.size()) {
+        const uint8_t* packet = stream.data() + offset + sizeof(SYNC_MARKER);
+        uint16_t apid = ((packet[0] & 0x07) << 8) | packet[1];
+        uint16_t ssc = ((packet[2] & 0x3F) << 8) | packet[3];
+        size_t packetBytes = PACKET_HEADER_SIZE + (((packet[4] << 8) | packet[5]) + 1);
+        if ((apid == MEGSA_APID) && (ssc < 20)) {
+            processOnePacket(reader, std::vector<uint8_t>(packet, packet + packetBytes));
+        }
+        offset += sizeof(SYNC_MARKER) + packetBytes;
+    }
+    REQUIRE(globalState.megsAImagePackets.load() == 20);
+
+    auto now = std::chrono::steady_clock::now();
+    tickPacketProcessing(reader, now);
+    REQUIRE(globalState.megsAImageCount.load() == imagesBefore); // still waiting for the rest
+    tickPacketProcessing(reader, now + std::chrono::seconds(globalState.args.imageTimeoutSeconds.load() + 1));
+    REQUIRE(globalState.megsAImageCount.load() == imagesBefore + 1);
+    REQUIRE(globalState.megsAPartialImages.load() == partialBefore + 1);
+    REQUIRE(globalState.megsAImagePackets.load() == 0);
+
+    globalState.args.skipFITS.store(skipFITS);
+}
+
+TEST_CASE("FITS table schemas are built once with packed column offsets", "[FITSTableSchema]") {
+    const FITSTableSchema& megsA = megsTableSchema(MEGSA_APID);
+    const FITSTableSchema& megsB = megsTableSchema(MEGSB_APID);
+    REQUIRE(&megsA == &megsTableSchema(MEGSA_APID));
+    REQUIRE(megsA.extname() == "MEGSA_TABLE");
+    REQUIRE(megsB.extname() == "MEGSB_TABLE");
+
+    // 6 uint32 times, uint16 vcdu count, 4 float temperatures, uint16 packet count, then one byte per packet bit
+    const std::vector<FITSColumn>& columns = megsA.columns();
+    REQUIRE(columns.size() == 13);
+    REQUIRE(columns[6].name == "VCDU_COUNT");
+    REQUIRE(columns[6].offset == 6 * sizeof(uint32_t));
+    REQUIRE(columns[12].tform == std::to_string(N_PKT_PER_IMAGE) + "X");
+    REQUIRE(columns[12].offset == 6 * sizeof(uint32_t) + 2 * sizeof(uint16_t) + 4 * sizeof(float));
+    REQUIRE(megsA.rowBytes() == columns[12].offset + N_PKT_PER_IMAGE);
+    REQUIRE(std::string(megsA.ttype()[0]) == "YYYYDOY");
+    REQUIRE(std::string(megsA.tform()[7]) == "1E");
+    REQUIRE(std::string(megsA.tunit()[7]) == "degC");
+
+    const FITSTableSchema& shk = shkTableSchema();
+    REQUIRE(shk.columns().size() == 107);
+    REQUIRE(shk.extname() == "SHK_DATA");
+    // 6 scalar times, mode and 56 raw uint32 arrays, 44 converted double arrays
+    REQUIRE(shk.rowBytes() == 6 * sizeof(uint32_t) + SHK_INTEGRATIONS_PER_FILE * (57 * sizeof(uint32_t) + 44 * sizeof(double)));
+    REQUIRE(espTableSchema().columns().back().offset + ESP_INTEGRATIONS_PER_FILE * sizeof(uint16_t) == espTableSchema().rowBytes());
+    REQUIRE(megsPTableSchema().columns().size() == 10);
+
+    REQUIRE_THROWS_AS(FITSTableSchema("BAD", {"A"}, "Q", {1}, {""}), std::invalid_argument);
+}
+
+TEST_CASE("Level0BReader binds every table column to a struct member", "[Level0BReader]") {
+    struct Product {
+        uint16_t apid;
+        const FITSTableSchema& schema;
+    };
+    std::vector<Product> products = {
+        {MEGSA_APID, megsTableSchema(MEGSA_APID)}, {MEGSP_APID, megsPTableSchema()},
+        {ESP_APID, espTableSchema()}, {SHK_APID, shkTableSchema()}
+    };
+    for (const Product& product : products) {
+        const std::vector<Level0BField>& fields = Level0BReader::tableFields(product.apid);
+        size_t bound = 0;
+        for (const FITSColumn& column : product.schema.columns()) {
+            if (column.name == "RECEIVED_PACKETS") {
+                continue; // read as bits into received_packets
+            }
+            auto field = std::find_if(fields.begin(), fields.end(), [&](const Level0BField& f) {
+                return strcasecmp(f.name, column.name.c_str()) == 0;
+            });
+            INFO(product.schema.extname() << " " << column.name);
+            REQUIRE(field != fields.end());
+            CHECK(field->typeCode == column.typeCode);
+            CHECK(field->length == column.length);
+            ++bound;
+        }
+        CHECK(bound == fields.size());
+    }
+    CHECK(Level0BReader::tableFields(0).empty());
+}
+
+TEST_CASE("Level0BReader finds the files of a time range in order", "[Level0BReader]") {
+    uint32_t tai = 0;
+    // 2025 day 79 is 2025-03-20, unix 1742428800
+    REQUIRE(Level0BReader::filenameTai("/data/level0b/megs_a/2025/079/MA__L0B_0_2025079_000000.fit.gz", tai));
+    CHECK(tai == 1742428800u + static_cast<uint32_t>(TAI_EPOCH_OFFSET_TO_UNIX) + static_cast<uint32_t>(TAI_LEAP_SECONDS));
+    uint32_t later = 0;
+    REQUIRE(Level0BReader::filenameTai("ESP_L0B_0_2025079_010203.fit", later));
+    CHECK(later - tai == 3723);
+    CHECK_FALSE(Level0BReader::filenameTai("MA__L0B_0_2025079.fit", later));
+    CHECK_FALSE(Level0BReader::filenameTai("MA__L0B_0_2025400_000000.fit", later));
+
+    const std::string root = "./test_l0b_root/";
+    const std::string day79 = root + "level0b/megs_a/2025/079/";
+    const std::string day80 = root + "level0b/megs_a/2025/080/";
+    REQUIRE(PathService::getInstance().ensureDirectory(day79));
+    REQUIRE(PathService::getInstance().ensureDirectory(day80));
+    std::vector<std::string> names = {
+        day79 + "MA__L0B_0_2025079_235950.fit.gz", day79 + "MA__L0B_0_2025079_000010.fit.gz",
+        day79 + "MA__L0B_0_2025079_000010.fit", day80 + "MA__L0B_0_2025080_000000.fit",
+        day79 + "MB__L0B_0_2025079_000020.fit.gz", day79 + "MA__L0B_0_2025079_000030.fit.gz.tmp"
+    };
+    for (const std::string& name : names) {
+        std::ofstream(name) << "x";
+    }
+
+    std::vector<std::string> found = Level0BReader::findFiles("./test_l0b_root", MEGSA_APID, tai, tai + 2 * 86400);
+    REQUIRE(found.size() == 3);
+    CHECK(found[0] == day79 + "MA__L0B_0_2025079_000010.fit.gz"); // the stale .fit of the same second is dropped
+    CHECK(found[1] == day79 + "MA__L0B_0_2025079_235950.fit.gz");
+    CHECK(found[2] == day80 + "MA__L0B_0_2025080_000000.fit");
+
+    // the end is exclusive and days outside the range are not listed
+    found = Level0BReader::findFiles(root, MEGSA_APID, tai + 10, tai + 86400);
+    REQUIRE(found.size() == 2);
+    CHECK(Level0BReader::findFiles(root, MEGSA_APID, tai + 11, tai + 86390).empty());
+    // the MB file in megs_a/ belongs to neither channel
+    CHECK(Level0BReader::findFiles(root, MEGSB_APID, tai, tai + 86400).empty());
+
+    for (const std::string& name : names) {
+        remove(name.c_str());
+    }
+    rmdir(day79.c_str());
+    rmdir(day80.c_str());
+    rmdir((root + "level0b/megs_a/2025").c_str());
+    rmdir((root + "level0b/megs_a").c_str());
+    rmdir((root + "level0b").c_str());
+    rmdir(root.c_str());
+    PathService::getInstance().forget();
+}
+
+TEST_CASE("Level0BStream hands out gunzipped files in order", "[Level0BReader]") {
+    std::vector<std::string> filenames;
+    std::vector<std::vector<uint8_t>> contents;
+    FileCompressor compressor;
+    for (int i = 0; i < 12; ++i) {
+        std::vector<uint8_t> content(2880 * (i + 1));
+        for (size_t j = 0; j < content.size(); ++j) {
+            content[j] = static_cast<uint8_t>((j * 7 + i) & 0xff);
+        }
+        std::string name = "./test_l0b_stream_" + std::to_string(i) + ".fit";
+        if ((i % 3) != 0) {
+            std::vector<uint8_t> gzipped;
+            REQUIRE(compressor.compressBuffer(content.data(), content.size(), gzipped));
+            name += ".gz";
+            std::ofstream(name, std::ios::binary).write(reinterpret_cast<const char*>(gzipped.data()), gzipped.size());
+        } else {
+            std::ofstream(name, std::ios::binary).write(reinterpret_cast<const char*>(content.data()), content.size());
+        }
+        filenames.push_back(name);
+        contents.push_back(content);
+    }
+    filenames.insert(filenames.begin() + 5, "./test_l0b_stream_missing.fit");
+    contents.insert(contents.begin() + 5, std::vector<uint8_t>());
+
+    Level0BStream stream(filenames, 3, 2);
+    REQUIRE(stream.size() == 13);
+    Level0BFile file;
+    size_t index = 0;
+    while (stream.next(file)) {
+        REQUIRE(index < filenames.size());
+        CHECK(file.filename == filenames[index]);
+        if (contents[index].empty()) {
+            CHECK_FALSE(file.error.empty());
+        } else {
+            CHECK(file.error.empty());
+            CHECK(file.bytes == contents[index]);
+        }
+        ++index;
+    }
+    CHECK(index == filenames.size());
+
+    std::vector<uint8_t> bytes;
+    std::string error;
+    std::vector<uint8_t> truncated = {0x1f, 0x8b, 0x08, 0x00};
+    CHECK_FALSE(Level0BReader::gunzip(truncated, bytes, error));
+    CHECK_FALSE(error.empty());
+
+    for (const std::string& name : filenames) {
+        remove(name.c_str());
+    }
+}
+
+// bytes of one element of a Level0BField, the reader only binds these types
+size_t level0bElementBytes(int typeCode) {
+    switch (typeCode) {
+        case TUSHORT: return sizeof(uint16_t);
+        case TUINT: return sizeof(uint32_t);
+        case TFLOAT: return sizeof(float);
+        case TDOUBLE: return sizeof(double);
+        default: return 0;
+    }
+}
+
+// a value unique to each field and element, exact in every bound type
+void fillLevel0BFields(void* record, const std::vector<Level0BField>& fields) {
+    for (size_t f = 0; f < fields.size(); ++f) {
+        uint8_t* member = static_cast<uint8_t*>(record) + fields[f].offset;
+        for (long i = 0; i < fields[f].length; ++i) {
+            uint32_t value = static_cast<uint32_t>(f * 100 + i + 1);
+            switch (fields[f].typeCode) {
+                case TUSHORT: reinterpret_cast<uint16_t*>(member)[i] = static_cast<uint16_t>(value); break;
+                case TUINT: reinterpret_cast<uint32_t*>(member)[i] = value; break;
+                case TFLOAT: reinterpret_cast<float*>(member)[i] = value + 0.25f; break;
+                case TDOUBLE: reinterpret_cast<double*>(member)[i] = value + 0.125; break;
+            }
+        }
+    }
+}
+
+void checkLevel0BFields(const void* written, const void* read, const std::vector<Level0BField>& fields) {
+    for (const Level0BField& field : fields) {
+        INFO(field.name);
+        REQUIRE(level0bElementBytes(field.typeCode) != 0);
+        CHECK(std::memcmp(static_cast<const uint8_t*>(written) + field.offset, static_cast<const uint8_t*>(read) + field.offset,
+                          field.length * level0bElementBytes(field.typeCode)) == 0);
+    }
+}
+
+TEST_CASE("Level0BReader reads back what FITSWriter wrote", "[Level0BReader]") {
+    char directoryTemplate[] = "/tmp/l0b_round_trip_XXXXXX";
+    REQUIRE(mkdtemp(directoryTemplate) != nullptr);
+    const std::string root = std::string(directoryTemplate) + "/";
+    const char* previousDataRoot = std::getenv("eve_data_root");
+    const std::string previousDataRootValue = (previousDataRoot != nullptr) ? previousDataRoot : "";
+    setenv("eve_data_root", root.c_str(), 1);
+    PathService::getInstance().forget(); // resolves eve_data_root again
+
+    const bool skipFITS = globalState.args.skipFITS.load();
+    const bool skipCompress = globalState.args.skipCompress.load();
+    const bool skipCatalog = globalState.args.skipCatalog.load();
+    const bool skipColumns = globalState.args.skipColumns.load();
+    const bool transposeFITS = globalState.args.transposeFITS.load();
+    globalState.args.skipFITS.store(false);
+    globalState.args.skipCompress.store(false);
+    globalState.args.skipCatalog.store(true);
+    globalState.args.skipColumns.store(true);
+
+    uint32_t tai = 0;
+    REQUIRE(Level0BReader::filenameTai("ESP_L0B_0_2025079_120000.fit", tai));
+
+    std::unique_ptr<ESP_PACKET> esp(new ESP_PACKET{});
+    fillLevel0BFields(esp.get(), Level0BReader::tableFields(ESP_APID));
+    esp->tai_time_seconds = tai;
+    std::unique_ptr<MEGSP_PACKET> megsP(new MEGSP_PACKET{});
+    fillLevel0BFields(megsP.get(), Level0BReader::tableFields(MEGSP_APID));
+    megsP->tai_time_seconds = tai;
+    std::unique_ptr<SHK_PACKET> shk(new SHK_PACKET{});
+    fillLevel0BFields(shk.get(), Level0BReader::tableFields(SHK_APID));
+    shk->tai_time_seconds = tai;
+    std::unique_ptr<MEGS_IMAGE_REC> megs(new MEGS_IMAGE_REC{});
+    fillLevel0BFields(megs.get(), Level0BReader::tableFields(MEGSA_APID));
+    megs->tai_time_seconds = tai;
+    for (uint16_t ssc = 0; ssc < N_PKT_PER_IMAGE; ssc += 3) {
+        markMegsPacketReceived(*megs, ssc);
+    }
+    for (uint32_t y = 0; y < MEGS_IMAGE_HEIGHT; ++y) {
+        for (uint32_t x = 0; x < MEGS_IMAGE_WIDTH; ++x) {
+            megs->image[y][x] = static_cast<uint16_t>((x * 7 + y * 13) & 0x3fff);
+        }
+    }
+
+    FITSWriter writer;
+    REQUIRE(writer.writeESPFITS(*esp));
+    REQUIRE(writer.writeMegsPFITS(*megsP));
+    REQUIRE(writer.writeSHKFITS(*shk));
+    REQUIRE(writer.writeMegsAFITS(*megs, 0));
+    // a second MEGS-A image a second later, written 1024 wide by 2048 tall
+    std::unique_ptr<MEGS_IMAGE_REC> transposedMegs(new MEGS_IMAGE_REC(*megs));
+    transposedMegs->tai_time_seconds = tai + 1;
+    globalState.args.transposeFITS.store(true);
+    REQUIRE(writer.writeMegsAFITS(*transposedMegs, 0));
+    globalState.args.transposeFITS.store(transposeFITS);
+    FITSPublisher::getInstance().flush();
+
+    std::vector<std::string> written;
+    auto load = [&](uint16_t apid, uint32_t fileTai, std::vector<uint8_t>& bytes) {
+        std::vector<std::string> found = Level0BReader::findFiles(root, apid, fileTai, fileTai + 1);
+        REQUIRE(found.size() == 1);
+        CHECK(found[0].size() > 3);
+        CHECK(found[0].compare(found[0].size() - 3, 3, ".gz") == 0);
+        written.push_back(found[0]);
+        std::string error;
+        REQUIRE(Level0BReader::loadFile(found[0], bytes, error));
+    };
+    std::vector<uint8_t> bytes;
+    std::string error;
+
+    load(ESP_APID, tai, bytes);
+    std::unique_ptr<ESP_PACKET> espRead(new ESP_PACKET{});
+    REQUIRE(Level0BReader::readESP(bytes, *espRead, error));
+    checkLevel0BFields(esp.get(), espRead.get(), Level0BReader::tableFields(ESP_APID));
+
+    load(MEGSP_APID, tai, bytes);
+    std::unique_ptr<MEGSP_PACKET> megsPRead(new MEGSP_PACKET{});
+    REQUIRE(Level0BReader::readMegsP(bytes, *megsPRead, error));
+    checkLevel0BFields(megsP.get(), megsPRead.get(), Level0BReader::tableFields(MEGSP_APID));
+
+    load(SHK_APID, tai, bytes);
+    std::unique_ptr<SHK_PACKET> shkRead(new SHK_PACKET{});
+    REQUIRE(Level0BReader::readSHK(bytes, *shkRead, error));
+    checkLevel0BFields(shk.get(), shkRead.get(), Level0BReader::tableFields(SHK_APID));
+
+    for (const MEGS_IMAGE_REC* image : {megs.get(), transposedMegs.get()}) {
+        load(MEGSA_APID, image->tai_time_seconds, bytes);
+        std::unique_ptr<MEGS_IMAGE_REC> megsRead(new MEGS_IMAGE_REC{});
+        bool transposed = false;
+        REQUIRE(Level0BReader::readMegsImage(bytes, *megsRead, error, &transposed));
+        CHECK(transposed == (image == transposedMegs.get()));
+        checkLevel0BFields(image, megsRead.get(), Level0BReader::tableFields(MEGSA_APID));
+        CHECK(std::memcmp(image->received_packets, megsRead->received_packets, sizeof(image->received_packets)) == 0);
+        CHECK(std::memcmp(image->image, megsRead->image, sizeof(image->image)) == 0);
+    }
+
+    // a rebuilt catalog keeps the transposed flag of the second image
+    size_t failedFiles = 0;
+    CHECK(ArchiveCatalog::rebuild(root, MEGSA_APID, tai, tai + 2, 1, failedFiles) == 2);
+    CHECK(failedFiles == 0);
+    written.push_back(written.back().substr(0, written.back().find_last_of('/') + 1) + ARCHIVE_CATALOG_NAME);
+    ArchiveCatalogQuery query;
+    query.startTai = tai;
+    query.endTai = tai + 2;
+    query.apids = {MEGSA_APID};
+    std::vector<ArchiveCatalogRecord> records = ArchiveCatalog::query(root, query);
+    REQUIRE(records.size() == 2);
+    CHECK((records[0].flags & CATALOG_TRANSPOSED) == 0);
+    CHECK((records[1].flags & CATALOG_TRANSPOSED) != 0);
+    CHECK((records[1].flags & CATALOG_REBUILT) != 0);
+
+    globalState.args.skipFITS.store(skipFITS);
+    globalState.args.skipCompress.store(skipCompress);
+    globalState.args.skipCatalog.store(skipCatalog);
+    globalState.args.skipColumns.store(skipColumns);
+    if (previousDataRoot != nullptr) {
+        setenv("eve_data_root", previousDataRootValue.c_str(), 1);
+    } else {
+        unsetenv("eve_data_root");
+    }
+    PathService::getInstance().forget();
+
+    // each file sits in root/level0b/<channel>/%Y/%j/
+    for (const std::string& name : written) {
+        remove(name.c_str());
+        std::string directory = name.substr(0, name.find_last_of('/'));
+        while (directory.size() > root.size()) {
+            rmdir(directory.c_str());
+            directory = directory.substr(0, directory.find_last_of('/'));
+        }
+    }
+    CHECK(rmdir(root.c_str()) == 0);
+}
+
+TEST_CASE("ArchiveCatalog appends products and finds them by time and quality", "[ArchiveCatalog]") {
+    const std::string root = "./test_catalog_root/";
+    uint32_t dayTai = 0;
+    REQUIRE(Level0BReader::filenameTai("MA__L0B_0_2025079_000000.fit", dayTai));
+    const std::string megsADay = Level0BReader::dayDirectories(root, MEGSA_APID, dayTai, dayTai + 1)[0];
+    const std::string espDay = Level0BReader::dayDirectories(root, ESP_APID, dayTai, dayTai + 1)[0];
+    REQUIRE(megsADay == root + "level0b/megs_a/2025/079/");
+    REQUIRE(PathService::getInstance().ensureDirectory(megsADay));
+    REQUIRE(PathService::getInstance().ensureDirectory(espDay));
+
+    std::unique_ptr<MEGS_IMAGE_REC> megsImage(new MEGS_IMAGE_REC{});
+    std::vector<std::string> products;
+    for (uint32_t i = 0; i < 6; ++i) {
+        megsImage->tai_time_seconds = dayTai + 10 * i;
+        megsImage->packets_received = (i == 3) ? 1200 : N_PKT_PER_IMAGE;
+        megsImage->image[MEGS_IMAGE_HEIGHT - 1][i] = 0x3fff;  // i + 1 saturated pixels in image i
+        uint32_t saturatedTop, saturatedBottom;
+        countSaturatedPixels(megsImage->image, saturatedTop, saturatedBottom);
+        ArchiveCatalogRecord record = ArchiveCatalog::describe(*megsImage, MEGSA_APID, i, saturatedTop + saturatedBottom);
+        CHECK(record.endTai == record.startTai + SECONDS_PER_MEGS_IMAGE);
+        CHECK(record.saturatedPixels == i + 1);
+        std::string name = megsADay + "MA__L0B_0_2025079_0000" + std::to_string(i) + "0.fit.gz";
+        std::ofstream(name) << std::string(100 + i, 'x');
+        products.push_back(name);
+        REQUIRE(ArchiveCatalog::append(root, name, record));
+    }
+    ESP_PACKET esp = {};
+    esp.tai_time_seconds = dayTai + 5;
+    std::string espName = espDay + "ESP_L0B_0_2025079_000005.fit";
+    std::ofstream(espName) << "esp";
+    products.push_back(espName);
+    REQUIRE(ArchiveCatalog::append(root, espName, ArchiveCatalog::describe(esp)));
+
+    ArchiveCatalogQuery query;
+    query.startTai = dayTai;
+    query.endTai = dayTai + 86400;
+    std::vector<ArchiveCatalogRecord> records = ArchiveCatalog::query(root, query);
+    REQUIRE(records.size() == 7);
+    CHECK(records[0].apid == MEGSA_APID);
+    CHECK(records[1].apid == ESP_APID);  // ordered by time across channels
+    CHECK(std::string(records[0].path) == "level0b/megs_a/2025/079/MA__L0B_0_2025079_000000.fit.gz");
+    CHECK(records[0].fileBytes == 100);
+    CHECK((records[0].flags & CATALOG_COMPRESSED) != 0);
+    CHECK((records[1].flags & CATALOG_COMPRESSED) == 0);
+
+    // binary search by time, the end is exclusive
+    query.startTai = dayTai + 20;
+    query.endTai = dayTai + 40;
+    query.apids = {MEGSA_APID};
+    records = ArchiveCatalog::query(root, query);
+    REQUIRE(records.size() == 2);
+    CHECK(records[0].startTai == dayTai + 20);
+    CHECK(records[1].startTai == dayTai + 30);
+
+    // quality filters
+    query.startTai = dayTai;
+    query.endTai = dayTai + 86400;
+    query.minCompleteness = 0.99;
+    CHECK(ArchiveCatalog::query(root, query).size() == 5);
+    query.maxSaturatedPixels = 2;
+    CHECK(ArchiveCatalog::query(root, query).size() == 2);
+    query.maxParityErrors = 0;
+    CHECK(ArchiveCatalog::query(root, query).size() == 1);
+
+    // a record cut short by a crash is ignored and overwritten by the next append
+    const std::string catalogName = megsADay + ARCHIVE_CATALOG_NAME;
+    std::ofstream(catalogName, std::ios::app) << "partial";
+    query = ArchiveCatalogQuery();
+    query.startTai = dayTai;
+    query.endTai = dayTai + 86400;
+    query.apids = {MEGSA_APID};
+    CHECK(ArchiveCatalog::query(root, query).size() == 6);
+
+    // an earlier product appended late marks the day unsorted, and it is still found
+    megsImage->tai_time_seconds = dayTai + 15;
+    REQUIRE(ArchiveCatalog::append(root, products[0], ArchiveCatalog::describe(*megsImage, MEGSA_APID, 0, 6)));
+    struct stat info;
+    REQUIRE(stat(catalogName.c_str(), &info) == 0);
+    CHECK(static_cast<size_t>(info.st_size) == sizeof(ArchiveCatalogHeader) + 7 * sizeof(ArchiveCatalogRecord));
+    query.startTai = dayTai + 11;
+    query.endTai = dayTai + 21;
+    records = ArchiveCatalog::query(root, query);
+    REQUIRE(records.size() == 2);
+    CHECK(records[0].startTai == dayTai + 15);
+    CHECK(records[1].startTai == dayTai + 20);
+
+    for (const std::string& name : products) {
+        remove(name.c_str());
+    }
+    remove(catalogName.c_str());
+    remove((espDay + ARCHIVE_CATALOG_NAME).c_str());
+    for (const std::string& channel : {std::string("megs_a"), std::string("esp")}) {
+        rmdir((root + "level0b/" + channel + "/2025/079").c_str());
+        rmdir((root + "level0b/" + channel + "/2025").c_str());
+        rmdir((root + "level0b/" + channel).c_str());
+    }
+    rmdir((root + "level0b").c_str());
+    rmdir(root.c_str());
+    PathService::getInstance().forget();
+}
+
+TEST_CASE("ColumnStore appends products to day columns and reads spans of them", "[ColumnStore]") {
+    const std::string root = "./test_columns_root/";
+    uint32_t dayTai = 0;
+    REQUIRE(Level0BReader::filenameTai("ESP_L0B_0_2025079_000000.fit", dayTai));
+    std::vector<std::string> names = ColumnStore::columnNames(ESP_APID);
+    CHECK(std::find(names.begin(), names.end(), "ESP_q0") != names.end());
+    CHECK(std::find(names.begin(), names.end(), "tai_time_seconds") == names.end());
+    CHECK(names.back() == COLUMN_PRESENT_NAME);
+    CHECK(ColumnStore::columnFilename(root, ESP_APID, "ESP_q0", dayTai + 100) ==
+          root + "level0b/esp/2025/079/columns/ESP_q0.col");
+
+    std::unique_ptr<ESP_PACKET> esp(new ESP_PACKET{});
+    for (uint32_t product = 0; product < 3; ++product) {
+        esp->tai_time_seconds = dayTai + 10 * product;
+        esp->ESP_Detector_Temperature = 20.0f + product;
+        for (int32_t i = 0; i < ESP_INTEGRATIONS_PER_FILE; ++i) {
+            esp->ESP_q0[i] = static_cast<uint16_t>(1000 * product + i);
+        }
+        REQUIRE(ColumnStore::getInstance().append(root, *esp));
+    }
+    // the last product of the day runs 5 s into the next one
+    esp->tai_time_seconds = dayTai + 86395;
+    REQUIRE(ColumnStore::getInstance().append(root, *esp));
+    ColumnStore::getInstance().closeAll();
+
+    ColumnReader q0(root, ESP_APID, "ESP_q0");
+    std::vector<ColumnSpan> spans = q0.read(dayTai + 10, dayTai + 20);
+    REQUIRE(spans.size() == 1);
+    REQUIRE(spans[0].count == static_cast<size_t>(ESP_INTEGRATIONS_PER_FILE));
+    CHECK(spans[0].typeCode == TUSHORT);
+    CHECK(spans[0].firstTai == Approx(dayTai + 10));
+    CHECK(spans[0].samplePeriod == Approx(0.25));
+    CHECK(spans[0].as<uint16_t>()[0] == 1000);
+    CHECK(spans[0].as<uint16_t>()[39] == 1039);
+    CHECK(q0.read(dayTai + 10, dayTai + 20)[0].data == spans[0].data);  // the same mapping, no copy
+
+    // samples that fall past midnight are in the next day's file
+    spans = q0.read(dayTai + 86390, dayTai + 86410);
+    REQUIRE(spans.size() == 2);
+    CHECK(spans[0].count == 40);
+    CHECK(spans[0].as<uint16_t>()[20] == 2000);  // 86395 s
+    CHECK(spans[1].firstTai == Approx(dayTai + 86400));
+    CHECK(spans[1].as<uint16_t>()[0] == 2020);
+    CHECK(spans[1].as<uint16_t>()[19] == 2039);
+    CHECK(spans[1].as<uint16_t>()[20] == 0);
+
+    // the first chunk of 256 samples holds the first three products
+    std::vector<ColumnSummarySpan> summaries = q0.summary(dayTai, dayTai + 30);
+    REQUIRE(summaries.size() == 1);
+    REQUIRE(summaries[0].count == 1);
+    CHECK(summaries[0].chunkSeconds == Approx(64.0));
+    CHECK(summaries[0].data[0].count == 120);
+    CHECK(summaries[0].data[0].minimum == 0.0);
+    CHECK(summaries[0].data[0].maximum == 2039.0);
+    CHECK(q0.summary(dayTai, dayTai + 86400)[0].count == 86400 * 4 / COLUMN_SUMMARY_CHUNK);
+
+    ColumnReader temperature(root, ESP_APID, "ESP_Detector_Temperature");
+    spans = temperature.read(dayTai, dayTai + 30);
+    REQUIRE(spans.size() == 1);
+    REQUIRE(spans[0].count == 3);
+    CHECK(spans[0].samplePeriod == Approx(10.0));
+    CHECK(spans[0].as<float>()[2] == 22.0f);
+
+    ColumnReader present(root, ESP_APID, COLUMN_PRESENT_NAME);
+    spans = present.read(dayTai, dayTai + 40);
+    REQUIRE(spans.size() == 1);
+    REQUIRE(spans[0].count == 4);
+    CHECK(spans[0].as<uint8_t>()[2] == 1);
+    CHECK(spans[0].as<uint8_t>()[3] == 0);  // a gap, not a product of zeros
+    CHECK(ColumnReader(root, SHK_APID, "mode").read(dayTai, dayTai + 86400).empty());
+
+    for (uint32_t day : {dayTai, dayTai + 86400}) {
+        for (const std::string& name : names) {
+            remove(ColumnStore::columnFilename(root, ESP_APID, name, day).c_str());
+        }
+        std::string dayDirectory = Level0BReader::dayDirectories(root, ESP_APID, day, day + 1)[0];
+        rmdir((dayDirectory + "columns").c_str());
+        rmdir(dayDirectory.c_str());
+    }
+    rmdir((root + "level0b/esp/2025").c_str());
+    rmdir((root + "level0b/esp").c_str());
+    rmdir((root + "level0b").c_str());
+    rmdir(root.c_str());
+    PathService::getInstance().forget();
+}
+
+TEST_CASE("ColumnStore places samples by TAI subseconds and counts a replaced slot once", "[ColumnStore]") {
+    const std::string root = "./test_columns_overwrite_root/";
+    uint32_t dayTai = 0;
+    REQUIRE(Level0BReader::filenameTai("ESP_L0B_0_2025079_000000.fit", dayTai));
+
+    // two products in the same TAI second, the second half a second later and two 4 Hz samples along
+    std::unique_ptr<ESP_PACKET> esp(new ESP_PACKET{});
+    esp->tai_time_seconds = dayTai + 1000;
+    esp->tai_time_subseconds = 0;
+    for (int32_t i = 0; i < ESP_INTEGRATIONS_PER_FILE; ++i) {
+        esp->ESP_q0[i] = static_cast<uint16_t>(500 + i);
+    }
+    REQUIRE(ColumnStore::getInstance().append(root, *esp));
+    esp->tai_time_subseconds = 0x80000000u;
+    for (int32_t i = 0; i < ESP_INTEGRATIONS_PER_FILE; ++i) {
+        esp->ESP_q0[i] = static_cast<uint16_t>(7 + i);
+    }
+    REQUIRE(ColumnStore::getInstance().append(root, *esp));
+    ColumnStore::getInstance().closeAll();
+
+    ColumnReader q0(root, ESP_APID, "ESP_q0");
+    std::vector<ColumnSpan> spans = q0.read(dayTai + 1000, dayTai + 1011);
+    REQUIRE(spans.size() == 1);
+    CHECK(spans[0].as<uint16_t>()[0] == 500);  // the first product keeps the slots the second did not reach
+    CHECK(spans[0].as<uint16_t>()[1] == 501);
+    CHECK(spans[0].as<uint16_t>()[2] == 7);
+    CHECK(spans[0].as<uint16_t>()[41] == 46);
+
+    // slots 4000 to 4041 are in chunk 15, each written slot counted once with the values it holds now
+    std::vector<ColumnSummarySpan> summaries = q0.summary(dayTai + 1000, dayTai + 1001);
+    REQUIRE(summaries.size() == 1);
+    REQUIRE(summaries[0].count == 1);
+    CHECK(summaries[0].firstTai == Approx(dayTai + 15 * 64.0));
+    CHECK(summaries[0].data[0].count == 42);
+    CHECK(summaries[0].data[0].minimum == 7.0);
+    CHECK(summaries[0].data[0].maximum == 501.0);
+
+    // the same product again changes nothing
+    REQUIRE(ColumnStore::getInstance().append(root, *esp));
+    ColumnStore::getInstance().closeAll();
+    ColumnReader again(root, ESP_APID, "ESP_q0");
+    summaries = again.summary(dayTai + 1000, dayTai + 1001);
+    REQUIRE(summaries.size() == 1);
+    CHECK(summaries[0].data[0].count == 42);
+    CHECK(summaries[0].data[0].maximum == 501.0);
+
+    for (const std::string& name : ColumnStore::columnNames(ESP_APID)) {
+        remove(ColumnStore::columnFilename(root, ESP_APID, name, dayTai).c_str());
+    }
+    std::string dayDirectory = Level0BReader::dayDirectories(root, ESP_APID, dayTai, dayTai + 1)[0];
+    rmdir((dayDirectory + "columns").c_str());
+    rmdir(dayDirectory.c_str());
+    rmdir((root + "level0b/esp/2025").c_str());
+    rmdir((root + "level0b/esp").c_str());
+    rmdir((root + "level0b").c_str());
+    rmdir(root.c_str());
+    PathService::getInstance().forget();
+}
+
+TEST_CASE("MegsCodec round trips MEGS images losslessly", "[MegsCodec]") {
+    std::unique_ptr<MEGS_IMAGE_REC> megsImage(new MEGS_IMAGE_REC{});
+    std::unique_ptr<MEGS_IMAGE_REC> decoded(new MEGS_IMAGE_REC{});
+    // spectral lines that fade along the slit over a dark level with a few DN of noise, a saturated column
+    // and a different dark level in each half
+    uint32_t noise = 12345;
+    for (uint32_t y = 0; y < MEGS_IMAGE_HEIGHT; ++y) {
+        double slit = std::exp(-std::pow((y % (MEGS_IMAGE_HEIGHT / 2)) - 256.0, 2) / 20000.0);
+        for (uint32_t x = 0; x < MEGS_IMAGE_WIDTH; ++x) {
+            noise = noise * 1664525u + 1013904223u;
+            double line = 3000.0 * std::exp(-std::pow((x % 300) - 150.0, 2) / 50.0) * slit;
+            double dark = (y < MEGS_IMAGE_HEIGHT / 2) ? 200.0 : 260.0;
+            megsImage->image[y][x] = static_cast<uint16_t>(std::min(dark + line + (noise >> 30), 16383.0));
+        }
+        megsImage->image[y][1000] = 0x3fff;
+    }
+    std::vector<uint8_t> encoded;
+    std::string error;
+    MegsCodec::encode(megsImage->image, encoded);
+    REQUIRE(MegsCodec::isEncoded(encoded.data(), encoded.size()));
+    REQUIRE(MegsCodec::decode(encoded.data(), encoded.size(), decoded->image, error));
+    CHECK(std::memcmp(decoded->image, megsImage->image, sizeof(megsImage->image)) == 0);
+    CHECK(encoded.size() * 3 < sizeof(megsImage->image));
+
+    FileCompressor compressor;
+    std::vector<uint8_t> gzipped;
+    REQUIRE(compressor.compressBuffer(megsImage->image, sizeof(megsImage->image), gzipped));
+    CHECK(encoded.size() < gzipped.size());
+
+    // noise over the full 16 bits is stored raw, and still round trips
+    for (uint32_t y = 0; y < MEGS_IMAGE_HEIGHT; ++y) {
+        for (uint32_t x = 0; x < MEGS_IMAGE_WIDTH; ++x) {
+            noise = noise * 1664525u + 1013904223u;
+            megsImage->image[y][x] = static_cast<uint16_t>(noise >> 16);
+        }
+    }
+    MegsCodec::encode(megsImage->image, encoded);
+    CHECK(encoded.size() == sizeof(MegsCodecHeader) + MEGS_CODEC_BANDS * sizeof(uint32_t) + sizeof(megsImage->image));
+    REQUIRE(MegsCodec::decode(encoded.data(), encoded.size(), decoded->image, error));
+    CHECK(std::memcmp(decoded->image, megsImage->image, sizeof(megsImage->image)) == 0);
+
+    // truncated or foreign data is refused
+    CHECK_FALSE(MegsCodec::decode(encoded.data(), encoded.size() - 1, decoded->image, error));
+    CHECK_FALSE(error.empty());
+    CHECK_FALSE(MegsCodec::isEncoded(reinterpret_cast<const uint8_t*>(megsImage->image), sizeof(megsImage->image)));
+    CHECK_FALSE(MegsCodec::decode(reinterpret_cast<const uint8_t*>(megsImage->image), sizeof(megsImage->image), decoded->image, error));
+}
+
+TEST_CASE("StageTimers percentiles and nested stages", "[StageTimer]") {
+    StageTimers& timers = StageTimers::getInstance();
+    timers.reset();
+
+    SECTION("Percentiles come from the histogram, max is exact") {
+        for (uint64_t us = 1; us <= 1000; ++us) {
+            timers.record(STAGE_ASSEMBLE, us * 1000); // 1 to 1000 microseconds
+        }
+        StageLatencySummary summary = timers.summarize(STAGE_ASSEMBLE);
+        REQUIRE(summary.count == 1000);
+        REQUIRE(summary.maxMicrosec == Approx(1000.0));
+        REQUIRE(summary.p50Microsec == Approx(500.0).epsilon(0.07));
+        REQUIRE(summary.p99Microsec == Approx(990.0).epsilon(0.07));
+        REQUIRE(summary.totalSeconds == Approx(0.5005));
+        REQUIRE(timers.summarize(STAGE_READ).count == 0);
+    }
+
+    SECTION("Disabled timers record nothing") {
+        timers.enable(false);
+        {
+            ScopedStageTimer timer(STAGE_READ);
+        }
+        REQUIRE(timers.summarize(STAGE_READ).count == 0);
+    }
+
+    SECTION("A stage excludes the time of the stages it calls") {
+        timers.enable(true);
+        {
+            ScopedStageTimer outer(STAGE_DECODE);
+            ScopedStageTimer inner(STAGE_FITS_WRITE);
+            std::this_thread::sleep_for(std::chrono::milliseconds(20));
+        }
+        timers.enable(false);
+        REQUIRE(timers.summarize(STAGE_DECODE).count == 1);
+        REQUIRE(timers.summarize(STAGE_FITS_WRITE).count == 1);
+        REQUIRE(timers.summarize(STAGE_FITS_WRITE).maxMicrosec >= 20000.0);
+        REQUIRE(timers.summarize(STAGE_DECODE).maxMicrosec < 10000.0);
+    }
+    timers.reset();
+}
+
+TEST_CASE("PacketStats sums per-thread counters and latencies by APID", "[PacketStats]") {
+    PacketStats& stats = PacketStats::getInstance();
+    stats.enable(true);
+    PacketStatsInterval before = stats.aggregate();
+
+    auto worker = [&stats](uint16_t apid) {
+        stats.setCurrentAPID(apid);
+        for (int i = 0; i < 1000; ++i) {
+            stats.count(apid, COUNTER_PACKETS);
+            stats.count(apid, COUNTER_BYTES, 100);
+            stats.recordLatency(STAGE_DECODE, 2000);
+        }
+    };
+    std::thread megsA(worker, MEGSA_APID);
+    std::thread esp(worker, ESP_APID);
+    megsA.join();
+    esp.join();
+    stats.count(999, COUNTER_DROPS);
+
+    PacketStatsInterval after = stats.aggregate();
+    stats.enable(false);
+    stats.count(MEGSA_APID, COUNTER_PACKETS); // disabled, not counted
+
+    REQUIRE(after.sequence == before.sequence + 1);
+    REQUIRE(after.interval[APID_SLOT_MA][COUNTER_PACKETS] == 1000);
+    REQUIRE(after.interval[APID_SLOT_ESP][COUNTER_BYTES] == 100000);
+    REQUIRE(after.interval[APID_SLOT_UNKNOWN][COUNTER_DROPS] == 1);
+    REQUIRE(after.interval[APID_SLOT_MB][COUNTER_PACKETS] == 0);
+    REQUIRE(after.totals[APID_SLOT_MA][COUNTER_PACKETS] == before.totals[APID_SLOT_MA][COUNTER_PACKETS] + 1000);
+    REQUIRE(after.latency[APID_SLOT_MA][STAGE_DECODE].count == 1000);
+    REQUIRE(after.latency[APID_SLOT_MA][STAGE_DECODE].p99Microsec == Approx(2.0).epsilon(0.07));
+    REQUIRE(after.latency[APID_SLOT_MP][STAGE_DECODE].count == 0);
+
+    PacketStatsInterval latest;
+    stats.readLatest(latest);
+    REQUIRE(latest.sequence == after.sequence);
+    REQUIRE(stats.aggregate().interval[APID_SLOT_MA][COUNTER_PACKETS] == 0);
+
+    std::string jsonName = "test_packet_stats.json";
+    REQUIRE(PacketStats::writeJson(after, jsonName));
+    std::ifstream json(jsonName);
+    std::string contents((std::istreambuf_iterator<char>(json)), std::istreambuf_iterator<char>());
+    REQUIRE(contents.find("\"MA\"") != std::string::npos);
+    REQUIRE(contents.find("\"drops\"") != std::string::npos);
+    std::remove(jsonName.c_str());
+
+    // a gap in a non-MEGS APID is counted for that APID as well as in ProgramState
+    TelemetryGeneratorConfig config;
+    config.megsB = false;
+    TelemetryGenerator generator(config);
+    std::vector<uint8_t> stream;
+    TelemetryGeneratorStats generatorStats;
+    generator.generateSecond(0, stream, generatorStats);
+    std::vector<uint8_t> espPayload;
+    size_t offset = 0;
+    while (espPayload.empty() && (offset + sizeof(SYNC_MARKER) + PACKET_HEADER_SIZE <= stream.size())) {
+        const uint8_t* packet = stream.data() + offset + sizeof(SYNC_MARKER);
+        uint16_t apid = ((packet[0] & 0x07) << 8) | packet[1];
+        size_t packetBytes = PACKET_HEADER_SIZE + (((packet[4] << 8) | packet[5]) + 1);
+        if (apid == ESP_APID) {
+            espPayload.assign(packet + PACKET_HEADER_SIZE, packet + packetBytes);
+        }
+        offset += sizeof(SYNC_MARKER) + packetBytes;
+    }
+    REQUIRE_FALSE(espPayload.empty());
+
+    const bool skipFITS = globalState.args.skipFITS.load();
+    globalState.args.skipFITS.store(true);
+    stats.enable(true);
+    processESPPacket(espPayload, 100, static_cast<uint16_t>(espPayload.size()), 0.0);
+    processESPPacket(espPayload, 101, static_cast<uint16_t>(espPayload.size()), 0.0);
+    stats.aggregate();
+    const int64_t espGapsBefore = globalState.dataGapsESP.load();
+    processESPPacket(espPayload, 103, static_cast<uint16_t>(espPayload.size()), 0.0);
+    PacketStatsInterval gaps = stats.aggregate();
+    stats.enable(false);
+    globalState.args.skipFITS.store(skipFITS);
+    REQUIRE(globalState.dataGapsESP.load() == espGapsBefore + 1);
+    REQUIRE(gaps.interval[APID_SLOT_ESP][COUNTER_GAPS] == 1);
+    REQUIRE(gaps.interval[APID_SLOT_MA][COUNTER_GAPS] == 0);
+}
+
+TEST_CASE("SequenceReorderWindow restores counter order and drops duplicates", "[SequenceReorder]") {
+    // a fake packet is its counter and a content byte, enough for the hash to tell them apart
+    auto packetFor = [](uint16_t ssc, uint8_t content) {
+        return std::vector<uint8_t>{static_cast<uint8_t>(ssc >> 8), static_cast<uint8_t>(ssc & 0xff), content};
+    };
+    auto counters = [](const std::vector<std::vector<uint8_t>>& ready) {
+        std::vector<uint16_t> sscs;
+        for (const auto& packet : ready) {
+            sscs.push_back(static_cast<uint16_t>((packet[0] << 8) | packet[1]));
+        }
+        return sscs;
+    };
+    auto now = SequenceReorderWindow::Clock::now();
+    std::vector<std::vector<uint8_t>> ready;
+
+    SECTION("Out of order packets are released in order, repeats are dropped") {
+        SequenceReorderWindow window(MEGSA_APID, N_PKT_PER_IMAGE, 8, std::chrono::milliseconds(250));
+        for (uint16_t ssc : {10, 12, 13, 11, 11, 14, 12}) {
+            window.push(ssc, packetFor(ssc, 1), now, ready);
+        }
+        REQUIRE(counters(ready) == std::vector<uint16_t>{10, 11, 12, 13, 14});
+        REQUIRE(window.duplicates() == 2);
+        REQUIRE(window.waiting() == 0);
+    }
+
+    SECTION("A missing counter is given up after the timeout and a late arrival is dropped") {
+        SequenceReorderWindow window(ESP_APID, CCSDS_SEQUENCE_MODULUS, 8, std::chrono::milliseconds(250));
+        window.push(16383, packetFor(16383, 1), now, ready);
+        window.push(1, packetFor(1, 1), now, ready); // 0 is missing, counter wraps at 16384
+        window.releaseExpired(now + std::chrono::milliseconds(100), ready);
+        REQUIRE(counters(ready) == std::vector<uint16_t>{16383});
+        window.releaseExpired(now + std::chrono::milliseconds(300), ready);
+        REQUIRE(counters(ready) == std::vector<uint16_t>{16383, 1});
+        window.push(0, packetFor(0, 1), now, ready);
+        REQUIRE(window.missing() == 1);
+        REQUIRE(window.late() == 1);
+        REQUIRE(ready.size() == 2);
+    }
+
+    SECTION("A reused counter with new bytes restarts the sequence") {
+        SequenceReorderWindow window(MEGSB_APID, N_PKT_PER_IMAGE, 8, std::chrono::milliseconds(250));
+        window.push(100, packetFor(100, 1), now, ready);
+        window.push(101, packetFor(101, 1), now, ready);
+        window.push(100, packetFor(100, 2), now, ready); // same counter, different bytes
+        window.push(101, packetFor(101, 2), now, ready);
+        REQUIRE(counters(ready) == std::vector<uint16_t>{100, 101, 100, 101});
+        REQUIRE(window.restarts() == 1);
+        REQUIRE(window.duplicates() == 0);
+    }
+
+    SECTION("A counter past the window releases just enough to hold it, without a restart") {
+        SequenceReorderWindow window(MEGSB_APID, N_PKT_PER_IMAGE, 8, std::chrono::milliseconds(250));
+        window.push(100, packetFor(100, 1), now, ready);
+        window.push(102, packetFor(102, 1), now, ready);
+        window.push(110, packetFor(110, 1), now, ready); // 101 is given up, 110 waits for 103
+        REQUIRE(counters(ready) == std::vector<uint16_t>{100, 102});
+        REQUIRE(window.waiting() == 1);
+        REQUIRE(window.restarts() == 0);
+        REQUIRE(window.missing() == 1);
+        // a new image after an outage, SSC 0 was never passed so it is not late
+        window.push(0, packetFor(0, 1), now, ready);
+        window.push(1, packetFor(1, 1), now, ready);
+        REQUIRE(counters(ready) == std::vector<uint16_t>{100, 102, 110, 0, 1});
+        REQUIRE(window.restarts() == 1);
+        REQUIRE(window.late() == 0);
+    }
+
+    SECTION("A counter reset is processed in full") {
+        SequenceReorderWindow window(ESP_APID, CCSDS_SEQUENCE_MODULUS, 32, std::chrono::milliseconds(250));
+        std::vector<uint16_t> expected;
+        for (uint16_t ssc = 0; ssc < 5000; ++ssc) {
+            window.push(ssc, packetFor(ssc, 1), now, ready);
+            expected.push_back(ssc);
+        }
+        for (uint16_t ssc = 0; ssc < 1000; ++ssc) { // same counters, new packets
+            window.push(ssc, packetFor(ssc, 2), now, ready);
+            expected.push_back(ssc);
+        }
+        REQUIRE(counters(ready) == expected);
+        REQUIRE(window.restarts() == 1);
+        REQUIRE(window.late() == 0);
+        REQUIRE(window.duplicates() == 0);
+    }
+
+    SECTION("A silence longer than the timeout starts the sequence again") {
+        SequenceReorderWindow window(SHK_APID, CCSDS_SEQUENCE_MODULUS, 8, std::chrono::milliseconds(250));
+        window.push(40, packetFor(40, 1), now, ready);
+        window.push(41, packetFor(41, 1), now, ready);
+        window.push(41, packetFor(41, 1), now, ready); // a duplicate while the packets flow
+        window.push(41, packetFor(41, 1), now + std::chrono::milliseconds(300), ready);
+        REQUIRE(counters(ready) == std::vector<uint16_t>{40, 41, 41});
+        REQUIRE(window.duplicates() == 1);
+        REQUIRE(window.restarts() == 0);
+    }
+
+    SECTION("A timed out MEGS image lets the next one start at any counter") {
+        SequenceReorderWindow window(MEGSA_APID, N_PKT_PER_IMAGE, 8, std::chrono::milliseconds(250));
+        window.push(500, packetFor(500, 1), now, ready);
+        window.push(501, packetFor(501, 1), now, ready);
+        window.forgetSequence(ready);
+        window.push(500, packetFor(500, 1), now, ready);
+        REQUIRE(counters(ready) == std::vector<uint16_t>{500, 501, 500});
+        REQUIRE(window.duplicates() == 0);
+        REQUIRE(window.restarts() == 0);
+    }
+
+    SECTION("A packet behind a full window is dropped as late, not emitted out of order") {
+        SequenceReorderWindow window(MEGSA_APID, N_PKT_PER_IMAGE, 32, std::chrono::milliseconds(250));
+        std::vector<uint16_t> expected;
+        for (uint16_t ssc = 0; ssc <= 140; ++ssc) {
+            if (ssc != 100) {
+                window.push(ssc, packetFor(ssc, 1), now, ready);
+                expected.push_back(ssc);
+            }
+        }
+        window.push(100, packetFor(100, 1), now, ready);
+        REQUIRE(counters(ready) == expected);
+        REQUIRE(window.missing() == 1);
+        REQUIRE(window.late() == 1);
+        REQUIRE(window.restarts() == 0);
+    }
+
+    SECTION("A duplicate after the window overflowed is still dropped") {
+        SequenceReorderWindow window(ESP_APID, CCSDS_SEQUENCE_MODULUS, 8, std::chrono::milliseconds(250));
+        window.push(10, packetFor(10, 1), now, ready);
+        for (uint16_t ssc = 12; ssc <= 19; ++ssc) { // 19 overflows the window and gives up 11
+            window.push(ssc, packetFor(ssc, 1), now, ready);
+        }
+        window.push(19, packetFor(19, 1), now, ready);
+        window.push(12, packetFor(12, 1), now, ready);
+        REQUIRE(counters(ready) == std::vector<uint16_t>{10, 12, 13, 14, 15, 16, 17, 18, 19});
+        REQUIRE(window.duplicates() == 2);
+        REQUIRE(window.missing() == 1);
+        REQUIRE(window.restarts() == 0);
+    }
+
+    SECTION("A zero window passes packets straight through") {
+        SequenceReorderWindow window(SHK_APID, CCSDS_SEQUENCE_MODULUS, 0, std::chrono::milliseconds(250));
+        for (uint16_t ssc : {5, 4, 4}) {
+            window.push(ssc, packetFor(ssc, 1), now, ready);
+        }
+        REQUIRE(counters(ready) == std::vector<uint16_t>{5, 4, 4});
+    }
+}
+
+TEST_CASE("TraceRecorder writes per-thread events as Chrome trace JSON", "[TraceRecorder]") {
+    TraceRecorder& tracer = TraceRecorder::getInstance();
+    tracer.enable(true);
+    {
+        ScopedStageTimer decodeTimer(STAGE_DECODE);
+        ScopedTrace trace("test marker");
+    }
+    std::thread worker([&tracer]() {
+        tracer.setThreadName("trace test worker");
+        // more than one ring, only the newest TRACE_EVENTS_PER_THREAD survive
+        for (uint32_t i = 0; i < TRACE_EVENTS_PER_THREAD + 10; ++i) {
+            ScopedTrace trace("worker event");
+        }
+    });
+    worker.join();
+    tracer.enable(false);
+    {
+        ScopedTrace trace("disabled marker");
+    }
+
+    std::string traceName = "test_trace.json";
+    REQUIRE(tracer.writeChromeTrace(traceName));
+    std::ifstream json(traceName);
+    std::string contents((std::istreambuf_iterator<char>(json)), std::istreambuf_iterator<char>());
+    REQUIRE(contents.rfind("{\"displayTimeUnit\"", 0) == 0);
+    REQUIRE(contents.find("\"name\": \"test marker\", \"cat\": \"eve\", \"ph\": \"X\"") != std::string::npos);
+    REQUIRE(contents.find("\"name\": \"decode\"") != std::string::npos);
+    REQUIRE(contents.find("\"name\": \"trace test worker\"") != std::string::npos);
+    REQUIRE(contents.find("disabled marker") == std::string::npos);
+    size_t workerEvents = 0;
+    for (size_t pos = contents.find("worker event"); pos != std::string::npos; pos = contents.find("worker event", pos + 1)) {
+        ++workerEvents;
+    }
+    REQUIRE(workerEvents == TRACE_EVENTS_PER_THREAD - 1); // the oldest slot may be torn and is dropped
+    std::remove(traceName.c_str());
+}
 
 // CCSDSReader tests
 
@@ -887,6 +2634,231 @@ TEST_CASE("TimeInfo class functionality", "[TimeInfo]") {
 }
 
 // Test suite for the isValidFilename function
+TEST_CASE("parseMegsSpectrumRegions accepts row ranges inside the image", "[MegsSpectrum]") {
+    std::vector<MegsSpectrumRegion> regions;
+    std::string error;
+    REQUIRE(parseMegsSpectrumRegions(MEGS_SPECTRUM_DEFAULT_REGIONS, regions, error));
+    REQUIRE(regions.size() == 2);
+    CHECK(regions[1].firstRow == 512);
+    CHECK(regions[1].lastRow == 1023);
+    REQUIRE(parseMegsSpectrumRegions("200-300,250-260", regions, error));
+    CHECK(regions.size() == 2);
+
+    CHECK_FALSE(parseMegsSpectrumRegions("300-200", regions, error));
+    CHECK_FALSE(parseMegsSpectrumRegions("0-1024", regions, error));
+    CHECK_FALSE(parseMegsSpectrumRegions("10", regions, error));
+    CHECK_FALSE(parseMegsSpectrumRegions("10-", regions, error));
+    CHECK_FALSE(parseMegsSpectrumRegions("", regions, error));
+    CHECK_FALSE(parseMegsSpectrumRegions("0-1,2-3,4-5,6-7,8-9", regions, error));
+    CHECK_FALSE(error.empty());
+}
+
+TEST_CASE("MegsSpectrumAccumulator collapses complete rows minus the dark columns", "[MegsSpectrum]") {
+    std::unique_ptr<MEGS_IMAGE_REC> megsImage(new MEGS_IMAGE_REC{});
+    std::unique_ptr<MegsSpectrumAccumulator> accumulator(new MegsSpectrumAccumulator);
+    std::unique_ptr<MEGS_SPECTRUM> spectrum(new MEGS_SPECTRUM{});
+    // a different dark level in each half of every row, the light is x % 50 DN on the left and 7 DN on the right
+    for (uint32_t y = 0; y < MEGS_IMAGE_HEIGHT; ++y) {
+        for (uint32_t x = 0; x < MEGS_IMAGE_WIDTH; ++x) {
+            megsImage->image[y][x] = (x < MEGS_IMAGE_WIDTH / 2) ? 100 + x % 50 : 127;
+        }
+        for (uint32_t x = 0; x < X_DARK_COLUMNS; ++x) {
+            megsImage->image[y][X_DARK_START_LEFT + x] = 100;
+            megsImage->image[y][X_DARK_START_RIGHT + x] = 120;
+        }
+    }
+    for (uint32_t y = 0; y < 10; ++y) {
+        megsImage->image[y][510] = 0x3fff;  // saturated pixels are left out of their column
+    }
+    megsImage->image[30][X_DARK_START_LEFT] = 0x3fff; // the other dark pixels of the row stand in for it
+
+    std::vector<MegsSpectrumRegion> regions;
+    std::string error;
+    REQUIRE(parseMegsSpectrumRegions("0-511,512-1023,20-25", regions, error));
+    accumulator->start(regions);
+    // packet 100 is lost, so top row 21 and bottom row 1002 are never complete
+    for (uint16_t ssc = 0; ssc < N_PKT_PER_IMAGE; ++ssc) {
+        if (ssc != 100) {
+            markMegsPacketReceived(*megsImage, ssc);
+            accumulator->addPacketRows(*megsImage, ssc);
+        }
+    }
+    accumulator->finish(*spectrum);
+
+    REQUIRE(spectrum->regions == 3);
+    CHECK(spectrum->rows[0] == 511);
+    CHECK(spectrum->rows[1] == 511);
+    CHECK(spectrum->rows[2] == 5);
+    CHECK(spectrum->firstRow[2] == 20);
+    CHECK(spectrum->lastRow[2] == 25);
+    CHECK(spectrum->darkLeft[0] == Approx(100.0f));
+    CHECK(spectrum->darkRight[1] == Approx(120.0f));
+    bool matches = true;
+    for (uint16_t r = 0; r < spectrum->regions; ++r) {
+        for (uint32_t x = X_DARK_COLUMNS; x < X_DARK_START_RIGHT; ++x) {
+            float expected = (x < MEGS_IMAGE_WIDTH / 2) ? static_cast<float>(x % 50) : 7.0f;
+            matches = matches && (spectrum->spectrum[r][x] == Approx(expected));
+        }
+        matches = matches && (spectrum->spectrum[r][X_DARK_START_LEFT] == Approx(0.0f));
+    }
+    CHECK(matches);
+    CHECK(spectrum->pixels[0][510] == 501);
+    CHECK(spectrum->pixels[0][511] == 511);
+    CHECK(spectrum->pixels[1][510] == 511);
+
+    // a new image starts from zero
+    accumulator->start(regions);
+    accumulator->finish(*spectrum);
+    CHECK(spectrum->rows[0] == 0);
+    CHECK(spectrum->pixels[0][511] == 0);
+    CHECK(spectrum->spectrum[0][511] == 0.0f);
+}
+
+TEST_CASE("subtractMegsDark clamps at zero and keeps saturated pixels", "[MegsDark]") {
+    // an odd length so the scalar tail runs after the SSE2 loop
+    constexpr size_t pixels = 2045;
+    std::vector<uint16_t> image(pixels), dark(pixels), out(pixels);
+    for (size_t i = 0; i < pixels; ++i) {
+        image[i] = static_cast<uint16_t>(0xc000 | (100 + i % 7));   // bits above 14 are masked off
+        dark[i] = static_cast<uint16_t>(98 + i % 5);
+    }
+    image[3] = 0x3fff;
+    image[pixels - 1] = 0xffff;
+    subtractMegsDark(image.data(), dark.data(), out.data(), pixels);
+    bool matches = true;
+    for (size_t i = 0; i < pixels; ++i) {
+        int expected = std::max(0, static_cast<int>(100 + i % 7) - static_cast<int>(98 + i % 5));
+        if ((i == 3) || (i == pixels - 1)) {
+            expected = 0x3fff;
+        }
+        matches = matches && (out[i] == expected);
+    }
+    CHECK(matches);
+
+    // in place
+    subtractMegsDark(image.data(), dark.data(), image.data(), pixels);
+    CHECK(image == out);
+
+    CHECK(megsDarkKey(MEGSA_APID, 10, 24.5f).temperatureBin == 12);
+    CHECK(megsDarkKey(MEGSA_APID, 10, -0.5f).temperatureBin == -1);
+    CHECK(MegsDarkLibrary::filename(megsDarkKey(MEGSA_APID, 10, 24.5f)) == "MA_DARK_I10_T+24C.mgd");
+    CHECK(MegsDarkLibrary::filename(megsDarkKey(MEGSB_APID, 3, -0.5f)) == "MB_DARK_I3_T-2C.mgd");
+}
+
+TEST_CASE("MegsDarkLibrary builds, saves and finds darks by integration and temperature", "[MegsDark]") {
+    char directoryTemplate[] = "/tmp/eve_megs_dark_test_XXXXXX";
+    REQUIRE(mkdtemp(directoryTemplate) != nullptr);
+    const std::string directory = std::string(directoryTemplate) + "/";
+    MegsDarkLibrary& library = MegsDarkLibrary::getInstance();
+    CHECK(library.load(directory) == 0);
+
+    std::unique_ptr<MEGS_IMAGE_REC> megsImage(new MEGS_IMAGE_REC{});
+    const MegsDarkKey keyA = megsDarkKey(MEGSA_APID, 4321, 20.5f);
+    const MegsDarkKey keyB = megsDarkKey(MEGSB_APID, 4321, 20.5f);
+    uint16_t added = 0;
+    uint16_t wanted = 0;
+
+    // mean of 4 frames, a frame at another temperature restarts the collection
+    library.addImage(*megsImage, keyA);   // not collecting, ignored
+    library.startCollecting(MEGSA_APID, 4, MEGS_DARK_MEAN);
+    std::fill(&megsImage->image[0][0], &megsImage->image[0][0] + MEGS_TOTAL_PIXELS, 999);
+    library.addImage(*megsImage, megsDarkKey(MEGSA_APID, 4321, 30.0f));
+    for (uint16_t f = 0; f < 3; ++f) {
+        std::fill(&megsImage->image[0][0], &megsImage->image[0][0] + MEGS_TOTAL_PIXELS, 100 + f);
+        library.addImage(*megsImage, keyA);
+    }
+    library.collectionProgress(MEGSA_APID, added, wanted);
+    CHECK(added == 3);
+    CHECK(wanted == 4);
+    std::fill(&megsImage->image[0][0], &megsImage->image[0][0] + MEGS_TOTAL_PIXELS, 103);
+    library.addImage(*megsImage, keyA);
+    library.waitForBuild();
+    library.collectionProgress(MEGSA_APID, added, wanted);
+    CHECK(wanted == 0);
+
+    std::shared_ptr<const MegsDarkFrame> darkA = library.find(keyA);
+    REQUIRE(darkA);
+    CHECK(darkA->frames == 4);
+    CHECK(darkA->mode == MEGS_DARK_MEAN);
+    CHECK(darkA->image[0][0] == 102);   // 101.5 rounded
+    CHECK(std::count(&darkA->image[0][0], &darkA->image[0][0] + MEGS_TOTAL_PIXELS, 102) == static_cast<long>(MEGS_TOTAL_PIXELS));
+
+    // clipped median of 5 frames drops a cosmic ray hit that would pull the mean up
+    library.startCollecting(MEGSB_APID, 5, MEGS_DARK_CLIPPED_MEDIAN);
+    for (uint16_t f = 0; f < 5; ++f) {
+        std::fill(&megsImage->image[0][0], &megsImage->image[0][0] + MEGS_TOTAL_PIXELS, 200 + f);
+        if (f == 2) {
+            megsImage->image[10][10] = 5000;
+        }
+        library.addImage(*megsImage, keyB);
+    }
+    library.waitForBuild();
+    std::shared_ptr<const MegsDarkFrame> darkB = library.find(keyB);
+    REQUIRE(darkB);
+    CHECK(darkB->mode == MEGS_DARK_CLIPPED_MEDIAN);
+    CHECK(darkB->image[0][0] == 202);
+    CHECK(darkB->image[10][10] == 202);
+
+    // saved where load pointed, and read back the same
+    std::unique_ptr<MegsDarkFrame> reread(new MegsDarkFrame);
+    std::string error;
+    REQUIRE(MegsDarkLibrary::read(directory + MegsDarkLibrary::filename(keyB), *reread, error));
+    CHECK(reread->key == keyB);
+    CHECK(reread->frames == 5);
+    CHECK(std::memcmp(reread->image, darkB->image, sizeof(reread->image)) == 0);
+    CHECK_FALSE(MegsDarkLibrary::read(directory + "missing.mgd", *reread, error));
+
+    // the nearest temperature bin stands in, other integrations never do
+    CHECK(library.find(megsDarkKey(MEGSB_APID, 4321, 22.5f)) == darkB);
+    CHECK_FALSE(library.find(megsDarkKey(MEGSB_APID, 4321, 24.5f)));
+    CHECK_FALSE(library.find(megsDarkKey(MEGSB_APID, 4322, 20.5f)));
+
+    // active only while subtraction is enabled
+    library.setCurrentKey(keyB);
+    CHECK_FALSE(library.active(MEGSB_APID));
+    library.setEnabled(MEGSB_APID, true);
+    CHECK(library.active(MEGSB_APID) == darkB);
+    library.setEnabled(MEGSB_APID, false);
+
+    // quicklook images have it subtracted before binning
+    std::fill(&megsImage->image[0][0], &megsImage->image[0][0] + MEGS_TOTAL_PIXELS, 210);
+    std::vector<uint16_t> binned((MEGS_IMAGE_WIDTH / 4) * (MEGS_IMAGE_HEIGHT / 4));
+    downsampleMegsImage(megsImage->image, 4, binned.data(), darkB->image);
+    CHECK(binned[0] == 8);
+    CHECK(binned.back() == 8);
+
+    // loading the directory again reads both darks back
+    CHECK(library.load(directory) == 2);
+    CHECK(library.find(keyA)->image[5][5] == 102);
+
+    // MEGS-A and MEGS-B collected together both finish, the builder takes them one after the other
+    const MegsDarkKey bothA = megsDarkKey(MEGSA_APID, 777, 20.5f);
+    const MegsDarkKey bothB = megsDarkKey(MEGSB_APID, 777, 20.5f);
+    library.startCollecting(MEGSA_APID, 3, MEGS_DARK_CLIPPED_MEDIAN);
+    library.startCollecting(MEGSB_APID, 3, MEGS_DARK_CLIPPED_MEDIAN);
+    for (uint16_t f = 0; f < 3; ++f) {
+        std::fill(&megsImage->image[0][0], &megsImage->image[0][0] + MEGS_TOTAL_PIXELS, 300 + f);
+        library.addImage(*megsImage, bothA);
+        library.addImage(*megsImage, bothB);
+    }
+    library.waitForBuild();
+    REQUIRE(library.find(bothA));
+    REQUIRE(library.find(bothB));
+    CHECK(library.find(bothA)->image[0][0] == 301);
+    CHECK(library.find(bothB)->image[0][0] == 301);
+
+    for (const MegsDarkKey& key : {keyA, keyB, bothA, bothB}) {
+        std::remove((directory + MegsDarkLibrary::filename(key)).c_str());
+    }
+    rmdir(directoryTemplate);
+
+    // later tests see an empty library that saves nowhere
+    library.reset();
+    CHECK_FALSE(library.find(keyA));
+    library.collectionProgress(MEGSB_APID, added, wanted);
+    CHECK(wanted == 0);
+}
+
 TEST_CASE("isValidFilename function tests", "[isValidFilename]") {
 
     SECTION("Returns false for empty string") {
@@ -962,6 +2934,97 @@ TEST_CASE_METHOD(FileCompressorTests, "CompressWithPigz") {
     }
 }
 
+// with FITS enabled the packet thread only queues each finished product, gzip and the disk write are on the publisher thread
+TEST_CASE("FITSPublisher keeps gzip and the disk write off the packet thread", "[FITSPublisher]") {
+    const std::string directory = "./test_fits_publisher/";
+    mkdir(directory.c_str(), 0755);
+    const bool skipCompress = globalState.args.skipCompress.load();
+    const bool skipCatalog = globalState.args.skipCatalog.load();
+    globalState.args.skipCompress.store(false);
+    globalState.args.skipCatalog.store(true);
+
+    // the size of a MEGS image file, with noise like one so gzip has the usual work to do
+    const size_t productBytes = 2880 * 1460;
+    std::vector<uint8_t> product(productBytes);
+    uint32_t seed = 12345;
+    for (size_t i = 0; i + 1 < productBytes; i += 2) {
+        seed = seed * 1103515245u + 12345u;
+        uint16_t value = static_cast<uint16_t>(100 + ((seed >> 16) & 0xff));
+        product[i] = static_cast<uint8_t>(value >> 8);
+        product[i + 1] = static_cast<uint8_t>(value & 0xff);
+    }
+    ArchiveCatalogRecord record = {};
+
+    // what each product cost the packet thread when it was published inline
+    auto start = std::chrono::steady_clock::now();
+    REQUIRE(FITSPublisher::publish(directory + "inline.fit", product.data(), product.size(), record));
+    const auto inlineTime = std::chrono::steady_clock::now() - start;
+
+    FITSPublisher& publisher = FITSPublisher::getInstance();
+    const uint64_t failuresBefore = publisher.failures();
+    const int queuedProducts = 4;
+    for (int i = 0; i < queuedProducts; ++i) {
+        void* data = malloc(productBytes);
+        REQUIRE(data != nullptr);
+        std::memcpy(data, product.data(), productBytes);
+        start = std::chrono::steady_clock::now();
+        publisher.enqueue(directory + "queued" + std::to_string(i) + ".fit", data, productBytes, record);
+        CHECK(std::chrono::steady_clock::now() - start < inlineTime / 10);
+    }
+    publisher.flush();
+    CHECK(publisher.failures() == failuresBefore);
+
+    // a product that cannot be written is counted where metrics can see it, the writer already returned
+    const int64_t publishFailuresBefore = globalState.fitsPublishFailures.load();
+    void* unwritable = malloc(productBytes);
+    REQUIRE(unwritable != nullptr);
+    std::memcpy(unwritable, product.data(), productBytes);
+    publisher.enqueue(directory + "missing_dir/queued.fit", unwritable, productBytes, record);
+    publisher.flush();
+    CHECK(publisher.failures() == failuresBefore + 1);
+    CHECK(globalState.fitsPublishFailures.load() == publishFailuresBefore + 1);
+
+    struct stat info;
+    for (int i = 0; i < queuedProducts; ++i) {
+        std::string name = directory + "queued" + std::to_string(i) + ".fit.gz";
+        CHECK(stat(name.c_str(), &info) == 0);
+        remove(name.c_str());
+    }
+    CHECK(stat((directory + "inline.fit.gz").c_str(), &info) == 0);
+    remove((directory + "inline.fit.gz").c_str());
+    rmdir(directory.c_str());
+    globalState.args.skipCompress.store(skipCompress);
+    globalState.args.skipCatalog.store(skipCatalog);
+}
+
+// in-memory gzip used by FITSPublisher::publish must round trip through zlib
+TEST_CASE("compressBuffer writes a gzip stream that inflates to the input", "[FileCompressor]") {
+    std::vector<uint8_t> original(2880 * 4);
+    for (size_t i = 0; i < original.size(); ++i) {
+        original[i] = static_cast<uint8_t>((i * 7) % 251);
+    }
+
+    FileCompressor compressor;
+    std::vector<uint8_t> gzipped;
+    REQUIRE(compressor.compressBuffer(original.data(), original.size(), gzipped));
+    REQUIRE(gzipped.size() > 18);
+    REQUIRE(gzipped[0] == 0x1f); // gzip magic, so the published .gz files read like the pigz ones
+    REQUIRE(gzipped[1] == 0x8b);
+    REQUIRE(gzipped.size() < original.size());
+
+    z_stream stream = {};
+    REQUIRE(inflateInit2(&stream, 15 + 16) == Z_OK);
+    std::vector<uint8_t> inflated(original.size() + 1);
+    stream.next_in = gzipped.data();
+    stream.avail_in = static_cast<uInt>(gzipped.size());
+    stream.next_out = inflated.data();
+    stream.avail_out = static_cast<uInt>(inflated.size());
+    REQUIRE(inflate(&stream, Z_FINISH) == Z_STREAM_END);
+    inflated.resize(stream.total_out);
+    inflateEnd(&stream);
+    REQUIRE(inflated == original);
+}
+
 // Test case to check if the thread runs in the background and does not block
 TEST_CASE_METHOD(FileCompressorTests, "CompressionThreading") {
     FileCompressor compressor;